@@ -146,7 +146,7 @@ function connectToEvents() {
 
   // Listen for lap events
   source.addEventListener('lap', (e) => {
-    const lapTimeMs = parseFloat(e.data);
+    const lapTimeMs = parseFloat(JSON.parse(e.data).lapTime);
     const lapTimeSec = (lapTimeMs / 1000).toFixed(2);
     console.log('Lap received:', lapTimeSec);
     addLap(parseFloat(lapTimeSec));
@@ -154,10 +154,11 @@ function connectToEvents() {
 
   // Listen for race state events
   source.addEventListener('raceState', (e) => {
-    console.log('Race state changed:', e.data);
-    if (e.data === 'started') {
+    const state = JSON.parse(e.data).state;
+    console.log('Race state changed:', state);
+    if (state === 'started') {
       handleRaceStart();
-    } else if (e.data === 'stopped') {
+    } else if (state === 'stopped') {
       handleRaceStop();
     }
   });
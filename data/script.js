@@ -5,6 +5,7 @@ let usbConnected = false;
 let eventSource = null;
 let eventSourceReconnectTimer = null;
 let eventSourceReconnectAttempts = 0;
+let lastLapEventId = 0; // Id of the last lap event, to skip replayed ones
 const MAX_RECONNECT_ATTEMPTS = 10;
 const RECONNECT_DELAY_MS = 2000;
 let connectionStatusUpdateInterval = null;
@@ -98,6 +99,16 @@ var rssiCrossingSeries = new TimeSeries();
 var maxRssiValue = enterRssi + 10;
 var minRssiValue = exitRssi - 10;
 
+// Batched RSSI stream for the calibration graph: 200 Hz in batches of 50,
+// four messages a second. The WiFi stream is leased and renewed
+const RSSI_STREAM_RATE_HZ = 200;
+const RSSI_STREAM_BATCH = 50;
+const RSSI_STREAM_RENEW_MS = 5000;
+var rssiStreamId = null;
+var sseClientId = null; // Ours on the timer, from the "hello" event
+var rssiStreamTimer = null;
+var rssiDeviceOffset = null; // Local minus device ms, from the fastest batch seen
+
 // Add localized validation message for IP pattern
 document.addEventListener("DOMContentLoaded", () => {
   const webhookIP = document.getElementById("webhookIP");
@@ -226,7 +237,9 @@ function setupWiFiEvents() {
   }
 
   if (window.EventSource) {
+    // A new EventSource sends no Last-Event-ID and gets no replay
     eventSource = new EventSource("/events");
+    lastLapEventId = 0;
 
     eventSource.addEventListener(
       "open",
@@ -249,8 +262,13 @@ function setupWiFiEvents() {
     eventSource.addEventListener(
       "error",
       function (e) {
-        if (e.target.readyState != EventSource.OPEN) {
-          console.log("WiFi Events Disconnected - attempting reconnect...");
+        if (e.target.readyState == EventSource.CONNECTING) {
+          // The browser reconnects by itself and sends Last-Event-ID, so
+          // the timer replays the laps missed meanwhile
+          console.log("WiFi Events Disconnected - browser reconnecting...");
+          updateConnectionStatus("WiFi", false);
+        } else if (e.target.readyState == EventSource.CLOSED) {
+          console.log("WiFi Events Closed - attempting reconnect...");
           updateConnectionStatus("WiFi", false);
 
           // Attempt to reconnect
@@ -273,11 +291,48 @@ function setupWiFiEvents() {
     eventSource.addEventListener(
       "rssi",
       function (e) {
-        rssiBuffer.push(e.data);
+        // {"rssi":..,"t":device ms}
+        var rssi = JSON.parse(e.data).rssi;
+        rssiBuffer.push(rssi);
         if (rssiBuffer.length > 10) {
           rssiBuffer.shift();
         }
-        console.log("rssi", e.data, "buffer size", rssiBuffer.length);
+        console.log("rssi", rssi, "buffer size", rssiBuffer.length);
+      },
+      false
+    );
+
+    eventSource.addEventListener(
+      "hello",
+      function (e) {
+        // Our id on the timer, new on every connect; RSSI streams belong to it
+        sseClientId = JSON.parse(e.data).client;
+        if (rssiSending && !usbConnected) {
+          clearTimeout(rssiStreamTimer);
+          rssiStreamId = null;
+          renewRssiStream();
+        }
+      },
+      false
+    );
+
+    eventSource.addEventListener(
+      "rssiBatch",
+      function (e) {
+        var batch = JSON.parse(e.data);
+        if (batch.s === rssiStreamId) {
+          addRssiBatch(batch);
+        }
+      },
+      false
+    );
+
+    eventSource.addEventListener(
+      "resync",
+      function (e) {
+        // The timer no longer has the events missed (or rebooted)
+        lastLapEventId = 0;
+        console.warn("Lap events missed while disconnected, check the lap list against the timer");
       },
       false
     );
@@ -285,9 +340,17 @@ function setupWiFiEvents() {
     eventSource.addEventListener(
       "lap",
       function (e) {
-        var lap = (parseFloat(e.data) / 1000).toFixed(2);
+        // {"lapTime":..,"t":device ms of the gate crossing}. A replayed
+        // lap already shown is skipped by its id
+        var eventId = parseInt(e.lastEventId) || 0;
+        if (eventId && eventId <= lastLapEventId) {
+          return;
+        }
+        lastLapEventId = eventId;
+        var lapTime = JSON.parse(e.data).lapTime;
+        var lap = (parseFloat(lapTime) / 1000).toFixed(2);
         addLap(lap);
-        console.log("lap raw:", e.data, " formatted:", lap);
+        console.log("lap raw:", lapTime, " formatted:", lap);
       },
       false
     );
@@ -305,6 +368,8 @@ function setupUSBEvents() {
     console.log("USB rssi", data, "buffer size", rssiBuffer.length);
   });
 
+  transportManager.on("rssiBatch", addRssiBatch);
+
   transportManager.on("lap", (data) => {
     var lap = (parseFloat(data) / 1000).toFixed(2);
     addLap(lap);
@@ -626,20 +691,42 @@ async function getBatteryVoltage() {
 
 setInterval(getBatteryVoltage, 2000);
 
+function plotRssiSample(time, value) {
+  if (crossing && value < exitRssi) {
+    crossing = false;
+  } else if (!crossing && value > enterRssi) {
+    crossing = true;
+  }
+  maxRssiValue = Math.max(maxRssiValue, value);
+  minRssiValue = Math.min(minRssiValue, value);
+  rssiSeries.append(time, value);
+  rssiCrossingSeries.append(time, crossing ? 256 : -10);
+}
+
+// {"t":device ms of v[0],"dt":ms between samples,"lost":n,"v":[first, deltas...]}
+// Device times are placed on the local clock with the smallest transit
+// seen, creeping up 1 ms per batch so a slower link or restart is followed
+function addRssiBatch(batch) {
+  if (!batch.v || batch.v.length === 0) return;
+  var lastT = batch.t + (batch.v.length - 1) * batch.dt;
+  var offset = Date.now() - lastT;
+  rssiDeviceOffset = rssiDeviceOffset === null ? offset : Math.min(rssiDeviceOffset + 1, offset);
+  var value = 0;
+  for (var i = 0; i < batch.v.length; i++) {
+    value += batch.v[i];
+    rssiValue = value;
+    plotRssiSample(batch.t + i * batch.dt + rssiDeviceOffset, value);
+  }
+}
+
 function addRssiPoint() {
   if (!rssiChart) return; // Chart not initialized yet
 
   if (calib.style.display != "none") {
     rssiChart.start();
-    if (rssiBuffer.length > 0) {
+    var streaming = rssiStreamId !== null || (usbConnected && rssiSending);
+    if (!streaming && rssiBuffer.length > 0) {
       rssiValue = parseInt(rssiBuffer.shift());
-      if (crossing && rssiValue < exitRssi) {
-        crossing = false;
-      } else if (!crossing && rssiValue > enterRssi) {
-        crossing = true;
-      }
-      maxRssiValue = Math.max(maxRssiValue, rssiValue);
-      minRssiValue = Math.min(minRssiValue, rssiValue);
     }
 
     // update horizontal lines and min max values
@@ -652,12 +739,8 @@ function addRssiPoint() {
 
     rssiChart.options.minValue = Math.max(0, Math.min(minRssiValue, exitRssi - 10));
 
-    var now = Date.now();
-    rssiSeries.append(now, rssiValue);
-    if (crossing) {
-      rssiCrossingSeries.append(now, 256);
-    } else {
-      rssiCrossingSeries.append(now, -10);
+    if (!streaming) {
+      plotRssiSample(Date.now(), rssiValue);
     }
   } else {
     rssiChart.stop();
@@ -694,7 +777,64 @@ function createRssiChart() {
     strokeStyle: "none",
     fillStyle: "hsla(136, 71%, 70%, 0.3)",
   });
-  rssiChart.streamTo(document.getElementById("rssiChart"), 200);
+  // Batches arrive up to a batch span after their first sample
+  rssiChart.streamTo(document.getElementById("rssiChart"), (RSSI_STREAM_BATCH * 1000) / RSSI_STREAM_RATE_HZ + 200);
+}
+
+function startRssiStream() {
+  if (usbConnected && transportManager) {
+    transportManager
+      .sendCommand("rssi/stream", "POST", { rate: RSSI_STREAM_RATE_HZ, batch: RSSI_STREAM_BATCH })
+      .then((response) => {
+        rssiSending = true;
+        console.log("rssi/stream:", response);
+      })
+      .catch((err) => console.error("Failed to start RSSI:", err));
+    return;
+  }
+  rssiSending = true;
+  renewRssiStream();
+}
+
+function renewRssiStream() {
+  if (sseClientId === null) {
+    // The "hello" event starts it
+    return;
+  }
+  var url = "/rssi/stream?client=" + sseClientId + "&rate=" + RSSI_STREAM_RATE_HZ + "&batch=" + RSSI_STREAM_BATCH;
+  if (rssiStreamId !== null) url += "&stream=" + rssiStreamId;
+  fetch(url, { method: "POST" })
+    .then((response) => response.json())
+    .then((response) => {
+      if (response.status !== "OK") {
+        // Lease ran out (or the timer rebooted): open a new stream
+        rssiStreamId = null;
+      } else {
+        rssiStreamId = response.stream;
+      }
+    })
+    .catch((err) => console.error("Failed to renew RSSI stream:", err))
+    .finally(() => {
+      if (rssiSending) {
+        rssiStreamTimer = setTimeout(renewRssiStream, rssiStreamId === null ? 1000 : RSSI_STREAM_RENEW_MS);
+      }
+    });
+}
+
+function stopRssiStream() {
+  rssiSending = false;
+  if (usbConnected && transportManager) {
+    transportManager
+      .sendCommand("rssi/stop", "POST")
+      .then((response) => console.log("rssi/stop:", response))
+      .catch((err) => console.error("Failed to stop RSSI:", err));
+    return;
+  }
+  clearTimeout(rssiStreamTimer);
+  if (rssiStreamId !== null) {
+    fetch("/rssi/stream/stop?stream=" + rssiStreamId + "&client=" + sseClientId, { method: "POST" });
+    rssiStreamId = null;
+  }
 }
 
 function openTab(evt, tabName) {
@@ -719,51 +859,9 @@ function openTab(evt, tabName) {
 
   // if event comes from calibration tab, signal to start sending RSSI events
   if (tabName === "calib" && !rssiSending) {
-    if (usbConnected && transportManager) {
-      transportManager
-        .sendCommand("timer/rssiStart", "POST")
-        .then((response) => {
-          rssiSending = true;
-          console.log("/timer/rssiStart:", response);
-        })
-        .catch((err) => console.error("Failed to start RSSI:", err));
-    } else {
-      fetch("/timer/rssiStart", {
-        method: "POST",
-        headers: {
-          Accept: "application/json",
-          "Content-Type": "application/json",
-        },
-      })
-        .then((response) => {
-          if (response.ok) rssiSending = true;
-          return response.json();
-        })
-        .then((response) => console.log("/timer/rssiStart:" + JSON.stringify(response)));
-    }
-  } else if (rssiSending) {
-    if (usbConnected && transportManager) {
-      transportManager
-        .sendCommand("timer/rssiStop", "POST")
-        .then((response) => {
-          rssiSending = false;
-          console.log("/timer/rssiStop:", response);
-        })
-        .catch((err) => console.error("Failed to stop RSSI:", err));
-    } else {
-      fetch("/timer/rssiStop", {
-        method: "POST",
-        headers: {
-          Accept: "application/json",
-          "Content-Type": "application/json",
-        },
-      })
-        .then((response) => {
-          if (response.ok) rssiSending = false;
-          return response.json();
-        })
-        .then((response) => console.log("/timer/rssiStop:" + JSON.stringify(response)));
-    }
+    startRssiStream();
+  } else if (tabName !== "calib" && rssiSending) {
+    stopRssiStream();
   }
 
   // Load race history when opening history tab
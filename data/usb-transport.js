@@ -34,6 +34,7 @@ class USBTransport {
         this.responseHandlers = new Map();
         this.eventHandlers = {
             rssi: [],
+            rssiBatch: [],
             lap: [],
             raceState: [],
             disconnect: []
@@ -49,7 +49,7 @@ void BatteryMonitor::checkBatteryState(uint32_t currentTimeMs, uint8_t alarmThre
                 lastCheckTimeMs = currentTimeMs;
                 if (getBatteryVoltage() <= alarmThreshold) {
                     state = ALARM_BEEPING;
-                    buz->beep(MONITOR_BEEP_TIME_MS);
+                    buz->playLowBattery();
                     led->blink(MONITOR_BEEP_TIME_MS);
                 }
             }
@@ -65,7 +65,7 @@ void BatteryMonitor::checkBatteryState(uint32_t currentTimeMs, uint8_t alarmThre
                 lastCheckTimeMs = currentTimeMs;
                 if (getBatteryVoltage() <= alarmThreshold + 1) {  // add 0.1V of histeresis
                     state = ALARM_BEEPING;
-                    buz->beep(MONITOR_BEEP_TIME_MS);
+                    buz->playLowBattery();
                 } else {
                     led->off();
                     state = ALARM_OFF;
@@ -1,34 +1,73 @@
 #include "buzzer.h"
 
+#define BUZZER_SHORT_MS 120
+#define BUZZER_LONG_MS 400
+#define BUZZER_GAP_MS 120
+
 void Buzzer::init(uint8_t pin, bool inverted) {
-    pinMode(pin, OUTPUT);
-    initialState = inverted ? HIGH : LOW;
-    buzzerPin = pin;
-    buzzerState = BUZZER_IDLE;
-    digitalWrite(buzzerPin, initialState);
+#ifdef BUZZER_PASSIVE
+    sequencer.init(pin, inverted, BUZZER_LEDC_CHANNEL);
+#else
+    sequencer.init(pin, inverted);
+#endif
 }
 
 void Buzzer::beep(uint32_t timeMs) {
-    beepTimeMs = timeMs;
-    buzzerState = BUZZER_BEEPING;
-    startTimeMs = millis();
-    digitalWrite(buzzerPin, !initialState);
-}
-
-void Buzzer::handleBuzzer(uint32_t currentTimeMs) {
-    switch (buzzerState) {
-        case BUZZER_IDLE:
-            break;
-        case BUZZER_BEEPING:
-            if (currentTimeMs < startTimeMs) {
-                break;  // updated from different core
-            }
-            if ((currentTimeMs - startTimeMs) > beepTimeMs) {
-                digitalWrite(buzzerPin, initialState);
-                buzzerState = BUZZER_IDLE;
-            }
-            break;
-        default:
-            break;
+    if (timeMs > UINT16_MAX) {
+        timeMs = UINT16_MAX;
+    }
+    PatternStep step = {BUZZER_TONE_HZ, (uint16_t)timeMs};
+    sequencer.offer(&step, 1);
+}
+
+void Buzzer::play(const PatternStep* steps, uint8_t count, uint8_t repeat, int64_t startUs) {
+    sequencer.play(steps, count, repeat, startUs);
+}
+
+// Steps playLapNumber() takes: a beep and a gap per ten and per unit,
+// without the last gap
+static constexpr uint8_t lapNumberBeeps(uint16_t lap) {
+    return (lap / 10 > 9 ? 0 : lap / 10) + lap % 10;
+}
+static constexpr uint8_t lapNumberSteps(uint16_t lap) {
+    return lapNumberBeeps(lap) == 0 ? 1 : lapNumberBeeps(lap) * 2 - 1;
+}
+static_assert(lapNumberSteps(99) <= SEQ_MAX_STEPS, "Lap 99 must fit in one pattern");
+
+void Buzzer::playLapNumber(uint16_t lap) {
+    PatternStep steps[SEQ_MAX_STEPS];
+    uint8_t count = 0;
+    uint16_t tens = lap / 10;
+    uint16_t units = lap % 10;
+    // Anything past 99 laps just gets the units, the count would be too long to follow
+    if (tens > 9) {
+        tens = 0;
+    }
+    for (uint16_t i = 0; i < tens && count + 2 <= SEQ_MAX_STEPS; i++) {
+        steps[count++] = {BUZZER_TONE_HZ, BUZZER_LONG_MS};
+        steps[count++] = {0, BUZZER_GAP_MS};
+    }
+    for (uint16_t i = 0; i < units && count + 2 <= SEQ_MAX_STEPS; i++) {
+        steps[count++] = {BUZZER_TONE_HZ, BUZZER_SHORT_MS};
+        steps[count++] = {0, BUZZER_GAP_MS};
+    }
+    if (count == 0) {
+        steps[count++] = {BUZZER_TONE_HZ, BUZZER_LONG_MS};
+    } else {
+        count--;  // Nothing follows the last gap
     }
+    sequencer.offer(steps, count);
+}
+
+void Buzzer::playLowBattery() {
+    static const PatternStep lowBattery[] = {
+        {BUZZER_TONE_HZ, 100}, {0, 100},
+        {BUZZER_TONE_HZ, 100}, {0, 100},
+        {BUZZER_TONE_HZ, 500},
+    };
+    sequencer.offer(lowBattery, sizeof(lowBattery) / sizeof(lowBattery[0]));
+}
+
+void Buzzer::stop() {
+    sequencer.stop();
 }
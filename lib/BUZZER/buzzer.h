@@ -1,22 +1,30 @@
 #include <Arduino.h>
 
+#include "sequencer.h"
+
 #pragma once
 
-typedef enum {
-    BUZZER_IDLE,
-    BUZZER_BEEPING
-} buzzer_state_e;
+#define BUZZER_TONE_HZ 2700     // Resonant frequency of the usual 12mm passive buzzers
+#define BUZZER_LEDC_CHANNEL 0   // Only used with BUZZER_PASSIVE
 
+// Beeps and beep patterns, played by a PatternSequencer. Active buzzers are
+// switched on and off; define BUZZER_PASSIVE to drive a passive one with LEDC
+// tones. Safe to call from any task on either core. beep(), playLapNumber()
+// and playLowBattery() are dropped during a hold(), play() and stop() are not
 class Buzzer {
    public:
     void init(uint8_t pin, bool inverted);
-    void handleBuzzer(uint32_t currentTimeMs);
     void beep(uint32_t timeMs);
+    void play(const PatternStep* steps, uint8_t count, uint8_t repeat = 1, int64_t startUs = 0);
+    // One long beep per ten and one short beep per unit of the lap number
+    void playLapNumber(uint16_t lap);
+    void playLowBattery();
+    // Keeps the pattern just played, e.g. an armed start, until untilUs
+    // (esp_timer_get_time()); 0 releases
+    void hold(int64_t untilUs) { sequencer.hold(untilUs); }
+    void stop();
+    bool isPlaying() const { return sequencer.isPlaying(); }
 
    private:
-    buzzer_state_e buzzerState = BUZZER_IDLE;
-    uint8_t buzzerPin;
-    uint8_t initialState = LOW;
-    uint32_t beepTimeMs;
-    uint32_t startTimeMs;
+    PatternSequencer sequencer;
 };
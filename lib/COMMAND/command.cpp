@@ -0,0 +1,708 @@
+#include "command.h"
+
+#include <WiFi.h>
+
+#include "debug.h"
+
+#ifdef ESP32S3
+#include "rgbled.h"
+extern RgbLed* g_rgbLed;
+#endif
+
+uint32_t CommandArgs::getUint(const char *key, uint32_t def) const {
+    JsonVariantConst value = data[key];
+    if (value.is<const char *>()) {
+        return strtoul(value.as<const char *>(), NULL, 10);
+    }
+    return value.isNull() ? def : value.as<uint32_t>();
+}
+
+float CommandArgs::getFloat(const char *key, float def) const {
+    JsonVariantConst value = data[key];
+    if (value.is<const char *>()) {
+        return strtof(value.as<const char *>(), NULL);
+    }
+    return value.isNull() ? def : value.as<float>();
+}
+
+bool CommandArgs::getBool(const char *key, bool def) const {
+    JsonVariantConst value = data[key];
+    if (value.is<const char *>()) {
+        const char *text = value.as<const char *>();
+        return strcmp(text, "1") == 0 || strcmp(text, "true") == 0;
+    }
+    return value.isNull() ? def : value.as<bool>();
+}
+
+uint32_t CommandArgs::getColor(const char *key, uint32_t def) const {
+    JsonVariantConst value = data[key];
+    if (value.is<const char *>()) {
+        return strtoul(value.as<const char *>(), NULL, 16);
+    }
+    return value.isNull() ? def : value.as<uint32_t>();
+}
+
+const char *CommandArgs::getString(const char *key, const char *def) const {
+    return data[key] | def;
+}
+
+static const CommandResult OK = {CMD_OK, nullptr};
+static const CommandResult TIMER_BUSY = {CMD_BUSY, "Timer busy"};
+#ifndef ESP32S3
+static const CommandResult NO_RGB_LED = {CMD_UNAVAILABLE, "RGB LED not supported on this hardware"};
+#endif
+
+// Timer
+
+// Queues a timer command and waits up to LAPTIMER_ACK_TIMEOUT_MS for the
+// timing loop to apply it. A slower loop still applies it later, so that
+// is "pending", not a failure; only a full queue is. True if applied now
+static bool submitTimer(CommandContext &ctx, laptimer_cmd_e type, JsonObject reply, CommandResult &result) {
+    uint32_t ticket = ctx.timer->submit(type);
+    if (ticket == 0) {
+        result = TIMER_BUSY;
+        return false;
+    }
+    result = OK;
+    if (!ctx.timer->waitForAck(ticket)) {
+        reply["pending"] = true;
+        return false;
+    }
+    return true;
+}
+
+static CommandResult timerStart(CommandContext &ctx, const CommandArgs &args, JsonObject reply) {
+    CommandResult result;
+    submitTimer(ctx, LAPTIMER_CMD_START, reply, result);
+    if (result.status == CMD_OK && ctx.transportMgr) {
+        ctx.transportMgr->broadcastRaceStateEvent("started");
+    }
+    return result;
+}
+
+// Armed start: arm tone, random hold, start tone, timed on the device.
+// Answers with the start tone time before it sounds; loop() broadcasts it
+// (raceArmed) once the timer has armed, even if this reply was pending
+static CommandResult timerArm(CommandContext &ctx, const CommandArgs &args, JsonObject reply) {
+    CommandResult result;
+    if (submitTimer(ctx, LAPTIMER_CMD_ARM, reply, result)) {
+        uint32_t startTimeMs = ctx.timer->getScheduledStartMs();
+        reply["startTimeMs"] = startTimeMs;
+        reply["startsInMs"] = (int32_t)(startTimeMs - millis());
+    }
+    return result;
+}
+
+static CommandResult timerStop(CommandContext &ctx, const CommandArgs &args, JsonObject reply) {
+    CommandResult result;
+    submitTimer(ctx, LAPTIMER_CMD_STOP, reply, result);
+    if (result.status != CMD_OK) {
+        return result;
+    }
+    ctx.storage->requestFlush();
+    if (ctx.transportMgr) {
+        ctx.transportMgr->broadcastRaceStateEvent("stopped");
+    }
+    return result;
+}
+
+static CommandResult timerLap(CommandContext &ctx, const CommandArgs &args, JsonObject reply) {
+#ifdef ESP32S3
+    if (g_rgbLed) g_rgbLed->flashLap();
+#endif
+    return OK;
+}
+
+// Manual or replayed lap, broadcast to every client like a timed one
+static CommandResult timerAddLap(CommandContext &ctx, const CommandArgs &args, JsonObject reply) {
+    if (!args.has("lapTime")) {
+        return {CMD_BAD_REQUEST, "Missing lapTime"};
+    }
+    if (ctx.transportMgr) {
+        ctx.transportMgr->broadcastLapEvent(args.getUint("lapTime"));
+    }
+#ifdef ESP32S3
+    if (g_rgbLed) g_rgbLed->flashLap();
+#endif
+    if (ctx.webhooks && ctx.config->getGateLEDsEnabled() && ctx.config->getWebhookLap()) {
+        ctx.webhooks->triggerLap();
+    }
+    return OK;
+}
+
+// Playback of a saved race: race events without the timer
+static CommandResult timerPlaybackStart(CommandContext &ctx, const CommandArgs &args, JsonObject reply) {
+    if (ctx.transportMgr) {
+        ctx.transportMgr->broadcastRaceStateEvent("started");
+    }
+    if (ctx.webhooks && ctx.config->getGateLEDsEnabled() && ctx.config->getWebhookRaceStart()) {
+        ctx.webhooks->triggerRaceStart();
+    }
+    return OK;
+}
+
+static CommandResult timerPlaybackStop(CommandContext &ctx, const CommandArgs &args, JsonObject reply) {
+    if (ctx.transportMgr) {
+        ctx.transportMgr->broadcastRaceStateEvent("stopped");
+    }
+    if (ctx.webhooks && ctx.config->getGateLEDsEnabled() && ctx.config->getWebhookRaceStop()) {
+        ctx.webhooks->triggerRaceStop();
+    }
+    return OK;
+}
+
+// Polled by the web UI while a race runs
+static CommandResult timerDistance(CommandContext &ctx, const CommandArgs &args, JsonObject reply) {
+    reply["totalDistance"] = ctx.timer->getTotalDistance();
+    reply["distanceRemaining"] = ctx.timer->getDistanceRemaining();
+    Track *selected = ctx.timer->getSelectedTrack();
+    reply["trackId"] = selected ? selected->trackId : 0;
+    reply["trackName"] = selected ? selected->name : String();
+    reply["trackDistance"] = selected ? selected->distance : 0.0f;
+    return OK;
+}
+
+static CommandResult calibrationStart(CommandContext &ctx, const CommandArgs &args, JsonObject reply) {
+    CommandResult result;
+    submitTimer(ctx, LAPTIMER_CMD_CALIBRATION_START, reply, result);
+    return result;
+}
+
+static CommandResult calibrationStop(CommandContext &ctx, const CommandArgs &args, JsonObject reply) {
+    CommandResult result;
+    submitTimer(ctx, LAPTIMER_CMD_CALIBRATION_STOP, reply, result);
+    return result;
+}
+
+// Config and device
+
+static CommandResult configGet(CommandContext &ctx, const CommandArgs &args, JsonObject reply) {
+    ctx.config->toJson(reply, args.withSecrets());
+    return OK;
+}
+
+static CommandResult configSet(CommandContext &ctx, const CommandArgs &args, JsonObject reply) {
+    if (!args.raw().is<JsonObjectConst>()) {
+        return {CMD_BAD_REQUEST, "Missing data"};
+    }
+    ctx.config->fromJson(args.raw().as<JsonObjectConst>());
+    return OK;
+}
+
+static CommandResult status(CommandContext &ctx, const CommandArgs &args, JsonObject reply) {
+    JsonObject heap = reply.createNestedObject("heap");
+    heap["free"] = ESP.getFreeHeap();
+    heap["min"] = ESP.getMinFreeHeap();
+    heap["size"] = ESP.getHeapSize();
+    heap["maxAlloc"] = ESP.getMaxAllocHeap();
+
+    JsonObject stor = reply.createNestedObject("storage");
+    stor["type"] = ctx.storage->getStorageType();
+    stor["used"] = ctx.storage->getUsedBytes();
+    stor["total"] = ctx.storage->getTotalBytes();
+    stor["free"] = ctx.storage->getFreeBytes();
+    StorageStats cacheStats = ctx.storage->getStats();
+    stor["dirtyFiles"] = cacheStats.dirtyFiles;
+    stor["cacheHits"] = cacheStats.cacheHits;
+    stor["bytesWritten"] = cacheStats.bytesWritten;
+    stor["lastFlushUs"] = cacheStats.lastFlushUs;
+
+    JsonObject chip = reply.createNestedObject("chip");
+    chip["model"] = ESP.getChipModel();
+    chip["revision"] = ESP.getChipRevision();
+    chip["cores"] = ESP.getChipCores();
+    chip["sdk"] = ESP.getSdkVersion();
+    chip["flashSize"] = ESP.getFlashChipSize();
+    chip["flashSpeed"] = ESP.getFlashChipSpeed() / 1000000;
+    chip["cpuSpeed"] = getCpuFrequencyMhz();
+
+    JsonObject network = reply.createNestedObject("network");
+    network["ip"] = WiFi.localIP().toString();
+    network["mac"] = WiFi.macAddress();
+
+    // Battery monitoring is no longer fitted on most builds
+    if (ctx.monitor) {
+        reply["batteryVoltage"] = (float)ctx.monitor->getBatteryVoltage() / 10;
+    }
+    return OK;
+}
+
+static CommandResult selftest(CommandContext &ctx, const CommandArgs &args, JsonObject reply) {
+    ctx.selftest->runAllTests();
+    DynamicJsonDocument results(4096);
+    deserializeJson(results, ctx.selftest->getResultsJSON());
+    for (JsonPair field : results.as<JsonObject>()) {
+        reply[field.key()] = field.value();
+    }
+    return OK;
+}
+
+// Flushes the write cache now; "interval" sets the flush period too
+static CommandResult storageFlush(CommandContext &ctx, const CommandArgs &args, JsonObject reply) {
+    if (args.has("interval")) {
+        uint32_t interval = args.getUint("interval");
+        if (interval < 100 || interval > 60000) {
+            return {CMD_BAD_REQUEST, "Interval must be 100-60000 ms"};
+        }
+        ctx.storage->setFlushInterval(interval);
+    }
+    ctx.storage->flush();
+    return OK;
+}
+
+// Race history
+
+static CommandResult racesGet(CommandContext &ctx, const CommandArgs &args, JsonObject reply) {
+    ctx.history->toJson(reply);
+    return OK;
+}
+
+static CommandResult racesSave(CommandContext &ctx, const CommandArgs &args, JsonObject reply) {
+    JsonVariantConst data = args.raw();
+    if (!data.is<JsonObjectConst>()) {
+        return {CMD_BAD_REQUEST, "Missing data"};
+    }
+    RaceSession race;
+    race.timestamp = data["timestamp"];
+    race.fastestLap = data["fastestLap"];
+    race.medianLap = data["medianLap"];
+    race.best3LapsTotal = data["best3LapsTotal"];
+    race.pilotName = data["pilotName"] | "";
+    race.pilotCallsign = data["pilotCallsign"] | "";
+    race.frequency = data["frequency"] | 0;
+    race.band = data["band"] | "";
+    race.channel = data["channel"] | 0;
+    race.trackId = data["trackId"] | 0;
+    race.trackName = data["trackName"] | "";
+    race.totalDistance = data["totalDistance"] | 0.0;
+    for (uint32_t lap : data["lapTimes"].as<JsonArrayConst>()) {
+        race.lapTimes.push_back(lap);
+    }
+    return ctx.history->saveRace(race) ? OK : CommandResult{CMD_FAILED, nullptr};
+}
+
+static CommandResult racesDelete(CommandContext &ctx, const CommandArgs &args, JsonObject reply) {
+    if (!args.has("timestamp")) {
+        return {CMD_BAD_REQUEST, "Missing timestamp"};
+    }
+    return ctx.history->deleteRace(args.getUint("timestamp")) ? OK : CommandResult{CMD_FAILED, nullptr};
+}
+
+static CommandResult racesClear(CommandContext &ctx, const CommandArgs &args, JsonObject reply) {
+    return ctx.history->clearAll() ? OK : CommandResult{CMD_FAILED, nullptr};
+}
+
+// One race, in the format of races/get (HTTP sends it as a file)
+static CommandResult racesGetOne(CommandContext &ctx, const CommandArgs &args, JsonObject reply) {
+    if (!args.has("timestamp")) {
+        return {CMD_BAD_REQUEST, "Missing timestamp"};
+    }
+    return ctx.history->toJson(reply, args.getUint("timestamp")) ? OK : CommandResult{CMD_NOT_FOUND, "Race not found"};
+}
+
+// Name, tag and, if given, the total distance of a saved race
+static CommandResult racesUpdate(CommandContext &ctx, const CommandArgs &args, JsonObject reply) {
+    if (!args.has("timestamp") || !args.has("name") || !args.has("tag")) {
+        return {CMD_BAD_REQUEST, "Missing parameters"};
+    }
+    bool updated = ctx.history->updateRace(args.getUint("timestamp"), args.getString("name"), args.getString("tag"),
+                                           args.getFloat("totalDistance", -1.0f));
+    return updated ? OK : CommandResult{CMD_FAILED, nullptr};
+}
+
+static CommandResult racesUpdateLaps(CommandContext &ctx, const CommandArgs &args, JsonObject reply) {
+    if (!args.has("timestamp") || !args.raw()["lapTimes"].is<JsonArrayConst>()) {
+        return {CMD_BAD_REQUEST, "Missing parameters"};
+    }
+    std::vector<uint32_t> lapTimes;
+    for (uint32_t lap : args.raw()["lapTimes"].as<JsonArrayConst>()) {
+        lapTimes.push_back(lap);
+    }
+    return ctx.history->updateLaps(args.getUint("timestamp"), lapTimes) ? OK : CommandResult{CMD_FAILED, nullptr};
+}
+
+// Tracks
+
+// The timer must let go of its track before the track is freed. Waits
+// for the timer to apply it; false if the queue was full or it did not
+static bool deselectTrack(CommandContext &ctx) {
+    uint32_t ticket = ctx.timer->submit(LAPTIMER_CMD_SET_TRACK, nullptr);
+    if (ticket == 0 || !ctx.timer->waitForAck(ticket)) {
+        return false;
+    }
+    ctx.config->setSelectedTrackId(0);
+    return true;
+}
+
+static void readTrack(const CommandArgs &args, Track &track) {
+    track.trackId = args.getUint("trackId");
+    track.name = args.getString("name");
+    track.tags = args.getString("tags");
+    track.distance = args.getFloat("distance");
+    track.notes = args.getString("notes");
+    track.imagePath = "";
+}
+
+static CommandResult tracksGet(CommandContext &ctx, const CommandArgs &args, JsonObject reply) {
+    ctx.tracks->toJson(reply);
+    return OK;
+}
+
+static CommandResult tracksCreate(CommandContext &ctx, const CommandArgs &args, JsonObject reply) {
+    Track track;
+    readTrack(args, track);
+    return ctx.tracks->createTrack(track) ? OK : CommandResult{CMD_FAILED, nullptr};
+}
+
+static CommandResult tracksUpdate(CommandContext &ctx, const CommandArgs &args, JsonObject reply) {
+    if (!args.has("trackId")) {
+        return {CMD_BAD_REQUEST, "Missing trackId"};
+    }
+    Track track;
+    readTrack(args, track);
+    return ctx.tracks->updateTrack(track.trackId, track) ? OK : CommandResult{CMD_FAILED, nullptr};
+}
+
+static CommandResult tracksDelete(CommandContext &ctx, const CommandArgs &args, JsonObject reply) {
+    if (!args.has("trackId")) {
+        return {CMD_BAD_REQUEST, "Missing trackId"};
+    }
+    uint32_t trackId = args.getUint("trackId");
+    Track *selected = ctx.timer->getSelectedTrack();
+    if (ctx.config->getSelectedTrackId() == trackId || (selected && selected->trackId == trackId)) {
+        if (!deselectTrack(ctx)) {
+            return TIMER_BUSY;
+        }
+    }
+    return ctx.tracks->deleteTrack(trackId) ? OK : CommandResult{CMD_FAILED, nullptr};
+}
+
+static CommandResult tracksClear(CommandContext &ctx, const CommandArgs &args, JsonObject reply) {
+    if (ctx.config->getSelectedTrackId() != 0 || ctx.timer->getSelectedTrack()) {
+        if (!deselectTrack(ctx)) {
+            return TIMER_BUSY;
+        }
+    }
+    return ctx.tracks->clearAll() ? OK : CommandResult{CMD_FAILED, nullptr};
+}
+
+// Track 0 deselects
+static CommandResult tracksSelect(CommandContext &ctx, const CommandArgs &args, JsonObject reply) {
+    if (!args.has("trackId")) {
+        return {CMD_BAD_REQUEST, "Missing trackId"};
+    }
+    uint32_t trackId = args.getUint("trackId");
+    Track *track = nullptr;
+    if (trackId != 0) {
+        track = ctx.tracks->getTrackById(trackId);
+        if (!track) {
+            return {CMD_NOT_FOUND, "Track not found"};
+        }
+    }
+    if (ctx.timer->submit(LAPTIMER_CMD_SET_TRACK, track) == 0) {
+        return TIMER_BUSY;
+    }
+    ctx.config->setSelectedTrackId(trackId);
+    return OK;
+}
+
+// Webhooks. The config holds the list, WebhookManager follows it via the
+// change bus
+
+static CommandResult webhooksGet(CommandContext &ctx, const CommandArgs &args, JsonObject reply) {
+    reply["enabled"] = ctx.config->getWebhooksEnabled() != 0;
+    JsonArray ips = reply.createNestedArray("webhooks");
+    uint8_t count = ctx.config->getWebhookCount();
+    for (uint8_t i = 0; i < count; i++) {
+        ips.add(ctx.config->getWebhookIP(i));
+    }
+    return OK;
+}
+
+static CommandResult webhooksAdd(CommandContext &ctx, const CommandArgs &args, JsonObject reply) {
+    if (!args.has("ip")) {
+        return {CMD_BAD_REQUEST, "Missing ip"};
+    }
+    if (!ctx.config->addWebhookIP(args.getString("ip"))) {
+        return {CMD_BAD_REQUEST, "Failed to add webhook"};
+    }
+    return {CMD_OK, "Webhook added"};
+}
+
+static CommandResult webhooksRemove(CommandContext &ctx, const CommandArgs &args, JsonObject reply) {
+    if (!args.has("ip")) {
+        return {CMD_BAD_REQUEST, "Missing ip"};
+    }
+    if (!ctx.config->removeWebhookIP(args.getString("ip"))) {
+        return {CMD_BAD_REQUEST, "Webhook not found"};
+    }
+    return {CMD_OK, "Webhook removed"};
+}
+
+static CommandResult webhooksClear(CommandContext &ctx, const CommandArgs &args, JsonObject reply) {
+    ctx.config->clearWebhookIPs();
+    return {CMD_OK, "All webhooks cleared"};
+}
+
+static CommandResult webhooksEnable(CommandContext &ctx, const CommandArgs &args, JsonObject reply) {
+    if (!args.has("enabled")) {
+        return {CMD_BAD_REQUEST, "Missing enabled"};
+    }
+    bool enabled = args.getBool("enabled");
+    ctx.config->setWebhooksEnabled(enabled ? 1 : 0);
+    return {CMD_OK, enabled ? "Webhooks enabled" : "Webhooks disabled"};
+}
+
+// Test flash on every webhook. Only queued here, the main loop sends it
+static CommandResult webhooksTriggerFlash(CommandContext &ctx, const CommandArgs &args, JsonObject reply) {
+    if (!ctx.webhooks) {
+        return {CMD_BAD_REQUEST, "Webhooks not initialized"};
+    }
+    if (!ctx.webhooks->isEnabled()) {
+        return {CMD_BAD_REQUEST, "Webhooks are disabled"};
+    }
+    uint8_t hookCount = ctx.webhooks->getWebhookCount();
+    if (hookCount == 0) {
+        return {CMD_BAD_REQUEST, "No webhooks configured"};
+    }
+    DEBUG("Triggering flash webhook to %d endpoints\n", hookCount);
+    ctx.webhooks->triggerFlash();
+    return {CMD_OK, "Flash triggered"};
+}
+
+// RGB LED. Settings go through the config bus, which applies and saves them
+
+static CommandResult ledColor(CommandContext &ctx, const CommandArgs &args, JsonObject reply) {
+    if (!args.has("color")) return {CMD_BAD_REQUEST, "Missing color"};
+#ifdef ESP32S3
+    ctx.config->setLedColor(args.getColor("color"));
+    return OK;
+#else
+    return NO_RGB_LED;
+#endif
+}
+
+static CommandResult ledFadeColor(CommandContext &ctx, const CommandArgs &args, JsonObject reply) {
+    if (!args.has("color")) return {CMD_BAD_REQUEST, "Missing color"};
+#ifdef ESP32S3
+    ctx.config->setLedFadeColor(args.getColor("color"));
+    return OK;
+#else
+    return NO_RGB_LED;
+#endif
+}
+
+static CommandResult ledStrobeColor(CommandContext &ctx, const CommandArgs &args, JsonObject reply) {
+    if (!args.has("color")) return {CMD_BAD_REQUEST, "Missing color"};
+#ifdef ESP32S3
+    ctx.config->setLedStrobeColor(args.getColor("color"));
+    return OK;
+#else
+    return NO_RGB_LED;
+#endif
+}
+
+static CommandResult ledBrightness(CommandContext &ctx, const CommandArgs &args, JsonObject reply) {
+    if (!args.has("brightness")) return {CMD_BAD_REQUEST, "Missing brightness"};
+#ifdef ESP32S3
+    ctx.config->setLedBrightness(args.getUint("brightness"));
+    return OK;
+#else
+    return NO_RGB_LED;
+#endif
+}
+
+static CommandResult ledPreset(CommandContext &ctx, const CommandArgs &args, JsonObject reply) {
+    if (!args.has("preset")) return {CMD_BAD_REQUEST, "Missing preset"};
+#ifdef ESP32S3
+    ctx.config->setLedPreset(args.getUint("preset"));
+    return OK;
+#else
+    return NO_RGB_LED;
+#endif
+}
+
+static CommandResult ledSpeed(CommandContext &ctx, const CommandArgs &args, JsonObject reply) {
+    if (!args.has("speed")) return {CMD_BAD_REQUEST, "Missing speed"};
+#ifdef ESP32S3
+    ctx.config->setLedSpeed(args.getUint("speed"));
+    return OK;
+#else
+    return NO_RGB_LED;
+#endif
+}
+
+static CommandResult ledCount(CommandContext &ctx, const CommandArgs &args, JsonObject reply) {
+    if (!args.has("count")) return {CMD_BAD_REQUEST, "Missing count"};
+#ifdef ESP32S3
+    uint32_t count = args.getUint("count");
+    if (count < 1 || count > RGB_MAX_LEDS) {
+        return {CMD_BAD_REQUEST, "Count must be 1-600"};
+    }
+    ctx.config->setLedCount(count);
+    return OK;
+#else
+    return NO_RGB_LED;
+#endif
+}
+
+static CommandResult ledOverride(CommandContext &ctx, const CommandArgs &args, JsonObject reply) {
+    if (!args.has("enable")) return {CMD_BAD_REQUEST, "Missing enable"};
+#ifdef ESP32S3
+    ctx.config->setLedManualOverride(args.getBool("enable") ? 1 : 0);
+    return OK;
+#else
+    return NO_RGB_LED;
+#endif
+}
+
+// 0 off, 1 solid, 2 pulse, 3 rainbow wave
+static CommandResult ledMode(CommandContext &ctx, const CommandArgs &args, JsonObject reply) {
+    if (!args.has("mode")) return {CMD_BAD_REQUEST, "Missing mode"};
+#ifdef ESP32S3
+    uint32_t mode = args.getUint("mode");
+    if (g_rgbLed) {
+        if (mode == 0) {
+            g_rgbLed->off();
+        } else if (mode == 1) {
+            g_rgbLed->setManualMode(RGB_SOLID);
+        } else if (mode == 2) {
+            g_rgbLed->setManualMode(RGB_PULSE);
+        } else if (mode == 3) {
+            g_rgbLed->setRainbowWave();
+        }
+    }
+    return OK;
+#else
+    return NO_RGB_LED;
+#endif
+}
+
+static CommandResult ledError(CommandContext &ctx, const CommandArgs &args, JsonObject reply) {
+    if (!args.has("code")) return {CMD_BAD_REQUEST, "Missing code"};
+#ifdef ESP32S3
+    if (g_rgbLed) g_rgbLed->showErrorCode(args.getUint("code"));
+    return OK;
+#else
+    return NO_RGB_LED;
+#endif
+}
+
+// Sorted by name (strcmp), for the binary search in find(). The
+// static_assert below holds the order
+static constexpr CommandDef commands[] = {
+    {"calibration/start", calibrationStart, 0},
+    {"calibration/stop", calibrationStop, 0},
+    {"config/get", configGet, CMD_FLAG_DATA_ONLY},
+    {"config/set", configSet, 0},
+    {"led/brightness", ledBrightness, 0},
+    {"led/color", ledColor, 0},
+    {"led/count", ledCount, 0},
+    {"led/error", ledError, 0},
+    {"led/fadecolor", ledFadeColor, 0},
+    {"led/mode", ledMode, 0},
+    {"led/override", ledOverride, 0},
+    {"led/preset", ledPreset, 0},
+    {"led/speed", ledSpeed, 0},
+    {"led/strobecolor", ledStrobeColor, 0},
+    {"races/clear", racesClear, 0},
+    {"races/delete", racesDelete, 0},
+    {"races/get", racesGet, CMD_FLAG_DATA_ONLY},
+    {"races/getOne", racesGetOne, CMD_FLAG_DATA_ONLY},
+    {"races/save", racesSave, 0},
+    {"races/update", racesUpdate, 0},
+    {"races/updateLaps", racesUpdateLaps, 0},
+    {"selftest", selftest, 0},
+    {"status", status, 0},
+    {"storage/flush", storageFlush, 0},
+    {"timer/addLap", timerAddLap, 0},
+    {"timer/arm", timerArm, CMD_FLAG_NO_BLINK},
+    {"timer/distance", timerDistance, CMD_FLAG_DATA_ONLY | CMD_FLAG_NO_BLINK},
+    {"timer/lap", timerLap, 0},
+    {"timer/playbackLap", timerAddLap, 0},
+    {"timer/playbackStart", timerPlaybackStart, 0},
+    {"timer/playbackStop", timerPlaybackStop, 0},
+    {"timer/start", timerStart, 0},
+    {"timer/stop", timerStop, 0},
+    {"tracks/clear", tracksClear, 0},
+    {"tracks/create", tracksCreate, 0},
+    {"tracks/delete", tracksDelete, 0},
+    {"tracks/get", tracksGet, CMD_FLAG_DATA_ONLY},
+    {"tracks/select", tracksSelect, 0},
+    {"tracks/update", tracksUpdate, 0},
+    {"webhooks/add", webhooksAdd, 0},
+    {"webhooks/clear", webhooksClear, 0},
+    {"webhooks/enable", webhooksEnable, 0},
+    {"webhooks/get", webhooksGet, CMD_FLAG_DATA_ONLY},
+    {"webhooks/remove", webhooksRemove, 0},
+    {"webhooks/trigger/flash", webhooksTriggerFlash, 0},
+};
+static const size_t COMMAND_COUNT = sizeof(commands) / sizeof(commands[0]);
+
+// C++11 constexpr: one return statement each, so recursion
+static constexpr int compareNames(const char *a, const char *b) {
+    return *a != *b ? (int)(unsigned char)*a - (int)(unsigned char)*b : (*a == 0 ? 0 : compareNames(a + 1, b + 1));
+}
+
+static constexpr bool isSorted(const CommandDef *table, size_t count) {
+    return count < 2 || (compareNames(table[0].name, table[1].name) < 0 && isSorted(table + 1, count - 1));
+}
+
+static_assert(isSorted(commands, sizeof(commands) / sizeof(commands[0])), "commands[] must be sorted by name");
+
+const CommandDef *CommandRouter::find(const char *name) {
+    size_t low = 0;
+    size_t high = COMMAND_COUNT;
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        int order = strcmp(name, commands[mid].name);
+        if (order == 0) {
+            return &commands[mid];
+        }
+        if (order < 0) {
+            high = mid;
+        } else {
+            low = mid + 1;
+        }
+    }
+    return nullptr;
+}
+
+CommandResult CommandRouter::run(const CommandDef *command, JsonVariantConst args, JsonObject reply, bool withSecrets) {
+    return command->handler(ctx, CommandArgs(args, withSecrets), reply);
+}
+
+CommandResult CommandRouter::execute(const char *name, JsonVariantConst args, JsonObject reply) {
+    const CommandDef *command = find(name);
+    if (!command) {
+        return {CMD_NOT_FOUND, "Unknown command"};
+    }
+    return run(command, args, reply);
+}
+
+void CommandRouter::executeToReply(const char *name, uint32_t id, JsonVariantConst args, JsonDocument &out) {
+    out["id"] = id;
+    JsonObject data = out.createNestedObject("data");
+    CommandResult result = execute(name, args, data);
+    out["status"] = getStatusName(result.status);
+    if (result.message) {
+        out["message"] = result.message;
+    }
+    if (data.size() == 0) {
+        out.remove("data");
+    }
+}
+
+int CommandRouter::getHttpCode(command_status_e status) {
+    switch (status) {
+        case CMD_OK:
+        case CMD_FAILED:
+            return 200;
+        case CMD_BAD_REQUEST:
+            return 400;
+        case CMD_NOT_FOUND:
+            return 404;
+        default:
+            return 503;
+    }
+}
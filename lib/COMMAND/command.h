@@ -0,0 +1,120 @@
+#ifndef COMMAND_H
+#define COMMAND_H
+
+/**
+ * Commands shared by every transport
+ *
+ * The operations a client runs (start the timer, save a race, set the LED
+ * color ...) are written once, as the handlers of a table sorted by name.
+ * The table's order is checked at compile time and looked up by binary
+ * search; HTTP looks each route's handler up once, when the route is added.
+ * A transport only turns its request into arguments and the result into
+ * its reply, so a command behaves the same on all of them:
+ * - USB, WebSocket: {"cmd":"timer/arm","id":1,"data":{...}}
+ *   -> {"id":1,"status":"OK","data":{"startTimeMs":..}}
+ * - HTTP: POST /timer/arm with form fields or a JSON body
+ *   -> {"status":"OK","startTimeMs":..}, or the data alone for the
+ *   CMD_FLAG_DATA_ONLY ones (GET /config)
+ *
+ * HTTP downloads (GET /races/download) are the same commands, sent back
+ * as a file.
+ *
+ * Transport specific commands stay in their transport: proto, time,
+ * events, subscribe, the RSSI streams, and the uploads that stream their
+ * bytes to storage as they arrive (tracks/image, races/upload)
+ */
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#include "battery.h"
+#include "config.h"
+#include "laptimer.h"
+#include "racehistory.h"
+#include "selftest.h"
+#include "storage.h"
+#include "trackmanager.h"
+#include "transport.h"
+#include "webhook.h"
+
+typedef enum {
+    CMD_OK = 0,
+    CMD_FAILED,        // Ran, didn't work (HTTP 200 with status ERROR, as before)
+    CMD_BAD_REQUEST,   // Missing or out of range argument
+    CMD_BUSY,          // Timer command queue full, nothing was queued
+    CMD_UNAVAILABLE,   // Not on this hardware
+    CMD_NOT_FOUND
+} command_status_e;
+
+struct CommandResult {
+    command_status_e status;
+    const char *message;  // String literal or nullptr
+};
+
+// Arguments as JSON values (USB, WebSocket, JSON bodies) or as strings
+// (HTTP form fields); the getters read either
+class CommandArgs {
+   public:
+    explicit CommandArgs(JsonVariantConst data, bool secrets = false) : data(data), secrets(secrets) {}
+    bool has(const char *key) const { return !data[key].isNull(); }
+    uint32_t getUint(const char *key, uint32_t def = 0) const;
+    float getFloat(const char *key, float def = 0) const;
+    // true, 1, "1" or "true"
+    bool getBool(const char *key, bool def = false) const;
+    // Hex string ("ff8800") or number
+    uint32_t getColor(const char *key, uint32_t def = 0) const;
+    const char *getString(const char *key, const char *def = "") const;
+    JsonVariantConst raw() const { return data; }
+    // The reply may carry the WiFi password: HTTP only, for the config page
+    bool withSecrets() const { return secrets; }
+
+   private:
+    JsonVariantConst data;
+    bool secrets;
+};
+
+// What the handlers work on, set once in setup()
+struct CommandContext {
+    Config *config = nullptr;
+    LapTimer *timer = nullptr;
+    RaceHistory *history = nullptr;
+    Storage *storage = nullptr;
+    TrackManager *tracks = nullptr;
+    SelfTest *selftest = nullptr;
+    TransportManager *transportMgr = nullptr;
+    WebhookManager *webhooks = nullptr;
+    BatteryMonitor *monitor = nullptr;
+};
+
+typedef CommandResult (*CommandHandler)(CommandContext &ctx, const CommandArgs &args, JsonObject reply);
+
+typedef enum {
+    CMD_FLAG_DATA_ONLY = 1 << 0,  // HTTP replies with the data alone, no status
+    CMD_FLAG_NO_BLINK = 1 << 1    // HTTP leaves the status LED alone: polled, or plays its own pattern
+} command_flags_e;
+
+struct CommandDef {
+    const char *name;
+    CommandHandler handler;
+    uint8_t flags;
+};
+
+class CommandRouter {
+   public:
+    void init(const CommandContext &context) { ctx = context; }
+    // nullptr if there is no such command
+    static const CommandDef *find(const char *name);
+    // Runs a command found with find(), its data goes into reply
+    CommandResult run(const CommandDef *command, JsonVariantConst args, JsonObject reply, bool withSecrets = false);
+    CommandResult execute(const char *name, JsonVariantConst args, JsonObject reply);
+
+    // The USB and WebSocket reply: {"id","status","message","data"}
+    void executeToReply(const char *name, uint32_t id, JsonVariantConst args, JsonDocument &out);
+    static const char *getStatusName(command_status_e status) { return status == CMD_OK ? "OK" : "ERROR"; }
+    static int getHttpCode(command_status_e status);
+
+   private:
+    CommandContext ctx;
+};
+
+#endif  // COMMAND_H
@@ -6,11 +6,84 @@
 #include "debug.h"
 #include "storage.h"
 
-#ifdef ESP32S3
-#include <SD.h>
-#endif
-
 #define CONFIG_BACKUP_PATH "/config_backup.bin"
+#define CONFIG_STORE_VERSION_KEY "ver"
+
+#define CONFIG_FIELD(key, member, group) \
+    { key, offsetof(laptimer_config_t, member), sizeof(((laptimer_config_t*)0)->member), group }
+
+struct ConfigField {
+    const char* key;  // Store key, max 15 chars (NVS limit). Never rename - it is the on-flash identity
+    uint16_t offset;
+    uint16_t size;
+    uint32_t group;   // CONFIG_CHANGED_* group reported to listeners
+};
+
+// Every persisted field, its store key and its change group
+static const ConfigField configFields[] = {
+    CONFIG_FIELD("freq", frequency, CONFIG_CHANGED_FREQUENCY),
+    CONFIG_FIELD("minLap", minLap, CONFIG_CHANGED_TIMING),
+    CONFIG_FIELD("alarm", alarm, CONFIG_CHANGED_OTHER),
+    CONFIG_FIELD("anType", announcerType, CONFIG_CHANGED_PILOT),
+    CONFIG_FIELD("anRate", announcerRate, CONFIG_CHANGED_PILOT),
+    CONFIG_FIELD("enterRssi", enterRssi, CONFIG_CHANGED_TIMING),
+    CONFIG_FIELD("exitRssi", exitRssi, CONFIG_CHANGED_TIMING),
+    CONFIG_FIELD("maxLaps", maxLaps, CONFIG_CHANGED_TIMING),
+    CONFIG_FIELD("ledMode", ledMode, CONFIG_CHANGED_OTHER),
+    CONFIG_FIELD("ledBright", ledBrightness, CONFIG_CHANGED_LED_BRIGHTNESS),
+    CONFIG_FIELD("ledColor", ledColor, CONFIG_CHANGED_LED_COLOR),
+    CONFIG_FIELD("ledPreset", ledPreset, CONFIG_CHANGED_LED_PRESET),
+    CONFIG_FIELD("ledSpeed", ledSpeed, CONFIG_CHANGED_LED_SPEED),
+    CONFIG_FIELD("ledFadeColor", ledFadeColor, CONFIG_CHANGED_LED_EFFECT_COLORS),
+    CONFIG_FIELD("ledStrobeCol", ledStrobeColor, CONFIG_CHANGED_LED_EFFECT_COLORS),
+    CONFIG_FIELD("ledOverride", ledManualOverride, CONFIG_CHANGED_LED_OVERRIDE),
+    CONFIG_FIELD("opMode", operationMode, CONFIG_CHANGED_NETWORK),
+    CONFIG_FIELD("tracksEn", tracksEnabled, CONFIG_CHANGED_TRACKS),
+    CONFIG_FIELD("selTrackId", selectedTrackId, CONFIG_CHANGED_TRACKS),
+    CONFIG_FIELD("webhooksEn", webhooksEnabled, CONFIG_CHANGED_WEBHOOKS),
+    CONFIG_FIELD("webhookIPs", webhookIPs, CONFIG_CHANGED_WEBHOOKS),
+    CONFIG_FIELD("webhookCnt", webhookCount, CONFIG_CHANGED_WEBHOOKS),
+    CONFIG_FIELD("gateLEDsEn", gateLEDsEnabled, CONFIG_CHANGED_OTHER),
+    CONFIG_FIELD("whRaceStart", webhookRaceStart, CONFIG_CHANGED_WEBHOOKS),
+    CONFIG_FIELD("whRaceStop", webhookRaceStop, CONFIG_CHANGED_WEBHOOKS),
+    CONFIG_FIELD("whLap", webhookLap, CONFIG_CHANGED_WEBHOOKS),
+    CONFIG_FIELD("pilotName", pilotName, CONFIG_CHANGED_PILOT),
+    CONFIG_FIELD("callsign", pilotCallsign, CONFIG_CHANGED_PILOT),
+    CONFIG_FIELD("phonetic", pilotPhonetic, CONFIG_CHANGED_PILOT),
+    CONFIG_FIELD("pilotColor", pilotColor, CONFIG_CHANGED_PILOT),
+    CONFIG_FIELD("theme", theme, CONFIG_CHANGED_PILOT),
+    CONFIG_FIELD("voice", selectedVoice, CONFIG_CHANGED_PILOT),
+    CONFIG_FIELD("lapFormat", lapFormat, CONFIG_CHANGED_PILOT),
+    CONFIG_FIELD("ssid", ssid, CONFIG_CHANGED_NETWORK),
+    CONFIG_FIELD("pwd", password, CONFIG_CHANGED_NETWORK),
+    CONFIG_FIELD("ledCount", ledCount, CONFIG_CHANGED_LED_COUNT),
+    CONFIG_FIELD("startHoldMinMs", startHoldMinMs, CONFIG_CHANGED_OTHER),
+    CONFIG_FIELD("startHoldMaxMs", startHoldMaxMs, CONFIG_CHANGED_OTHER),
+};
+
+static const size_t configFieldCount = sizeof(configFields) / sizeof(configFields[0]);
+static const uint64_t allConfigFields = (configFieldCount >= 64) ? ~0ULL : ((1ULL << configFieldCount) - 1);
+
+// Bytes of laptimer_config_t a blob of the given layout version fills, 0 if
+// that version can't be read
+static size_t layoutSize(uint32_t version) {
+    switch (version) {
+        case 6:
+            return CONFIG_V6_SIZE;
+        case 7:
+            return CONFIG_V7_SIZE;
+        case CONFIG_VERSION:
+            return sizeof(laptimer_config_t);
+        default:
+            return 0;
+    }
+}
+
+#ifdef CONFIG_STORE_FILE
+static FileConfigStore defaultStore(CONFIG_STORE_FILE);
+#else
+static NvsConfigStore defaultStore(CONFIG_STORE_NAMESPACE);
+#endif
 
 void Config::init(void) {
     if (sizeof(laptimer_config_t) > EEPROM_RESERVED_SIZE) {
@@ -18,65 +91,178 @@ void Config::init(void) {
         return;
     }
 
-    EEPROM.begin(EEPROM_RESERVED_SIZE);  // Size of EEPROM
-    load();                              // Override default settings from EEPROM
+    // EEPROM only holds the legacy blob now, read once by the migration
+    EEPROM.begin(EEPROM_RESERVED_SIZE);
+
+    if (!store) {
+        store = &defaultStore;
+    }
+    if (!store->begin()) {
+        DEBUG("Config store failed to open\n");
+    }
+    load();
 
     checkTimeMs = millis();
 
-    DEBUG("EEPROM Init Successful\n");
+    DEBUG("Config Init Successful\n");
 }
 
 void Config::load(void) {
     modified = false;
-    EEPROM.get(0, conf);
-
-    uint32_t version = 0xFFFFFFFF;
-    if ((conf.version & CONFIG_MAGIC_MASK) == CONFIG_MAGIC) {
-        version = conf.version & ~CONFIG_MAGIC_MASK;
-    }
-
-    // If version is not current, try to restore from SD backup
-    if (version != CONFIG_VERSION) {
-        DEBUG("EEPROM config invalid (version=%u, expected=%u)\n", version, CONFIG_VERSION);
-        if (loadFromSD()) {
-            DEBUG("Successfully restored config from SD card backup\n");
-            modified = true;  // Mark as modified to write back to EEPROM
-            write();  // Write restored config to EEPROM
+    forceDirty = 0;
+    setDefaults();
+    memcpy(&committed, &conf, sizeof(conf));
+
+    uint32_t storeVersion = 0;
+    if (!store->get(CONFIG_STORE_VERSION_KEY, &storeVersion, sizeof(storeVersion))) {
+        storeVersion = 0;  // Nothing in the key-value store yet
+    }
+
+    // Fields missing from the store (or stored with another size) keep their
+    // default and are written on the next commit
+    uint8_t* confBytes = (uint8_t*)&conf;
+    uint8_t* committedBytes = (uint8_t*)&committed;
+    for (size_t i = 0; i < configFieldCount; i++) {
+        const ConfigField& field = configFields[i];
+        if (storeVersion > 0 && store->get(field.key, confBytes + field.offset, field.size)) {
+            memcpy(committedBytes + field.offset, confBytes + field.offset, field.size);
         } else {
-            DEBUG("No SD backup found, using defaults\n");
-            setDefaults();
+            forceDirty |= 1ULL << i;
         }
     }
 
+    if (storeVersion != CONFIG_STORE_VERSION) {
+        migrate(storeVersion);
+    }
+    if (forceDirty) {
+        modified = true;
+    }
+
     // Sanity: announcerRate stored as x10 (1–20). If invalid, reset to default (10).
     if (conf.announcerRate < 1 || conf.announcerRate > 20) {
         DEBUG("Invalid announcerRate=%u; resetting to default 10\n", conf.announcerRate);
         conf.announcerRate = 10;
         modified = true;
     }
+
+    publishTimingParams();
+}
+
+// Fill the next free slot and swap it in. Writers (web, USB, boot) are
+// serialized by the spinlock; readers never take it
+void Config::publishTimingParams() {
+    portENTER_CRITICAL(&timingMux);
+    const timing_params_t* current = timingParams.load(std::memory_order_relaxed);
+    if (current && current->enterRssi == conf.enterRssi && current->exitRssi == conf.exitRssi &&
+        current->maxLaps == conf.maxLaps && current->minLapMs == getMinLapMs()) {
+        portEXIT_CRITICAL(&timingMux);
+        return;
+    }
+
+    timingSlot = (timingSlot + 1) % TIMING_PARAMS_SLOTS;
+    timing_params_t* next = &timingSlots[timingSlot];
+    next->enterRssi = conf.enterRssi;
+    next->exitRssi = conf.exitRssi;
+    next->maxLaps = conf.maxLaps;
+    next->minLapMs = getMinLapMs();
+    next->generation = current ? current->generation + 1 : 0;
+    timingParams.store(next, std::memory_order_release);
+    portEXIT_CRITICAL(&timingMux);
 }
 
 void Config::write(void) {
     if (!modified) return;
 
-    DEBUG("Writing to EEPROM\n");
+    // Only fields that differ from what the store holds are written, so e.g.
+    // dragging the brightness slider rewrites a single byte-sized key
+    const uint8_t* confBytes = (const uint8_t*)&conf;
+    uint8_t* committedBytes = (uint8_t*)&committed;
+    uint8_t written = 0;
+    uint8_t failed = 0;
+    for (size_t i = 0; i < configFieldCount; i++) {
+        const ConfigField& field = configFields[i];
+        bool forced = forceDirty & (1ULL << i);
+        if (!forced && memcmp(confBytes + field.offset, committedBytes + field.offset, field.size) == 0) {
+            continue;
+        }
+        if (store->put(field.key, confBytes + field.offset, field.size)) {
+            memcpy(committedBytes + field.offset, confBytes + field.offset, field.size);
+            forceDirty &= ~(1ULL << i);
+            written++;
+        } else {
+            failed++;
+        }
+    }
 
-    EEPROM.put(0, conf);
-    EEPROM.commit();
+    if (written > 0 && !store->commit()) {
+        DEBUG("Config store commit failed\n");
+        failed++;
+    }
+    DEBUG("Config: %u fields written, %u failed\n", written, failed);
 
-    DEBUG("Writing to EEPROM done\n");
-    
     // Also backup to SD card if available
-    if (saveToSD()) {
+    if (written > 0 && saveToSD()) {
         DEBUG("Config backed up to SD card\n");
     }
 
-    modified = false;
+    // Failed fields stay different from the shadow and are retried next time
+    modified = failed > 0;
 }
 
-void Config::toJson(AsyncResponseStream& destination) {
-    // Use https://arduinojson.org/v6/assistant to estimate memory
-    DynamicJsonDocument config(512);
+// Store schema migrations, applied in order up to CONFIG_STORE_VERSION.
+// Fields added later need no step: a missing key keeps its default
+void Config::migrate(uint32_t fromVersion) {
+    uint32_t version = fromVersion;
+    DEBUG("Migrating config store from version %u to %u\n", version, CONFIG_STORE_VERSION);
+
+    if (version == 0) {
+        // v0: the whole config lived in one EEPROM blob. Import it (or the SD
+        // backup of it) instead of starting over with defaults
+        if (importLegacyEeprom()) {
+            DEBUG("Imported legacy EEPROM config\n");
+        } else if (loadFromSD()) {
+            DEBUG("Imported config from SD card backup\n");
+        } else {
+            DEBUG("No legacy config found, using defaults\n");
+        }
+        forceDirty = allConfigFields;
+        version = 1;
+    }
+
+    if (version > CONFIG_STORE_VERSION) {
+        // Written by newer firmware - keep every field this version knows
+        DEBUG("Config store version %u is newer than supported %u\n", version, CONFIG_STORE_VERSION);
+    }
+
+    // Fields first, version last: a reset in between just reruns the migration
+    modified = true;
+    write();
+    version = CONFIG_STORE_VERSION;
+    store->put(CONFIG_STORE_VERSION_KEY, &version, sizeof(version));
+    store->commit();
+}
+
+bool Config::importLegacyEeprom() {
+    laptimer_config_t legacy;
+    EEPROM.get(0, legacy);
+
+    uint32_t version = 0xFFFFFFFF;
+    if ((legacy.version & CONFIG_MAGIC_MASK) == CONFIG_MAGIC) {
+        version = legacy.version & ~CONFIG_MAGIC_MASK;
+    }
+    // Older blob layouts were never migrated, only v6 and later can be read.
+    // Fields an older blob predates keep their defaults
+    size_t size = layoutSize(version);
+    if (size == 0) {
+        DEBUG("Legacy EEPROM config not usable (version=%u, expected=%u)\n", version, CONFIG_VERSION);
+        return false;
+    }
+    memcpy(&conf, &legacy, size);
+    conf.version = CONFIG_VERSION | CONFIG_MAGIC;
+    return true;
+}
+
+void Config::toJson(JsonObject config, bool withPassword) {
     config["freq"] = conf.frequency;
     config["minLap"] = conf.minLap;
     config["alarm"] = conf.alarm;
@@ -93,6 +279,9 @@ void Config::toJson(AsyncResponseStream& destination) {
     config["ledFadeColor"] = conf.ledFadeColor;
     config["ledStrobeColor"] = conf.ledStrobeColor;
     config["ledManualOverride"] = conf.ledManualOverride;
+    config["ledCount"] = conf.ledCount;
+    config["startHoldMinMs"] = conf.startHoldMinMs;
+    config["startHoldMaxMs"] = conf.startHoldMaxMs;
     config["opMode"] = conf.operationMode;
     config["tracksEnabled"] = conf.tracksEnabled;
     config["selectedTrackId"] = conf.selectedTrackId;
@@ -114,7 +303,15 @@ void Config::toJson(AsyncResponseStream& destination) {
     config["selectedVoice"] = conf.selectedVoice;
     config["lapFormat"] = conf.lapFormat;
     config["ssid"] = conf.ssid;
-    config["pwd"] = conf.password;
+    if (withPassword) {
+        config["pwd"] = conf.password;
+    }
+}
+
+void Config::toJson(AsyncResponseStream& destination) {
+    // Use https://arduinojson.org/v6/assistant to estimate memory
+    DynamicJsonDocument config(512);
+    toJson(config.to<JsonObject>());
     serializeJson(config, destination);
 }
 
@@ -136,6 +333,9 @@ void Config::toJsonString(char* buf) {
     config["ledFadeColor"] = conf.ledFadeColor;
     config["ledStrobeColor"] = conf.ledStrobeColor;
     config["ledManualOverride"] = conf.ledManualOverride;
+    config["ledCount"] = conf.ledCount;
+    config["startHoldMinMs"] = conf.startHoldMinMs;
+    config["startHoldMaxMs"] = conf.startHoldMaxMs;
     config["opMode"] = conf.operationMode;
     config["tracksEnabled"] = conf.tracksEnabled;
     config["selectedTrackId"] = conf.selectedTrackId;
@@ -145,22 +345,23 @@ void Config::toJsonString(char* buf) {
     serializeJsonPretty(config, buf, 256);
 }
 
-void Config::fromJson(JsonObject source) {
+void Config::fromJson(JsonObjectConst source) {
+    bool changed = false;
     if (source["freq"] != conf.frequency) {
         conf.frequency = source["freq"];
-        modified = true;
+        changed = true;
     }
     if (source["minLap"] != conf.minLap) {
         conf.minLap = source["minLap"];
-        modified = true;
+        changed = true;
     }
     if (source["alarm"] != conf.alarm) {
         conf.alarm = source["alarm"];
-        modified = true;
+        changed = true;
     }
     if (source["anType"] != conf.announcerType) {
         conf.announcerType = source["anType"];
-        modified = true;
+        changed = true;
     }
     if (source.containsKey("anRate")) {
         int r = source["anRate"].as<int>();
@@ -171,119 +372,131 @@ void Config::fromJson(JsonObject source) {
 
         if ((uint8_t)r != conf.announcerRate) {
             conf.announcerRate = (uint8_t)r;
-            modified = true;
+            changed = true;
         }
     }
     if (source["enterRssi"] != conf.enterRssi) {
         conf.enterRssi = source["enterRssi"];
-        modified = true;
+        changed = true;
     }
     if (source["exitRssi"] != conf.exitRssi) {
         conf.exitRssi = source["exitRssi"];
-        modified = true;
+        changed = true;
     }
     if (source["maxLaps"] != conf.maxLaps) {
         conf.maxLaps = source["maxLaps"];
-        modified = true;
+        changed = true;
     }
     if (source.containsKey("ledMode") && source["ledMode"] != conf.ledMode) {
         conf.ledMode = source["ledMode"];
-        modified = true;
+        changed = true;
     }
     if (source.containsKey("ledBrightness") && source["ledBrightness"] != conf.ledBrightness) {
         conf.ledBrightness = source["ledBrightness"];
-        modified = true;
+        changed = true;
     }
     if (source.containsKey("ledColor") && source["ledColor"] != conf.ledColor) {
         conf.ledColor = source["ledColor"];
-        modified = true;
+        changed = true;
     }
     if (source.containsKey("ledPreset") && source["ledPreset"] != conf.ledPreset) {
         conf.ledPreset = source["ledPreset"];
-        modified = true;
+        changed = true;
     }
     if (source.containsKey("ledSpeed") && source["ledSpeed"] != conf.ledSpeed) {
         conf.ledSpeed = source["ledSpeed"];
-        modified = true;
+        changed = true;
     }
     if (source.containsKey("ledFadeColor") && source["ledFadeColor"] != conf.ledFadeColor) {
         conf.ledFadeColor = source["ledFadeColor"];
-        modified = true;
+        changed = true;
     }
     if (source.containsKey("ledStrobeColor") && source["ledStrobeColor"] != conf.ledStrobeColor) {
         conf.ledStrobeColor = source["ledStrobeColor"];
-        modified = true;
+        changed = true;
     }
     if (source.containsKey("ledManualOverride") && source["ledManualOverride"] != conf.ledManualOverride) {
         conf.ledManualOverride = source["ledManualOverride"];
-        modified = true;
+        changed = true;
+    }
+    if (source.containsKey("ledCount") && source["ledCount"] != conf.ledCount) {
+        conf.ledCount = source["ledCount"];
+        changed = true;
+    }
+    if (source.containsKey("startHoldMinMs") && source["startHoldMinMs"] != conf.startHoldMinMs) {
+        conf.startHoldMinMs = source["startHoldMinMs"];
+        changed = true;
+    }
+    if (source.containsKey("startHoldMaxMs") && source["startHoldMaxMs"] != conf.startHoldMaxMs) {
+        conf.startHoldMaxMs = source["startHoldMaxMs"];
+        changed = true;
     }
     if (source.containsKey("opMode") && source["opMode"] != conf.operationMode) {
         conf.operationMode = source["opMode"];
-        modified = true;
+        changed = true;
     }
     if (source.containsKey("tracksEnabled") && source["tracksEnabled"] != conf.tracksEnabled) {
         conf.tracksEnabled = source["tracksEnabled"];
-        modified = true;
+        changed = true;
     }
     if (source.containsKey("selectedTrackId") && source["selectedTrackId"] != conf.selectedTrackId) {
         conf.selectedTrackId = source["selectedTrackId"];
-        modified = true;
+        changed = true;
     }
     if (source.containsKey("gateLEDsEnabled") && source["gateLEDsEnabled"] != conf.gateLEDsEnabled) {
         conf.gateLEDsEnabled = source["gateLEDsEnabled"];
-        modified = true;
+        changed = true;
     }
     if (source.containsKey("webhookRaceStart") && source["webhookRaceStart"] != conf.webhookRaceStart) {
         conf.webhookRaceStart = source["webhookRaceStart"];
-        modified = true;
+        changed = true;
     }
     if (source.containsKey("webhookRaceStop") && source["webhookRaceStop"] != conf.webhookRaceStop) {
         conf.webhookRaceStop = source["webhookRaceStop"];
-        modified = true;
+        changed = true;
     }
     if (source.containsKey("webhookLap") && source["webhookLap"] != conf.webhookLap) {
         conf.webhookLap = source["webhookLap"];
-        modified = true;
+        changed = true;
     }
     // Webhook IPs and enabled state
     if (source.containsKey("webhooksEnabled") && source["webhooksEnabled"] != conf.webhooksEnabled) {
         conf.webhooksEnabled = source["webhooksEnabled"];
-        modified = true;
+        changed = true;
     }
     if (source.containsKey("webhookIPs")) {
-        JsonArray webhookArray = source["webhookIPs"].as<JsonArray>();
+        JsonArrayConst webhookArray = source["webhookIPs"].as<JsonArrayConst>();
 
-        bool changed = false;
+        bool ipsChanged = false;
 
         // Compare count
         if (webhookArray.size() != conf.webhookCount) {
-            changed = true;
+            ipsChanged = true;
         } else {
             // Compare entries
             uint8_t i = 0;
-            for (JsonVariant ip : webhookArray) {
+            for (JsonVariantConst ip : webhookArray) {
                 const char* ipStr = ip.as<const char*>() ? ip.as<const char*>() : "";
                 if (strcmp(conf.webhookIPs[i], ipStr) != 0) {
-                    changed = true;
+                    ipsChanged = true;
                     break;
                 }
                 i++;
             }
         }
 
-        if (changed) {
+        if (ipsChanged) {
             memset(conf.webhookIPs, 0, sizeof(conf.webhookIPs));
             conf.webhookCount = 0;
 
-            for (JsonVariant ip : webhookArray) {
+            for (JsonVariantConst ip : webhookArray) {
                 if (conf.webhookCount < 10) {
                     const char* ipStr = ip.as<const char*>() ? ip.as<const char*>() : "";
                     strlcpy(conf.webhookIPs[conf.webhookCount], ipStr, 16);
                     conf.webhookCount++;
                 }
             }
-            modified = true;
+            changed = true;
         }
     }
 
@@ -291,47 +504,54 @@ void Config::fromJson(JsonObject source) {
         const char* v = source["name"] | "";
         if (strcmp(v, conf.pilotName) != 0) {
             strlcpy(conf.pilotName, v, sizeof(conf.pilotName));
-            modified = true;
+            changed = true;
         }
     }
     if (source.containsKey("pilotCallsign") && source["pilotCallsign"] != conf.pilotCallsign) {
         strlcpy(conf.pilotCallsign, source["pilotCallsign"] | "", sizeof(conf.pilotCallsign));
-        modified = true;
+        changed = true;
     }
     if (source.containsKey("pilotPhonetic") && source["pilotPhonetic"] != conf.pilotPhonetic) {
         strlcpy(conf.pilotPhonetic, source["pilotPhonetic"] | "", sizeof(conf.pilotPhonetic));
-        modified = true;
+        changed = true;
     }
     if (source.containsKey("pilotColor") && source["pilotColor"] != conf.pilotColor) {
         conf.pilotColor = source["pilotColor"];
-        modified = true;
+        changed = true;
     }
     if (source.containsKey("theme") && source["theme"] != conf.theme) {
         strlcpy(conf.theme, source["theme"] | "oceanic", sizeof(conf.theme));
-        modified = true;
+        changed = true;
     }
     if (source.containsKey("selectedVoice") && source["selectedVoice"] != conf.selectedVoice) {
         strlcpy(conf.selectedVoice, source["selectedVoice"] | "default", sizeof(conf.selectedVoice));
-        modified = true;
+        changed = true;
     }
     if (source.containsKey("lapFormat") && source["lapFormat"] != conf.lapFormat) {
         strlcpy(conf.lapFormat, source["lapFormat"] | "full", sizeof(conf.lapFormat));
-        modified = true;
+        changed = true;
     }
     if (source.containsKey("ssid")) {
         const char* v = source["ssid"] | "";
         if (strcmp(v, conf.ssid) != 0) {
             strlcpy(conf.ssid, v, sizeof(conf.ssid));
-            modified = true;
+            changed = true;
         }
     }
     if (source.containsKey("pwd")) {
         const char* v = source["pwd"] | "";
         if (strcmp(v, conf.password) != 0) {
             strlcpy(conf.password, v, sizeof(conf.password));
-            modified = true;
+            changed = true;
         }
     }
+
+    // One publish after all fields, so the detector switches over atomically,
+    // and one notification, so listeners see the whole update at once
+    publishTimingParams();
+    if (changed) {
+        markChanged();
+    }
 }
 
 uint16_t Config::getFrequency() {
@@ -403,6 +623,18 @@ uint8_t Config::getLedManualOverride() {
     return conf.ledManualOverride;
 }
 
+uint16_t Config::getLedCount() {
+    return conf.ledCount;
+}
+
+uint16_t Config::getStartHoldMinMs() {
+    return conf.startHoldMinMs;
+}
+
+uint16_t Config::getStartHoldMaxMs() {
+    return conf.startHoldMaxMs;
+}
+
 uint8_t Config::getOperationMode() {
     return conf.operationMode;
 }
@@ -474,102 +706,123 @@ char* Config::getLapFormat() {
 void Config::setFrequency(uint16_t freq) {
     if (conf.frequency != freq) {
         conf.frequency = freq;
-        modified = true;
+        markChanged();
     }
 }
 
 void Config::setEnterRssi(uint8_t rssi) {
     if (conf.enterRssi != rssi) {
         conf.enterRssi = rssi;
-        modified = true;
+        markChanged();
+        publishTimingParams();
     }
 }
 
 void Config::setExitRssi(uint8_t rssi) {
     if (conf.exitRssi != rssi) {
         conf.exitRssi = rssi;
-        modified = true;
+        markChanged();
+        publishTimingParams();
     }
 }
 
 void Config::setOperationMode(uint8_t mode) {
     if (conf.operationMode != mode) {
         conf.operationMode = mode;
-        modified = true;
+        markChanged();
     }
 }
 
 void Config::setLedPreset(uint8_t preset) {
     if (conf.ledPreset != preset) {
         conf.ledPreset = preset;
-        modified = true;
+        markChanged();
     }
 }
 
 void Config::setLedBrightness(uint8_t brightness) {
     if (conf.ledBrightness != brightness) {
         conf.ledBrightness = brightness;
-        modified = true;
+        markChanged();
     }
 }
 
 void Config::setLedSpeed(uint8_t speed) {
     if (conf.ledSpeed != speed) {
         conf.ledSpeed = speed;
-        modified = true;
+        markChanged();
     }
 }
 
 void Config::setLedColor(uint32_t color) {
     if (conf.ledColor != color) {
         conf.ledColor = color;
-        modified = true;
+        markChanged();
     }
 }
 
 void Config::setLedFadeColor(uint32_t color) {
     if (conf.ledFadeColor != color) {
         conf.ledFadeColor = color;
-        modified = true;
+        markChanged();
     }
 }
 
 void Config::setLedStrobeColor(uint32_t color) {
     if (conf.ledStrobeColor != color) {
         conf.ledStrobeColor = color;
-        modified = true;
+        markChanged();
     }
 }
 
 void Config::setLedManualOverride(uint8_t override) {
     if (conf.ledManualOverride != override) {
         conf.ledManualOverride = override;
-        modified = true;
+        markChanged();
+    }
+}
+
+void Config::setLedCount(uint16_t count) {
+    if (conf.ledCount != count) {
+        conf.ledCount = count;
+        markChanged();
+    }
+}
+
+void Config::setStartHold(uint16_t minMs, uint16_t maxMs) {
+    if (conf.startHoldMinMs != minMs || conf.startHoldMaxMs != maxMs) {
+        conf.startHoldMinMs = minMs;
+        conf.startHoldMaxMs = maxMs;
+        markChanged();
     }
 }
 
 void Config::setTracksEnabled(uint8_t enabled) {
     if (conf.tracksEnabled != enabled) {
         conf.tracksEnabled = enabled;
-        modified = true;
+        markChanged();
     }
 }
 
 void Config::setSelectedTrackId(uint32_t trackId) {
     if (conf.selectedTrackId != trackId) {
         conf.selectedTrackId = trackId;
-        modified = true;
+        markChanged();
     }
 }
 
 void Config::setWebhooksEnabled(uint8_t enabled) {
     if (conf.webhooksEnabled != enabled) {
         conf.webhooksEnabled = enabled;
-        modified = true;
+        markChanged();
     }
 }
 
 bool Config::addWebhookIP(const char* ip) {
+    if (!ip || strlen(ip) == 0 || strlen(ip) > 15) {
+        DEBUG("Invalid webhook IP\n");
+        return false;
+    }
     if (conf.webhookCount >= 10) {
         DEBUG("Max webhooks reached\n");
         return false;
@@ -585,7 +838,7 @@ bool Config::addWebhookIP(const char* ip) {
     
     strlcpy(conf.webhookIPs[conf.webhookCount], ip, 16);
     conf.webhookCount++;
-    modified = true;
+    markChanged();
     return true;
 }
 
@@ -598,7 +851,7 @@ bool Config::removeWebhookIP(const char* ip) {
             }
             conf.webhookCount--;
             memset(conf.webhookIPs[conf.webhookCount], 0, 16);  // Clear last entry
-            modified = true;
+            markChanged();
             return true;
         }
     }
@@ -608,39 +861,39 @@ bool Config::removeWebhookIP(const char* ip) {
 void Config::clearWebhookIPs() {
     memset(conf.webhookIPs, 0, sizeof(conf.webhookIPs));
     conf.webhookCount = 0;
-    modified = true;
+    markChanged();
 }
 
 void Config::setGateLEDsEnabled(uint8_t enabled) {
     if (conf.gateLEDsEnabled != enabled) {
         conf.gateLEDsEnabled = enabled;
-        modified = true;
+        markChanged();
     }
 }
 
 void Config::setWebhookRaceStart(uint8_t enabled) {
     if (conf.webhookRaceStart != enabled) {
         conf.webhookRaceStart = enabled;
-        modified = true;
+        markChanged();
     }
 }
 
 void Config::setWebhookRaceStop(uint8_t enabled) {
     if (conf.webhookRaceStop != enabled) {
         conf.webhookRaceStop = enabled;
-        modified = true;
+        markChanged();
     }
 }
 
 void Config::setWebhookLap(uint8_t enabled) {
     if (conf.webhookLap != enabled) {
         conf.webhookLap = enabled;
-        modified = true;
+        markChanged();
     }
 }
 
 void Config::setDefaults(void) {
-    DEBUG("Setting EEPROM defaults\n");
+    DEBUG("Setting config defaults\n");
     // Reset everything to 0/false and then just set anything that zero is not appropriate
     memset(&conf, 0, sizeof(conf));
     conf.version = CONFIG_VERSION | CONFIG_MAGIC;
@@ -679,14 +932,96 @@ void Config::setDefaults(void) {
     strlcpy(conf.lapFormat, "timeonly", sizeof(conf.lapFormat));  // Default lap format
     strlcpy(conf.ssid, "", sizeof(conf.ssid));  // Empty WiFi credentials
     strlcpy(conf.password, "", sizeof(conf.password));  // Empty WiFi credentials
+    conf.ledCount = 2;  // Two pixels, the original gate build
+    conf.startHoldMinMs = 1000;  // Armed start: tone 1-5 s after the arm tone
+    conf.startHoldMaxMs = 5000;
+}
+
+bool Config::subscribe(ConfigListener* listener, uint32_t groups) {
+    if (busTask || listenerCount >= CONFIG_MAX_LISTENERS) {
+        DEBUG("Config listener rejected\n");
+        return false;
+    }
+    listeners[listenerCount].listener = listener;
+    listeners[listenerCount].groups = groups;
+    listenerCount++;
+    return true;
+}
+
+void Config::startBus() {
+    if (busTask) {
+        return;
+    }
+    // Priority 1 on core 0: above the busy parallelTask, below WiFi and async_tcp
+    xTaskCreatePinnedToCore(busTaskEntry, "configBus", CONFIG_BUS_TASK_STACK, this, 1, &busTask, 0);
+}
+
+// Called by every setter after the field is updated. Only wakes the bus
+// task; diffing and fan-out happen there, off the web/USB handler
+void Config::markChanged() {
     modified = true;
-    write();
+    if (busTask) {
+        xTaskNotifyGive(busTask);
+    }
 }
 
-void Config::handleEeprom(uint32_t currentTimeMs) {
-    if (modified && ((currentTimeMs - checkTimeMs) > EEPROM_CHECK_TIME_MS)) {
-        checkTimeMs = currentTimeMs;
-        write();
+// Groups of the fields that differ from what listeners last saw
+uint32_t Config::collectChanges() {
+    const uint8_t* confBytes = (const uint8_t*)&conf;
+    uint8_t* notifiedBytes = (uint8_t*)&notified;
+    uint32_t changed = 0;
+    for (size_t i = 0; i < configFieldCount; i++) {
+        const ConfigField& field = configFields[i];
+        if (memcmp(confBytes + field.offset, notifiedBytes + field.offset, field.size) != 0) {
+            memcpy(notifiedBytes + field.offset, confBytes + field.offset, field.size);
+            changed |= field.group;
+        }
+    }
+    return changed;
+}
+
+void Config::dispatch(uint32_t changed) {
+    DEBUG("Config changed, groups 0x%04X\n", changed);
+    for (uint8_t i = 0; i < listenerCount; i++) {
+        uint32_t groups = changed & listeners[i].groups;
+        if (groups) {
+            listeners[i].listener->onConfigChanged(*this, groups);
+        }
+    }
+}
+
+void Config::busTaskEntry(void* param) {
+    static_cast<Config*>(param)->runBus();
+}
+
+// Sleeps until a setter notifies it, or until a pending store write is due.
+// Writes are spaced by EEPROM_CHECK_TIME_MS so a dragged slider costs one
+// store write per interval, not one per step
+void Config::runBus() {
+    memcpy(&notified, &conf, sizeof(conf));
+    dispatch(CONFIG_CHANGED_ALL);
+
+    for (;;) {
+        TickType_t wait = portMAX_DELAY;
+        if (modified) {
+            uint32_t elapsed = millis() - checkTimeMs;
+            wait = elapsed >= EEPROM_CHECK_TIME_MS ? 0 : pdMS_TO_TICKS(EEPROM_CHECK_TIME_MS - elapsed);
+        }
+
+        if (ulTaskNotifyTake(pdTRUE, wait) > 0) {
+            uint32_t changed = collectChanges();
+            if (changed) {
+                // A change racing with the previous write() may have had its
+                // flag cleared there; the notification still carries it
+                modified = true;
+                dispatch(changed);
+            }
+        }
+
+        if (modified && (millis() - checkTimeMs) >= EEPROM_CHECK_TIME_MS) {
+            checkTimeMs = millis();
+            write();
+        }
     }
 }
 
@@ -697,26 +1032,13 @@ bool Config::saveToSD() {
     
     DEBUG("Saving config to SD: %s\n", CONFIG_BACKUP_PATH);
     
-#ifdef ESP32S3
-    File file = SD.open(CONFIG_BACKUP_PATH, FILE_WRITE);
-    if (!file) {
-        DEBUG("Failed to open config backup file for writing\n");
+    if (!storage->writeFile(CONFIG_BACKUP_PATH, (const uint8_t*)&conf, sizeof(laptimer_config_t))) {
+        DEBUG("Failed to write complete config backup (%d bytes)\n", sizeof(laptimer_config_t));
         return false;
     }
     
-    size_t written = file.write((uint8_t*)&conf, sizeof(laptimer_config_t));
-    file.close();
-    
-    if (written != sizeof(laptimer_config_t)) {
-        DEBUG("Failed to write complete config (wrote %d of %d bytes)\n", written, sizeof(laptimer_config_t));
-        return false;
-    }
-    
-    DEBUG("Config saved to SD (%d bytes)\n", written);
+    DEBUG("Config saved to SD (%d bytes)\n", sizeof(laptimer_config_t));
     return true;
-#else
-    return false;
-#endif
 }
 
 bool Config::loadFromSD() {
@@ -726,31 +1048,25 @@ bool Config::loadFromSD() {
     
     DEBUG("Attempting to load config from SD: %s\n", CONFIG_BACKUP_PATH);
     
-#ifdef ESP32S3
-    if (!SD.exists(CONFIG_BACKUP_PATH)) {
+    if (!storage->exists(CONFIG_BACKUP_PATH)) {
         DEBUG("No config backup file found on SD\n");
         return false;
     }
     
-    File file = SD.open(CONFIG_BACKUP_PATH, FILE_READ);
-    if (!file) {
-        DEBUG("Failed to open config backup file for reading\n");
-        return false;
-    }
-    
-    size_t fileSize = file.size();
-    if (fileSize != sizeof(laptimer_config_t)) {
+    // Older backups are shorter, see layoutSize()
+    size_t fileSize = storage->fileSize(CONFIG_BACKUP_PATH);
+    if (fileSize < CONFIG_V6_SIZE || fileSize > sizeof(laptimer_config_t)) {
         DEBUG("Config backup file size mismatch (found %d, expected %d)\n", fileSize, sizeof(laptimer_config_t));
-        file.close();
         return false;
     }
     
+    // Fields the backup predates keep their current value
     laptimer_config_t temp_conf;
-    size_t bytesRead = file.read((uint8_t*)&temp_conf, sizeof(laptimer_config_t));
-    file.close();
+    memcpy(&temp_conf, &conf, sizeof(laptimer_config_t));
+    size_t bytesRead = storage->readAt(CONFIG_BACKUP_PATH, 0, (uint8_t*)&temp_conf, fileSize);
     
-    if (bytesRead != sizeof(laptimer_config_t)) {
-        DEBUG("Failed to read complete config (read %d of %d bytes)\n", bytesRead, sizeof(laptimer_config_t));
+    if (bytesRead != fileSize) {
+        DEBUG("Failed to read complete config (read %d of %d bytes)\n", bytesRead, fileSize);
         return false;
     }
     
@@ -760,16 +1076,20 @@ bool Config::loadFromSD() {
         version = temp_conf.version & ~CONFIG_MAGIC_MASK;
     }
     
-    if (version != CONFIG_VERSION) {
+    size_t known = layoutSize(version);
+    bool sizeOk = version == CONFIG_VERSION ? fileSize == sizeof(laptimer_config_t) : known != 0 && fileSize >= known;
+    if (!sizeOk) {
         DEBUG("SD config version mismatch (found %u, expected %u)\n", version, CONFIG_VERSION);
         return false;
     }
+    // An older struct's tail padding overlaps the first newer field
+    memcpy((uint8_t*)&temp_conf + known, (uint8_t*)&conf + known, sizeof(laptimer_config_t) - known);
+    temp_conf.version = CONFIG_VERSION | CONFIG_MAGIC;
     
-    // Config is valid, use it
+    // Config is valid, use it - write() persists whatever fields differ
     memcpy(&conf, &temp_conf, sizeof(laptimer_config_t));
+    publishTimingParams();
+    markChanged();
     DEBUG("Config loaded from SD successfully\n");
     return true;
-#else
-    return false;
-#endif
 }
@@ -4,6 +4,11 @@
 #include <ArduinoJson.h>
 #include <AsyncJson.h>
 #include <stdint.h>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include "configstore.h"
 
 /*
 ## Pinout ##
@@ -81,9 +86,37 @@
 #define EEPROM_RESERVED_SIZE 512
 #define CONFIG_MAGIC_MASK (0b11U << 30)
 #define CONFIG_MAGIC (0b01U << 30)
-#define CONFIG_VERSION 6U
+#define CONFIG_VERSION 8U        // Layout of laptimer_config_t (legacy EEPROM blob, SD backup)
+#define CONFIG_V6_SIZE offsetof(laptimer_config_t, ledCount)        // v6 ends before ledCount
+#define CONFIG_V7_SIZE offsetof(laptimer_config_t, startHoldMinMs)  // v7 ends before startHoldMinMs
+#define CONFIG_STORE_VERSION 1U  // Schema of the per-field key-value store
+#define CONFIG_STORE_NAMESPACE "fpvgate"
+
+#define EEPROM_CHECK_TIME_MS 1000  // Minimum spacing of store writes while changes keep coming
 
-#define EEPROM_CHECK_TIME_MS 1000
+// Change groups for ConfigListener. A listener subscribes to the groups it
+// cares about and is called once per change with the groups that differ
+#define CONFIG_CHANGED_FREQUENCY (1UL << 0)
+#define CONFIG_CHANGED_TIMING (1UL << 1)             // Enter/exit RSSI, min lap, max laps
+#define CONFIG_CHANGED_LED_BRIGHTNESS (1UL << 2)
+#define CONFIG_CHANGED_LED_SPEED (1UL << 3)
+#define CONFIG_CHANGED_LED_COLOR (1UL << 4)          // Solid colour
+#define CONFIG_CHANGED_LED_EFFECT_COLORS (1UL << 5)  // Fade and strobe colours
+#define CONFIG_CHANGED_LED_OVERRIDE (1UL << 6)
+#define CONFIG_CHANGED_LED_PRESET (1UL << 7)
+#define CONFIG_CHANGED_WEBHOOKS (1UL << 8)           // Enable flag and IP list
+#define CONFIG_CHANGED_TRACKS (1UL << 9)
+#define CONFIG_CHANGED_PILOT (1UL << 10)             // Pilot, announcer, voice, lap format, theme
+#define CONFIG_CHANGED_NETWORK (1UL << 11)           // WiFi credentials, operation mode
+#define CONFIG_CHANGED_OTHER (1UL << 12)
+#define CONFIG_CHANGED_LED_COUNT (1UL << 13)         // Strip length
+#define CONFIG_CHANGED_LED (CONFIG_CHANGED_LED_BRIGHTNESS | CONFIG_CHANGED_LED_SPEED | CONFIG_CHANGED_LED_COLOR | \
+                            CONFIG_CHANGED_LED_EFFECT_COLORS | CONFIG_CHANGED_LED_OVERRIDE | CONFIG_CHANGED_LED_PRESET | \
+                            CONFIG_CHANGED_LED_COUNT)
+#define CONFIG_CHANGED_ALL ((1UL << 14) - 1)
+
+#define CONFIG_MAX_LISTENERS 8
+#define CONFIG_BUS_TASK_STACK 4096
 
 typedef struct {
     uint32_t version;
@@ -122,19 +155,54 @@ typedef struct {
     char lapFormat[11];        // Lap announcement format (full, laptime, timeonly)
     char ssid[33];
     char password[33];
+    uint16_t ledCount;         // Pixels on the external strip (v7)
+    uint16_t startHoldMinMs;   // Random hold between arm and start tone (v8)
+    uint16_t startHoldMaxMs;
 } laptimer_config_t;
 
+// Lap detector settings, published as one immutable snapshot so the timing
+// loop on the other core never sees a partially applied change
+typedef struct {
+    uint8_t enterRssi;
+    uint8_t exitRssi;
+    uint8_t maxLaps;
+    uint32_t minLapMs;
+    uint32_t generation;  // Bumped on every publish
+} timing_params_t;
+
+// Readers hold a snapshot for one sample (microseconds), writers are human
+// paced, so three slots mean a slot is never rewritten while still being read
+#define TIMING_PARAMS_SLOTS 3
+
 class Storage;  // Forward declaration
+class Config;
+
+class ConfigListener {
+   public:
+    virtual ~ConfigListener() {}
+    // Runs on the config bus task, changed holds the subscribed groups that differ
+    virtual void onConfigChanged(Config& config, uint32_t changed) = 0;
+};
 
 class Config {
    public:
+    void setStore(ConfigStore* configStore) { store = configStore; }  // Before init(), defaults to NVS
     void init();
     void load();
     void write();
+    // pwd only with withPassword
+    void toJson(JsonObject config, bool withPassword = true);
     void toJson(AsyncResponseStream& destination);
     void toJsonString(char* buf);
-    void fromJson(JsonObject source);
-    void handleEeprom(uint32_t currentTimeMs);
+    void fromJson(JsonObjectConst source);
+    
+    // Change bus. Subscribe during setup; startBus() delivers the current
+    // state to every listener once, then each change as it is made
+    bool subscribe(ConfigListener* listener, uint32_t groups);
+    void startBus();
+    
+    // Lock-free snapshot for the timing hot path: one atomic load, no locking
+    const timing_params_t* getTimingParams() const { return timingParams.load(std::memory_order_acquire); }
     
     // SD card backup/restore
     void setStorage(Storage* stor) { storage = stor; }
@@ -156,6 +224,9 @@ class Config {
     uint32_t getLedFadeColor();
     uint32_t getLedStrobeColor();
     uint8_t getLedManualOverride();
+    uint16_t getLedCount();
+    uint16_t getStartHoldMinMs();
+    uint16_t getStartHoldMaxMs();
     uint8_t getTracksEnabled();
     uint32_t getSelectedTrackId();
     uint8_t getWebhooksEnabled();
@@ -189,6 +260,8 @@ class Config {
     void setLedFadeColor(uint32_t color);
     void setLedStrobeColor(uint32_t color);
     void setLedManualOverride(uint8_t override);
+    void setLedCount(uint16_t count);
+    void setStartHold(uint16_t minMs, uint16_t maxMs);
     void setTracksEnabled(uint8_t enabled);
     void setSelectedTrackId(uint32_t trackId);
     void setWebhooksEnabled(uint8_t enabled);
@@ -202,10 +275,33 @@ class Config {
 
    private:
     laptimer_config_t conf;
-    bool modified;
-    volatile uint32_t checkTimeMs = 0;
+    laptimer_config_t committed;  // What the store holds, write() only persists fields that differ
+    laptimer_config_t notified;   // What listeners were last told about
+    uint64_t forceDirty = 0;      // Fields to write even if unchanged (missing from the store)
+    volatile bool modified;
+    uint32_t checkTimeMs = 0;
     Storage* storage = nullptr;
+    ConfigStore* store = nullptr;
+    timing_params_t timingSlots[TIMING_PARAMS_SLOTS];
+    std::atomic<const timing_params_t*> timingParams{nullptr};
+    uint8_t timingSlot = 0;
+    portMUX_TYPE timingMux = portMUX_INITIALIZER_UNLOCKED;
+    struct Subscription {
+        ConfigListener* listener;
+        uint32_t groups;
+    };
+    Subscription listeners[CONFIG_MAX_LISTENERS];
+    uint8_t listenerCount = 0;
+    TaskHandle_t busTask = nullptr;
+    void markChanged();
+    uint32_t collectChanges();
+    void dispatch(uint32_t changed);
+    static void busTaskEntry(void* param);
+    void runBus();
+    void publishTimingParams();
     void setDefaults();
+    void migrate(uint32_t fromVersion);
+    bool importLegacyEeprom();
 };
 
 #endif // CONFIG_H
@@ -0,0 +1,219 @@
+#include "configstore.h"
+
+#include <string.h>
+
+#ifdef ARDUINO
+bool NvsConfigStore::begin() {
+    return prefs.begin(ns, false);
+}
+
+bool NvsConfigStore::get(const char* key, void* buf, size_t len) {
+    // isKey() first - a missing key would otherwise log an NVS error
+    if (!prefs.isKey(key) || prefs.getBytesLength(key) != len) {
+        return false;
+    }
+    return prefs.getBytes(key, buf, len) == len;
+}
+
+bool NvsConfigStore::put(const char* key, const void* buf, size_t len) {
+    return prefs.putBytes(key, buf, len) == len;
+}
+
+bool NvsConfigStore::commit() {
+    // Preferences commits every put() on its own, each key is already durable
+    return true;
+}
+
+bool NvsConfigStore::clear() {
+    return prefs.clear();
+}
+#endif
+
+FileConfigStore::FileConfigStore(const char* path, size_t compactBytes)
+    : path(path), compactBytes(compactBytes), logBytes(0) {}
+
+bool FileConfigStore::begin() {
+    records.clear();
+    pending.clear();
+    logBytes = 0;
+
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) {
+        return true;  // No log yet, starts empty
+    }
+
+    bool damaged = false;
+    Record record;
+    while (true) {
+        long start = ftell(f);
+        ReadResult result = readRecord(f, record);
+        if (result == READ_END) {
+            // Anything after the last whole record is a torn append
+            fseek(f, 0, SEEK_END);
+            damaged = damaged || ftell(f) != start;
+            break;
+        }
+        if (result == READ_BAD) {
+            // Only this key loses its update, the records after it still count
+            damaged = true;
+            continue;
+        }
+        Record* existing = find(records, record.key.c_str());
+        if (existing) {
+            existing->data = record.data;
+        } else {
+            records.push_back(record);
+        }
+        logBytes = ftell(f);
+    }
+    fclose(f);
+
+    return damaged ? compact() : true;
+}
+
+bool FileConfigStore::get(const char* key, void* buf, size_t len) {
+    Record* record = find(pending, key);
+    if (!record) {
+        record = find(records, key);
+    }
+    if (!record || record->data.size() != len) {
+        return false;
+    }
+    memcpy(buf, record->data.data(), len);
+    return true;
+}
+
+bool FileConfigStore::put(const char* key, const void* buf, size_t len) {
+    if (strlen(key) > 255 || len > 0xFFFF) {
+        return false;
+    }
+    const uint8_t* bytes = (const uint8_t*)buf;
+    Record* record = find(pending, key);
+    if (!record) {
+        pending.push_back(Record());
+        record = &pending.back();
+        record->key = key;
+    }
+    record->data.assign(bytes, bytes + len);
+    return true;
+}
+
+bool FileConfigStore::commit() {
+    if (pending.empty()) {
+        return true;
+    }
+
+    for (const Record& record : pending) {
+        Record* existing = find(records, record.key.c_str());
+        if (existing) {
+            existing->data = record.data;
+        } else {
+            records.push_back(record);
+        }
+    }
+
+    if (logBytes >= compactBytes) {
+        pending.clear();
+        return compact();
+    }
+
+    FILE* f = fopen(path.c_str(), "ab");
+    if (!f) {
+        return false;
+    }
+    bool ok = true;
+    for (const Record& record : pending) {
+        ok = ok && writeRecord(f, record);
+    }
+    ok = fflush(f) == 0 && ok;
+    logBytes = ftell(f);
+    fclose(f);
+    pending.clear();
+    return ok;
+}
+
+bool FileConfigStore::clear() {
+    records.clear();
+    pending.clear();
+    logBytes = 0;
+    remove(path.c_str());
+    return true;
+}
+
+FileConfigStore::Record* FileConfigStore::find(std::vector<Record>& list, const char* key) {
+    for (Record& record : list) {
+        if (record.key == key) {
+            return &record;
+        }
+    }
+    return nullptr;
+}
+
+uint8_t FileConfigStore::checksum(const Record& record) {
+    uint8_t sum = (uint8_t)record.key.size() ^ (uint8_t)record.data.size() ^ (uint8_t)(record.data.size() >> 8);
+    for (char c : record.key) {
+        sum = (uint8_t)((sum << 1) | (sum >> 7)) ^ (uint8_t)c;
+    }
+    for (uint8_t b : record.data) {
+        sum = (uint8_t)((sum << 1) | (sum >> 7)) ^ b;
+    }
+    return sum;
+}
+
+bool FileConfigStore::writeRecord(FILE* f, const Record& record) {
+    uint8_t lenBytes[2] = {(uint8_t)record.data.size(), (uint8_t)(record.data.size() >> 8)};
+    return fputc((uint8_t)record.key.size(), f) != EOF &&
+           fwrite(record.key.data(), 1, record.key.size(), f) == record.key.size() &&
+           fwrite(lenBytes, 1, 2, f) == 2 &&
+           fwrite(record.data.data(), 1, record.data.size(), f) == record.data.size() &&
+           fputc(checksum(record), f) != EOF;
+}
+
+FileConfigStore::ReadResult FileConfigStore::readRecord(FILE* f, Record& record) {
+    int keyLen = fgetc(f);
+    if (keyLen == EOF || keyLen == 0) {
+        return READ_END;
+    }
+    record.key.resize(keyLen);
+    if (fread(&record.key[0], 1, keyLen, f) != (size_t)keyLen) {
+        return READ_END;
+    }
+    uint8_t lenBytes[2];
+    if (fread(lenBytes, 1, 2, f) != 2) {
+        return READ_END;
+    }
+    size_t dataLen = lenBytes[0] | (lenBytes[1] << 8);
+    record.data.resize(dataLen);
+    if (dataLen > 0 && fread(record.data.data(), 1, dataLen, f) != dataLen) {
+        return READ_END;
+    }
+    int sum = fgetc(f);
+    if (sum == EOF) {
+        return READ_END;
+    }
+    return (uint8_t)sum == checksum(record) ? READ_OK : READ_BAD;
+}
+
+bool FileConfigStore::compact() {
+    std::string tmpPath = path + ".tmp";
+    FILE* f = fopen(tmpPath.c_str(), "wb");
+    if (!f) {
+        return false;
+    }
+    bool ok = true;
+    for (const Record& record : records) {
+        ok = ok && writeRecord(f, record);
+    }
+    ok = fflush(f) == 0 && ok;
+    size_t size = ftell(f);
+    fclose(f);
+
+    // rename() over the old log is atomic on LittleFS and POSIX hosts, so a
+    // reset leaves either the old or the new log
+    if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0) {
+        remove(tmpPath.c_str());
+        return false;
+    }
+    logBytes = size;
+    return true;
+}
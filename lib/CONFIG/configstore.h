@@ -0,0 +1,90 @@
+#ifndef CONFIGSTORE_H
+#define CONFIGSTORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#ifdef ARDUINO
+#include <Preferences.h>
+#endif
+
+// Key-value backend for Config. Every field lives under its own key, so
+// changing one setting only rewrites that setting. put() stages a value,
+// commit() makes the staged values durable
+class ConfigStore {
+   public:
+    virtual ~ConfigStore() {}
+    virtual bool begin() = 0;
+    // True only if the key exists and holds exactly len bytes
+    virtual bool get(const char* key, void* buf, size_t len) = 0;
+    virtual bool put(const char* key, const void* buf, size_t len) = 0;
+    virtual bool commit() = 0;
+    virtual bool clear() = 0;
+};
+
+#ifdef ARDUINO
+// NVS backend. NVS appends each entry to the next free slot and rotates
+// through its pages, so repeated writes of one key are spread over the
+// whole partition. Keys are limited to 15 characters
+class NvsConfigStore : public ConfigStore {
+   public:
+    explicit NvsConfigStore(const char* ns) : ns(ns) {}
+    bool begin() override;
+    bool get(const char* key, void* buf, size_t len) override;
+    bool put(const char* key, const void* buf, size_t len) override;
+    bool commit() override;
+    bool clear() override;
+
+   private:
+    const char* ns;
+    Preferences prefs;
+};
+#endif
+
+// Log-structured file backend on plain stdio, so it runs on the host as well
+// as on a mounted VFS path. commit() appends the changed records; once the
+// log outgrows compactBytes it is rewritten with one record per key.
+// Record: [keyLen u8][key][dataLen u16 LE][data][checksum u8]. begin()
+// skips a whole record with a bad checksum and stops at a short one (a
+// torn append), then rewrites the log without them
+class FileConfigStore : public ConfigStore {
+   public:
+    explicit FileConfigStore(const char* path, size_t compactBytes = 4096);
+    bool begin() override;
+    bool get(const char* key, void* buf, size_t len) override;
+    bool put(const char* key, const void* buf, size_t len) override;
+    bool commit() override;
+    bool clear() override;
+
+    size_t getLogBytes() const { return logBytes; }
+
+   private:
+    struct Record {
+        std::string key;
+        std::vector<uint8_t> data;
+    };
+
+    std::string path;
+    size_t compactBytes;
+    size_t logBytes;
+    std::vector<Record> records;  // Latest committed value per key
+    std::vector<Record> pending;  // Staged by put(), written by commit()
+
+    static Record* find(std::vector<Record>& list, const char* key);
+    static bool writeRecord(FILE* f, const Record& record);
+    enum ReadResult {
+        READ_OK,
+        READ_BAD,  // All there, checksum wrong
+        READ_END   // End of the log, or cut short
+    };
+
+    static ReadResult readRecord(FILE* f, Record& record);
+    static uint8_t checksum(const Record& record);
+    bool compact();
+};
+
+#endif
@@ -43,6 +43,9 @@ static const int kMaxStepPerSample = 12;
 static const uint8_t kExitConfirmSamples = 2;
 
 void LapTimer::init(Config *config, RX5808 *rx5808, Buzzer *buzzer, Led *l, WebhookManager *webhook) {
+    // init() runs from setup(), on the loop task that drains the command queue
+    consumerTask = xTaskGetCurrentTaskHandle();
+    ackEvents = xEventGroupCreate();
     conf = config;
     rx = rx5808;
     buz = buzzer;
@@ -74,6 +77,59 @@ void LapTimer::init(Config *config, RX5808 *rx5808, Buzzer *buzzer, Led *l, Webh
 }
 
 void LapTimer::start() {
+    beginRace(millis());
+
+    // Cuts an armed start short
+    buz->hold(0);
+    led->hold(0);
+    buz->beep(500);
+    led->on(500);
+
+#ifdef ESP32S3
+    if (g_rgbLed) g_rgbLed->flashGreen();
+#endif
+}
+
+// Plays arm tone, random hold and start tone on the buzzer and LED
+// sequencers from one scheduled edge, and shows the RGB countdown against
+// the same instant. The race itself begins when the timing loop passes the
+// start tone edge, see handleLapTimerUpdate()
+void LapTimer::arm() {
+    uint16_t holdMin = conf->getStartHoldMinMs();
+    uint16_t holdMax = conf->getStartHoldMaxMs();
+    if (holdMax > LAPTIMER_START_HOLD_MAX_MS) holdMax = LAPTIMER_START_HOLD_MAX_MS;
+    if (holdMin > holdMax) holdMin = holdMax;
+    uint16_t holdMs = holdMin + esp_random() % (holdMax - holdMin + 1);
+
+    int64_t armUs = esp_timer_get_time() + LAPTIMER_ARM_LEAD_MS * 1000LL;
+    startToneUs = armUs + (LAPTIMER_ARM_TONE_MS + holdMs) * 1000LL;
+    // millis() is esp_timer_get_time() / 1000, so this is the tone edge in
+    // the timebase lap times are measured in
+    scheduledStartMs = (uint32_t)(startToneUs / 1000);
+
+    const PatternStep sequence[] = {
+        {LAPTIMER_ARM_TONE_HZ, LAPTIMER_ARM_TONE_MS},
+        {0, holdMs},
+        {LAPTIMER_START_TONE_HZ, LAPTIMER_START_TONE_MS},
+    };
+    buz->play(sequence, 3, 1, armUs);
+    led->play(sequence, 3, 1, armUs);
+    // Beeps and blinks from other tasks (replies, battery alarm) wait until
+    // the start tone is over; stop() and start() release this
+    int64_t sequenceEndUs = startToneUs + LAPTIMER_START_TONE_MS * 1000LL;
+    buz->hold(sequenceEndUs);
+    led->hold(sequenceEndUs);
+
+#ifdef ESP32S3
+    if (g_rgbLed) g_rgbLed->startCountdown(scheduledStartMs);
+#endif
+
+    state = ARMED;
+    armedAvailable = true;
+    DEBUG("Race armed, hold %u ms, start tone at %u ms\n", holdMs, (uint32_t)scheduledStartMs);
+}
+
+void LapTimer::beginRace(uint32_t startMs) {
     DEBUG("\n=== RACE STARTED ===\n");
     DEBUG("Current Thresholds:\n");
     DEBUG("  Enter RSSI: %u\n", conf->getEnterRssi());
@@ -87,7 +143,7 @@ void LapTimer::start() {
     filter.setMeasurementNoise(rssi_filter_q * 0.01f);
     filter.setProcessNoise(rssi_filter_r * 0.0001f);
 
-    raceStartTimeMs = millis();
+    raceStartTimeMs = startMs;
     startTimeMs = raceStartTimeMs;
     state = RUNNING;
 
@@ -103,13 +159,7 @@ void LapTimer::start() {
 
     totalDistanceTravelled = 0.0f;
     distanceRemaining = 0.0f;
-
-    buz->beep(500);
-    led->on(500);
-
-#ifdef ESP32S3
-    if (g_rgbLed) g_rgbLed->flashGreen();
-#endif
+    lapsFinished = 0;
 
     if (webhooks && conf->getGateLEDsEnabled() && conf->getWebhookRaceStart()) {
         webhooks->triggerRaceStart();
@@ -134,8 +184,11 @@ void LapTimer::stop() {
 
     totalDistanceTravelled = 0.0f;
     distanceRemaining = 0.0f;
+    lapsFinished = 0;
 
     memset(lapTimes, 0, sizeof(lapTimes));
+    buz->hold(0);
+    led->hold(0);
     buz->beep(500);
     led->on(500);
 
@@ -148,7 +201,120 @@ void LapTimer::stop() {
     }
 }
 
+uint32_t LapTimer::submit(laptimer_cmd_e type, Track* track) {
+    LapTimerCommand command;
+    command.type = type;
+    command.track = track;
+    uint32_t position;
+    if (!commands.push(command, &position)) {
+        DEBUG("LapTimer command queue full, dropped command %d\n", type);
+        return 0;
+    }
+    if (consumerTask) {
+        xTaskNotifyGive(consumerTask);
+    }
+    // Tickets follow consumption order, so "applied >= ticket" is exact
+    uint32_t ticket = position + 1;
+    return ticket ? ticket : 1;
+}
+
+bool LapTimer::isApplied(uint32_t ticket) const {
+    return (int32_t)(commandsApplied.load(std::memory_order_acquire) - ticket) >= 0;
+}
+
+// One bit per waiting task, so no waiter can clear another one's wake-up
+EventBits_t LapTimer::claimAckBit() {
+    const uint32_t allBits = (1u << LAPTIMER_ACK_WAITERS) - 1;
+    uint32_t claimed = ackWaiters.load();
+    uint32_t bit;
+    do {
+        uint32_t free = ~claimed & allBits;
+        if (!free) {
+            return 0;
+        }
+        bit = free & (~free + 1);
+    } while (!ackWaiters.compare_exchange_weak(claimed, claimed | bit));
+    // Left over from a waiter that timed out
+    xEventGroupClearBits(ackEvents, bit);
+    return bit;
+}
+
+bool LapTimer::waitForAck(uint32_t ticket, uint32_t timeoutMs) {
+    if (ticket == 0) {
+        return false;
+    }
+    if (isApplied(ticket)) {
+        return true;
+    }
+    EventBits_t bit = ackEvents ? claimAckBit() : 0;
+    if (!bit) {
+        DEBUG("LapTimer no free ack slot for command %u\n", ticket);
+        return false;
+    }
+    // The bit is ours before the check below, so an apply in between still
+    // ends the wait
+    uint32_t startMs = millis();
+    bool applied;
+    while (!(applied = isApplied(ticket))) {
+        uint32_t elapsedMs = millis() - startMs;
+        if (elapsedMs >= timeoutMs) {
+            break;
+        }
+        TickType_t ticks = pdMS_TO_TICKS(timeoutMs - elapsedMs);
+        xEventGroupWaitBits(ackEvents, bit, pdTRUE, pdTRUE, ticks ? ticks : 1);
+    }
+    ackWaiters.fetch_and(~bit);
+    if (!applied) {
+        DEBUG("LapTimer command %u still queued after %u ms\n", ticket, timeoutMs);
+    }
+    return applied;
+}
+
+// Runs at the top of each sample, before any state is read
+void LapTimer::processCommands() {
+    LapTimerCommand command;
+    uint8_t i = 0;
+    for (; i < LAPTIMER_COMMANDS_PER_SAMPLE && commands.pop(command); i++) {
+        switch (command.type) {
+            case LAPTIMER_CMD_START:
+                start();
+                break;
+            case LAPTIMER_CMD_ARM:
+                arm();
+                break;
+            case LAPTIMER_CMD_STOP:
+                stop();
+                break;
+            case LAPTIMER_CMD_CALIBRATION_START:
+                startCalibrationWizard();
+                break;
+            case LAPTIMER_CMD_CALIBRATION_STOP:
+                stopCalibrationWizard();
+                break;
+            case LAPTIMER_CMD_SET_TRACK:
+                setTrack(command.track);
+                break;
+            case LAPTIMER_CMD_REFRESH_DISTANCE:
+                refreshDistanceRemaining();
+                break;
+        }
+        commandsApplied.store(commands.consumed(), std::memory_order_release);
+    }
+    // Orders the stores above before reading who waits: a waiter that
+    // claims its bit after this load sees them in its own check
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint32_t waiters = ackWaiters.load();
+    if (i > 0 && waiters && ackEvents) {
+        xEventGroupSetBits(ackEvents, waiters);
+    }
+}
+
 void LapTimer::handleLapTimerUpdate(uint32_t currentTimeMs) {
+    processCommands();
+
+    // One snapshot per sample - every threshold below comes from the same version
+    const timing_params_t& params = *conf->getTimingParams();
+
     // --- Stage 1: raw RSSI ---
     uint8_t rawRssi = rx->readRssi();
 
@@ -199,6 +365,7 @@ void LapTimer::handleLapTimerUpdate(uint32_t currentTimeMs) {
 
     // Store final value used by lap logic
     rssi[rssiCount] = out;
+    rssiRing.add(currentTimeMs, out);
 
     // Debug/state tracking (raw/kalman/ma)
     lastRawRssi = rawRssi;
@@ -208,8 +375,8 @@ void LapTimer::handleLapTimerUpdate(uint32_t currentTimeMs) {
 #if LAPTIMER_RACE_DEBUG
     if (state == RUNNING) {
         const uint8_t cur = rssi[rssiCount];
-        const uint8_t enter = conf->getEnterRssi();
-        const uint8_t exitT = conf->getExitRssi();
+        const uint8_t enter = params.enterRssi;
+        const uint8_t exitT = params.exitRssi;
 
         if (prevAvgRssi < enter && cur >= enter) {
             DEBUG("[RACE] ENTER crossed: cur=%u raw=%u kal=%u med=%u ma=%u lp=%u out=%u t=%lu(ms since lap start)\n",
@@ -244,9 +411,20 @@ void LapTimer::handleLapTimerUpdate(uint32_t currentTimeMs) {
         case STOPPED:
             break;
 
+        case ARMED:
+            // Latch the scheduled tone edge, not the sample time
+            if (esp_timer_get_time() >= startToneUs) {
+                beginRace(scheduledStartMs);
+                armedStartAvailable = true;
+#ifdef ESP32S3
+                if (g_rgbLed) g_rgbLed->flashGreen();
+#endif
+            }
+            break;
+
         case WAITING:
-            lapPeakCapture();
-            if (lapPeakCaptured()) {
+            lapPeakCapture(params);
+            if (lapPeakCaptured(params)) {
                 state = RUNNING;
                 startLap();
             }
@@ -254,14 +432,14 @@ void LapTimer::handleLapTimerUpdate(uint32_t currentTimeMs) {
 
         case RUNNING: {
             bool isGate1 = (lapCount == 0 && !lapCountWraparound);
-            bool minLapElapsed = (currentTimeMs - startTimeMs) > conf->getMinLapMs();
+            bool minLapElapsed = (currentTimeMs - startTimeMs) > params.minLapMs;
 
             if (isGate1 || minLapElapsed) {
-                lapPeakCapture();
-                if (lapPeakCaptured()) {
+                lapPeakCapture(params);
+                if (lapPeakCaptured(params)) {
                     DEBUG("Lap triggered! Time: %u ms (Gate 1: %s)\n",
                           currentTimeMs - startTimeMs, isGate1 ? "YES" : "NO");
-                    finishLap();
+                    finishLap(params);
                     startLap();
                 }
             }
@@ -285,10 +463,10 @@ void LapTimer::handleLapTimerUpdate(uint32_t currentTimeMs) {
     rssiCount = (rssiCount + 1) % LAPTIMER_RSSI_HISTORY;
 }
 
-void LapTimer::lapPeakCapture() {
+void LapTimer::lapPeakCapture(const timing_params_t& params) {
     const uint8_t cur = rssi[rssiCount];
-    const uint8_t enter = conf->getEnterRssi();
-    const uint8_t exitT = conf->getExitRssi();
+    const uint8_t enter = params.enterRssi;
+    const uint8_t exitT = params.exitRssi;
     const uint32_t now = millis();
 
     // Debounce: require consecutive samples at/above enter before peak tracking
@@ -324,9 +502,9 @@ void LapTimer::lapPeakCapture() {
     }
 }
 
-bool LapTimer::lapPeakCaptured() {
-    const uint8_t enter = conf->getEnterRssi();
-    const uint8_t exitT = conf->getExitRssi();
+bool LapTimer::lapPeakCaptured(const timing_params_t& params) {
+    const uint8_t enter = params.enterRssi;
+    const uint8_t exitT = params.exitRssi;
 
     bool validPeak = (rssiPeak > 0) &&
                      (rssiPeak >= enter) &&
@@ -377,11 +555,14 @@ void LapTimer::startLap() {
     enterHoldSamples = 0;
     enterHoldStartMs = 0;
 
-    buz->beep(200);
+    // Completed laps already got their number from finishLap()
+    if (lapsFinished == 0) {
+        buz->beep(200);
+    }
     led->on(200);
 }
 
-void LapTimer::finishLap() {
+void LapTimer::finishLap(const timing_params_t& params) {
     lapTimes[lapCount] = rssiPeakTimeMs - startTimeMs;
     if (lapCount == 0 && lapCountWraparound == false) {
         lapTimes[0] = rssiPeakTimeMs - raceStartTimeMs;
@@ -389,21 +570,18 @@ void LapTimer::finishLap() {
         lapTimes[lapCount] = rssiPeakTimeMs - startTimeMs;
     }
     DEBUG("Lap finished, lap time = %u\n", lapTimes[lapCount]);
+    lapCrossingMs = rssiPeakTimeMs;
+    lapsFinished++;
+    buz->playLapNumber(lapsFinished);
 
     if (selectedTrack && selectedTrack->distance > 0) {
         totalDistanceTravelled += selectedTrack->distance;
 
-        uint8_t maxLaps = conf->getMaxLaps();
-        if (maxLaps > 0) {
-            int lapsCompleted = lapCount + 1;
-            if (lapCountWraparound) {
-                lapsCompleted = LAPTIMER_LAP_HISTORY + (lapCount + 1);
-            }
-            int lapsRemaining = maxLaps - lapsCompleted;
-            distanceRemaining = (lapsRemaining > 0) ? (lapsRemaining * selectedTrack->distance) : 0.0f;
-        } else {
-            distanceRemaining = 0.0f;
+        int lapsCompleted = lapCount + 1;
+        if (lapCountWraparound) {
+            lapsCompleted = LAPTIMER_LAP_HISTORY + (lapCount + 1);
         }
+        updateDistanceRemaining(params.maxLaps, lapsCompleted);
 
         DEBUG("Distance: Travelled = %.2f m, Remaining = %.2f m\n",
               totalDistanceTravelled, distanceRemaining);
@@ -443,13 +621,24 @@ bool LapTimer::isLapAvailable() {
     return lapAvailable;
 }
 
+bool LapTimer::takeArmed() {
+    bool armed = armedAvailable;
+    armedAvailable = false;
+    return armed;
+}
+
+bool LapTimer::takeArmedStart() {
+    bool started = armedStartAvailable;
+    armedStartAvailable = false;
+    return started;
+}
+
 void LapTimer::startCalibrationWizard() {
     DEBUG("Calibration wizard started\n");
     state = CALIBRATION_WIZARD;
     calibrationRssiCount = 0;
     lastCalibrationSampleMs = 0;  // Reset sample timing
-    memset(calibrationRssi, 0, sizeof(calibrationRssi));
-    memset(calibrationTimestamps, 0, sizeof(calibrationTimestamps));
+    // No need to clear the 25 KB of sample buffers: reads stop at calibrationRssiCount
     buz->beep(300);
     led->on(300);
 #ifdef ESP32S3
@@ -485,6 +674,33 @@ uint32_t LapTimer::getCalibrationTimestamp(uint16_t index) {
     return 0;
 }
 
+void LapTimer::updateDistanceRemaining(uint8_t maxLaps, int lapsCompleted) {
+    if (maxLaps > 0) {
+        int lapsRemaining = maxLaps - lapsCompleted;
+        distanceRemaining = (lapsRemaining > 0) ? (lapsRemaining * selectedTrack->distance) : 0.0f;
+    } else {
+        distanceRemaining = 0.0f;
+    }
+}
+
+void LapTimer::onConfigChanged(Config& config, uint32_t changed) {
+    // Max laps edited mid-race: refresh now rather than at the next lap.
+    // Thresholds need nothing here, they arrive through getTimingParams()
+    submit(LAPTIMER_CMD_REFRESH_DISTANCE);
+}
+
+// Timing loop only
+void LapTimer::refreshDistanceRemaining() {
+    if (state != RUNNING || !selectedTrack || selectedTrack->distance <= 0 || totalDistanceTravelled <= 0) {
+        return;
+    }
+    int lapsCompleted = lapCount;
+    if (lapCountWraparound) {
+        lapsCompleted = LAPTIMER_LAP_HISTORY + lapCount;
+    }
+    updateDistanceRemaining(conf->getMaxLaps(), lapsCompleted);
+}
+
 void LapTimer::setTrack(Track* track) {
     selectedTrack = track;
     totalDistanceTravelled = 0.0f;
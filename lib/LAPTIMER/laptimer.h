@@ -1,11 +1,16 @@
 #ifndef LAPTIMER_H
 #define LAPTIMER_H
 
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+
 #include "RX5808.h"
 #include "buzzer.h"
 #include "config.h"
 #include "kalman.h"
 #include "led.h"
+#include "mpscqueue.h"
+#include "rssistream.h"
 
 // Forward declarations to avoid circular dependency
 struct Track;
@@ -13,6 +18,7 @@ class WebhookManager;
 
 typedef enum {
     STOPPED,
+    ARMED,  // Start sequence playing, the race begins on the start tone
     WAITING,
     RUNNING,
     CALIBRATION_WIZARD
@@ -21,25 +27,79 @@ typedef enum {
 #define LAPTIMER_LAP_HISTORY 10
 #define LAPTIMER_RSSI_HISTORY 100
 #define LAPTIMER_CALIBRATION_HISTORY 5000  // Increased buffer for longer recordings
+#define LAPTIMER_COMMAND_QUEUE_SIZE 16     // Power of two
+#define LAPTIMER_COMMANDS_PER_SAMPLE 4     // Bounds the work between two samples
+#define LAPTIMER_ACK_TIMEOUT_MS 20         // Longest a command handler waits, on async_tcp
+#define LAPTIMER_ACK_WAITERS 8             // Tasks blocked in waitForAck() at once, one event bit each
+
+// Armed start: arm tone, random hold (config startHoldMinMs-startHoldMaxMs),
+// start tone. The lead puts the whole sequence on a scheduled timer edge
+#define LAPTIMER_ARM_LEAD_MS 20
+#define LAPTIMER_ARM_TONE_HZ 880
+#define LAPTIMER_ARM_TONE_MS 400
+#define LAPTIMER_START_TONE_HZ 1760
+#define LAPTIMER_START_TONE_MS 600
+#define LAPTIMER_START_HOLD_MAX_MS 30000
 
-class LapTimer {
+typedef enum {
+    LAPTIMER_CMD_START,
+    LAPTIMER_CMD_ARM,
+    LAPTIMER_CMD_STOP,
+    LAPTIMER_CMD_CALIBRATION_START,
+    LAPTIMER_CMD_CALIBRATION_STOP,
+    LAPTIMER_CMD_SET_TRACK,
+    LAPTIMER_CMD_REFRESH_DISTANCE  // Max laps changed
+} laptimer_cmd_e;
+
+struct LapTimerCommand {
+    laptimer_cmd_e type;
+    Track* track;  // LAPTIMER_CMD_SET_TRACK only
+};
+
+class LapTimer : public ConfigListener {
    public:
     void init(Config *config, RX5808 *rx5808, Buzzer *buzzer, Led *l, WebhookManager *webhook = nullptr);
-    void start();
-    void stop();
+    // Subscribed to CONFIG_CHANGED_TIMING, keeps race distance in step with
+    // max laps. Runs on the config bus task, so it only queues the refresh
+    void onConfigChanged(Config& config, uint32_t changed) override;
     void handleLapTimerUpdate(uint32_t currentTimeMs);
+    // Applies queued commands without taking a sample, for loop() passes
+    // that skip sampling while idle
+    void processCommands();
+    laptimer_state_e getState() const { return state; }
+    // millis() of the start tone of the last armed start, set once its
+    // LAPTIMER_CMD_ARM is acked
+    uint32_t getScheduledStartMs() const { return scheduledStartMs; }
+
+    // State changes from other tasks (web, USB) go through a lock-free queue
+    // that handleLapTimerUpdate() drains between samples, so the timing loop
+    // is the only writer. submit() returns a ticket for waitForAck(), 0 if
+    // the queue is full; waitForAck() blocks until processCommands() has
+    // applied it, without polling. submit() also wakes the timing loop's
+    // task if it is parked in PowerManager::idleWait()
+    uint32_t submit(laptimer_cmd_e type, Track* track = nullptr);
+    bool waitForAck(uint32_t ticket, uint32_t timeoutMs = LAPTIMER_ACK_TIMEOUT_MS);
     uint8_t getRssi();
+    // Every filtered sample, for streaming to clients on other tasks
+    RssiRing* getRssiRing() { return &rssiRing; }
     uint32_t getLapTime();
+    // millis() at the gate crossing that ended the lap getLapTime() returns
+    uint32_t getLapCrossingMs() const { return lapCrossingMs; }
     bool isLapAvailable();
+    // True once after an arm command was applied, for loop() to broadcast
+    // the start tone time; a command handler may not have waited for it
+    bool takeArmed();
+    // True once after an armed start latched on the start tone, for loop()
+    // to broadcast the race start the way timer/start does
+    bool takeArmedStart();
     
-    // Calibration wizard methods
-    void startCalibrationWizard();
-    void stopCalibrationWizard();
+    // Calibration wizard data
     uint16_t getCalibrationRssiCount();
     uint8_t getCalibrationRssi(uint16_t index);
     uint32_t getCalibrationTimestamp(uint16_t index);
     
-    // Track/distance methods
+    // Track/distance methods. setTrack() directly only from the timing loop's
+    // own task (or before it starts), otherwise submit LAPTIMER_CMD_SET_TRACK
     void setTrack(Track* track);
     float getTotalDistance();
     float getDistanceRemaining();
@@ -47,6 +107,14 @@ class LapTimer {
 
    private:
     laptimer_state_e state = STOPPED;
+    MpscQueue<LapTimerCommand, LAPTIMER_COMMAND_QUEUE_SIZE> commands;
+    std::atomic<uint32_t> commandsApplied{0};
+    // processCommands() sets the bits of every waiter after applying
+    EventGroupHandle_t ackEvents = nullptr;
+    std::atomic<uint32_t> ackWaiters{0};  // Event bits claimed by waitForAck()
+    bool isApplied(uint32_t ticket) const;
+    EventBits_t claimAckBit();
+    TaskHandle_t consumerTask = nullptr;  // Task running handleLapTimerUpdate()
     RX5808 *rx;
     Config *conf;
     Buzzer *buz;
@@ -55,14 +123,19 @@ class LapTimer {
     KalmanFilter filter;
     boolean lapCountWraparound;
     uint32_t raceStartTimeMs;
+    uint32_t lapCrossingMs;
+    int64_t startToneUs;  // esp_timer time of the start tone while ARMED
+    std::atomic<uint32_t> scheduledStartMs{0};
     uint32_t startTimeMs;
     uint8_t lapCount;
+    uint16_t lapsFinished;  // Not wrapped, for the lap number beeps
     uint8_t rssiCount;
     uint32_t lapTimes[LAPTIMER_LAP_HISTORY];
     uint8_t rssi[LAPTIMER_RSSI_HISTORY];
     uint8_t rssi_window[7];  // Medium window for moving average (5 is lower latency)
     uint8_t rssi_window_index;
     uint8_t lastLpRssi;
+    RssiRing rssiRing;
 
     uint8_t rssiPeak;
     uint32_t rssiPeakTimeMs;
@@ -81,6 +154,8 @@ class LapTimer {
     uint32_t lastRaceDebugPrintMs;
 
     bool lapAvailable = false;
+    bool armedAvailable = false;
+    bool armedStartAvailable = false;
     
     // Calibration wizard data
     uint16_t calibrationRssiCount;
@@ -93,12 +168,22 @@ class LapTimer {
     float totalDistanceTravelled;
     float distanceRemaining;
 
-    void lapPeakCapture();
-    bool lapPeakCaptured();
+    void lapPeakCapture(const timing_params_t& params);
+    bool lapPeakCaptured(const timing_params_t& params);
     void lapPeakReset();
 
+    // Timing loop only, reached through the command queue
+    void start();
+    void arm();
+    void beginRace(uint32_t startMs);
+    void stop();
+    void startCalibrationWizard();
+    void stopCalibrationWizard();
+
     void startLap();
-    void finishLap();
+    void finishLap(const timing_params_t& params);
+    void updateDistanceRemaining(uint8_t maxLaps, int lapsCompleted);
+    void refreshDistanceRemaining();
 };
 
 #endif
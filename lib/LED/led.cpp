@@ -1,67 +1,36 @@
 #include "led.h"
 
+static uint16_t clampMs(uint32_t timeMs) {
+    return timeMs > UINT16_MAX ? UINT16_MAX : (uint16_t)timeMs;
+}
+
 void Led::init(uint8_t pin, bool inverted) {
-    pinMode(pin, OUTPUT);
-    initialState = inverted ? HIGH : LOW;
-    currentState = initialState;
-    ledPin = pin;
-    ledState = LED_IDLE;
-    digitalWrite(ledPin, initialState);
+    sequencer.init(pin, inverted);
 }
 
 void Led::on(uint32_t timeMs) {
     if (timeMs > 0) {
-        ledState = LED_ON;
-        onTimeMs = timeMs;
-        checkTimeMs = millis();
+        PatternStep step = {1, clampMs(timeMs)};
+        sequencer.offer(&step, 1);
     } else {
-        ledState = LED_IDLE;
+        // A looping one-step pattern keeps it on without re-arming the timer
+        PatternStep step = {1, UINT16_MAX};
+        sequencer.offer(&step, 1, 0);
     }
-    digitalWrite(ledPin, !initialState);
 }
 
 void Led::off() {
-    ledState = LED_IDLE;
-    digitalWrite(ledPin, initialState);
+    sequencer.offer(nullptr, 0);
 }
 
 void Led::blink(uint32_t onMs, uint32_t offMs) {
-    onTimeMs = onMs;
-    if (offMs > 0) {
-        offTimeMs = offMs;
-    } else {
-        offTimeMs = onTimeMs;
+    if (offMs == 0) {
+        offMs = onMs;
     }
-    ledState = LED_BLINKING;
-    checkTimeMs = millis();
-    currentState = !initialState;
-    digitalWrite(ledPin, currentState);
+    PatternStep steps[] = {{1, clampMs(onMs)}, {0, clampMs(offMs)}};
+    sequencer.offer(steps, 2, 0);
 }
 
-void Led::handleLed(uint32_t currentTimeMs) {
-    switch (ledState) {
-        case LED_IDLE:
-            break;
-        case LED_BLINKING:
-            if (currentTimeMs < checkTimeMs) {
-                break;  // updated from different core
-            }
-            if (((currentState == !initialState) && (currentTimeMs - checkTimeMs) > onTimeMs) ||  // currently led is turned on and it's time to turn it off
-                ((currentState == initialState) && (currentTimeMs - checkTimeMs) > offTimeMs)) {  // currently led is turned off and it's time to turn it on
-                currentState = !currentState;
-                digitalWrite(ledPin, currentState);
-                checkTimeMs = currentTimeMs;
-            }
-            break;
-        case LED_ON:
-            if (currentTimeMs < checkTimeMs) {
-                break;  // updated from different core
-            }
-            if ((currentTimeMs - checkTimeMs) > onTimeMs) {
-                digitalWrite(ledPin, initialState);
-                ledState = LED_IDLE;
-            }
-        default:
-            break;
-    }
+void Led::play(const PatternStep* steps, uint8_t count, uint8_t repeat, int64_t startUs) {
+    sequencer.play(steps, count, repeat, startUs);
 }
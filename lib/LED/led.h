@@ -1,27 +1,23 @@
 #include <Arduino.h>
 
-#pragma once
+#include "sequencer.h"
 
-typedef enum {
-    LED_IDLE,
-    LED_BLINKING,
-    LED_ON
-} led_state_e;
+#pragma once
 
+// Status LED on a PatternSequencer, so on-times and blinking run off the
+// hardware timer and the calls are safe from either core. on(), off() and
+// blink() are dropped during a hold(), play() is not
 class Led {
    public:
     void init(uint8_t pin, bool inverted);
-    void handleLed(uint32_t currentTimeMs);
+    // timeMs 0 = stay on until off()
     void on(uint32_t timeMs = 0);
     void off();
     void blink(uint32_t onTimeMs, uint32_t offTimeMs = 0);
+    void play(const PatternStep* steps, uint8_t count, uint8_t repeat = 1, int64_t startUs = 0);
+    // Keeps the pattern just played until untilUs (esp_timer_get_time()); 0 releases
+    void hold(int64_t untilUs) { sequencer.hold(untilUs); }
 
    private:
-    led_state_e ledState = LED_IDLE;
-    uint8_t ledPin;
-    uint8_t initialState = LOW;
-    uint8_t currentState = LOW;
-    uint32_t onTimeMs;
-    uint32_t offTimeMs;
-    uint32_t checkTimeMs;
+    PatternSequencer sequencer;
 };
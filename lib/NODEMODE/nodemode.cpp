@@ -25,7 +25,7 @@ void NodeMode::begin(LapTimer* timer, Config* config) {
     _lastPass.rssiPeak = 0;
     
     // Start race automatically in node mode (RotorHazard expects node to be always active)
-    _timer->start();
+    _timer->submit(LAPTIMER_CMD_START);
 }
 
 void NodeMode::process() {
@@ -0,0 +1,172 @@
+#include "power.h"
+
+#include <esp_pm.h>
+#include <esp_timer.h>
+#include <sdkconfig.h>
+
+#include "debug.h"
+
+#if CONFIG_IDF_TARGET_ESP32S3
+typedef esp_pm_config_esp32s3_t power_pm_config_t;
+#elif CONFIG_IDF_TARGET_ESP32C3
+typedef esp_pm_config_esp32c3_t power_pm_config_t;
+#else
+typedef esp_pm_config_esp32_t power_pm_config_t;
+#endif
+
+static const char* const powerModeNames[POWER_MODE_COUNT] = {"full", "idle", "low"};
+
+void PowerManager::init() {
+    fullCpuMhz = getCpuFrequencyMhz();
+#ifdef CONFIG_PM_ENABLE
+    pmAvailable = true;
+#endif
+    uint32_t now = millis();
+    lastActivityMs = now;
+    modeSinceMs = now;
+    mode = POWER_FULL;
+    applyClock(POWER_FULL);
+    DEBUG("Power manager: %u MHz, esp_pm %s\n", fullCpuMhz, pmAvailable ? "available" : "not available");
+}
+
+void PowerManager::update(uint32_t currentTimeMs, laptimer_state_e timerState, bool clientsActive, uint16_t rssiStreamHz) {
+    if (clientsActive || timerState != STOPPED) {
+        lastActivityMs = currentTimeMs;
+    }
+
+    power_mode_e wanted;
+    if (timerState != STOPPED || rssiStreamHz > 1000 / POWER_IDLE_SAMPLE_MS) {
+        wanted = POWER_FULL;
+    } else if (currentTimeMs - lastActivityMs < POWER_LOW_DELAY_MS) {
+        wanted = POWER_IDLE;
+    } else {
+        wanted = POWER_LOW;
+    }
+
+    if (wanted != mode) {
+        enterMode(wanted, currentTimeMs);
+    }
+}
+
+void PowerManager::enterMode(power_mode_e newMode, uint32_t currentTimeMs) {
+    int64_t startUs = esp_timer_get_time();
+    bool ok = applyClock(newMode);
+    uint32_t tookUs = (uint32_t)(esp_timer_get_time() - startUs);
+
+    timeInModeMs[mode] += currentTimeMs - modeSinceMs;
+    modeSinceMs = currentTimeMs;
+    transitions++;
+    lastTransitionUs = tookUs;
+    if (tookUs > maxTransitionUs) {
+        maxTransitionUs = tookUs;
+    }
+    if (newMode == POWER_FULL && tookUs > maxWakeUs) {
+        maxWakeUs = tookUs;
+    }
+
+    DEBUG("Power: %s -> %s in %u us (%u MHz%s)%s\n", powerModeNames[mode], powerModeNames[newMode], tookUs,
+          getCpuFrequencyMhz(), lightSleep ? ", light sleep" : "", ok ? "" : " - clock change failed");
+    mode = newMode;
+}
+
+// With esp_pm the clock scales between min and max on demand (WiFi and
+// other drivers hold it up while busy) and POWER_LOW may light-sleep.
+// Without it, a fixed clock per mode
+bool PowerManager::applyClock(power_mode_e newMode) {
+    uint16_t idleMhz = fullCpuMhz < POWER_IDLE_CPU_MHZ ? fullCpuMhz : POWER_IDLE_CPU_MHZ;
+#ifdef CONFIG_PM_ENABLE
+    if (pmAvailable) {
+        power_pm_config_t pm;
+        pm.max_freq_mhz = newMode == POWER_LOW ? idleMhz : fullCpuMhz;
+        pm.min_freq_mhz = newMode == POWER_FULL ? fullCpuMhz : POWER_LOW_CPU_MHZ;
+#if CONFIG_FREERTOS_USE_TICKLESS_IDLE
+        pm.light_sleep_enable = newMode == POWER_LOW;
+#else
+        pm.light_sleep_enable = false;
+#endif
+        if (esp_pm_configure(&pm) == ESP_OK) {
+            lightSleep = pm.light_sleep_enable;
+            return true;
+        }
+        DEBUG("esp_pm_configure failed, using fixed clocks\n");
+        pmAvailable = false;
+    }
+#endif
+    lightSleep = false;
+    uint16_t mhz = newMode == POWER_FULL ? fullCpuMhz : (newMode == POWER_IDLE ? idleMhz : POWER_LOW_CPU_MHZ);
+    if (getCpuFrequencyMhz() == mhz) {
+        return true;
+    }
+    return setCpuFrequencyMhz(mhz);
+}
+
+uint16_t PowerManager::samplePeriodMs() const {
+    switch (mode) {
+        case POWER_IDLE:
+            return POWER_IDLE_SAMPLE_MS;
+        case POWER_LOW:
+            return POWER_LOW_SAMPLE_MS;
+        default:
+            return 0;
+    }
+}
+
+bool PowerManager::sampleDue(uint32_t currentTimeMs) {
+    uint16_t period = samplePeriodMs();
+    if (period == 0 || currentTimeMs - lastSampleMs >= period) {
+        lastSampleMs = currentTimeMs;
+        return true;
+    }
+    return false;
+}
+
+void PowerManager::idleWait(uint32_t currentTimeMs) {
+    uint16_t period = samplePeriodMs();
+    if (period == 0) {
+        return;  // Full power: loop() keeps spinning as before
+    }
+    uint32_t elapsed = currentTimeMs - lastSampleMs;
+    if (elapsed >= period) {
+        return;
+    }
+    // Blocking here is what lets the clock drop and the core sleep
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(period - elapsed));
+}
+
+const char* PowerManager::getModeName(power_mode_e m) {
+    return m < POWER_MODE_COUNT ? powerModeNames[m] : "unknown";
+}
+
+uint16_t PowerManager::modeCurrentMa(power_mode_e m) const {
+    switch (m) {
+        case POWER_FULL:
+            return POWER_EST_FULL_MA;
+        case POWER_IDLE:
+            return POWER_EST_IDLE_MA;
+        default:
+            return lightSleep ? POWER_EST_LOW_SLEEP_MA : POWER_EST_LOW_MA;
+    }
+}
+
+PowerStats PowerManager::getStats() {
+    PowerStats stats;
+    stats.mode = mode;
+    stats.cpuMhz = getCpuFrequencyMhz();
+    stats.samplePeriodMs = samplePeriodMs();
+    stats.lightSleep = lightSleep;
+    stats.transitions = transitions;
+    stats.lastTransitionUs = lastTransitionUs;
+    stats.maxTransitionUs = maxTransitionUs;
+    stats.maxWakeUs = maxWakeUs;
+    float mAms = 0;
+    for (uint8_t i = 0; i < POWER_MODE_COUNT; i++) {
+        stats.timeInModeMs[i] = timeInModeMs[i];
+        if (i == mode) {
+            stats.timeInModeMs[i] += millis() - modeSinceMs;
+        }
+        mAms += (float)stats.timeInModeMs[i] * modeCurrentMa((power_mode_e)i);
+    }
+    stats.estimatedMa = modeCurrentMa(mode);
+    stats.estimatedMah = mAms / 3600000.0f;
+    return stats;
+}
@@ -0,0 +1,89 @@
+#ifndef POWER_H
+#define POWER_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include "laptimer.h"
+
+// Stopped with nobody connected for this long drops to POWER_LOW
+#define POWER_LOW_DELAY_MS 60000
+
+// RSSI sample period per mode, 0 = every loop() pass
+#define POWER_IDLE_SAMPLE_MS 10
+#define POWER_LOW_SAMPLE_MS 100
+
+// CPU clock per mode. POWER_FULL uses the board_build.f_cpu clock the board
+// booted with. 80 MHz is the lowest clock the WiFi driver accepts
+#define POWER_IDLE_CPU_MHZ 160
+#define POWER_LOW_CPU_MHZ 80
+
+// Rough average supply current per mode with the radio up, from the
+// datasheets. Only good for a first battery estimate - measure your board
+#define POWER_EST_FULL_MA 160
+#define POWER_EST_IDLE_MA 110
+#define POWER_EST_LOW_MA 60
+#define POWER_EST_LOW_SLEEP_MA 25  // POWER_LOW with automatic light sleep
+
+typedef enum {
+    POWER_FULL,  // Race running, waiting for first gate, calibrating or streaming RSSI fast
+    POWER_IDLE,  // Stopped, clients connected
+    POWER_LOW    // Stopped, no clients for POWER_LOW_DELAY_MS
+} power_mode_e;
+
+#define POWER_MODE_COUNT 3
+
+struct PowerStats {
+    power_mode_e mode;
+    uint16_t cpuMhz;
+    uint16_t samplePeriodMs;
+    bool lightSleep;                        // Automatic light sleep enabled in POWER_LOW
+    uint32_t transitions;
+    uint32_t lastTransitionUs;              // Time to reconfigure clocks on the last mode change
+    uint32_t maxTransitionUs;
+    uint32_t maxWakeUs;                     // Worst time back to POWER_FULL
+    uint64_t timeInModeMs[POWER_MODE_COUNT];
+    uint16_t estimatedMa;                   // Estimate for the current mode
+    float estimatedMah;                     // Estimated charge used since boot
+};
+
+// Picks CPU clock, sleep and RSSI sample rate from the lap timer state and
+// client activity. Runs on the loop() task, which is also the one it parks
+// between slow samples; LapTimer::submit() wakes it, so a start command is
+// picked up within a tick instead of at the next slow sample
+class PowerManager {
+   public:
+    void init();
+    // rssiStreamHz: fastest batched RSSI stream. One faster than the idle
+    // sample rate keeps full power, so the stream carries real samples
+    void update(uint32_t currentTimeMs, laptimer_state_e timerState, bool clientsActive, uint16_t rssiStreamHz = 0);
+    bool sampleDue(uint32_t currentTimeMs);
+    // Blocks until the next sample is due or a LapTimer command arrives
+    void idleWait(uint32_t currentTimeMs);
+
+    power_mode_e getMode() const { return mode; }
+    static const char* getModeName(power_mode_e m);
+    PowerStats getStats();
+
+   private:
+    power_mode_e mode = POWER_FULL;
+    uint16_t fullCpuMhz = 240;
+    bool pmAvailable = false;  // esp_pm (DFS + auto light sleep) compiled in
+    bool lightSleep = false;
+    uint32_t lastActivityMs = 0;
+    uint32_t lastSampleMs = 0;
+    uint32_t modeSinceMs = 0;
+    uint32_t transitions = 0;
+    uint32_t lastTransitionUs = 0;
+    uint32_t maxTransitionUs = 0;
+    uint32_t maxWakeUs = 0;
+    uint64_t timeInModeMs[POWER_MODE_COUNT] = {0, 0, 0};
+
+    void enterMode(power_mode_e newMode, uint32_t currentTimeMs);
+    bool applyClock(power_mode_e newMode);
+    uint16_t samplePeriodMs() const;
+    uint16_t modeCurrentMa(power_mode_e m) const;
+};
+
+#endif
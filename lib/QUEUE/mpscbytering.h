@@ -0,0 +1,143 @@
+#ifndef MPSCBYTERING_H
+#define MPSCBYTERING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+
+// Bounded ring of variable length records for many producers and one
+// consumer. A producer claims room for a record with one CAS on the tail,
+// fills it in place and commits it; the consumer reads committed records
+// in claim order, in as many parts as it likes, and frees each one when it
+// is done with it. Neither side blocks or allocates, a producer that finds
+// no room gets false. The buffer is the caller's, its size a power of two
+// of at least 64.
+//
+// A record is an 8-byte header (stride | COMMITTED, length) and its bytes,
+// padded to 8 so headers never wrap. The consumer zeroes a record before
+// freeing it, so the header of one still being filled in reads 0
+class MpscByteRing {
+   public:
+    struct Reservation {
+        size_t pos;
+        size_t stride;
+        size_t maxLen;
+        size_t len;
+    };
+
+    MpscByteRing(uint32_t* buffer, size_t size) : words(buffer), N(size), tail(0), head(0) {
+        memset(words, 0, N);
+    }
+
+    // Largest record that can ever fit
+    size_t maxRecord() const { return N - HEADER; }
+
+    // Any task. Claims room for up to maxLen bytes, false if there is none
+    bool reserve(size_t maxLen, Reservation& r) {
+        size_t stride = (HEADER + maxLen + 7) & ~(size_t)7;
+        if (stride > N) {
+            return false;
+        }
+        size_t pos = tail.load(std::memory_order_relaxed);
+        for (;;) {
+            if (pos - head.load(std::memory_order_acquire) + stride > N) {
+                return false;
+            }
+            if (tail.compare_exchange_weak(pos, pos + stride, std::memory_order_relaxed)) {
+                break;
+            }
+        }
+        r.pos = pos;
+        r.stride = stride;
+        r.maxLen = maxLen;
+        r.len = 0;
+        return true;
+    }
+
+    // Appends to a reserved record, anything past maxLen is cut off
+    void write(Reservation& r, const uint8_t* data, size_t len) {
+        if (len > r.maxLen - r.len) {
+            len = r.maxLen - r.len;
+        }
+        uint8_t* bytes = (uint8_t*)words;
+        size_t start = (r.pos + HEADER + r.len) & (N - 1);
+        size_t first = len < N - start ? len : N - start;
+        memcpy(bytes + start, data, first);
+        memcpy(bytes, data + first, len - first);
+        r.len += len;
+    }
+
+    // Publishes what was written. An empty record is skipped by the consumer
+    void commit(Reservation& r) {
+        size_t word = (r.pos & (N - 1)) / 4;
+        words[word + 1] = r.len;
+        __atomic_store_n(&words[word], (uint32_t)r.stride | COMMITTED, __ATOMIC_RELEASE);
+    }
+
+    // Consumer only. The next unread bytes of the oldest committed record,
+    // up to the end of the buffer; 0 if there are none yet
+    size_t front(const uint8_t*& data) {
+        for (;;) {
+            size_t pos = head.load(std::memory_order_relaxed);
+            size_t word = (pos & (N - 1)) / 4;
+            uint32_t header = __atomic_load_n(&words[word], __ATOMIC_ACQUIRE);
+            if (!(header & COMMITTED)) {
+                return 0;
+            }
+            size_t len = words[word + 1];
+            if (offset < len) {
+                size_t start = (pos + HEADER + offset) & (N - 1);
+                data = (const uint8_t*)words + start;
+                return len - offset < N - start ? len - offset : N - start;
+            }
+            release(header & ~COMMITTED);
+        }
+    }
+
+    // Consumer only. len bytes of front() were used, the record is freed
+    // as soon as all of it was
+    void consume(size_t len) {
+        offset += len;
+        size_t word = (head.load(std::memory_order_relaxed) & (N - 1)) / 4;
+        if (offset >= words[word + 1]) {
+            release(words[word] & ~COMMITTED);
+        }
+    }
+
+    // Consumer only. True while part of a record has been read
+    bool inRecord() const { return offset > 0; }
+
+    // Consumer only. Frees every committed record
+    void discard() {
+        const uint8_t* data;
+        size_t len;
+        while ((len = front(data)) > 0) {
+            consume(len);
+        }
+    }
+
+   private:
+    static const size_t HEADER = 8;
+    static const uint32_t COMMITTED = 0x80000000UL;
+
+    void release(size_t stride) {
+        uint8_t* bytes = (uint8_t*)words;
+        size_t pos = head.load(std::memory_order_relaxed);
+        size_t start = pos & (N - 1);
+        size_t first = stride < N - start ? stride : N - start;
+        memset(bytes + start, 0, first);
+        memset(bytes, 0, stride - first);
+        offset = 0;
+        head.store(pos + stride, std::memory_order_release);
+    }
+
+    uint32_t* words;
+    const size_t N;
+    std::atomic<size_t> tail;
+    std::atomic<size_t> head;
+    size_t offset = 0;  // Read so far of the record at head
+};
+
+#endif
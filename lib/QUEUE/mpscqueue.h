@@ -0,0 +1,78 @@
+#ifndef MPSCQUEUE_H
+#define MPSCQUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+// Bounded lock-free queue for many producers and one consumer (Vyukov's
+// sequence-per-cell ring). Producers claim a slot with one CAS, the consumer
+// never writes shared state other than the cell sequence, and neither side
+// blocks or allocates. N must be a power of two
+template <typename T, size_t N>
+class MpscQueue {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "MpscQueue size must be a power of two");
+
+   public:
+    MpscQueue() : tail(0), head(0) {
+        for (size_t i = 0; i < N; i++) {
+            cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // Any task. False if the queue is full. position is the item's place in
+    // consumption order, so the consumer can acknowledge it
+    bool push(const T& item, uint32_t* position = nullptr) {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        Cell* cell;
+        for (;;) {
+            cell = &cells[pos & (N - 1)];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = item;
+        cell->seq.store(pos + 1, std::memory_order_release);
+        if (position) {
+            *position = (uint32_t)pos;
+        }
+        return true;
+    }
+
+    // Consumer task only
+    bool pop(T& item) {
+        Cell& cell = cells[head & (N - 1)];
+        size_t seq = cell.seq.load(std::memory_order_acquire);
+        if ((intptr_t)seq - (intptr_t)(head + 1) < 0) {
+            return false;
+        }
+        item = cell.data;
+        cell.seq.store(head + N, std::memory_order_release);
+        head++;
+        return true;
+    }
+
+    // Number of items popped so far (consumer side)
+    uint32_t consumed() const { return (uint32_t)head; }
+
+   private:
+    struct Cell {
+        std::atomic<size_t> seq;
+        T data;
+    };
+
+    Cell cells[N];
+    std::atomic<size_t> tail;
+    size_t head;
+};
+
+#endif
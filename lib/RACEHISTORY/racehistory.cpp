@@ -52,15 +52,11 @@ bool RaceHistory::saveRace(const RaceSession& race) {
         lapsArray.add(lap);
     }
     
-    String json;
-    serializeJson(doc, json);
-    
     DEBUG("Saving race JSON: totalDistance=%.2f\n", race.totalDistance);
-    DEBUG("JSON content: %s\n", json.c_str());
     
-    bool success = storage->writeFile(filepath, json);
+    bool success = storage->writeJson(filepath, doc);
     if (success) {
-        DEBUG("Saved race to %s (%d bytes)\n", filepath.c_str(), json.length());
+        DEBUG("Saved race to %s (%d bytes)\n", filepath.c_str(), measureJson(doc));
         
         // Add to in-memory list
         races.insert(races.begin(), race);
@@ -96,16 +92,9 @@ bool RaceHistory::loadRaces() {
         }
         
         String filepath = String(RACES_DIR) + "/" + filename;
-        String json;
-        if (!storage->readFile(filepath, json)) {
-            DEBUG("Failed to read %s\n", filepath.c_str());
-            continue;
-        }
-        
         DynamicJsonDocument doc(16384);
-        DeserializationError error = deserializeJson(doc, json);
-        if (error) {
-            DEBUG("Failed to parse %s: %s\n", filepath.c_str(), error.c_str());
+        if (!storage->readJson(filepath, doc)) {
+            DEBUG("Failed to read %s\n", filepath.c_str());
             continue;
         }
         
@@ -221,10 +210,7 @@ bool RaceHistory::updateRace(uint32_t timestamp, const String& name, const Strin
         lapsArray.add(lap);
     }
     
-    String json;
-    serializeJson(doc, json);
-    
-    return storage->writeFile(filepath, json);
+    return storage->writeJson(filepath, doc);
 }
 
 bool RaceHistory::updateLaps(uint32_t timestamp, const std::vector<uint32_t>& newLapTimes) {
@@ -307,10 +293,7 @@ bool RaceHistory::updateLaps(uint32_t timestamp, const std::vector<uint32_t>& ne
         lapsArray.add(lap);
     }
     
-    String json;
-    serializeJson(doc, json);
-    
-    bool success = storage->writeFile(filepath, json);
+    bool success = storage->writeJson(filepath, doc);
     if (success) {
         DEBUG("Updated laps for race %u\n", timestamp);
     }
@@ -333,38 +316,89 @@ bool RaceHistory::clearAll() {
     return true;
 }
 
-String RaceHistory::toJsonString() {
-    DynamicJsonDocument doc(32768);
-    JsonArray racesArray = doc.createNestedArray("races");
-    
+void RaceHistory::raceToJson(const RaceSession& race, JsonObject raceObj) {
+    raceObj["timestamp"] = race.timestamp;
+    raceObj["fastestLap"] = race.fastestLap;
+    raceObj["medianLap"] = race.medianLap;
+    raceObj["best3LapsTotal"] = race.best3LapsTotal;
+    raceObj["name"] = race.name;
+    raceObj["tag"] = race.tag;
+    raceObj["pilotName"] = race.pilotName;
+    raceObj["pilotCallsign"] = race.pilotCallsign;
+    raceObj["frequency"] = race.frequency;
+    raceObj["band"] = race.band;
+    raceObj["channel"] = race.channel;
+    raceObj["trackId"] = race.trackId;
+    raceObj["trackName"] = race.trackName;
+    raceObj["totalDistance"] = race.totalDistance;
+
+    JsonArray lapsArray = raceObj.createNestedArray("lapTimes");
+    for (uint32_t lap : race.lapTimes) {
+        lapsArray.add(lap);
+    }
+}
+
+void RaceHistory::toJson(JsonObject destination) {
+    JsonArray racesArray = destination.createNestedArray("races");
     for (const auto& race : races) {
-        JsonObject raceObj = racesArray.createNestedObject();
-        raceObj["timestamp"] = race.timestamp;
-        raceObj["fastestLap"] = race.fastestLap;
-        raceObj["medianLap"] = race.medianLap;
-        raceObj["best3LapsTotal"] = race.best3LapsTotal;
-        raceObj["name"] = race.name;
-        raceObj["tag"] = race.tag;
-        raceObj["pilotName"] = race.pilotName;
-        raceObj["pilotCallsign"] = race.pilotCallsign;
-        raceObj["frequency"] = race.frequency;
-        raceObj["band"] = race.band;
-        raceObj["channel"] = race.channel;
-        raceObj["trackId"] = race.trackId;
-        raceObj["trackName"] = race.trackName;
-        raceObj["totalDistance"] = race.totalDistance;
-        
-        JsonArray lapsArray = raceObj.createNestedArray("lapTimes");
-        for (uint32_t lap : race.lapTimes) {
-            lapsArray.add(lap);
+        raceToJson(race, racesArray.createNestedObject());
+    }
+}
+
+bool RaceHistory::toJson(JsonObject destination, uint32_t timestamp) {
+    for (const auto& race : races) {
+        if (race.timestamp == timestamp) {
+            raceToJson(race, destination.createNestedArray("races").createNestedObject());
+            return true;
         }
     }
-    
+    return false;
+}
+
+String RaceHistory::toJsonString() {
+    DynamicJsonDocument doc(32768);
+    toJson(doc.to<JsonObject>());
     String output;
     serializeJson(doc, output);
     return output;
 }
 
+// Saves one race unless one with its timestamp is already there
+bool RaceHistory::importRace(JsonObjectConst raceObj) {
+    RaceSession race;
+    race.timestamp = raceObj["timestamp"];
+    race.fastestLap = raceObj["fastestLap"];
+    race.medianLap = raceObj["medianLap"];
+    race.best3LapsTotal = raceObj["best3LapsTotal"];
+    race.name = raceObj["name"] | "";
+    race.tag = raceObj["tag"] | "";
+    race.pilotName = raceObj["pilotName"] | "";
+    race.pilotCallsign = raceObj["pilotCallsign"] | "";
+    race.frequency = raceObj["frequency"] | 0;
+    race.band = raceObj["band"] | "";
+    race.channel = raceObj["channel"] | 0;
+    race.trackId = raceObj["trackId"] | 0;
+    race.trackName = raceObj["trackName"] | "";
+    race.totalDistance = raceObj["totalDistance"] | 0.0f;
+    
+    JsonArrayConst lapsArray = raceObj["lapTimes"];
+    for (uint32_t lap : lapsArray) {
+        race.lapTimes.push_back(lap);
+    }
+    
+    // Check if race with this timestamp already exists
+    bool exists = false;
+    for (const auto& existingRace : races) {
+        if (existingRace.timestamp == race.timestamp) {
+            exists = true;
+            break;
+        }
+    }
+    
+    // Save to individual file if it doesn't exist
+    return !exists && saveRace(race);
+}
+
 bool RaceHistory::fromJsonString(const String& json) {
     DynamicJsonDocument doc(32768);
     DeserializationError error = deserializeJson(doc, json);
@@ -374,50 +408,28 @@ bool RaceHistory::fromJsonString(const String& json) {
         return false;
     }
     
-    // Import races from JSON array
+    // Import races from JSON array. The files are journaled so a reset during
+    // the import leaves either all of them or none
     JsonArray racesArray = doc["races"];
     int importedCount = 0;
+    bool journaled = storage->beginJournal();
     
     for (JsonObject raceObj : racesArray) {
-        RaceSession race;
-        race.timestamp = raceObj["timestamp"];
-        race.fastestLap = raceObj["fastestLap"];
-        race.medianLap = raceObj["medianLap"];
-        race.best3LapsTotal = raceObj["best3LapsTotal"];
-        race.name = raceObj["name"] | "";
-        race.tag = raceObj["tag"] | "";
-        race.pilotName = raceObj["pilotName"] | "";
-        race.pilotCallsign = raceObj["pilotCallsign"] | "";
-        race.frequency = raceObj["frequency"] | 0;
-        race.band = raceObj["band"] | "";
-        race.channel = raceObj["channel"] | 0;
-        race.trackId = raceObj["trackId"] | 0;
-        race.trackName = raceObj["trackName"] | "";
-        race.totalDistance = raceObj["totalDistance"] | 0.0f;
-        
-        JsonArray lapsArray = raceObj["lapTimes"];
-        for (uint32_t lap : lapsArray) {
-            race.lapTimes.push_back(lap);
-        }
-        
-        // Check if race with this timestamp already exists
-        bool exists = false;
-        for (const auto& existingRace : races) {
-            if (existingRace.timestamp == race.timestamp) {
-                exists = true;
-                break;
-            }
-        }
-        
-        // Save to individual file if it doesn't exist
-        if (!exists && saveRace(race)) {
+        if (importRace(raceObj)) {
             importedCount++;
         }
     }
     
+    bool committed = !journaled || storage->commitJournal();
+    
     // Reload all races to update in-memory list
     loadRaces();
     
+    if (!committed) {
+        DEBUG("Failed to commit race import\n");
+        return false;
+    }
+    
     DEBUG("Imported %d races\n", importedCount);
     return true;
 }
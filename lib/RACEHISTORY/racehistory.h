@@ -37,12 +37,19 @@ class RaceHistory {
     bool updateRace(uint32_t timestamp, const String& name, const String& tag, float totalDistance = -1.0f);
     bool updateLaps(uint32_t timestamp, const std::vector<uint32_t>& newLapTimes);
     bool clearAll();
+    void toJson(JsonObject destination);
+    // One race, as {"races":[race]} so it imports like the full list;
+    // false if there is none with this timestamp
+    bool toJson(JsonObject destination, uint32_t timestamp);
     String toJsonString();
     bool fromJsonString(const String& json);
+    // One race of an import, false if it was there already or not saved
+    bool importRace(JsonObjectConst raceObj);
     const std::vector<RaceSession>& getRaces() const { return races; }
     size_t getRaceCount() const { return races.size(); }
 
    private:
+    static void raceToJson(const RaceSession& race, JsonObject raceObj);
     std::vector<RaceSession> races;
     Storage* storage;
 };
@@ -0,0 +1,166 @@
+#include "ledeffects.h"
+
+#include <math.h>
+#include <string.h>
+
+LedEffects::LedEffects() {
+    // Palettes are only built here, so the float maths never runs per frame
+    for (int i = 0; i < 256; i++) {
+        rainbowLut[i] = hsv(i, 255, 255);
+
+        // Blue-cyan range, hue and brightness follow a sine wave
+        uint8_t wave = (uint8_t)lroundf(127.5f + 127.5f * sinf(i * 2.0f * (float)M_PI / 256.0f));
+        int val = 200 + wave / 4;
+        oceanLut[i] = hsv(160 + wave / 8, 255, val > 255 ? 255 : val);
+
+        // Warm flicker: red 200-255, green 50-150
+        fireLut[i].r = 200 + ((i * 56) >> 8);
+        fireLut[i].g = 50 + ((i * 101) >> 8);
+        fireLut[i].b = 0;
+    }
+    setLength(RGB_DEFAULT_LEDS);
+}
+
+void LedEffects::setLength(uint16_t count) {
+    if (count < 1) count = 1;
+    if (count > RGB_MAX_LEDS) count = RGB_MAX_LEDS;
+    length = count;
+
+    uint32_t span = count < RGB_WAVE_MIN_SPAN ? RGB_WAVE_MIN_SPAN : count;
+    for (uint16_t i = 0; i < count; i++) {
+        pixelPhase[i] = (uint8_t)((i * 256UL) / span);
+    }
+
+    // Tail an eighth of the strip, quadratic falloff
+    uint16_t tail = count / 8;
+    if (tail < 2) tail = 2;
+    if (tail > RGB_COMET_MAX_TAIL) tail = RGB_COMET_MAX_TAIL;
+    if (tail > count) tail = count;
+    cometTail = tail;
+    for (uint16_t k = 0; k < tail; k++) {
+        uint32_t left = tail - k;
+        cometLut[k] = (uint8_t)((255UL * left * left) / (tail * tail));
+    }
+}
+
+void LedEffects::fill(LedPixel* out, LedPixel color) const {
+    for (uint16_t i = 0; i < length; i++) {
+        out[i] = color;
+    }
+}
+
+void LedEffects::fillScaled(LedPixel* out, LedPixel color, uint8_t scale) const {
+    LedPixel scaled;
+    scaled.r = (color.r * (scale + 1)) >> 8;
+    scaled.g = (color.g * (scale + 1)) >> 8;
+    scaled.b = (color.b * (scale + 1)) >> 8;
+    fill(out, scaled);
+}
+
+void LedEffects::fade(LedPixel* out, uint8_t scale) const {
+    uint8_t* bytes = (uint8_t*)out;
+    size_t count = (size_t)length * 3;
+    uint16_t factor = scale + 1;
+    for (size_t i = 0; i < count; i++) {
+        bytes[i] = (bytes[i] * factor) >> 8;
+    }
+}
+
+void LedEffects::rainbow(LedPixel* out, uint8_t hue) const {
+    for (uint16_t i = 0; i < length; i++) {
+        out[i] = rainbowLut[(uint8_t)(pixelPhase[i] + hue)];
+    }
+}
+
+void LedEffects::ocean(LedPixel* out, uint8_t phase) const {
+    for (uint16_t i = 0; i < length; i++) {
+        out[i] = oceanLut[(uint8_t)(pixelPhase[i] + phase)];
+    }
+}
+
+void LedEffects::fire(LedPixel* out) {
+    // One 32-bit random draw feeds four pixels
+    uint16_t i = 0;
+    while (i < length) {
+        uint32_t r = random32();
+        for (uint8_t k = 0; k < 4 && i < length; k++, r >>= 8) {
+            out[i++] = fireLut[r & 0xFF];
+        }
+    }
+}
+
+void LedEffects::comet(LedPixel* out, uint32_t headPos) const {
+    memset(out, 0, (size_t)length * sizeof(LedPixel));
+    uint16_t head = (uint16_t)((headPos >> 8) % length);
+    for (uint16_t k = 0; k < cometTail; k++) {
+        uint16_t index = head >= k ? head - k : head + length - k;
+        uint8_t v = cometLut[k];
+        out[index].r = v;
+        out[index].g = v;
+        out[index].b = v;
+    }
+}
+
+void LedEffects::sparkle(LedPixel* out, LedPixel color) {
+    fade(out, 200);
+    // About one new sparkle per 320 pixels per frame, at least one chance per frame
+    uint16_t attempts = length / 32 + 1;
+    for (uint16_t a = 0; a < attempts; a++) {
+        uint32_t r = random32();
+        if ((r & 0xFF) < 26) {
+            out[((r >> 16) * length) >> 16] = color;
+        }
+    }
+}
+
+uint8_t LedEffects::random8() {
+    return (uint8_t)random32();
+}
+
+// xorshift32 - much cheaper than random() and plenty for flicker
+uint32_t LedEffects::random32() {
+    uint32_t x = rngState;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    rngState = x;
+    return x;
+}
+
+LedPixel LedEffects::fromHex(uint32_t hex) {
+    LedPixel p;
+    p.r = (hex >> 16) & 0xFF;
+    p.g = (hex >> 8) & 0xFF;
+    p.b = hex & 0xFF;
+    return p;
+}
+
+LedPixel LedEffects::hsv(uint8_t hue, uint8_t sat, uint8_t val) {
+    uint8_t sector = hue / 43;
+    uint8_t rem = (hue - sector * 43) * 6;
+    uint8_t p = (val * (255 - sat)) >> 8;
+    uint8_t q = (val * (255 - ((sat * rem) >> 8))) >> 8;
+    uint8_t t = (val * (255 - ((sat * (255 - rem)) >> 8))) >> 8;
+    LedPixel out;
+    switch (sector) {
+        case 0:
+            out.r = val; out.g = t; out.b = p;
+            break;
+        case 1:
+            out.r = q; out.g = val; out.b = p;
+            break;
+        case 2:
+            out.r = p; out.g = val; out.b = t;
+            break;
+        case 3:
+            out.r = p; out.g = q; out.b = val;
+            break;
+        case 4:
+            out.r = t; out.g = p; out.b = val;
+            break;
+        default:
+            out.r = val; out.g = p; out.b = q;
+            break;
+    }
+    return out;
+}
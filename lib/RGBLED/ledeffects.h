@@ -0,0 +1,62 @@
+#ifndef LEDEFFECTS_H
+#define LEDEFFECTS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RGB_MAX_LEDS 600         // Longest strip the buffers are sized for (a full gate outline)
+#define RGB_DEFAULT_LEDS 2
+#define RGB_WAVE_MIN_SPAN 16     // Waves span at least this many pixels, so short strips stay near one colour
+#define RGB_COMET_MAX_TAIL 64
+
+// Same layout as FastLED's CRGB, so a CRGB buffer can be rendered into directly
+struct LedPixel {
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+};
+
+// Effects for strips of any length up to RGB_MAX_LEDS. Colour palettes are
+// 256-entry tables built once, per-pixel phase offsets and the comet tail are
+// rebuilt by setLength(), so a frame is a single integer loop of table
+// lookups over the strip. Plain C++ with no Arduino or FastLED dependency,
+// so tools/led_bench can time it on the host
+class LedEffects {
+   public:
+    LedEffects();
+
+    void setLength(uint16_t count);
+    uint16_t getLength() const { return length; }
+
+    void fill(LedPixel* out, LedPixel color) const;
+    // color scaled by scale/256 on every pixel
+    void fillScaled(LedPixel* out, LedPixel color, uint8_t scale) const;
+    // Scales every pixel by scale/256 (fading trails)
+    void fade(LedPixel* out, uint8_t scale) const;
+
+    void rainbow(LedPixel* out, uint8_t hue) const;
+    void ocean(LedPixel* out, uint8_t phase) const;
+    void fire(LedPixel* out);
+    // headPos is in 1/256 pixel, wrapping at the strip length
+    void comet(LedPixel* out, uint32_t headPos) const;
+    // Fades the strip and lights a few random pixels
+    void sparkle(LedPixel* out, LedPixel color);
+
+    uint8_t random8();
+    static LedPixel fromHex(uint32_t hex);
+
+   private:
+    uint16_t length = 0;
+    uint16_t cometTail = 0;
+    uint32_t rngState = 0x9E3779B9;
+    LedPixel rainbowLut[256];
+    LedPixel oceanLut[256];
+    LedPixel fireLut[256];
+    uint8_t cometLut[RGB_COMET_MAX_TAIL];
+    uint8_t pixelPhase[RGB_MAX_LEDS];  // Position along the wave, 0-255
+
+    uint32_t random32();
+    static LedPixel hsv(uint8_t hue, uint8_t sat, uint8_t val);
+};
+
+#endif
@@ -1,310 +1,596 @@
 #ifdef ESP32S3
 
 #include "rgbled.h"
+
+#include <esp_timer.h>
+
 #include "debug.h"
 
 #define PULSE_SPEED 5
 #define FLASH_DURATION_MS 200
-#define COUNTDOWN_PHASE_MS 1000  // 1 second per phase (Red, Yellow, Green)
+#define START_FLASH_MS 300
+#define RESET_PHASE_MS 200       // Reset flash: 3 x on + off
+#define ERROR_PHASE_MS 300
+#define RACE_BLACKOUT_MS 3000    // Strip stays dark this long after a start or reset flash
+
+static_assert(sizeof(CRGB) == sizeof(LedPixel), "LedEffects renders straight into CRGB buffers");
 
 void RgbLed::init() {
-    // GPIO5 for external NeoPixel strip - must be compile-time constant for FastLED template
-    FastLED.addLeds<WS2812, 5, GRB>(leds, NUM_LEDS);
-    FastLED.setBrightness(80); // Medium-high brightness
+    // GPIO5 for external NeoPixel strip - must be compile-time constant for FastLED template.
+    // On ESP32 FastLED drives clockless strips from the RMT peripheral, refilled
+    // by interrupt, so long strips don't mask interrupts for the whole frame.
+    // The controller reads shown[], which only the show task touches while busy
+    effects.setLength(numLeds);
+    controller = &FastLED.addLeds<WS2812, 5, GRB>(shown, numLeds);
+    FastLED.setBrightness(savedBrightness);
     // Initialize all LEDs to off
-    for (int i = 0; i < NUM_LEDS; i++) {
-        leds[i] = CRGB::Black;
-    }
+    fill_solid(leds, RGB_MAX_LEDS, CRGB::Black);
+    fill_solid(shown, RGB_MAX_LEDS, CRGB::Black);
+    fill_solid(base, RGB_MAX_LEDS, CRGB::Black);
+    shownBrightness = savedBrightness;
     FastLED.show();
-    DEBUG("RGB LED initialized on GPIO5 with %d LEDs\n", NUM_LEDS);
+    xTaskCreatePinnedToCore(showTaskEntry, "rgbShow", RGB_SHOW_TASK_STACK, this, 1, &showTask, 0);
+    DEBUG("RGB LED initialized on GPIO5 with %d LEDs\n", numLeds);
 }
 
-void RgbLed::handleRgbLed(uint32_t currentTimeMs) {
-    // Check if we need to re-enable LEDs after temporary disable
-    if (temporarilyDisabled && currentTimeMs >= disableUntilMs) {
-        temporarilyDisabled = false;
-        if (inRace) {
-            // Resume at 50% brightness during race
-            FastLED.setBrightness(savedBrightness / 2);
-        }
-        restoreSavedState();
-        DEBUG("RGB LED: Re-enabled after delay\n");
+void RgbLed::onConfigChanged(Config& config, uint32_t changed) {
+    if (changed & CONFIG_CHANGED_LED_COUNT) {
+        setLedCount(config.getLedCount());
     }
-    
-    // If temporarily disabled, keep LEDs off
-    if (temporarilyDisabled) {
-        return;
+    if (changed & CONFIG_CHANGED_LED_BRIGHTNESS) {
+        setBrightness(config.getLedBrightness());
     }
-    
-    // Handle countdown sequence - priority, no latency
-    if (isCountdown) {
-        updateCountdown(currentTimeMs);
-        return;
+    if (changed & CONFIG_CHANGED_LED_SPEED) {
+        setEffectSpeed(config.getLedSpeed());
     }
-    
-    // Handle flash timeout - priority, check immediately for race events
-    if (isFlashing && (currentTimeMs - flashStartMs) > flashDuration) {
-        if (flashesRemaining > 0) {
-            // More flashes to do - toggle between on and off
-            flashesRemaining--;
-            flashStartMs = currentTimeMs;
-            CRGB color = (flashesRemaining % 2 == 0) ? flashColor : CRGB::Black;
-            for (int i = 0; i < NUM_LEDS; i++) {
-                leds[i] = color;
-            }
-            FastLED.show();
+    if (changed & CONFIG_CHANGED_LED_COLOR) {
+        setManualColor(config.getLedColor());
+    }
+    if (changed & CONFIG_CHANGED_LED_EFFECT_COLORS) {
+        setFadeColor(config.getLedFadeColor());
+        setStrobeColor(config.getLedStrobeColor());
+    }
+    if (changed & CONFIG_CHANGED_LED_OVERRIDE) {
+        enableManualOverride(config.getLedManualOverride());
+    }
+    // Preset last so it picks up the colours set above (requests apply in order)
+    if (changed & CONFIG_CHANGED_LED_PRESET) {
+        setPreset((led_preset_e)config.getLedPreset());
+    }
+}
+
+void RgbLed::handleRgbLed(uint32_t currentTimeMs) {
+    if (statsResetPending) {
+        statsResetPending = false;
+        memset(&stats, 0, sizeof(stats));
+        totalFrameUs = 0;
+        droppedRequests = 0;
+    }
+    int64_t startUs = esp_timer_get_time();
+
+    // Bounded, so a burst of requests can't stretch one frame
+    RgbRequest req;
+    uint8_t applied = 0;
+    while (applied < RGB_REQUESTS_PER_FRAME && requests.pop(req)) {
+        applyRequest(req, currentTimeMs);
+        applied++;
+    }
+
+    compose(currentTimeMs);
+
+    // Only changed frames go out. While the show task is still pushing the
+    // previous one (600 pixels take ~18 ms) the frame is skipped; the next
+    // changed frame goes out once the strip is free
+    size_t frameBytes = numLeds * sizeof(CRGB);
+    if (frameBrightness != shownBrightness || pushCount != numLeds || memcmp(leds, shown, frameBytes) != 0) {
+        if (showBusy || !showTask) {
+            stats.busyFrames++;
         } else {
-            isFlashing = false;
-            // If we're entering a temporarily disabled period, turn LEDs off
-            if (temporarilyDisabled) {
-                for (int i = 0; i < NUM_LEDS; i++) {
-                    leds[i] = CRGB::Black;
-                }
+            memcpy(shown, leds, frameBytes);
+            shownBrightness = frameBrightness;
+            pushBrightness = frameBrightness;
+            pushCount = numLeds;
+            showBusy = true;
+            xTaskNotifyGive(showTask);
+        }
+    }
+    frameCount++;
+
+    uint32_t frameUs = (uint32_t)(esp_timer_get_time() - startUs);
+    stats.frames++;
+    stats.requests += applied;
+    stats.lastFrameUs = frameUs;
+    if (frameUs > stats.maxFrameUs) {
+        stats.maxFrameUs = frameUs;
+    }
+    totalFrameUs += frameUs;
+    stats.avgFrameUs = (uint32_t)(totalFrameUs / stats.frames);
+}
+
+RgbFrameStats RgbLed::getFrameStats() const {
+    RgbFrameStats copy = stats;
+    copy.dropped = droppedRequests.load(std::memory_order_relaxed);
+    copy.ledCount = numLeds;
+    return copy;
+}
+
+void RgbLed::showTaskEntry(void* param) {
+    static_cast<RgbLed*>(param)->runShow();
+}
+
+void RgbLed::runShow() {
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        int64_t startUs = esp_timer_get_time();
+
+        uint16_t count = pushCount;
+        if (count != activeCount) {
+            if (count < activeCount) {
+                // Blank the pixels the strip no longer drives before letting go of them
+                fill_solid(shown + count, activeCount - count, CRGB::Black);
                 FastLED.show();
-            } else {
-                restoreSavedState();  // Restore previous state after flash
             }
+            controller->setLeds(shown, count);
+            activeCount = count;
+        }
+        FastLED.setBrightness(pushBrightness);
+        FastLED.show();
+
+        uint32_t showUs = (uint32_t)(esp_timer_get_time() - startUs);
+        stats.shows++;
+        stats.lastShowUs = showUs;
+        if (showUs > stats.maxShowUs) {
+            stats.maxShowUs = showUs;
         }
+        showBusy = false;
     }
-    
-    // Update animations
-    updateAnimation(currentTimeMs);
 }
 
-void RgbLed::setStatus(rgb_status_e status) {
-    // Don't override an active flash or countdown
-    if (isFlashing || isCountdown) {
-        return;
-    }
-    
-    // Don't override manual preset mode with non-critical status changes
-    // Allow race events (countdown, flashes) to override, but not connection status
-    if (manualOverride) {
-        // Only update status for race events, not connection status
-        if (status != STATUS_USER_CONNECTED && status != STATUS_BOOTING) {
-            DEBUG("RGB LED: Setting status to %d (manual override active, allowing race event)\n", status);
-            currentStatus = status;
-            applyStatus();
-        } else {
-            DEBUG("RGB LED: Ignoring status %d (manual override active)\n", status);
-        }
-        return;
+void RgbLed::resetFrameStats() {
+    // Applied by the frame loop, which owns the counters
+    statsResetPending = true;
+}
+
+void RgbLed::post(uint8_t type, uint8_t arg, uint32_t color) {
+    RgbRequest req;
+    req.type = type;
+    req.arg = arg;
+    req.color = color;
+    if (!requests.push(req)) {
+        droppedRequests.fetch_add(1, std::memory_order_relaxed);
     }
-    
-    DEBUG("RGB LED: Setting status to %d\n", status);
-    currentStatus = status;
-    applyStatus();
 }
 
-void RgbLed::startCountdown() {
-    // Deprecated - now just flash green and go to cyan
-    flashGreen();
+static uint32_t toHex(CRGB color) {
+    return ((uint32_t)color.r << 16) | ((uint32_t)color.g << 8) | color.b;
+}
+
+void RgbLed::setStatus(rgb_status_e status) {
+    post(RGB_REQ_STATUS, status);
+}
+
+void RgbLed::startCountdown(uint32_t startMs) {
+    post(RGB_REQ_COUNTDOWN, 0, startMs);
 }
 
 void RgbLed::flashGreen() {
-    saveCurrentState();  // Save current state before event
-    savedBrightness = FastLED.getBrightness();
-    
-    // Flash green for race start
-    isFlashing = true;
-    flashStartMs = millis();
-    flashDuration = 300;  // 300ms flash
-    flashesRemaining = 0; // Single flash
-    flashColor = CRGB::Green;
-    currentMode = RGB_SOLID;
-    for (int i = 0; i < NUM_LEDS; i++) {
-        leds[i] = flashColor;
-    }
-    FastLED.show();
-    
-    // Schedule: After flash ends (300ms), disable LEDs for 3 seconds
-    temporarilyDisabled = true;
-    disableUntilMs = millis() + 300 + 3000; // flash duration + 3 seconds
-    inRace = true;
-    DEBUG("RGB LED: Race start flash, will disable for 3s then resume at 50%% brightness\n");
+    post(RGB_REQ_FLASH_GREEN);
 }
 
 void RgbLed::flashLap() {
-    saveCurrentState();  // Save current state before event
-    
-    // Save current brightness and set to maximum for bright flash
-    uint8_t currentBrightness = FastLED.getBrightness();
-    FastLED.setBrightness(255); // Full brightness for bright white flash
-    
-    isFlashing = true;
-    flashStartMs = millis();
-    flashDuration = FLASH_DURATION_MS;
-    flashesRemaining = 0; // Single flash
-    flashColor = CRGB::White;
-    currentMode = RGB_SOLID;
-    for (int i = 0; i < NUM_LEDS; i++) {
-        leds[i] = flashColor;
-    }
-    FastLED.show();
-    
-    // Schedule brightness restore after flash
-    // Note: brightness will be restored in restoreSavedState() based on inRace flag
-    DEBUG("RGB LED: Bright white lap flash at full brightness\n");
+    post(RGB_REQ_FLASH_LAP);
 }
 
 void RgbLed::flashReset() {
-    saveCurrentState();  // Save current state before event
-    
-    // Flash red 3 times for race end
-    isFlashing = true;
-    flashStartMs = millis();
-    flashDuration = 200;  // 200ms per flash phase
-    flashesRemaining = 5; // 3 flashes = 6 phases (on-off-on-off-on-off)
-    flashColor = CRGB::Red;
-    currentMode = RGB_SOLID;
-    for (int i = 0; i < NUM_LEDS; i++) {
-        leds[i] = flashColor;
-    }
-    FastLED.show();
-    
-    // Schedule: After flashes end (200*6=1200ms), disable LEDs for 3 seconds
-    temporarilyDisabled = true;
-    disableUntilMs = millis() + (200 * 6) + 3000; // all flash phases + 3 seconds
-    inRace = false;
-    
-    // Restore normal brightness when re-enabling
-    FastLED.setBrightness(savedBrightness);
-    DEBUG("RGB LED: Race end flash, will disable for 3s then resume at normal brightness\n");
+    post(RGB_REQ_FLASH_RESET);
 }
 
 void RgbLed::off() {
-    currentStatus = STATUS_OFF;
-    currentMode = RGB_OFF;
-    targetColor = CRGB::Black;
-    isCountdown = false;
-    isFlashing = false;
-    for (int i = 0; i < NUM_LEDS; i++) {
-        leds[i] = CRGB::Black;
-    }
-    FastLED.show();
+    post(RGB_REQ_OFF);
+}
+
+void RgbLed::celebrateLap(uint8_t lapNumber) {
+    post(RGB_REQ_CELEBRATE_LAP, lapNumber);
+}
+
+void RgbLed::celebrateRaceEnd(bool newRecord) {
+    post(RGB_REQ_CELEBRATE_END, newRecord ? 1 : 0);
+}
+
+void RgbLed::showErrorCode(uint8_t errorCode) {
+    post(RGB_REQ_ERROR_CODE, errorCode);
 }
 
 void RgbLed::setColor(CRGB color, rgb_mode_e mode) {
-    targetColor = color;
-    currentMode = mode;
-    if (mode == RGB_SOLID) {
-        for (int i = 0; i < NUM_LEDS; i++) {
-            leds[i] = color;
-        }
-        FastLED.show();
-    }
+    post(RGB_REQ_COLOR, mode, toHex(color));
 }
 
 void RgbLed::setBrightness(uint8_t brightness) {
-    FastLED.setBrightness(brightness);
-    FastLED.show();
+    post(RGB_REQ_BRIGHTNESS, brightness);
 }
 
-void RgbLed::updateCountdown(uint32_t currentTimeMs) {
-    uint32_t elapsed = currentTimeMs - countdownStartMs;
-    uint32_t phaseTime = elapsed / COUNTDOWN_PHASE_MS;
-    
-    if (phaseTime != countdownPhase && phaseTime < 3) {
-        countdownPhase = phaseTime;
-        
-        // Update color based on phase
-        CRGB color;
-        switch (countdownPhase) {
-            case 0:  // RED
-                color = CRGB::Red;
-                break;
-            case 1:  // YELLOW
-                color = CRGB::Yellow;
-                break;
-            case 2:  // GREEN
-                color = CRGB::Green;
-                break;
-        }
-        for (int i = 0; i < NUM_LEDS; i++) {
-            leds[i] = color;
-        }
-        FastLED.show();
-    }
-    
-    // After 3 seconds (3 phases), countdown is done
-    if (elapsed >= (COUNTDOWN_PHASE_MS * 3)) {
-        isCountdown = false;
-        setStatus(STATUS_RACE_RUNNING);
-    }
+void RgbLed::setManualColor(uint32_t colorHex) {
+    post(RGB_REQ_MANUAL_COLOR, 0, colorHex);
 }
 
-void RgbLed::applyStatus() {
-    switch (currentStatus) {
-        case STATUS_BOOTING:
-            targetColor = CRGB::Blue;
-            currentMode = RGB_PULSE;
+void RgbLed::setFadeColor(uint32_t colorHex) {
+    post(RGB_REQ_FADE_COLOR, 0, colorHex);
+}
+
+void RgbLed::setStrobeColor(uint32_t colorHex) {
+    post(RGB_REQ_STROBE_COLOR, 0, colorHex);
+}
+
+void RgbLed::setManualMode(rgb_mode_e mode) {
+    post(RGB_REQ_MANUAL_MODE, mode);
+}
+
+void RgbLed::setRainbowWave(uint8_t speed) {
+    post(RGB_REQ_RAINBOW, speed);
+}
+
+void RgbLed::setEffectSpeed(uint8_t speed) {
+    post(RGB_REQ_EFFECT_SPEED, speed);
+}
+
+void RgbLed::setPreset(led_preset_e preset) {
+    post(RGB_REQ_PRESET, preset);
+}
+
+void RgbLed::enableManualOverride(bool enable) {
+    post(RGB_REQ_OVERRIDE, enable ? 1 : 0);
+}
+
+void RgbLed::setLedCount(uint16_t count) {
+    post(RGB_REQ_LED_COUNT, 0, count);
+}
+
+// Everything below runs in the frame loop only
+
+void RgbLed::applyRequest(const RgbRequest& req, uint32_t currentTimeMs) {
+    switch (req.type) {
+        case RGB_REQ_STATUS:
+            applyStatus((rgb_status_e)req.arg);
             break;
-        
-        case STATUS_USER_CONNECTED:
-            targetColor = CRGB::Green;
-            currentMode = RGB_SOLID;
-            for (int i = 0; i < NUM_LEDS; i++) {
-                leds[i] = targetColor;
+
+        case RGB_REQ_FLASH_GREEN:
+            // Flash green, then dark for 3 seconds, then resume at 50% brightness
+            startEvent(RGB_EVENT_FLASH_GREEN, currentTimeMs);
+            if (currentStatus == STATUS_RACE_COUNTDOWN) {
+                currentStatus = STATUS_OFF;
             }
-            FastLED.show();
+            temporarilyDisabled = true;
+            disableUntilMs = currentTimeMs + START_FLASH_MS + RACE_BLACKOUT_MS;
+            inRace = true;
+            DEBUG("RGB LED: Race start flash, will disable for 3s then resume at 50%% brightness\n");
             break;
-        
-        case STATUS_RACE_RUNNING:
-            targetColor = CRGB::Cyan;
-            currentMode = RGB_SOLID;
-            for (int i = 0; i < NUM_LEDS; i++) {
-                leds[i] = targetColor;
+
+        case RGB_REQ_FLASH_LAP:
+            startEvent(RGB_EVENT_FLASH_LAP, currentTimeMs);
+            DEBUG("RGB LED: Bright white lap flash at full brightness\n");
+            break;
+
+        case RGB_REQ_FLASH_RESET:
+            // Flash red 3 times, then dark for 3 seconds, then normal brightness
+            startEvent(RGB_EVENT_FLASH_RESET, currentTimeMs);
+            if (currentStatus == STATUS_RACE_COUNTDOWN) {
+                currentStatus = STATUS_OFF;
             }
-            FastLED.show();
+            temporarilyDisabled = true;
+            disableUntilMs = currentTimeMs + RESET_PHASE_MS * 6 + RACE_BLACKOUT_MS;
+            inRace = false;
+            DEBUG("RGB LED: Race end flash, will disable for 3s then resume at normal brightness\n");
             break;
-        
-        case STATUS_RACE_END:
-            targetColor = CRGB::Blue;
+
+        case RGB_REQ_OFF:
+            applyOff();
+            break;
+
+        case RGB_REQ_COLOR:
+            targetColor = CRGB(req.color);
+            currentMode = (rgb_mode_e)req.arg;
+            break;
+
+        case RGB_REQ_BRIGHTNESS:
+            savedBrightness = req.arg;
+            break;
+
+        case RGB_REQ_MANUAL_COLOR:
+            targetColor = CRGB(req.color);
             currentMode = RGB_SOLID;
-            for (int i = 0; i < NUM_LEDS; i++) {
-                leds[i] = targetColor;
+            currentStatus = STATUS_OFF;
+            DEBUG("RGB LED: Manual color set to #%06X\n", req.color);
+            break;
+
+        case RGB_REQ_FADE_COLOR:
+            fadeColor = CRGB(req.color);
+            DEBUG("RGB LED: Fade color set to #%06X\n", req.color);
+            // If currently using COLOR_FADE preset, apply immediately
+            if (currentPreset == PRESET_COLOR_FADE) {
+                targetColor = fadeColor;
             }
-            FastLED.show();
             break;
-        
+
+        case RGB_REQ_STROBE_COLOR:
+            strobeColor = CRGB(req.color);
+            DEBUG("RGB LED: Strobe color set to #%06X\n", req.color);
+            break;
+
+        case RGB_REQ_MANUAL_MODE:
+            currentMode = (rgb_mode_e)req.arg;
+            currentStatus = STATUS_OFF;
+            if (currentMode == RGB_RAINBOW_WAVE) {
+                rainbowHue = 0;
+                DEBUG("RGB LED: Rainbow wave enabled\n");
+            } else if (currentMode == RGB_OFF) {
+                applyOff();
+            }
+            break;
+
+        case RGB_REQ_RAINBOW:
+            applyRainbow(req.arg);
+            break;
+
+        case RGB_REQ_EFFECT_SPEED:
+            effectSpeed = constrain(req.arg, 1, 20);
+            rainbowSpeed = effectSpeed;
+            DEBUG("RGB LED: Effect speed set to %d\n", effectSpeed);
+            break;
+
+        case RGB_REQ_PRESET:
+            currentPreset = (led_preset_e)req.arg;
+            manualOverride = true;
+            DEBUG("RGB LED: Setting preset %d\n", currentPreset);
+            applyPreset(currentPreset);
+            break;
+
+        case RGB_REQ_OVERRIDE:
+            manualOverride = req.arg != 0;
+            break;
+
+        case RGB_REQ_CELEBRATE_LAP:
+            startEvent(RGB_EVENT_CELEBRATE_LAP, currentTimeMs);
+            break;
+
+        case RGB_REQ_CELEBRATE_END:
+            startEvent(req.arg ? RGB_EVENT_CELEBRATE_RECORD : RGB_EVENT_CELEBRATE_FINISH, currentTimeMs);
+            break;
+
+        case RGB_REQ_ERROR_CODE:
+            DEBUG("RGB LED: Showing error code %d\n", req.arg);
+            startEvent(RGB_EVENT_ERROR_CODE, currentTimeMs, req.arg);
+            break;
+
+        case RGB_REQ_COUNTDOWN:
+            if (req.color != 0) {
+                countdownStartMs = req.color;
+                currentStatus = STATUS_RACE_COUNTDOWN;
+            } else if (currentStatus == STATUS_RACE_COUNTDOWN) {
+                currentStatus = STATUS_OFF;
+            }
+            break;
+
+        case RGB_REQ_LED_COUNT: {
+            uint16_t count = constrain(req.color, 1, RGB_MAX_LEDS);
+            if (count != numLeds) {
+                // Newly driven pixels start dark rather than with stale data
+                if (count > numLeds) {
+                    fill_solid(base + numLeds, count - numLeds, CRGB::Black);
+                    fill_solid(eventLeds + numLeds, count - numLeds, CRGB::Black);
+                }
+                numLeds = count;
+                effects.setLength(count);
+                cometPos = 0;
+                DEBUG("RGB LED: Strip length set to %u\n", count);
+            }
+            break;
+        }
+    }
+}
+
+void RgbLed::applyStatus(rgb_status_e status) {
+    // Don't override manual preset mode with non-critical status changes
+    // Allow race events to override, but not connection status
+    if (manualOverride && (status == STATUS_USER_CONNECTED || status == STATUS_BOOTING)) {
+        DEBUG("RGB LED: Ignoring status %d (manual override active)\n", status);
+        return;
+    }
+    DEBUG("RGB LED: Setting status to %d\n", status);
+    switch (status) {
+        case STATUS_BOOTING:
+        case STATUS_USER_CONNECTED:
+        case STATUS_RACE_RUNNING:
+        case STATUS_RACE_END:
         case STATUS_BATTERY_ALARM:
-            targetColor = CRGB::Red;
-            currentMode = RGB_FLASH;
+            currentStatus = status;
             break;
-        
+
         case STATUS_RACE_RESET:
         case STATUS_OFF:
         default:
-            off();
+            applyOff();
             break;
     }
 }
 
-void RgbLed::updateRainbowWave() {
-    // Create rainbow wave effect - both LEDs same color
-    CRGB color = CHSV(rainbowHue, 255, 255);
-    for (int i = 0; i < NUM_LEDS; i++) {
-        leds[i] = color;
+void RgbLed::applyOff() {
+    currentStatus = STATUS_OFF;
+    currentMode = RGB_OFF;
+    targetColor = CRGB::Black;
+    event = RGB_EVENT_NONE;
+}
+
+void RgbLed::applyRainbow(uint8_t speed) {
+    rainbowSpeed = speed;
+    effectSpeed = speed;
+    currentMode = RGB_RAINBOW_WAVE;
+    currentStatus = STATUS_OFF;
+    rainbowHue = 0;
+    DEBUG("RGB LED: Rainbow wave enabled (speed=%d)\n", speed);
+}
+
+void RgbLed::startEvent(rgb_event_e newEvent, uint32_t currentTimeMs, uint8_t arg) {
+    event = newEvent;
+    eventStartMs = currentTimeMs;
+    eventArg = arg;
+    eventPhase = -1;
+}
+
+LedPixel RgbLed::toPixel(CRGB color) {
+    LedPixel p;
+    p.r = color.r;
+    p.g = color.g;
+    p.b = color.b;
+    return p;
+}
+
+void RgbLed::fill(CRGB* target, CRGB color) {
+    effects.fill(pixels(target), toPixel(color));
+}
+
+// Layers, top first: event, post-race blackout, status, base
+void RgbLed::compose(uint32_t currentTimeMs) {
+    // During race: use 50% brightness
+    frameBrightness = inRace ? savedBrightness / 2 : savedBrightness;
+
+    if (event != RGB_EVENT_NONE) {
+        if (renderEvent(currentTimeMs)) {
+            memcpy(leds, eventLeds, numLeds * sizeof(CRGB));
+            if (event == RGB_EVENT_FLASH_LAP) {
+                frameBrightness = 255;  // Full brightness for bright white flash
+            }
+            return;
+        }
+        event = RGB_EVENT_NONE;
+        if (!temporarilyDisabled && manualOverride) {
+            applyPreset(currentPreset);
+        }
+    }
+
+    if (temporarilyDisabled) {
+        if ((int32_t)(currentTimeMs - disableUntilMs) < 0) {
+            fill(leds, CRGB::Black);
+            return;
+        }
+        temporarilyDisabled = false;
+        if (manualOverride) {
+            applyPreset(currentPreset);
+        }
+        DEBUG("RGB LED: Re-enabled after delay\n");
+    }
+
+    updateAnimation();
+    if (!renderStatus(currentTimeMs)) {
+        memcpy(leds, base, numLeds * sizeof(CRGB));
     }
-    rainbowHue += rainbowSpeed;
-    FastLED.show();
 }
 
-void RgbLed::updateAnimation(uint32_t currentTimeMs) {
-    // Throttle updates to reduce CPU usage - BUT NOT for race events
-    // Race events (flashing) bypass this throttle entirely via direct FastLED.show()
-    // Reduced to 10ms for more responsive animations (was 20ms)
-    if (currentTimeMs - lastUpdateMs < 10) {
-        return;
+// Fills eventLeds for the current event, false once it has run out
+bool RgbLed::renderEvent(uint32_t currentTimeMs) {
+    uint32_t elapsed = currentTimeMs - eventStartMs;
+    switch (event) {
+        case RGB_EVENT_FLASH_GREEN:
+            if (elapsed >= START_FLASH_MS) return false;
+            fill(eventLeds, CRGB::Green);
+            return true;
+
+        case RGB_EVENT_FLASH_LAP:
+            if (elapsed >= FLASH_DURATION_MS) return false;
+            fill(eventLeds, CRGB::White);
+            return true;
+
+        case RGB_EVENT_FLASH_RESET: {
+            // 3 flashes = 6 phases (on-off-on-off-on-off)
+            uint32_t phase = elapsed / RESET_PHASE_MS;
+            if (phase >= 6) return false;
+            fill(eventLeds, phase % 2 == 0 ? CRGB::Red : CRGB::Black);
+            return true;
+        }
+
+        case RGB_EVENT_ERROR_CODE: {
+            // One red blink per count
+            uint32_t phase = elapsed / ERROR_PHASE_MS;
+            if (phase >= (uint32_t)eventArg * 2) return false;
+            fill(eventLeds, phase % 2 == 0 ? CRGB::Red : CRGB::Black);
+            return true;
+        }
+
+        case RGB_EVENT_CELEBRATE_LAP: {
+            // Quick rainbow flash sequence
+            static const CRGB colors[] = {CRGB::Red, CRGB::Orange, CRGB::Yellow, CRGB::Green, CRGB::Blue};
+            uint32_t phase = elapsed / 50;
+            if (phase >= 5) return false;
+            fill(eventLeds, colors[phase]);
+            return true;
+        }
+
+        case RGB_EVENT_CELEBRATE_RECORD: {
+            // Gold sparkle effect for new record, new sparkles every 100ms
+            uint32_t phase = elapsed / 100;
+            if (phase >= 20) return false;
+            if ((int16_t)phase != eventPhase) {
+                eventPhase = phase;
+                for (int i = 0; i < numLeds; i++) {
+                    eventLeds[i] = (effects.random8() < 85) ? CRGB(255, 215, 0) : CRGB::Black;
+                }
+            }
+            return true;
+        }
+
+        case RGB_EVENT_CELEBRATE_FINISH:
+            // Green ramp for race completion, then hold
+            if (elapsed >= 1010) return false;
+            fill(eventLeds, CRGB(0, elapsed < 510 ? (elapsed / 10) * 5 : 250, 0));
+            return true;
+
+        default:
+            return false;
     }
-    lastUpdateMs = currentTimeMs;
-    
-    // Handle error blinking
-    if (currentMode == RGB_ERROR_BLINK) {
-        updateErrorBlink(currentTimeMs);
-        return;
+}
+
+// Fills leds when a status is showing, false to let the base layer through
+bool RgbLed::renderStatus(uint32_t currentTimeMs) {
+    switch (currentStatus) {
+        case STATUS_RACE_COUNTDOWN:
+            // Judged against the same millis() the lap timer latches the
+            // start with, so green lands on the start tone. The start flash
+            // takes over a sample later
+            fill(leds, (int32_t)(currentTimeMs - countdownStartMs) < 0 ? CRGB::Red : CRGB::Green);
+            return true;
+        case STATUS_BOOTING: {
+            // Blue pulse
+            CRGB color = CRGB::Blue;
+            color.nscale8(triwave8(frameCount * PULSE_SPEED));
+            fill(leds, color);
+            return true;
+        }
+        case STATUS_USER_CONNECTED:
+            fill(leds, CRGB::Green);
+            return true;
+        case STATUS_RACE_RUNNING:
+            fill(leds, CRGB::Cyan);
+            return true;
+        case STATUS_RACE_END:
+            fill(leds, CRGB::Blue);
+            return true;
+        case STATUS_BATTERY_ALARM:
+            // Fast on/off red flashing
+            fill(leds, (frameCount & 1) ? CRGB::Red : CRGB::Black);
+            return true;
+        default:
+            return false;
     }
-    
+}
+
+void RgbLed::updateRainbowWave() {
+    // Rainbow wave along the strip (short strips stay close to one colour)
+    effects.rainbow(pixels(base), rainbowHue);
+    rainbowHue += rainbowSpeed;
+}
+
+// Advances the base layer one frame (10ms). Every effect is one integer
+// pass over the strip, see LedEffects
+void RgbLed::updateAnimation() {
     switch (currentMode) {
         case RGB_RAINBOW_WAVE:
             updateRainbowWave();
@@ -359,11 +645,7 @@ void RgbLed::updateAnimation(uint32_t currentTimeMs) {
                     pulseValue -= pulseSpeed;
                 }
             }
-            for (int i = 0; i < NUM_LEDS; i++) {
-                leds[i] = targetColor;
-                leds[i].nscale8(pulseValue);
-            }
-            FastLED.show();
+            effects.fillScaled(pixels(base), toPixel(targetColor), pulseValue);
             break;
         }
         
@@ -371,206 +653,26 @@ void RgbLed::updateAnimation(uint32_t currentTimeMs) {
             // Fast on/off flashing
             static bool flashState = false;
             flashState = !flashState;
-            CRGB color = flashState ? targetColor : CRGB::Black;
-            for (int i = 0; i < NUM_LEDS; i++) {
-                leds[i] = color;
-            }
-            FastLED.show();
+            fill(base, flashState ? targetColor : CRGB(CRGB::Black));
             break;
         }
         
-        case RGB_SOLID:
         case RGB_OFF:
+            fill(base, CRGB::Black);
+            break;
+        
+        case RGB_SOLID:
         case RGB_COUNTDOWN:
         default:
             // No animation needed
+            fill(base, targetColor);
             break;
     }
 }
 
-void RgbLed::setManualColor(uint32_t colorHex) {
-    uint8_t r = (colorHex >> 16) & 0xFF;
-    uint8_t g = (colorHex >> 8) & 0xFF;
-    uint8_t b = colorHex & 0xFF;
-    targetColor = CRGB(r, g, b);
-    currentMode = RGB_SOLID;
-    currentStatus = STATUS_OFF;
-    savedMode = RGB_SOLID;
-    savedColor = targetColor;
-    
-    for (int i = 0; i < NUM_LEDS; i++) {
-        leds[i] = targetColor;
-    }
-    FastLED.show();
-    DEBUG("RGB LED: Manual color set to #%06X\n", colorHex);
-}
-
-void RgbLed::setFadeColor(uint32_t colorHex) {
-    uint8_t r = (colorHex >> 16) & 0xFF;
-    uint8_t g = (colorHex >> 8) & 0xFF;
-    uint8_t b = colorHex & 0xFF;
-    fadeColor = CRGB(r, g, b);
-    DEBUG("RGB LED: Fade color set to #%06X\n", colorHex);
-    
-    // If currently using COLOR_FADE preset, apply immediately
-    if (currentPreset == PRESET_COLOR_FADE) {
-        targetColor = fadeColor;
-    }
-}
-
-void RgbLed::setStrobeColor(uint32_t colorHex) {
-    uint8_t r = (colorHex >> 16) & 0xFF;
-    uint8_t g = (colorHex >> 8) & 0xFF;
-    uint8_t b = colorHex & 0xFF;
-    strobeColor = CRGB(r, g, b);
-    DEBUG("RGB LED: Strobe color set to #%06X\n", colorHex);
-}
-
-void RgbLed::setManualMode(rgb_mode_e mode) {
-    currentMode = mode;
-    currentStatus = STATUS_OFF;
-    savedMode = mode;
-    
-    if (mode == RGB_RAINBOW_WAVE) {
-        rainbowHue = 0;
-        DEBUG("RGB LED: Rainbow wave enabled\n");
-    } else if (mode == RGB_OFF) {
-        off();
-    }
-}
-
-void RgbLed::setRainbowWave(uint8_t speed) {
-    rainbowSpeed = speed;
-    effectSpeed = speed;
-    currentMode = RGB_RAINBOW_WAVE;
-    currentStatus = STATUS_OFF;
-    savedMode = RGB_RAINBOW_WAVE;
-    rainbowHue = 0;
-    DEBUG("RGB LED: Rainbow wave enabled (speed=%d)\n", speed);
-}
-
-void RgbLed::setEffectSpeed(uint8_t speed) {
-    effectSpeed = constrain(speed, 1, 20);
-    rainbowSpeed = effectSpeed;
-    DEBUG("RGB LED: Effect speed set to %d\n", effectSpeed);
-}
-
-void RgbLed::saveCurrentState() {
-    // Save current state before event (flash, countdown, etc.)
-    if (!isFlashing && !isCountdown) {
-        savedMode = currentMode;
-        savedColor = targetColor;
-    }
-}
-
-void RgbLed::restoreSavedState() {
-    // Restore brightness based on race state
-    if (inRace) {
-        // During race: use 50% brightness
-        FastLED.setBrightness(savedBrightness / 2);
-    } else {
-        // Not in race: use normal brightness
-        FastLED.setBrightness(savedBrightness);
-    }
-    
-    // Restore state after event
-    if (manualOverride) {
-        applyPreset(currentPreset);
-        return;
-    }
-    
-    currentMode = savedMode;
-    targetColor = savedColor;
-    
-    if (currentMode == RGB_SOLID) {
-        for (int i = 0; i < NUM_LEDS; i++) {
-            leds[i] = targetColor;
-        }
-        FastLED.show();
-    } else if (currentMode == RGB_OFF) {
-        off();
-    }
-}
-
-void RgbLed::celebrateLap(uint8_t lapNumber) {
-    saveCurrentState();
-    // Quick rainbow flash sequence
-    CRGB colors[] = {CRGB::Red, CRGB::Orange, CRGB::Yellow, CRGB::Green, CRGB::Blue};
-    for (int c = 0; c < 5; c++) {
-        for (int i = 0; i < NUM_LEDS; i++) {
-            leds[i] = colors[c];
-        }
-        FastLED.show();
-        delay(50);
-    }
-    restoreSavedState();
-}
-
-void RgbLed::celebrateRaceEnd(bool newRecord) {
-    saveCurrentState();
-    if (newRecord) {
-        // Gold sparkle effect for new record
-        for (int loop = 0; loop < 20; loop++) {
-            for (int i = 0; i < NUM_LEDS; i++) {
-                leds[i] = (random(0, 3) == 0) ? CRGB(255, 215, 0) : CRGB::Black;
-            }
-            FastLED.show();
-            delay(100);
-        }
-    } else {
-        // Green pulse for race completion
-        for (int brightness = 0; brightness < 255; brightness += 5) {
-            for (int i = 0; i < NUM_LEDS; i++) {
-                leds[i] = CRGB(0, brightness, 0);
-            }
-            FastLED.show();
-            delay(10);
-        }
-        delay(500);
-    }
-    restoreSavedState();
-}
-
-void RgbLed::showErrorCode(uint8_t errorCode) {
-    DEBUG("RGB LED: Showing error code %d\n", errorCode);
-    errorBlinkCount = errorCode;
-    errorBlinksRemaining = errorCode * 2; // On + off = 2 blinks per code
-    errorBlinkTime = millis();
-    currentMode = RGB_ERROR_BLINK;
-}
-
-void RgbLed::updateErrorBlink(uint32_t currentTimeMs) {
-    if (currentTimeMs - errorBlinkTime < 300) return;
-    
-    errorBlinkTime = currentTimeMs;
-    errorBlinksRemaining--;
-    
-    if (errorBlinksRemaining <= 0) {
-        restoreSavedState();
-        return;
-    }
-    
-    // Toggle red on/off
-    CRGB color = (errorBlinksRemaining % 2 == 0) ? CRGB::Red : CRGB::Black;
-    for (int i = 0; i < NUM_LEDS; i++) {
-        leds[i] = color;
-    }
-    FastLED.show();
-}
-
 void RgbLed::updateSparkle() {
-    // Both LEDs sparkle together
-    CRGB color;
-    if (random(0, 10) == 0) {
-        color = targetColor;
-    } else {
-        color = leds[0];
-        color.nscale8(200); // Fade
-    }
-    for (int i = 0; i < NUM_LEDS; i++) {
-        leds[i] = color;
-    }
-    FastLED.show();
+    // Random pixels light up and fade
+    effects.sparkle(pixels(base), toPixel(targetColor));
 }
 
 void RgbLed::updateBreathing() {
@@ -585,48 +687,26 @@ void RgbLed::updateBreathing() {
         if (breath == 0) breathDir = true;
     }
     
-    for (int i = 0; i < NUM_LEDS; i++) {
-        leds[i] = targetColor;
-        leds[i].nscale8(breath);
-    }
-    FastLED.show();
+    effects.fillScaled(pixels(base), toPixel(targetColor), breath);
 }
 
 void RgbLed::updateChase() {
-    // Both LEDs chase together (on/off blinking)
+    // Whole strip blinks on/off together
     static bool chaseState = false;
     chaseState = !chaseState;
-    CRGB color = chaseState ? targetColor : CRGB::Black;
-    for (int i = 0; i < NUM_LEDS; i++) {
-        leds[i] = color;
-    }
-    FastLED.show();
+    fill(base, chaseState ? targetColor : CRGB(CRGB::Black));
 }
 
 void RgbLed::updateFire() {
-    // Fire effect - warm flickering
+    // Fire effect - warm flickering, every pixel on its own
     firePhase += effectSpeed;
-    uint8_t red = 200 + random(0, 56);    // 200-255
-    uint8_t green = 50 + random(0, 100);   // 50-150  
-    uint8_t blue = 0;
-    
-    CRGB color = CRGB(red, green, blue);
-    for (int i = 0; i < NUM_LEDS; i++) {
-        leds[i] = color;
-    }
-    FastLED.show();
+    effects.fire(pixels(base));
 }
 
 void RgbLed::updateOcean() {
-    // Ocean effect - cool blue/cyan waves
+    // Ocean effect - cool blue/cyan waves travelling along the strip
     oceanPhase += effectSpeed;
-    uint8_t wave = sin8(oceanPhase);
-    
-    CRGB color = CHSV(160 + (wave / 8), 255, 200 + (wave / 4)); // Blue-cyan range
-    for (int i = 0; i < NUM_LEDS; i++) {
-        leds[i] = color;
-    }
-    FastLED.show();
+    effects.ocean(pixels(base), oceanPhase);
 }
 
 void RgbLed::updatePolice() {
@@ -640,11 +720,7 @@ void RgbLed::updatePolice() {
         policeState = !policeState;
     }
     
-    CRGB color = policeState ? CRGB::Red : CRGB::Blue;
-    for (int i = 0; i < NUM_LEDS; i++) {
-        leds[i] = color;
-    }
-    FastLED.show();
+    fill(base, policeState ? CRGB(CRGB::Red) : CRGB(CRGB::Blue));
 }
 
 void RgbLed::updateStrobe() {
@@ -659,48 +735,28 @@ void RgbLed::updateStrobe() {
         strobeState = !strobeState;
     }
     
-    CRGB color = strobeState ? strobeColor : CRGB::Black;
-    for (int i = 0; i < NUM_LEDS; i++) {
-        leds[i] = color;
-    }
-    FastLED.show();
+    fill(base, strobeState ? strobeColor : CRGB(CRGB::Black));
 }
 
 void RgbLed::updateComet() {
-    // Comet effect - shooting star
-    cometPos += effectSpeed;
-    if (cometPos > 255) cometPos = 0;
-    
-    // Create a fading tail effect
-    uint8_t brightness = cometPos > 200 ? 255 - (cometPos - 200) * 4 : 255;
-    CRGB color = CRGB(brightness, brightness, brightness);
-    
-    for (int i = 0; i < NUM_LEDS; i++) {
-        leds[i] = color;
-    }
-    FastLED.show();
-}
-
-void RgbLed::setPreset(led_preset_e preset) {
-    currentPreset = preset;
-    manualOverride = true;
-    DEBUG("RGB LED: Setting preset %d\n", preset);
-    applyPreset(preset);
+    // Comet effect - shooting star with a fading tail, speed 5 ~ 1 pixel per frame
+    cometPos += effectSpeed * 52;
+    cometPos %= (uint32_t)numLeds << 8;
+    effects.comet(pixels(base), cometPos);
 }
 
 void RgbLed::applyPreset(led_preset_e preset) {
+    currentStatus = STATUS_OFF;
     switch(preset) {
         case PRESET_OFF:
-            off();
+            applyOff();
             break;
         case PRESET_SOLID_COLOUR:
             // Use currently set manual color (solid)
             currentMode = RGB_SOLID;
-            for (int i = 0; i < NUM_LEDS; i++) leds[i] = targetColor;
-            FastLED.show();
             break;
         case PRESET_RAINBOW:
-            setRainbowWave(effectSpeed);
+            applyRainbow(effectSpeed);
             break;
         case PRESET_COLOR_FADE:
             // Pulse the fade color (customizable)
@@ -730,8 +786,6 @@ void RgbLed::applyPreset(led_preset_e preset) {
         case PRESET_PILOT_COLOUR:
             // Use currently set manual color (pilot color) as solid
             currentMode = RGB_SOLID;
-            for (int i = 0; i < NUM_LEDS; i++) leds[i] = targetColor;
-            FastLED.show();
             break;
     }
 }
@@ -5,7 +5,17 @@
 #include <Arduino.h>
 #include <FastLED.h>
 
-#define NUM_LEDS 2
+#include <atomic>
+
+#include "config.h"
+#include "ledeffects.h"
+#include "mpscqueue.h"
+
+#define RGB_SHOW_TASK_STACK 3072
+
+// Effect requests waiting for the frame loop, and how many one frame applies
+#define RGB_QUEUE_SIZE 32
+#define RGB_REQUESTS_PER_FRAME 8
 
 typedef enum {
     RGB_OFF,
@@ -41,7 +51,7 @@ typedef enum {
 typedef enum {
     STATUS_BOOTING,          // Blue pulse - system booting/AP launching
     STATUS_USER_CONNECTED,   // Green solid - user connected to web interface
-    STATUS_RACE_COUNTDOWN,   // Red->Yellow->Green traffic light sequence
+    STATUS_RACE_COUNTDOWN,   // Red until the scheduled start, then green
     STATUS_RACE_RUNNING,     // Cyan solid - race in progress
     STATUS_LAP_FLASH,        // White flash - new lap detected
     STATUS_RACE_END,         // Blue solid - race ended
@@ -50,14 +60,82 @@ typedef enum {
     STATUS_OFF
 } rgb_status_e;
 
-class RgbLed {
+typedef enum {
+    RGB_REQ_STATUS,
+    RGB_REQ_FLASH_GREEN,
+    RGB_REQ_FLASH_LAP,
+    RGB_REQ_FLASH_RESET,
+    RGB_REQ_OFF,
+    RGB_REQ_COLOR,
+    RGB_REQ_BRIGHTNESS,
+    RGB_REQ_MANUAL_COLOR,
+    RGB_REQ_FADE_COLOR,
+    RGB_REQ_STROBE_COLOR,
+    RGB_REQ_MANUAL_MODE,
+    RGB_REQ_RAINBOW,
+    RGB_REQ_EFFECT_SPEED,
+    RGB_REQ_PRESET,
+    RGB_REQ_OVERRIDE,
+    RGB_REQ_CELEBRATE_LAP,
+    RGB_REQ_CELEBRATE_END,
+    RGB_REQ_ERROR_CODE,
+    RGB_REQ_LED_COUNT,
+    RGB_REQ_COUNTDOWN
+} rgb_request_e;
+
+struct RgbRequest {
+    uint8_t type;    // rgb_request_e
+    uint8_t arg;     // Status, mode, preset, brightness, speed, count or flag
+    uint32_t color;  // 0xRRGGBB, the strip length or the countdown start time
+};
+
+// Short effects drawn over everything else until they run out
+typedef enum {
+    RGB_EVENT_NONE,
+    RGB_EVENT_FLASH_GREEN,
+    RGB_EVENT_FLASH_LAP,
+    RGB_EVENT_FLASH_RESET,
+    RGB_EVENT_ERROR_CODE,
+    RGB_EVENT_CELEBRATE_LAP,
+    RGB_EVENT_CELEBRATE_RECORD,
+    RGB_EVENT_CELEBRATE_FINISH
+} rgb_event_e;
+
+struct RgbFrameStats {
+    uint32_t frames;
+    uint32_t shows;        // Frames that changed and were pushed to the strip
+    uint32_t busyFrames;   // Changed frames not pushed because the strip was still busy with the last one
+    uint32_t requests;     // Requests applied
+    uint32_t dropped;      // Requests lost to a full queue
+    uint32_t lastFrameUs;  // Drain + compose
+    uint32_t maxFrameUs;
+    uint32_t avgFrameUs;
+    uint32_t lastShowUs;   // Push of one frame to the strip, in the show task
+    uint32_t maxShowUs;
+    uint16_t ledCount;
+};
+
+// Frame renderer for the external strip. The public setters only post a
+// request, so they are cheap and safe from any task (the timing loop, web
+// handlers, the config bus). handleRgbLed() is the frame loop on core 0: it
+// applies queued requests, composes the base (preset or manual mode), status
+// and event layers into the framebuffer and, if the frame changed, hands it
+// to the show task. That task pushes it out over RMT, so the ~30 us per
+// pixel wire time of a long strip blocks neither the frame loop nor the
+// other scheduler jobs, and interrupts stay enabled throughout
+class RgbLed : public ConfigListener {
    public:
     void init();
+    // One frame. Must only be called from the core 0 scheduler job
     void handleRgbLed(uint32_t currentTimeMs);
     
+    // Subscribed to CONFIG_CHANGED_LED, applies saved settings at boot and on change
+    void onConfigChanged(Config& config, uint32_t changed) override;
+    
     // Status-based methods
     void setStatus(rgb_status_e status);
-    void startCountdown();  // Start 3-2-1 countdown (deprecated, now just flashes green)
+    // Red until startMs (millis() timebase), then green. 0 cancels
+    void startCountdown(uint32_t startMs);
     void flashGreen();      // Flash green once for race start
     void flashLap();        // Flash white for lap detection
     void flashReset();      // Flash red 3 times for race reset
@@ -79,38 +157,58 @@ class RgbLed {
     void setManualMode(rgb_mode_e mode);
     void setRainbowWave(uint8_t speed = 5);
     void setEffectSpeed(uint8_t speed);      // Set animation speed (1-20)
+    void setLedCount(uint16_t count);        // Strip length, 1 to RGB_MAX_LEDS
+    uint16_t getLedCount() const { return numLeds; }
     void enableIdleRainbow(bool enable) { idleRainbowEnabled = enable; }
     rgb_mode_e getCurrentMode() const { return currentMode; }
     CRGB getCurrentColor() const { return targetColor; }
     
     // Preset system
     void setPreset(led_preset_e preset);
-    void enableManualOverride(bool enable) { manualOverride = enable; }
+    void enableManualOverride(bool enable);
     bool isManualOverride() const { return manualOverride; }
 
+    RgbFrameStats getFrameStats() const;
+    void resetFrameStats();
+
    private:
-    CRGB leds[NUM_LEDS];
+    MpscQueue<RgbRequest, RGB_QUEUE_SIZE> requests;
+    std::atomic<uint32_t> droppedRequests{0};
+    volatile bool statsResetPending = false;
+
+    CRGB leds[RGB_MAX_LEDS];   // Framebuffer, composed every frame
+    CRGB shown[RGB_MAX_LEDS];  // Last frame handed to the show task, owned by it while showBusy
+    CRGB base[RGB_MAX_LEDS];   // Base layer, kept between frames for fading effects
+    CRGB eventLeds[RGB_MAX_LEDS];
+    uint16_t numLeds = RGB_DEFAULT_LEDS;
+    LedEffects effects;
+    uint8_t frameBrightness = 80;
+    uint8_t shownBrightness = 80;
+
+    // Show task
+    CLEDController* controller = nullptr;
+    TaskHandle_t showTask = nullptr;
+    volatile bool showBusy = false;
+    uint16_t pushCount = RGB_DEFAULT_LEDS;
+    uint8_t pushBrightness = 80;
+    uint16_t activeCount = RGB_DEFAULT_LEDS;  // Length the controller drives
+    uint32_t frameCount = 0;
+    RgbFrameStats stats = {};
+    uint64_t totalFrameUs = 0;
+
     rgb_status_e currentStatus = STATUS_OFF;
     rgb_mode_e currentMode = RGB_OFF;
     CRGB targetColor = CRGB::Black;
     
     // Animation state
-    uint32_t lastUpdateMs = 0;
-    uint32_t flashStartMs = 0;
     uint8_t pulseValue = 0;
     bool pulseDirection = true;
     
-    // Flash parameters
-    bool isFlashing = false;
-    uint32_t flashDuration = 0;
-    uint8_t flashCount = 0;        // For multi-flash (reset)
-    uint8_t flashesRemaining = 0;  // Flashes left to do
-    CRGB flashColor = CRGB::White; // Color to flash
-    
-    // Countdown state
-    bool isCountdown = false;
-    uint32_t countdownStartMs = 0;
-    uint8_t countdownPhase = 0;  // 0=red, 1=yellow, 2=green, 3=done
+    // Event layer
+    rgb_event_e event = RGB_EVENT_NONE;
+    uint32_t eventStartMs = 0;
+    uint8_t eventArg = 0;       // Error code
+    int16_t eventPhase = -1;    // Last phase drawn into eventLeds
     
     // Animation speed and state
     uint8_t rainbowHue = 0;
@@ -119,10 +217,8 @@ class RgbLed {
     uint8_t firePhase = 0;           // Fire effect phase
     uint8_t oceanPhase = 0;          // Ocean effect phase
     bool policeState = false;        // Police effect state
-    uint8_t cometPos = 0;            // Comet position
+    uint32_t cometPos = 0;           // Comet head, 1/256 pixel
     bool idleRainbowEnabled = false;
-    rgb_mode_e savedMode = RGB_OFF;  // Mode to return to after events
-    CRGB savedColor = CRGB::Black;   // Color to return to after events
     
     // Manual override and presets
     bool manualOverride = false;
@@ -130,19 +226,26 @@ class RgbLed {
     CRGB fadeColor = CRGB::Blue;      // Color for COLOR_FADE preset
     CRGB strobeColor = CRGB::White;   // Color for STROBE preset
     
-    // Error code state
-    uint8_t errorBlinkCount = 0;
-    uint8_t errorBlinksRemaining = 0;
-    uint32_t errorBlinkTime = 0;
-    
     // Race timeline control
     bool temporarilyDisabled = false;
     uint32_t disableUntilMs = 0;
-    uint8_t savedBrightness = 80;
+    uint8_t savedBrightness = 80;    // Configured brightness, halved during a race
     bool inRace = false;
+    uint32_t countdownStartMs = 0;   // Race start STATUS_RACE_COUNTDOWN counts down to
     
-    void updateAnimation(uint32_t currentTimeMs);
-    void updateCountdown(uint32_t currentTimeMs);
+    void post(uint8_t type, uint8_t arg = 0, uint32_t color = 0);
+    void applyRequest(const RgbRequest& req, uint32_t currentTimeMs);
+    void startEvent(rgb_event_e newEvent, uint32_t currentTimeMs, uint8_t arg = 0);
+    void compose(uint32_t currentTimeMs);
+    bool renderEvent(uint32_t currentTimeMs);
+    bool renderStatus(uint32_t currentTimeMs);
+    void fill(CRGB* target, CRGB color);
+    static LedPixel* pixels(CRGB* buffer) { return reinterpret_cast<LedPixel*>(buffer); }
+    static LedPixel toPixel(CRGB color);
+    static void showTaskEntry(void* param);
+    void runShow();
+
+    void updateAnimation();
     void updateRainbowWave();
     void updateSparkle();
     void updateBreathing();
@@ -152,11 +255,10 @@ class RgbLed {
     void updatePolice();
     void updateStrobe();
     void updateComet();
-    void updateErrorBlink(uint32_t currentTimeMs);
-    void applyStatus();
+    void applyStatus(rgb_status_e status);
+    void applyOff();
+    void applyRainbow(uint8_t speed);
     void applyPreset(led_preset_e preset);
-    void saveCurrentState();
-    void restoreSavedState();
 };
 
 #endif // ESP32S3
@@ -0,0 +1,255 @@
+#include "rssihistory.h"
+
+#define RSSI_HISTORY_CHUNK 64
+
+static const uint16_t levelWidthsMs[RSSI_HISTORY_LEVELS] = {RSSI_RES_10MS, RSSI_RES_100MS, RSSI_RES_1S};
+
+void RssiHistory::init(RssiRing* rssiRing) {
+    if (!mutex) {
+        mutex = xSemaphoreCreateMutex();
+    }
+    for (uint8_t i = 0; i < RSSI_HISTORY_LEVELS; i++) {
+        levels[i].widthMs = levelWidthsMs[i];
+        levels[i].started = false;
+        levels[i].count = 0;
+    }
+    rawCount = 0;
+    cursor = rssiRing->head();
+    ring = rssiRing;
+}
+
+void RssiHistory::update() {
+    if (!ring) {
+        return;
+    }
+    RssiSample chunk[RSSI_HISTORY_CHUNK];
+    size_t count;
+    do {
+        // Samples the ring overwrote before we got here are a gap, nothing more
+        count = ring->read(cursor, chunk, RSSI_HISTORY_CHUNK, nullptr);
+        if (count == 0) {
+            break;
+        }
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        for (size_t i = 0; i < count; i++) {
+            add(chunk[i]);
+        }
+        xSemaphoreGive(mutex);
+    } while (count == RSSI_HISTORY_CHUNK);
+}
+
+void RssiHistory::add(const RssiSample& sample) {
+    rawTimes[rawCount % RSSI_HISTORY_RAW] = sample.timeMs;
+    rawValues[rawCount % RSSI_HISTORY_RAW] = sample.rssi;
+    rawCount++;
+    for (uint8_t i = 0; i < RSSI_HISTORY_LEVELS; i++) {
+        addToLevel(levels[i], sample);
+    }
+}
+
+void RssiHistory::addToLevel(Level& level, const RssiSample& sample) {
+    uint32_t number = sample.timeMs / level.widthMs;
+    if (!level.started) {
+        level.head = number;
+        level.count = 0;
+        level.started = true;
+    } else if ((int32_t)(number - level.head) > 0) {
+        level.buckets[level.head % RSSI_HISTORY_BUCKETS] = openBucket(level);
+        // Buckets nothing was sampled in, only as many as the ring holds
+        uint32_t gap = number - level.head - 1;
+        if (gap > RSSI_HISTORY_BUCKETS) {
+            gap = RSSI_HISTORY_BUCKETS;
+        }
+        for (uint32_t k = 1; k <= gap; k++) {
+            level.buckets[(number - k) % RSSI_HISTORY_BUCKETS].count = 0;
+        }
+        level.head = number;
+        level.count = 0;
+    }
+    // A sample older than the open bucket can't happen with one writer, and
+    // would only be counted into the open bucket
+
+    if (level.count == 0) {
+        level.min = sample.rssi;
+        level.max = sample.rssi;
+        level.sum = 0;
+    } else {
+        if (sample.rssi < level.min) level.min = sample.rssi;
+        if (sample.rssi > level.max) level.max = sample.rssi;
+    }
+    level.sum += sample.rssi;
+    level.count++;
+}
+
+RssiBucket RssiHistory::openBucket(const Level& level) const {
+    RssiBucket bucket = {0, 0, 0, 0};
+    if (level.count) {
+        bucket.min = level.min;
+        bucket.max = level.max;
+        bucket.mean = (level.sum + level.count / 2) / level.count;
+        bucket.count = level.count > 255 ? 255 : level.count;
+    }
+    return bucket;
+}
+
+// Finest level whose buckets over the range fit in maxPoints and that
+// still reaches back to fromMs; raw counts as one sample per millisecond
+uint16_t RssiHistory::pickResolution(const RssiHistoryQuery& q) const {
+    if (q.resolutionMs == RSSI_RES_RAW || q.resolutionMs == RSSI_RES_10MS ||
+        q.resolutionMs == RSSI_RES_100MS || q.resolutionMs == RSSI_RES_1S) {
+        return q.resolutionMs;
+    }
+    uint32_t spanMs = q.toMs - q.fromMs;
+    if (rawCount > 0 && spanMs <= q.maxPoints) {
+        uint32_t oldest = rawCount > RSSI_HISTORY_RAW ? rawCount - RSSI_HISTORY_RAW : 0;
+        if (rawCount <= RSSI_HISTORY_RAW || (int32_t)(rawTimes[oldest % RSSI_HISTORY_RAW] - q.fromMs) <= 0) {
+            return RSSI_RES_RAW;
+        }
+    }
+    for (uint8_t i = 0; i < RSSI_HISTORY_LEVELS - 1; i++) {
+        const Level& level = levels[i];
+        uint32_t keptFromMs = level.head >= RSSI_HISTORY_BUCKETS ? (level.head - RSSI_HISTORY_BUCKETS + 1) * level.widthMs : 0;
+        if (spanMs / level.widthMs < q.maxPoints && keptFromMs <= q.fromMs) {
+            return level.widthMs;
+        }
+    }
+    return levels[RSSI_HISTORY_LEVELS - 1].widthMs;
+}
+
+bool RssiHistory::query(const RssiHistoryQuery& request, RssiHistoryPoint* out, RssiHistoryResult& result) {
+    RssiHistoryQuery q = request;
+    if (q.maxPoints == 0 || q.maxPoints > RSSI_HISTORY_MAX_POINTS) {
+        q.maxPoints = RSSI_HISTORY_MAX_POINTS;
+    }
+    if ((int32_t)(q.toMs - q.fromMs) < 0) {
+        return false;
+    }
+    result.count = 0;
+    result.truncated = false;
+    result.points = out;
+    if (!mutex) {
+        return false;
+    }
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    uint16_t res = pickResolution(q);
+    result.resolutionMs = res;
+    bool found;
+    if (res == RSSI_RES_RAW) {
+        found = queryRaw(q, out, result);
+    } else {
+        found = false;
+        for (uint8_t i = 0; i < RSSI_HISTORY_LEVELS; i++) {
+            if (levels[i].widthMs == res) {
+                found = queryLevel(levels[i], q, out, result);
+            }
+        }
+    }
+    xSemaphoreGive(mutex);
+    return found;
+}
+
+// Newest first, so a range with more samples than maxPoints keeps its end
+bool RssiHistory::queryRaw(const RssiHistoryQuery& q, RssiHistoryPoint* out, RssiHistoryResult& result) {
+    uint32_t oldest = rawCount > RSSI_HISTORY_RAW ? rawCount - RSSI_HISTORY_RAW : 0;
+    size_t count = 0;
+    for (uint32_t i = rawCount; i > oldest; i--) {
+        uint32_t timeMs = rawTimes[(i - 1) % RSSI_HISTORY_RAW];
+        uint8_t value = rawValues[(i - 1) % RSSI_HISTORY_RAW];
+        if ((int32_t)(timeMs - q.toMs) > 0) {
+            continue;
+        }
+        if ((int32_t)(timeMs - q.fromMs) < 0) {
+            break;
+        }
+        if (count == q.maxPoints) {
+            result.truncated = true;
+            break;
+        }
+        out[count].timeMs = timeMs;
+        out[count].min = value;
+        out[count].max = value;
+        out[count].mean = value;
+        count++;
+    }
+    if (count == 0) {
+        return false;
+    }
+    for (size_t i = 0; i < count / 2; i++) {
+        RssiHistoryPoint swap = out[i];
+        out[i] = out[count - 1 - i];
+        out[count - 1 - i] = swap;
+    }
+    result.count = count;
+    result.fromMs = out[0].timeMs;
+    result.toMs = out[count - 1].timeMs;
+    return true;
+}
+
+bool RssiHistory::queryLevel(const Level& level, const RssiHistoryQuery& q, RssiHistoryPoint* out, RssiHistoryResult& result) {
+    if (!level.started) {
+        return false;
+    }
+    uint32_t width = level.widthMs;
+    uint32_t oldest = level.head >= RSSI_HISTORY_BUCKETS - 1 ? level.head - (RSSI_HISTORY_BUCKETS - 1) : 0;
+    uint32_t first = q.fromMs / width;
+    uint32_t last = q.toMs / width;
+    if (last > level.head) last = level.head;
+    if (first < oldest) first = oldest;
+    if (first > last) {
+        return false;
+    }
+    if (last - first + 1 > q.maxPoints) {
+        first = last - q.maxPoints + 1;
+        result.truncated = true;
+    }
+
+    size_t count = 0;
+    for (uint32_t number = first; number <= last; number++) {
+        RssiBucket bucket = number == level.head ? openBucket(level) : level.buckets[number % RSSI_HISTORY_BUCKETS];
+        if (bucket.count == 0) {
+            continue;
+        }
+        out[count].timeMs = number * width;
+        out[count].min = bucket.min;
+        out[count].max = bucket.max;
+        out[count].mean = bucket.mean;
+        count++;
+    }
+    result.count = count;
+    result.fromMs = first * width;
+    result.toMs = last * width + width - 1;
+    return count > 0;
+}
+
+// Columns rather than objects: with time deltas a 1000 point answer stays
+// around 12 KB. Written in pieces, so no buffer holds the whole text
+void RssiHistory::writeJson(const RssiHistoryResult& result, Sink sink, void* ctx) {
+    char buf[96];
+    int len = snprintf(buf, sizeof(buf), "{\"res\":%u,\"from\":%u,\"to\":%u,\"truncated\":%s,\"t\":[",
+                       result.resolutionMs, (unsigned)result.fromMs, (unsigned)result.toMs,
+                       result.truncated ? "true" : "false");
+    sink(ctx, buf, len);
+    for (size_t i = 0; i < result.count; i++) {
+        uint32_t t = i ? result.points[i].timeMs - result.points[i - 1].timeMs : result.points[i].timeMs;
+        len = snprintf(buf, sizeof(buf), i ? ",%u" : "%u", (unsigned)t);
+        sink(ctx, buf, len);
+    }
+
+    static const char* const rawColumns[] = {"v"};
+    static const char* const bucketColumns[] = {"min", "max", "mean"};
+    bool isRaw = result.resolutionMs == RSSI_RES_RAW;
+    const char* const* columns = isRaw ? rawColumns : bucketColumns;
+    uint8_t columnCount = isRaw ? 1 : 3;
+    for (uint8_t c = 0; c < columnCount; c++) {
+        len = snprintf(buf, sizeof(buf), "],\"%s\":[", columns[c]);
+        sink(ctx, buf, len);
+        for (size_t i = 0; i < result.count; i++) {
+            const RssiHistoryPoint& point = result.points[i];
+            uint8_t value = c == 0 ? (isRaw ? point.mean : point.min) : (c == 1 ? point.max : point.mean);
+            len = snprintf(buf, sizeof(buf), i ? ",%u" : "%u", value);
+            sink(ctx, buf, len);
+        }
+    }
+    sink(ctx, "]}", 2);
+}
@@ -0,0 +1,108 @@
+#ifndef RSSIHISTORY_H
+#define RSSIHISTORY_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include "rssistream.h"
+
+// Raw samples kept, a couple of seconds racing, about 20 s idle
+#define RSSI_HISTORY_RAW 2048
+// Buckets per level: 10 ms -> 20 s, 100 ms -> 3.4 min, 1 s -> 34 min
+#define RSSI_HISTORY_BUCKETS 2048
+#define RSSI_HISTORY_LEVELS 3
+// Most points one query returns
+#define RSSI_HISTORY_MAX_POINTS 1000
+
+typedef enum {
+    RSSI_RES_RAW = 0,
+    RSSI_RES_10MS = 10,
+    RSSI_RES_100MS = 100,
+    RSSI_RES_1S = 1000,
+    RSSI_RES_AUTO = 0xFFFF  // Finest resolution that covers the range in the points asked for
+} rssi_history_res_e;
+
+struct RssiBucket {
+    uint8_t min;
+    uint8_t max;
+    uint8_t mean;
+    uint8_t count;  // Samples, saturating; 0 = nothing sampled in this bucket
+};
+
+struct RssiHistoryPoint {
+    uint32_t timeMs;  // Sample time, or bucket start
+    uint8_t min;
+    uint8_t max;
+    uint8_t mean;
+};
+
+struct RssiHistoryQuery {
+    uint32_t fromMs;
+    uint32_t toMs;
+    uint16_t resolutionMs;  // rssi_history_res_e
+    uint16_t maxPoints;
+};
+
+// Result of a query, in a buffer owned by the caller. Empty buckets are
+// left out, so gaps in sampling show as gaps in time
+struct RssiHistoryResult {
+    uint16_t resolutionMs;  // Resolution picked, 0 = raw samples
+    uint32_t fromMs;        // Range actually covered, after clipping to what is kept
+    uint32_t toMs;
+    bool truncated;         // More points in range than maxPoints, the oldest were left out
+    size_t count;
+    RssiHistoryPoint* points;
+};
+
+// Multi-resolution RSSI history: the raw samples plus min/max/mean buckets
+// at 10 ms, 100 ms and 1 s, each level a ring updated per sample. update()
+// drains the lap timer's RssiRing on the housekeeping task; queries come
+// from the web server and USB and copy out under a mutex
+class RssiHistory {
+   public:
+    void init(RssiRing* rssiRing);
+    void update();
+
+    // False if nothing is kept for the range. out must hold q.maxPoints
+    // (at most RSSI_HISTORY_MAX_POINTS) points
+    bool query(const RssiHistoryQuery& q, RssiHistoryPoint* out, RssiHistoryResult& result);
+
+    // {"res":..,"from":..,"to":..,"truncated":..,"t":[first, deltas...],
+    //  "min":[..],"max":[..],"mean":[..]}, raw samples have "v" instead
+    // of min/max/mean
+    typedef void (*Sink)(void* ctx, const char* text, size_t len);
+    static void writeJson(const RssiHistoryResult& result, Sink sink, void* ctx);
+
+   private:
+    struct Level {
+        uint16_t widthMs;
+        RssiBucket buckets[RSSI_HISTORY_BUCKETS];
+        uint32_t head;  // Absolute number (timeMs / widthMs) of the open bucket
+        bool started;
+        // Open bucket
+        uint8_t min;
+        uint8_t max;
+        uint32_t sum;
+        uint32_t count;
+    };
+
+    RssiRing* ring = nullptr;
+    uint32_t cursor = 0;
+    SemaphoreHandle_t mutex = nullptr;
+
+    // Split rather than RssiSample[], which pads to 8 bytes
+    uint32_t rawTimes[RSSI_HISTORY_RAW];
+    uint8_t rawValues[RSSI_HISTORY_RAW];
+    uint32_t rawCount = 0;  // Total added, the newest is at (rawCount - 1) % RSSI_HISTORY_RAW
+    Level levels[RSSI_HISTORY_LEVELS];
+
+    void add(const RssiSample& sample);
+    void addToLevel(Level& level, const RssiSample& sample);
+    RssiBucket openBucket(const Level& level) const;
+    bool queryRaw(const RssiHistoryQuery& q, RssiHistoryPoint* out, RssiHistoryResult& result);
+    bool queryLevel(const Level& level, const RssiHistoryQuery& q, RssiHistoryPoint* out, RssiHistoryResult& result);
+    uint16_t pickResolution(const RssiHistoryQuery& q) const;
+};
+
+#endif
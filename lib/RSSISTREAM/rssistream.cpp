@@ -0,0 +1,192 @@
+#include "rssistream.h"
+
+#include <stdio.h>
+#include <string.h>
+
+void RssiRing::add(uint32_t timeMs, uint8_t rssi) {
+    if (hasPending && timeMs == pending.timeMs) {
+        if (rssi > pending.rssi) {
+            pending.rssi = rssi;
+        }
+        return;
+    }
+    // A millisecond is published once the next one starts, when its max is final
+    if (hasPending) {
+        uint32_t index = written.load(std::memory_order_relaxed);
+        samples[index & (RSSI_RING_SIZE - 1)] = pending;
+        written.store(index + 1, std::memory_order_release);
+    }
+    pending.timeMs = timeMs;
+    pending.rssi = rssi;
+    hasPending = true;
+}
+
+// The writer may be filling the slot of index written - RSSI_RING_SIZE at
+// any time, so a reader keeps one slot clear of it and throws away whatever
+// the writer reached while the copy ran
+size_t RssiRing::read(uint32_t& cursor, RssiSample* out, size_t max, uint32_t* lost) {
+    uint32_t skipped = 0;
+    uint32_t end = written.load(std::memory_order_acquire);
+    if (end - cursor > RSSI_RING_SIZE - 1) {
+        skipped = end - cursor - (RSSI_RING_SIZE - 1);
+        cursor += skipped;
+    }
+
+    size_t count = end - cursor;
+    if (count > max) {
+        count = max;
+    }
+    for (size_t i = 0; i < count; i++) {
+        out[i] = samples[(cursor + i) & (RSSI_RING_SIZE - 1)];
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint32_t safeFrom = written.load(std::memory_order_relaxed) - (RSSI_RING_SIZE - 1);
+    if ((int32_t)(safeFrom - cursor) > 0) {
+        uint32_t torn = safeFrom - cursor;
+        if (torn > count) {
+            torn = count;
+        }
+        memmove(out, out + torn, (count - torn) * sizeof(RssiSample));
+        count -= torn;
+        cursor += torn;
+        skipped += torn;
+    }
+
+    cursor += count;
+    if (lost) {
+        *lost = skipped;
+    }
+    return count;
+}
+
+uint16_t RssiBatcher::clampRate(uint32_t rateHz) {
+    if (rateHz == 0) return RSSI_STREAM_DEFAULT_RATE_HZ;
+    if (rateHz > RSSI_STREAM_MAX_RATE_HZ) return RSSI_STREAM_MAX_RATE_HZ;
+    return rateHz;
+}
+
+uint8_t RssiBatcher::clampBatch(uint32_t batch) {
+    if (batch == 0) return RSSI_BATCH_DEFAULT;
+    if (batch > RSSI_BATCH_MAX) return RSSI_BATCH_MAX;
+    return batch;
+}
+
+void RssiBatcher::start(RssiRing* rssiRing, uint32_t rateHz, uint32_t batch) {
+    intervalMs = 1000 / clampRate(rateHz);
+    batchSize = clampBatch(batch);
+    cursor = rssiRing->head();
+    gridStarted = false;
+    slotHasSample = false;
+    lost = 0;
+    chunkLen = 0;
+    chunkPos = 0;
+    building.count = 0;
+    ready = false;
+    ring = rssiRing;
+}
+
+// Samples are placed one at a time; a sample that closes a slot which
+// completes a batch stays pending, so the next poll() carries on with it
+bool RssiBatcher::poll() {
+    ready = false;
+    if (!ring) {
+        return false;
+    }
+
+    for (;;) {
+        if (chunkPos == chunkLen) {
+            uint32_t chunkLost = 0;
+            chunkLen = ring->read(cursor, chunk, RSSI_BATCHER_CHUNK, &chunkLost);
+            chunkPos = 0;
+            lost += chunkLost;
+            if (chunkLen == 0) {
+                break;
+            }
+        }
+        const RssiSample& sample = chunk[chunkPos];
+
+        if (!gridStarted) {
+            slotStartMs = sample.timeMs - sample.timeMs % intervalMs;
+            slotHasSample = false;
+            building.baseTimeMs = slotStartMs;
+            building.intervalMs = intervalMs;
+            building.count = 0;
+            gridStarted = true;
+        }
+
+        uint32_t sinceSlotMs = sample.timeMs - slotStartMs;
+        if ((int32_t)sinceSlotMs >= RSSI_STREAM_MAX_GAP_MS) {
+            if (building.count > 0) {
+                finishBatch();
+            }
+            gridStarted = false;
+            if (ready) {
+                return true;
+            }
+            continue;
+        }
+
+        if ((int32_t)sinceSlotMs >= (int32_t)intervalMs) {
+            closeSlot(slotHasSample ? slotMax : lastValue);
+            slotStartMs += intervalMs;
+            if (ready) {
+                return true;
+            }
+            continue;
+        }
+
+        if (!slotHasSample || sample.rssi > slotMax) {
+            slotMax = sample.rssi;
+        }
+        slotHasSample = true;
+        chunkPos++;
+    }
+    return ready;
+}
+
+void RssiBatcher::closeSlot(uint8_t value) {
+    building.values[building.count++] = value;
+    lastValue = value;
+    slotHasSample = false;
+    if (building.count >= batchSize || (uint32_t)building.count * intervalMs >= RSSI_BATCH_MAX_SPAN_MS) {
+        finishBatch();
+    }
+}
+
+void RssiBatcher::finishBatch() {
+    out.baseTimeMs = building.baseTimeMs;
+    out.intervalMs = building.intervalMs;
+    out.count = building.count;
+    out.lost = lost;
+    memcpy(out.values, building.values, building.count);
+    lost = 0;
+    ready = true;
+
+    building.baseTimeMs = slotStartMs + intervalMs;
+    building.count = 0;
+}
+
+size_t RssiBatcher::toJson(char* buf, size_t size, int streamId) const {
+    int len;
+    if (streamId >= 0) {
+        len = snprintf(buf, size, "{\"s\":%d,\"t\":%u,\"dt\":%u,\"lost\":%u,\"v\":[",
+                       streamId, (unsigned)out.baseTimeMs, (unsigned)out.intervalMs, (unsigned)out.lost);
+    } else {
+        len = snprintf(buf, size, "{\"t\":%u,\"dt\":%u,\"lost\":%u,\"v\":[",
+                       (unsigned)out.baseTimeMs, (unsigned)out.intervalMs, (unsigned)out.lost);
+    }
+    int previous = 0;
+    for (uint8_t i = 0; i < out.count && len > 0 && (size_t)len < size; i++) {
+        int value = out.values[i];
+        len += snprintf(buf + len, size - len, i ? ",%d" : "%d", value - previous);
+        previous = value;
+    }
+    if (len > 0 && (size_t)len < size) {
+        len += snprintf(buf + len, size - len, "]}");
+    }
+    if (len <= 0 || (size_t)len >= size) {
+        return 0;
+    }
+    return len;
+}
@@ -0,0 +1,114 @@
+#ifndef RSSISTREAM_H
+#define RSSISTREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+// Samples kept for streaming readers, about a second at the 1 kHz cap.
+// Power of two
+#define RSSI_RING_SIZE 1024
+
+// Per-client stream limits. A batch also goes out once it spans
+// RSSI_BATCH_MAX_SPAN_MS, so slow rates with big batches still update
+#define RSSI_STREAM_MAX_RATE_HZ 500
+#define RSSI_STREAM_DEFAULT_RATE_HZ 100
+#define RSSI_BATCH_MAX 100
+#define RSSI_BATCH_DEFAULT 50
+#define RSSI_BATCH_MAX_SPAN_MS 500
+// A gap this long (sampling paused, reader lapped) restarts the grid
+// instead of holding the last value across it
+#define RSSI_STREAM_MAX_GAP_MS 1000
+#define RSSI_BATCHER_CHUNK 16
+// Longest toJson() output: a full batch of -255 deltas plus the header
+#define RSSI_BATCH_JSON_MAX (80 + RSSI_BATCH_MAX * 5)
+
+struct RssiSample {
+    uint32_t timeMs;
+    uint8_t rssi;
+};
+
+// Filtered RSSI as the timing loop sees it, for readers on other tasks.
+// One writer (the timing loop), any number of readers, each with its own
+// cursor; a reader the writer laps loses the oldest samples and is told
+// how many. Samples within one millisecond are merged, keeping the max, so
+// a crossing's peak survives the loop spinning faster than 1 kHz
+class RssiRing {
+   public:
+    // Timing loop only
+    void add(uint32_t timeMs, uint8_t rssi);
+
+    // Cursor a new reader starts from: only samples added after this call
+    uint32_t head() const { return written.load(std::memory_order_acquire); }
+
+    // Copies up to max samples from cursor on and advances it. lost gets the
+    // samples that were overwritten before they could be read
+    size_t read(uint32_t& cursor, RssiSample* out, size_t max, uint32_t* lost);
+
+   private:
+    RssiSample samples[RSSI_RING_SIZE];
+    std::atomic<uint32_t> written{0};
+    RssiSample pending = {0, 0};
+    bool hasPending = false;
+};
+
+struct RssiBatch {
+    uint32_t baseTimeMs;  // Time of values[0]
+    uint16_t intervalMs;  // values[i] is at baseTimeMs + i * intervalMs
+    uint8_t count;
+    uint32_t lost;        // Ring samples lost since the previous batch
+    uint8_t values[RSSI_BATCH_MAX];
+};
+
+// One client's stream: resamples the ring onto a fixed grid of rateHz and
+// hands out batches of batchSize. Each grid slot carries the max of the
+// samples in it; a slot without samples (sampling slower than the stream)
+// repeats the previous value
+class RssiBatcher {
+   public:
+    // Rate and batch are clamped to the limits above, read them back with
+    // getRateHz() and getBatchSize()
+    void start(RssiRing* ring, uint32_t rateHz, uint32_t batchSize);
+    static uint16_t clampRate(uint32_t rateHz);
+    static uint8_t clampBatch(uint32_t batchSize);
+    void stop() { ring = nullptr; }
+    bool isActive() const { return ring != nullptr; }
+    uint16_t getRateHz() const { return 1000 / intervalMs; }
+    uint8_t getBatchSize() const { return batchSize; }
+
+    // Pulls new samples. True when a batch is ready, then batch() holds it
+    // until the next poll()
+    bool poll();
+    const RssiBatch& batch() const { return out; }
+
+    // "v" holds the first value, then differences to the previous one,
+    // which keeps a flat signal to a couple of characters per sample.
+    // streamId >= 0 adds "s". Returns the length, 0 if buf is too small
+    size_t toJson(char* buf, size_t size, int streamId = -1) const;
+
+   private:
+    RssiRing* ring = nullptr;
+    uint32_t cursor = 0;
+    uint16_t intervalMs = 10;
+    uint8_t batchSize = RSSI_BATCH_DEFAULT;
+
+    bool gridStarted = false;
+    uint32_t slotStartMs = 0;
+    bool slotHasSample = false;
+    uint8_t slotMax = 0;
+    uint8_t lastValue = 0;
+    uint32_t lost = 0;
+    RssiSample chunk[RSSI_BATCHER_CHUNK];
+    size_t chunkLen = 0;
+    size_t chunkPos = 0;
+
+    RssiBatch building;
+    RssiBatch out;
+    bool ready = false;
+
+    void closeSlot(uint8_t value);
+    void finishBatch();
+};
+
+#endif
@@ -40,18 +40,28 @@ void RX5808::init() {
     delay(50);
 }
 
-void RX5808::handleFrequencyChange(uint32_t currentTimeMs, uint16_t potentiallyNewFreq) {
-    if ((currentFrequency != potentiallyNewFreq) && ((currentTimeMs - lastSetFreqTimeMs) > RX5808_MIN_BUSTIME)) {
-        lastSetFreqTimeMs = currentTimeMs;
-        setFrequency(potentiallyNewFreq);
+// Runs on the config bus task, so the bus and tune times are plain task
+// delays instead of timestamps polled from the busy loop
+void RX5808::onConfigChanged(Config& config, uint32_t changed) {
+    uint16_t newFreq = config.getFrequency();
+    if (newFreq == currentFrequency) {
+        return;
     }
 
-    if (recentSetFreqFlag && (currentTimeMs - lastSetFreqTimeMs) > RX5808_MIN_TUNETIME) {
-        lastSetFreqTimeMs = currentTimeMs;
-        DEBUG("RX5808 Tune done\n");
-        verifyFrequency();
-        recentSetFreqFlag = false;  // don't need to check again until next freq change
+    uint32_t sinceLastSetMs = millis() - lastSetFreqTimeMs;
+    if (sinceLastSetMs < RX5808_MIN_BUSTIME) {
+        vTaskDelay(pdMS_TO_TICKS(RX5808_MIN_BUSTIME - sinceLastSetMs));
+    }
+    setFrequency(newFreq);
+    lastSetFreqTimeMs = millis();
+
+    if (newFreq == POWER_DOWN_FREQ_MHZ) {
+        return;
     }
+    vTaskDelay(pdMS_TO_TICKS(RX5808_MIN_TUNETIME));
+    DEBUG("RX5808 Tune done\n");
+    verifyFrequency();
+    recentSetFreqFlag = false;  // RSSI is valid again
 }
 
 bool RX5808::verifyFrequency() {
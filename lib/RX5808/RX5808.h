@@ -3,18 +3,21 @@
 
 #include <stdint.h>
 
+#include "config.h"
+
 #define RX5808_MIN_TUNETIME 35    // after set freq need to wait this long before read RSSI
 #define RX5808_MIN_BUSTIME 30     // after set freq need to wait this long before setting again
 #define POWER_DOWN_FREQ_MHZ 1111  // signal to power down the module
 #define RSSI_READS 5              // number of analog RSSI reads per tick
 
-class RX5808 {
+class RX5808 : public ConfigListener {
    public:
     RX5808(uint8_t _rssiInputPin, uint8_t _rx5808DataPin, uint8_t _rx5808SelPin, uint8_t _rx5808ClkPin);
     void init();
     void setFrequency(uint16_t frequency);
     uint8_t readRssi();
-    void handleFrequencyChange(uint32_t currentTimeMs, uint16_t potentiallyNewFreq);
+    // Subscribed to CONFIG_CHANGED_FREQUENCY, retunes on the config bus task
+    void onConfigChanged(Config& config, uint32_t changed) override;
 
    private:
     uint8_t rx5808DataPin = 0;  // DATA (CH1) output line to RX5808 module
@@ -25,7 +28,7 @@ class RX5808 {
     uint16_t currentFrequency = 0;
 
     bool rxPoweredDown = false;
-    bool recentSetFreqFlag = false;
+    volatile bool recentSetFreqFlag = false;  // Read by readRssi() on the timing core
     uint32_t lastSetFreqTimeMs = 0;
 
     void rx5808SerialSendBit1();
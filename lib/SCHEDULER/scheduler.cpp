@@ -0,0 +1,149 @@
+#include "scheduler.h"
+
+#include <esp_task_wdt.h>
+#include <esp_timer.h>
+
+#include "debug.h"
+
+int Scheduler::addJob(const char* name, uint32_t periodUs, uint32_t deadlineUs, SchedulerJobFn fn) {
+    if (task || jobCount >= SCHEDULER_MAX_JOBS || !fn || periodUs == 0) {
+        DEBUG("Scheduler: cannot add job %s\n", name);
+        return -1;
+    }
+    Job& job = jobs[jobCount];
+    memset(&job.stats, 0, sizeof(job.stats));
+    job.fn = fn;
+    job.nextReleaseUs = 0;
+    job.stats.name = name;
+    job.stats.periodUs = periodUs;
+    job.stats.deadlineUs = deadlineUs ? deadlineUs : periodUs;
+    return jobCount++;
+}
+
+bool Scheduler::start(const char* taskName, UBaseType_t priority, BaseType_t core) {
+    if (task) {
+        return false;
+    }
+    int64_t now = esp_timer_get_time();
+    for (uint8_t i = 0; i < jobCount; i++) {
+        jobs[i].nextReleaseUs = now;
+    }
+    statsSinceUs = now;
+    busyUs = 0;
+    return xTaskCreatePinnedToCore(taskEntry, taskName, SCHEDULER_TASK_STACK, this, priority, &task, core) == pdPASS;
+}
+
+bool Scheduler::getJobStats(uint8_t index, SchedulerJobStats& stats) const {
+    if (index >= jobCount) {
+        return false;
+    }
+    stats = jobs[index].stats;
+    return true;
+}
+
+void Scheduler::resetStats() {
+    for (uint8_t i = 0; i < jobCount; i++) {
+        SchedulerJobStats& stats = jobs[i].stats;
+        stats.runs = 0;
+        stats.overruns = 0;
+        stats.skipped = 0;
+        stats.lastRunUs = 0;
+        stats.maxRunUs = 0;
+        stats.maxLatenessUs = 0;
+        stats.totalRunUs = 0;
+    }
+    busyUs = 0;
+    statsSinceUs = esp_timer_get_time();
+}
+
+uint16_t Scheduler::getLoadPermille() const {
+    int64_t elapsed = esp_timer_get_time() - statsSinceUs;
+    if (elapsed <= 0) {
+        return 0;
+    }
+    uint64_t permille = busyUs * 1000 / (uint64_t)elapsed;
+    return permille > 1000 ? 1000 : (uint16_t)permille;
+}
+
+void Scheduler::taskEntry(void* param) {
+    static_cast<Scheduler*>(param)->run();
+}
+
+void Scheduler::run() {
+    // The task sleeps between releases now, so it can be watched like any other
+    esp_task_wdt_add(NULL);
+
+    for (;;) {
+        esp_task_wdt_reset();
+
+        // Run every released job, earliest absolute deadline first
+        for (;;) {
+            int64_t now = esp_timer_get_time();
+            Job* next = nullptr;
+            int64_t nextDeadline = 0;
+            for (uint8_t i = 0; i < jobCount; i++) {
+                Job& job = jobs[i];
+                if (job.nextReleaseUs > now) {
+                    continue;
+                }
+                int64_t deadline = job.nextReleaseUs + job.stats.deadlineUs;
+                if (!next || deadline < nextDeadline) {
+                    next = &job;
+                    nextDeadline = deadline;
+                }
+            }
+            if (!next) {
+                break;
+            }
+            runJob(*next, next->nextReleaseUs);
+        }
+
+        // Sleep until the earliest next release. At least one tick, so lower
+        // priority tasks on this core always get to run
+        int64_t now = esp_timer_get_time();
+        int64_t wakeUs = INT64_MAX;
+        for (uint8_t i = 0; i < jobCount; i++) {
+            if (jobs[i].nextReleaseUs < wakeUs) {
+                wakeUs = jobs[i].nextReleaseUs;
+            }
+        }
+        TickType_t ticks = 1;
+        if (wakeUs != INT64_MAX && wakeUs - now > portTICK_PERIOD_MS * 1000) {
+            ticks = (TickType_t)((wakeUs - now) / (portTICK_PERIOD_MS * 1000));
+        }
+        vTaskDelay(ticks);
+    }
+}
+
+void Scheduler::runJob(Job& job, int64_t releaseUs) {
+    SchedulerJobStats& stats = job.stats;
+    int64_t startUs = esp_timer_get_time();
+    job.fn(millis());
+    int64_t endUs = esp_timer_get_time();
+
+    uint32_t runUs = (uint32_t)(endUs - startUs);
+    stats.runs++;
+    stats.lastRunUs = runUs;
+    stats.totalRunUs += runUs;
+    busyUs += runUs;
+    if (runUs > stats.maxRunUs) {
+        stats.maxRunUs = runUs;
+    }
+
+    int64_t latenessUs = endUs - (releaseUs + stats.deadlineUs);
+    if (latenessUs > 0) {
+        stats.overruns++;
+        if ((uint32_t)latenessUs > stats.maxLatenessUs) {
+            stats.maxLatenessUs = (uint32_t)latenessUs;
+        }
+    }
+
+    // Keep the release grid; releases already in the past are dropped
+    // rather than run back to back to catch up
+    job.nextReleaseUs = releaseUs + stats.periodUs;
+    if (job.nextReleaseUs <= endUs) {
+        uint32_t behind = (uint32_t)((endUs - job.nextReleaseUs) / stats.periodUs) + 1;
+        stats.skipped += behind;
+        job.nextReleaseUs += (int64_t)behind * stats.periodUs;
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#define SCHEDULER_MAX_JOBS 8
+#define SCHEDULER_TASK_STACK 8192
+
+typedef void (*SchedulerJobFn)(uint32_t currentTimeMs);
+
+struct SchedulerJobStats {
+    const char* name;
+    uint32_t periodUs;
+    uint32_t deadlineUs;      // Must finish this long after its release
+    uint32_t runs;
+    uint32_t overruns;        // Runs that finished past the deadline
+    uint32_t skipped;         // Releases dropped because the job fell a full period behind
+    uint32_t lastRunUs;       // Execution time of the most recent run
+    uint32_t maxRunUs;
+    uint32_t maxLatenessUs;   // Worst finish time past the deadline
+    uint64_t totalRunUs;
+};
+
+// Cooperative periodic scheduler on one FreeRTOS task. Each job has a period
+// and a relative deadline; ready jobs run earliest-deadline-first and the
+// task sleeps until the next release, so the idle task (and its watchdog)
+// gets the CPU in between. Jobs must not block
+class Scheduler {
+   public:
+    // Returns the job index, or -1 if the table is full or already running
+    int addJob(const char* name, uint32_t periodUs, uint32_t deadlineUs, SchedulerJobFn fn);
+    bool start(const char* taskName, UBaseType_t priority, BaseType_t core);
+
+    uint8_t getJobCount() const { return jobCount; }
+    bool getJobStats(uint8_t index, SchedulerJobStats& stats) const;
+    void resetStats();
+    // Share of wall time spent running jobs since the last reset, in permille
+    uint16_t getLoadPermille() const;
+
+   private:
+    struct Job {
+        SchedulerJobFn fn;
+        int64_t nextReleaseUs;
+        SchedulerJobStats stats;
+    };
+
+    Job jobs[SCHEDULER_MAX_JOBS];
+    uint8_t jobCount = 0;
+    TaskHandle_t task = nullptr;
+    int64_t statsSinceUs = 0;
+    uint64_t busyUs = 0;
+
+    static void taskEntry(void* param);
+    void run();
+    void runJob(Job& job, int64_t releaseUs);
+};
+
+#endif
@@ -92,6 +92,9 @@ TestResult SelfTest::testStorage() {
         return result;
     }
     
+    // Push it out of the write-behind cache so the read comes from the medium
+    storage->flush();
+    
     String readData;
     bool readSuccess = storage->readFile("/test_selftest.txt", readData);
     
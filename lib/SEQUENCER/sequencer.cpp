@@ -0,0 +1,167 @@
+#include "sequencer.h"
+
+#include "debug.h"
+
+#define SEQ_EARLY_US 50  // A wakeup this close to the step end counts as on time
+
+bool PatternSequencer::init(uint8_t outputPin, bool inverted, int8_t channel) {
+    pin = outputPin;
+    idleLevel = inverted ? HIGH : LOW;
+    ledcChannel = channel;
+
+    if (ledcChannel != SEQ_NO_LEDC) {
+        ledcSetup(ledcChannel, 2000, 8);
+        ledcAttachPin(pin, ledcChannel);
+    } else {
+        pinMode(pin, OUTPUT);
+    }
+    output(0);
+
+    esp_timer_create_args_t args = {};
+    args.callback = timerCallback;
+    args.arg = this;
+    args.dispatch_method = ESP_TIMER_TASK;
+    args.name = "sequencer";
+    if (esp_timer_create(&args, &timer) != ESP_OK) {
+        DEBUG("Sequencer: timer create failed on pin %u\n", pin);
+        timer = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void PatternSequencer::play(const PatternStep* newSteps, uint8_t newCount, uint8_t newRepeat, int64_t startUs) {
+    load(newSteps, newCount, newRepeat, startUs, false);
+}
+
+bool PatternSequencer::offer(const PatternStep* newSteps, uint8_t newCount, uint8_t newRepeat) {
+    return load(newSteps, newCount, newRepeat, 0, true);
+}
+
+void PatternSequencer::hold(int64_t untilUs) {
+    portENTER_CRITICAL(&mux);
+    holdUntilUs = untilUs;
+    portEXIT_CRITICAL(&mux);
+}
+
+void PatternSequencer::stop() {
+    load(nullptr, 0, 1, 0, false);
+}
+
+// The hold is checked under the same lock the pattern is handed over with,
+// so an offer() can't land just after the play() it would cut into
+bool PatternSequencer::load(const PatternStep* newSteps, uint8_t newCount, uint8_t newRepeat, int64_t startUs, bool yieldToHold) {
+    if (!timer) {
+        return false;
+    }
+    if (newCount > SEQ_MAX_STEPS) {
+        newCount = SEQ_MAX_STEPS;
+    }
+    int64_t nowUs = esp_timer_get_time();
+    portENTER_CRITICAL(&mux);
+    if (yieldToHold && nowUs < holdUntilUs) {
+        portEXIT_CRITICAL(&mux);
+        return false;
+    }
+    if (newCount > 0) {
+        memcpy(pendingSteps, newSteps, newCount * sizeof(PatternStep));
+    }
+    pendingCount = newCount;
+    pendingRepeat = newRepeat;
+    pendingStartUs = startUs;
+    pending = true;
+    portEXIT_CRITICAL(&mux);
+    kick();
+    return true;
+}
+
+// Hands the pending pattern to the timer callback right away
+void PatternSequencer::kick() {
+    esp_timer_stop(timer);
+    esp_timer_start_once(timer, 1);
+}
+
+void PatternSequencer::timerCallback(void* arg) {
+    static_cast<PatternSequencer*>(arg)->onTimer();
+}
+
+// Only this callback touches the output and the playing pattern. Every
+// wakeup is checked against the absolute step end, so a spurious or
+// early one just re-arms
+void PatternSequencer::onTimer() {
+    for (;;) {
+        int64_t now = esp_timer_get_time();
+        bool started = false;
+        int64_t startUs = 0;
+        portENTER_CRITICAL(&mux);
+        if (pending) {
+            memcpy(steps, pendingSteps, pendingCount * sizeof(PatternStep));
+            count = pendingCount;
+            repeat = pendingRepeat;
+            startUs = pendingStartUs;
+            pending = false;
+            started = true;
+        }
+        portEXIT_CRITICAL(&mux);
+
+        if (started) {
+            if (count == 0) {
+                playing = false;
+                output(0);
+                return;
+            }
+            index = 0;
+            repeatsLeft = repeat;
+            playing = true;
+            if (startUs > now + SEQ_EARLY_US) {
+                // Scheduled start, the first step goes out on the wakeup at startUs
+                waiting = true;
+                stepEndUs = startUs;
+                output(0);
+            } else {
+                waiting = false;
+                stepEndUs = now + steps[0].durationMs * 1000LL;
+                output(steps[0].freqHz);
+            }
+        } else if (!playing) {
+            return;
+        } else if (now >= stepEndUs - SEQ_EARLY_US) {
+            if (waiting) {
+                waiting = false;
+            } else if (++index >= count) {
+                if (repeat != 0 && --repeatsLeft == 0) {
+                    playing = false;
+                    output(0);
+                    return;
+                }
+                index = 0;
+            }
+            // Step ends stay on the grid of the first step, so long
+            // patterns don't drift by the callback latency
+            stepEndUs += steps[index].durationMs * 1000LL;
+            output(steps[index].freqHz);
+        }
+
+        int64_t waitUs = stepEndUs - esp_timer_get_time();
+        esp_timer_stop(timer);
+        esp_timer_start_once(timer, waitUs > 1 ? waitUs : 1);
+
+        // A play() that raced with the re-arm above may have had its kick
+        // overridden; pick it up now
+        if (!pending) {
+            return;
+        }
+    }
+}
+
+void PatternSequencer::output(uint16_t freqHz) {
+    if (ledcChannel != SEQ_NO_LEDC) {
+        if (freqHz) {
+            ledcWriteTone(ledcChannel, freqHz);
+        } else {
+            ledcWrite(ledcChannel, 0);
+        }
+    } else {
+        digitalWrite(pin, freqHz ? !idleLevel : idleLevel);
+    }
+}
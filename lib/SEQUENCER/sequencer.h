@@ -0,0 +1,72 @@
+#ifndef SEQUENCER_H
+#define SEQUENCER_H
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+
+#define SEQ_MAX_STEPS 40  // Lap 99 on the buzzer takes 35
+#define SEQ_NO_LEDC -1
+
+// One step of a pattern. freqHz 0 is silence/off; on a plain GPIO output any
+// other value just means on
+struct PatternStep {
+    uint16_t freqHz;
+    uint16_t durationMs;
+};
+
+// Plays a list of steps on one pin, timed by an esp_timer (hardware timer,
+// callbacks on the high priority esp_timer task), so nothing polls it and
+// the step edges don't move with loop() or scheduler load. Tones come from
+// LEDC when a channel is given, otherwise the pin is switched on and off.
+// play()/stop() can be called from any task on either core; the steps are
+// copied, so callers can pass temporaries
+class PatternSequencer {
+   public:
+    bool init(uint8_t pin, bool inverted, int8_t ledcChannel = SEQ_NO_LEDC);
+    // repeat 0 = loop until stop() or the next play(). startUs is an
+    // esp_timer_get_time() instant for the first step edge, 0 = now; the
+    // output stays idle until then
+    void play(const PatternStep* steps, uint8_t count, uint8_t repeat = 1, int64_t startUs = 0);
+    // Like play() (count 0 like stop()), but dropped while a hold() is in
+    // force, for feedback beeps and blinks that must not cut into a
+    // scheduled pattern. False if dropped
+    bool offer(const PatternStep* steps, uint8_t count, uint8_t repeat = 1);
+    // Refuses offer() until esp_timer_get_time() reaches untilUs, 0 releases
+    void hold(int64_t untilUs);
+    void stop();
+    bool isPlaying() const { return playing; }
+
+   private:
+    uint8_t pin = 0;
+    uint8_t idleLevel = LOW;
+    int8_t ledcChannel = SEQ_NO_LEDC;
+    esp_timer_handle_t timer = nullptr;
+    portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+
+    // Written by play()/stop() under mux, taken over by the timer callback
+    volatile bool pending = false;
+    PatternStep pendingSteps[SEQ_MAX_STEPS];
+    uint8_t pendingCount = 0;
+    uint8_t pendingRepeat = 1;
+    int64_t pendingStartUs = 0;
+    int64_t holdUntilUs = 0;
+
+    // Owned by the timer callback
+    PatternStep steps[SEQ_MAX_STEPS];
+    uint8_t count = 0;
+    uint8_t index = 0;
+    uint8_t repeat = 1;
+    uint8_t repeatsLeft = 0;
+    int64_t stepEndUs = 0;  // Or the first edge while waiting
+    bool waiting = false;
+    volatile bool playing = false;
+
+    static void timerCallback(void* arg);
+    void onTimer();
+    void output(uint16_t freqHz);
+    bool load(const PatternStep* newSteps, uint8_t newCount, uint8_t newRepeat, int64_t startUs, bool yieldToHold);
+    void kick();
+};
+
+#endif
@@ -3,7 +3,17 @@
 #include "config.h"
 #include <FS.h>
 
-Storage::Storage() : sdAvailable(false) {
+Storage::Storage()
+    : sdAvailable(false),
+      journalOpen(false),
+      cacheBytes(0),
+      cacheLimit(STORAGE_CACHE_MAX_BYTES),
+      cacheGen(0),
+      flushIntervalMs(STORAGE_FLUSH_INTERVAL_MS),
+      cacheMutex(nullptr),
+      ioMutex(nullptr),
+      flushTask(nullptr) {
+    memset(&stats, 0, sizeof(stats));
 #ifdef ESP32S3
     spi = nullptr;
 #endif
@@ -15,6 +25,21 @@ bool Storage::init() {
     // SD card init deferred to after boot to prevent watchdog timeout
     sdAvailable = false;
     DEBUG("Storage: Using LittleFS (SD card will be initialized after boot)\n");
+    
+    // Finish or undo a transaction interrupted by a reset. If the mount fails
+    // here the web server formats LittleFS later, which leaves nothing to recover
+    if (LittleFS.begin(false)) {
+        recoverJournal();
+    }
+    
+    // init() runs again from the web server, the cache must survive that
+    if (!flushTask) {
+        cacheMutex = xSemaphoreCreateMutex();
+        ioMutex = xSemaphoreCreateRecursiveMutex();
+        cacheLimit = psramFound() ? STORAGE_CACHE_MAX_BYTES_PSRAM : STORAGE_CACHE_MAX_BYTES;
+        xTaskCreatePinnedToCore(flushTaskFn, "storageFlush", STORAGE_FLUSH_TASK_STACK, this, 1, &flushTask, 0);
+        DEBUG("Storage: Write-behind cache enabled (%d KB)\n", cacheLimit / 1024);
+    }
     return true;
 }
 
@@ -27,6 +52,10 @@ bool Storage::initSDDeferred() {
         return true;
     }
     
+    // Anything still cached belongs on LittleFS, get it there before switching
+    flush();
+    lockIo();
+    
     uint32_t startTime = millis();
     bool success = initSD();
     uint32_t duration = millis() - startTime;
@@ -34,9 +63,12 @@ bool Storage::initSDDeferred() {
     if (success) {
         sdAvailable = true;
         DEBUG("SD card initialized successfully (took %dms)\n", duration);
+        recoverJournal();
+        unlockIo();
         return true;
     } else {
         DEBUG("SD card init failed after %dms\n", duration);
+        unlockIo();
         return false;
     }
 #else
@@ -114,34 +146,78 @@ bool Storage::initSD() {
 }
 #endif
 
-bool Storage::writeFile(const String& path, const String& data) {
-    DEBUG("Storage: Writing to %s (%d bytes)\n", path.c_str(), data.length());
-    
+fs::FS& Storage::activeFs() {
 #ifdef ESP32S3
     if (sdAvailable) {
-        File file = SD.open(path, FILE_WRITE);
-        if (!file) {
-            DEBUG("Failed to open file on SD: %s\n", path.c_str());
-            return false;
-        }
-        size_t written = file.print(data);
-        file.close();
-        return written > 0;
+        return SD;
     }
 #endif
+    return LittleFS;
+}
+
+bool Storage::writeFile(const String& path, const String& data) {
+    return writeFile(path, (const uint8_t*)data.c_str(), data.length());
+}
+
+bool Storage::writeFile(const String& path, const uint8_t* data, size_t len) {
+    uint8_t* buf = cacheAlloc(len);
+    if (buf) {
+        memcpy(buf, data, len);
+        cacheStore(path, buf, len);
+        return true;
+    }
     
-    // Fall back to LittleFS
-    File file = LittleFS.open(path, "w");
+    lockIo();
+    dropCached(path);
+    bool success = writeDirect(path, data, len);
+    unlockIo();
+    return success;
+}
+
+bool Storage::writeDirect(const String& path, const uint8_t* data, size_t len) {
+    DEBUG("Storage: Writing to %s (%d bytes)\n", path.c_str(), len);
+    
+    File file = openWrite(tempPath(path));
     if (!file) {
-        DEBUG("Failed to open file on LittleFS: %s\n", path.c_str());
+        DEBUG("Failed to open file on %s: %s\n", getStorageType().c_str(), path.c_str());
         return false;
     }
-    size_t written = file.print(data);
+    size_t written = file.write(data, len);
+    return finishWrite(path, file, len > 0 && written == len);
+}
+
+bool Storage::finishWrite(const String& path, File& file, bool ok) {
+    size_t size = file.size();
+    // flush() also fsyncs, so the data is on the medium before the rename
+    file.flush();
     file.close();
-    return written > 0;
+    
+    String tmp = tempPath(path);
+    if (!ok) {
+        activeFs().remove(tmp);
+        return false;
+    }
+    if (cacheMutex) {
+        xSemaphoreTake(cacheMutex, portMAX_DELAY);
+        stats.bytesWritten += size;
+        xSemaphoreGive(cacheMutex);
+    }
+    if (journalOpen) {
+        journalEntries.push_back(JournalEntry{tmp, path});
+        return true;
+    }
+    return replaceFile(tmp, path);
 }
 
 bool Storage::readFile(const String& path, String& data) {
+    std::shared_ptr<uint8_t> cached;
+    size_t cachedLen;
+    if (cacheLookup(path, cached, cachedLen)) {
+        data = String();
+        data.concat((const char*)cached.get(), cachedLen);
+        return true;
+    }
+    
 #ifdef ESP32S3
     if (sdAvailable) {
         if (!SD.exists(path)) {
@@ -172,16 +248,133 @@ bool Storage::readFile(const String& path, String& data) {
     return true;
 }
 
+File Storage::openRead(const String& path) {
+    // A File handle can't be served from RAM, so a dirty copy is flushed first
+    flushEntry(path);
+    
+    // Check first - opening a missing file spams VFS errors on LittleFS
+    if (!activeFs().exists(path)) {
+        return File();
+    }
+    return activeFs().open(path, FILE_READ);
+}
+
+File Storage::openWrite(const String& path) {
+    return activeFs().open(path, FILE_WRITE);
+}
+
+File Storage::openAppend(const String& path) {
+    return activeFs().open(path, FILE_APPEND);
+}
+
+size_t Storage::readAt(const String& path, size_t offset, uint8_t* buf, size_t len) {
+    std::shared_ptr<uint8_t> cached;
+    size_t cachedLen;
+    if (cacheLookup(path, cached, cachedLen)) {
+        if (offset >= cachedLen) {
+            return 0;
+        }
+        size_t n = min(len, cachedLen - offset);
+        memcpy(buf, cached.get() + offset, n);
+        return n;
+    }
+    
+    File file = openRead(path);
+    if (!file) {
+        return 0;
+    }
+    if (offset > 0 && !file.seek(offset)) {
+        file.close();
+        return 0;
+    }
+    size_t bytesRead = file.read(buf, len);
+    file.close();
+    return bytesRead;
+}
+
+size_t Storage::fileSize(const String& path) {
+    std::shared_ptr<uint8_t> cached;
+    size_t cachedLen;
+    if (cacheLookup(path, cached, cachedLen)) {
+        return cachedLen;
+    }
+    
+    File file = openRead(path);
+    if (!file) {
+        return 0;
+    }
+    size_t size = file.size();
+    file.close();
+    return size;
+}
+
+bool Storage::writeJson(const String& path, const JsonDocument& doc) {
+    size_t expected = measureJson(doc);
+    
+    // +1 for the terminator serializeJson() always appends
+    uint8_t* buf = cacheAlloc(expected + 1);
+    if (buf) {
+        serializeJson(doc, (char*)buf, expected + 1);
+        cacheStore(path, buf, expected);
+        return true;
+    }
+    
+    lockIo();
+    dropCached(path);
+    File file = openWrite(tempPath(path));
+    if (!file) {
+        DEBUG("Failed to open file on %s: %s\n", getStorageType().c_str(), path.c_str());
+        unlockIo();
+        return false;
+    }
+    size_t written = serializeJson(doc, file);
+    DEBUG("Storage: Wrote %s (%d bytes)\n", path.c_str(), written);
+    bool success = finishWrite(path, file, written > 0 && written == expected);
+    unlockIo();
+    return success;
+}
+
+bool Storage::readJson(const String& path, JsonDocument& doc) {
+    DeserializationError error;
+    std::shared_ptr<uint8_t> cached;
+    size_t cachedLen;
+    if (cacheLookup(path, cached, cachedLen)) {
+        // const input makes ArduinoJson copy the strings out of the cache buffer
+        error = deserializeJson(doc, (const char*)cached.get(), cachedLen);
+    } else {
+        File file = openRead(path);
+        if (!file) {
+            return false;
+        }
+        error = deserializeJson(doc, file);
+        file.close();
+    }
+    if (error) {
+        DEBUG("Failed to parse %s: %s\n", path.c_str(), error.c_str());
+        return false;
+    }
+    return true;
+}
+
 bool Storage::deleteFile(const String& path) {
-#ifdef ESP32S3
-    if (sdAvailable) {
-        return SD.remove(path);
+    lockIo();
+    bool wasCached = dropCached(path);
+    bool success;
+    if (activeFs().exists(path)) {
+        success = activeFs().remove(path);
+    } else {
+        success = wasCached;  // Never reached the medium
     }
-#endif
-    return LittleFS.remove(path);
+    unlockIo();
+    return success;
 }
 
 bool Storage::exists(const String& path) {
+    std::shared_ptr<uint8_t> cached;
+    size_t cachedLen;
+    if (cacheLookup(path, cached, cachedLen, false)) {
+        return true;
+    }
 #ifdef ESP32S3
     if (sdAvailable) {
         return SD.exists(path);
@@ -190,6 +383,183 @@ bool Storage::exists(const String& path) {
     return LittleFS.exists(path);
 }
 
+bool Storage::rename(const String& from, const String& to) {
+    lockIo();
+    // The source must be on the medium, and a cached target would be flushed
+    // over the renamed file later
+    flushEntry(from);
+    dropCached(to);
+    
+    bool success;
+    if (!activeFs().exists(from)) {
+        success = false;
+    } else if (journalOpen) {
+        journalEntries.push_back(JournalEntry{from, to});
+        success = true;
+    } else {
+        success = replaceFile(from, to);
+    }
+    unlockIo();
+    return success;
+}
+
+bool Storage::replaceFile(const String& from, const String& to) {
+#ifdef ESP32S3
+    // FAT can't rename over an existing file. The remove + rename pair goes
+    // through the journal so a reset between the two is rolled forward
+    if (sdAvailable && SD.exists(to)) {
+        std::vector<JournalEntry> entries(1, JournalEntry{from, to});
+        return writeJournal(entries) && applyJournal(entries);
+    }
+#endif
+    // LittleFS renames replace the target atomically
+    if (!activeFs().rename(from, to)) {
+        DEBUG("Failed to rename %s -> %s\n", from.c_str(), to.c_str());
+        return false;
+    }
+    return true;
+}
+
+// The I/O lock is held from begin to commit/abort, so writes from other tasks
+// wait for the transaction instead of ending up in it
+bool Storage::beginJournal() {
+    lockIo();
+    if (journalOpen) {
+        DEBUG("Storage: Journal already open\n");
+        unlockIo();
+        return false;
+    }
+    journalEntries.clear();
+    journalOpen = true;
+    return true;
+}
+
+bool Storage::commitJournal() {
+    if (!journalOpen) {
+        return false;
+    }
+    journalOpen = false;
+    if (journalEntries.empty()) {
+        unlockIo();
+        return true;
+    }
+    
+    if (!writeJournal(journalEntries)) {
+        // Nothing has been renamed yet, so dropping the temp files undoes it all
+        for (const JournalEntry& entry : journalEntries) {
+            activeFs().remove(entry.from);
+        }
+        journalEntries.clear();
+        unlockIo();
+        return false;
+    }
+    
+    bool success = applyJournal(journalEntries);
+    DEBUG("Storage: Journal committed (%d files)\n", journalEntries.size());
+    journalEntries.clear();
+    unlockIo();
+    return success;
+}
+
+void Storage::abortJournal() {
+    if (!journalOpen) {
+        return;
+    }
+    for (const JournalEntry& entry : journalEntries) {
+        activeFs().remove(entry.from);
+    }
+    journalEntries.clear();
+    journalOpen = false;
+    unlockIo();
+}
+
+// Format: one "R\t<from>\t<to>" line per rename, then a "C" commit line.
+// The commit line is written last, so its presence means every entry made it
+bool Storage::writeJournal(const std::vector<JournalEntry>& entries) {
+    File file = activeFs().open(STORAGE_JOURNAL_PATH, FILE_WRITE);
+    if (!file) {
+        DEBUG("Storage: Failed to open journal\n");
+        return false;
+    }
+    bool ok = true;
+    for (const JournalEntry& entry : entries) {
+        String line = "R\t" + entry.from + "\t" + entry.to + "\n";
+        ok = ok && file.print(line) == line.length();
+    }
+    ok = ok && file.print("C\n") == 2;
+    file.flush();
+    file.close();
+    
+    if (!ok) {
+        activeFs().remove(STORAGE_JOURNAL_PATH);
+    }
+    return ok;
+}
+
+// Idempotent, so a reset during replay just replays again at the next mount
+bool Storage::applyJournal(const std::vector<JournalEntry>& entries) {
+    fs::FS& fs = activeFs();
+    bool success = true;
+    for (const JournalEntry& entry : entries) {
+        if (!fs.exists(entry.from)) {
+            continue;  // Already applied
+        }
+        if (fs.exists(entry.to)) {
+            fs.remove(entry.to);
+        }
+        if (!fs.rename(entry.from, entry.to)) {
+            DEBUG("Storage: Journal rename failed %s -> %s\n", entry.from.c_str(), entry.to.c_str());
+            success = false;
+        }
+    }
+    fs.remove(STORAGE_JOURNAL_PATH);
+    return success;
+}
+
+// Only the journal is read, so recovery time depends on the number of files
+// in the last transaction, not on how much data is stored. Temp files left by
+// a write that never reached the journal are ignored and overwritten later
+bool Storage::recoverJournal() {
+    fs::FS& fs = activeFs();
+    if (!fs.exists(STORAGE_JOURNAL_PATH)) {
+        return true;
+    }
+    
+    File file = fs.open(STORAGE_JOURNAL_PATH, FILE_READ);
+    if (!file) {
+        return false;
+    }
+    
+    std::vector<JournalEntry> entries;
+    bool committed = false;
+    while (file.available()) {
+        String line = file.readStringUntil('\n');
+        if (line == "C") {
+            committed = true;
+            break;
+        }
+        int fromStart = line.indexOf('\t');
+        int toStart = line.indexOf('\t', fromStart + 1);
+        if (!line.startsWith("R") || fromStart < 0 || toStart < 0) {
+            break;  // Torn entry, the commit line can't follow it
+        }
+        entries.push_back(JournalEntry{line.substring(fromStart + 1, toStart), line.substring(toStart + 1)});
+    }
+    file.close();
+    
+    if (committed) {
+        DEBUG("Storage: Rolling journal forward (%d files)\n", entries.size());
+        return applyJournal(entries);
+    }
+    
+    DEBUG("Storage: Rolling back incomplete journal (%d files)\n", entries.size());
+    for (const JournalEntry& entry : entries) {
+        fs.remove(entry.from);
+    }
+    fs.remove(STORAGE_JOURNAL_PATH);
+    return true;
+}
+
 bool Storage::mkdir(const String& path) {
 #ifdef ESP32S3
     if (sdAvailable) {
@@ -216,22 +586,45 @@ bool Storage::listDir(const String& path, std::vector<String>& files) {
             }
             file = root.openNextFile();
         }
-        return true;
-    }
+    } else
 #endif
-    
-    // LittleFS
-    File root = LittleFS.open(path);
-    if (!root || !root.isDirectory()) {
-        return false;
+    {
+        // LittleFS
+        File root = LittleFS.open(path);
+        if (!root || !root.isDirectory()) {
+            return false;
+        }
+        
+        File file = root.openNextFile();
+        while (file) {
+            if (!file.isDirectory()) {
+                files.push_back(String(file.name()));
+            }
+            file = root.openNextFile();
+        }
     }
     
-    File file = root.openNextFile();
-    while (file) {
-        if (!file.isDirectory()) {
-            files.push_back(String(file.name()));
+    // Add files that so far only exist in the write-behind cache
+    if (cacheMutex) {
+        String prefix = path.endsWith("/") ? path : path + "/";
+        xSemaphoreTake(cacheMutex, portMAX_DELAY);
+        for (const CacheEntry& entry : cache) {
+            if (!entry.path.startsWith(prefix) || entry.path.indexOf('/', prefix.length()) >= 0) {
+                continue;
+            }
+            String name = entry.path.substring(prefix.length());
+            bool listed = false;
+            for (const String& existing : files) {
+                if (existing == name) {
+                    listed = true;
+                    break;
+                }
+            }
+            if (!listed) {
+                files.push_back(name);
+            }
         }
-        file = root.openNextFile();
+        xSemaphoreGive(cacheMutex);
     }
     return true;
 }
@@ -292,6 +685,8 @@ bool Storage::migrateSoundsToSD() {
         DEBUG("✅ Migration complete!\n");
         DEBUG("You can now delete /sounds from LittleFS to free space\n");
     } else {
+        // Nothing was moved in - drop the empty directory so the next boot retries
+        SD.rmdir("/sounds");
         DEBUG("❌ Migration failed\n");
     }
     
@@ -301,6 +696,20 @@ bool Storage::migrateSoundsToSD() {
 #endif
 }
 
+bool Storage::copyFile(File& src, File& dst, uint8_t* buf, size_t bufSize, size_t* copied) {
+    size_t total = 0;
+    size_t bytesRead;
+    while ((bytesRead = src.read(buf, bufSize)) > 0) {
+        if (dst.write(buf, bytesRead) != bytesRead) {
+            if (copied) *copied = total;
+            return false;
+        }
+        total += bytesRead;
+    }
+    if (copied) *copied = total;
+    return true;
+}
+
 bool Storage::copyDirectory(const String& srcPath, const String& dstPath, bool deleteSource) {
     DEBUG("Copying %s to SD card...\n", srcPath.c_str());
     
@@ -310,21 +719,33 @@ bool Storage::copyDirectory(const String& srcPath, const String& dstPath, bool d
         return false;
     }
     
+    // Files are copied to temp names and only renamed into place together,
+    // so an interrupted migration never leaves a half-populated directory
+    if (!beginJournal()) {
+        srcDir.close();
+        return false;
+    }
+    
     int fileCount = 0;
     int errorCount = 0;
     uint32_t totalBytes = 0;
+    std::vector<String> copiedSources;
+    
+    // One copy buffer for the whole migration, reused for every file
+    uint8_t buffer[STORAGE_COPY_BUFFER_SIZE];
     
     File file = srcDir.openNextFile();
     while (file) {
         if (!file.isDirectory()) {
             String fileName = String(file.name());
-            String dstFilePath = dstPath + "/" + fileName.substring(fileName.lastIndexOf('/') + 1);
+            String baseName = fileName.substring(fileName.lastIndexOf('/') + 1);
+            String dstFilePath = dstPath + "/" + baseName;
             
             DEBUG("  Copying: %s -> %s", fileName.c_str(), dstFilePath.c_str());
             
             // Open destination file on SD
 #ifdef ESP32S3
-            File dstFile = SD.open(dstFilePath, FILE_WRITE);
+            File dstFile = SD.open(tempPath(dstFilePath), FILE_WRITE);
             if (!dstFile) {
                 DEBUG(" [FAIL - can't open dest]\n");
                 errorCount++;
@@ -332,26 +753,21 @@ bool Storage::copyDirectory(const String& srcPath, const String& dstPath, bool d
                 continue;
             }
             
-            // Copy data in chunks
-            uint8_t buffer[512];
-            size_t fileSize = file.size();
-            size_t bytesRead;
+            size_t copied = 0;
+            bool ok = copyFile(file, dstFile, buffer, sizeof(buffer), &copied);
             
-            while ((bytesRead = file.read(buffer, sizeof(buffer))) > 0) {
-                dstFile.write(buffer, bytesRead);
+            if (!finishWrite(dstFilePath, dstFile, ok)) {
+                DEBUG(" [FAIL - write error after %d bytes]\n", copied);
+                errorCount++;
+                file = srcDir.openNextFile();
+                continue;
             }
             
-            dstFile.close();
-            totalBytes += fileSize;
+            totalBytes += copied;
             fileCount++;
+            copiedSources.push_back(srcPath + "/" + baseName);
             
-            DEBUG(" [OK - %d bytes]\n", fileSize);
-            
-            // Delete source file if requested
-            if (deleteSource) {
-                LittleFS.remove(fileName);
-                DEBUG("  Deleted source file\n");
-            }
+            DEBUG(" [OK - %d bytes]\n", copied);
 #endif
         }
         file = srcDir.openNextFile();
@@ -359,8 +775,246 @@ bool Storage::copyDirectory(const String& srcPath, const String& dstPath, bool d
     
     srcDir.close();
     
-    DEBUG("\nCopied %d files (%d KB) with %d errors\n", 
-          fileCount, totalBytes / 1024, errorCount);
+    if (errorCount > 0) {
+        abortJournal();
+        DEBUG("\nCopy aborted with %d errors, nothing moved\n", errorCount);
+        return false;
+    }
     
-    return errorCount == 0;
+    if (!commitJournal()) {
+        DEBUG("\nFailed to commit copied files\n");
+        return false;
+    }
+    
+    // Sources go only after the copies are committed
+    if (deleteSource) {
+        for (const String& srcFile : copiedSources) {
+            LittleFS.remove(srcFile);
+        }
+        DEBUG("Deleted %d source files\n", copiedSources.size());
+    }
+    
+    DEBUG("\nCopied %d files (%d KB)\n", fileCount, totalBytes / 1024);
+    
+    return true;
+}
+
+void Storage::lockIo() {
+    if (ioMutex) {
+        xSemaphoreTakeRecursive(ioMutex, portMAX_DELAY);
+    }
+}
+
+void Storage::unlockIo() {
+    if (ioMutex) {
+        xSemaphoreGiveRecursive(ioMutex);
+    }
+}
+
+// Returns a buffer for a cached write, or nullptr when the write has to go
+// through synchronously (cache not running, journal open, too big, cache full)
+uint8_t* Storage::cacheAlloc(size_t len) {
+    if (!flushTask || journalOpen || len == 0 || len > STORAGE_CACHE_MAX_ENTRY_BYTES) {
+        return nullptr;
+    }
+    
+    xSemaphoreTake(cacheMutex, portMAX_DELAY);
+    bool fits = cacheBytes + len <= cacheLimit;
+    if (!fits) {
+        stats.writeThroughs++;
+    }
+    xSemaphoreGive(cacheMutex);
+    if (!fits) {
+        requestFlush();
+        return nullptr;
+    }
+    
+    uint8_t* buf = (uint8_t*)(psramFound() ? ps_malloc(len) : malloc(len));
+    if (!buf) {
+        xSemaphoreTake(cacheMutex, portMAX_DELAY);
+        stats.writeThroughs++;
+        xSemaphoreGive(cacheMutex);
+    }
+    return buf;
+}
+
+void Storage::cacheStore(const String& path, uint8_t* buf, size_t len) {
+    xSemaphoreTake(cacheMutex, portMAX_DELAY);
+    CacheEntry* entry = nullptr;
+    for (CacheEntry& e : cache) {
+        if (e.path == path) {
+            entry = &e;
+            break;
+        }
+    }
+    
+    if (entry) {
+        // Coalesce - only the newest version is ever written out
+        cacheBytes -= entry->len;
+        stats.coalesced++;
+    } else {
+        cache.push_back(CacheEntry());
+        entry = &cache.back();
+        entry->path = path;
+        entry->dirtySinceMs = millis();
+    }
+    entry->data.reset(buf, free);
+    entry->len = len;
+    entry->gen = ++cacheGen;
+    cacheBytes += len;
+    xSemaphoreGive(cacheMutex);
+}
+
+bool Storage::cacheLookup(const String& path, std::shared_ptr<uint8_t>& data, size_t& len, bool countStats) {
+    if (!cacheMutex) {
+        return false;
+    }
+    bool found = false;
+    xSemaphoreTake(cacheMutex, portMAX_DELAY);
+    for (const CacheEntry& entry : cache) {
+        if (entry.path == path) {
+            data = entry.data;
+            len = entry.len;
+            found = true;
+            break;
+        }
+    }
+    if (countStats) {
+        if (found) {
+            stats.cacheHits++;
+        } else {
+            stats.cacheMisses++;
+        }
+    }
+    xSemaphoreGive(cacheMutex);
+    return found;
+}
+
+bool Storage::dropCached(const String& path) {
+    if (!cacheMutex) {
+        return false;
+    }
+    bool dropped = false;
+    xSemaphoreTake(cacheMutex, portMAX_DELAY);
+    for (size_t i = 0; i < cache.size(); i++) {
+        if (cache[i].path == path) {
+            cacheBytes -= cache[i].len;
+            cache.erase(cache.begin() + i);
+            dropped = true;
+            break;
+        }
+    }
+    xSemaphoreGive(cacheMutex);
+    return dropped;
+}
+
+bool Storage::flushEntry(const String& path) {
+    if (!cacheMutex) {
+        return true;
+    }
+    
+    lockIo();
+    std::shared_ptr<uint8_t> data;
+    size_t len = 0;
+    uint32_t gen = 0;
+    bool found = false;
+    xSemaphoreTake(cacheMutex, portMAX_DELAY);
+    for (const CacheEntry& entry : cache) {
+        if (entry.path == path) {
+            data = entry.data;
+            len = entry.len;
+            gen = entry.gen;
+            found = true;
+            break;
+        }
+    }
+    xSemaphoreGive(cacheMutex);
+    
+    if (!found) {
+        unlockIo();
+        return true;
+    }
+    
+    // Written without the cache lock, so readers and writers aren't held up
+    uint32_t startUs = micros();
+    bool success = writeDirect(path, data.get(), len);
+    uint32_t elapsedUs = micros() - startUs;
+    
+    xSemaphoreTake(cacheMutex, portMAX_DELAY);
+    if (success) {
+        stats.filesFlushed++;
+        // Only clean if nobody rewrote it meanwhile, a newer version stays dirty
+        for (size_t i = 0; i < cache.size(); i++) {
+            if (cache[i].path == path && cache[i].gen == gen) {
+                cacheBytes -= cache[i].len;
+                cache.erase(cache.begin() + i);
+                break;
+            }
+        }
+    } else {
+        stats.flushErrors++;
+    }
+    stats.lastFlushUs = elapsedUs;
+    stats.totalFlushUs += elapsedUs;
+    if (elapsedUs > stats.maxFlushUs) {
+        stats.maxFlushUs = elapsedUs;
+    }
+    xSemaphoreGive(cacheMutex);
+    
+    unlockIo();
+    return success;
+}
+
+void Storage::flushDirty(bool all) {
+    std::vector<String> paths;
+    uint32_t now = millis();
+    xSemaphoreTake(cacheMutex, portMAX_DELAY);
+    for (const CacheEntry& entry : cache) {
+        if (all || now - entry.dirtySinceMs >= flushIntervalMs) {
+            paths.push_back(entry.path);
+        }
+    }
+    xSemaphoreGive(cacheMutex);
+    
+    for (const String& path : paths) {
+        flushEntry(path);
+    }
+}
+
+void Storage::flush() {
+    if (!flushTask) {
+        return;
+    }
+    flushDirty(true);
+}
+
+void Storage::requestFlush() {
+    if (flushTask) {
+        xTaskNotifyGive(flushTask);
+    }
+}
+
+StorageStats Storage::getStats() {
+    StorageStats snapshot;
+    memset(&snapshot, 0, sizeof(snapshot));
+    if (!cacheMutex) {
+        return snapshot;
+    }
+    xSemaphoreTake(cacheMutex, portMAX_DELAY);
+    snapshot = stats;
+    snapshot.dirtyFiles = cache.size();
+    snapshot.dirtyBytes = cacheBytes;
+    xSemaphoreGive(cacheMutex);
+    return snapshot;
+}
+
+void Storage::flushTaskFn(void* arg) {
+    Storage* self = (Storage*)arg;
+    for (;;) {
+        // Polls at a fraction of the interval so entries don't sit much past
+        // it, and wakes straight away on requestFlush()
+        uint32_t pollMs = max((uint32_t)100, (uint32_t)(self->flushIntervalMs / 4));
+        bool requested = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(pollMs)) > 0;
+        self->flushDirty(requested);
+    }
 }
@@ -2,7 +2,12 @@
 #define STORAGE_H
 
 #include <Arduino.h>
+#include <ArduinoJson.h>
+#include <memory>
 #include <vector>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
 
 #ifdef ESP32S3
 #include <SD.h>
@@ -11,6 +16,33 @@
 
 #include <LittleFS.h>
 
+#define STORAGE_COPY_BUFFER_SIZE 512
+#define STORAGE_TEMP_SUFFIX ".tmp"
+#define STORAGE_JOURNAL_PATH "/.journal"
+
+// Write-behind cache. Files larger than an entry, or arriving while the cache
+// is full, are written through synchronously
+#define STORAGE_CACHE_MAX_ENTRY_BYTES (32 * 1024)
+#define STORAGE_CACHE_MAX_BYTES (64 * 1024)
+#define STORAGE_CACHE_MAX_BYTES_PSRAM (512 * 1024)
+#define STORAGE_FLUSH_INTERVAL_MS 2000
+#define STORAGE_FLUSH_TASK_STACK 4096
+
+struct StorageStats {
+    uint32_t cacheHits;       // Reads served from dirty cache entries
+    uint32_t cacheMisses;     // Reads that went to the medium
+    uint32_t coalesced;       // Writes that replaced a not-yet-flushed version
+    uint32_t writeThroughs;   // Writes that bypassed the cache
+    uint32_t filesFlushed;
+    uint32_t flushErrors;
+    uint32_t lastFlushUs;     // Latency of the most recent file flush
+    uint32_t maxFlushUs;
+    uint64_t totalFlushUs;
+    uint64_t bytesWritten;    // Bytes actually written to the medium
+    uint32_t dirtyFiles;
+    uint32_t dirtyBytes;
+};
+
 class Storage {
    public:
     Storage();
@@ -18,26 +50,105 @@ class Storage {
     bool initSDDeferred();  // Initialize SD card after boot
     bool isSDAvailable() const { return sdAvailable; }
     
-    // File operations - automatically use SD if available, fall back to LittleFS
+    // File operations - automatically use SD if available, fall back to LittleFS.
+    // Writes go to <path>.tmp and are renamed over <path> once flushed, so a
+    // reset mid-write leaves the previous version intact
     bool writeFile(const String& path, const String& data);
+    bool writeFile(const String& path, const uint8_t* data, size_t len);
     bool readFile(const String& path, String& data);
     bool deleteFile(const String& path);
     bool exists(const String& path);
     bool mkdir(const String& path);
     bool listDir(const String& path, std::vector<String>& files);
+    bool rename(const String& from, const String& to);
+    
+    // Streaming file operations - data moves through caller-provided buffers,
+    // so peak heap is bounded by the buffer size instead of the file size
+    File openRead(const String& path);
+    File openWrite(const String& path);
+    File openAppend(const String& path);
+    size_t readAt(const String& path, size_t offset, uint8_t* buf, size_t len);
+    size_t fileSize(const String& path);
+    
+    // JSON documents are serialized straight to/from the file, no String copy
+    bool writeJson(const String& path, const JsonDocument& doc);
+    bool readJson(const String& path, JsonDocument& doc);
     
     // Storage info
     uint64_t getTotalBytes();
     uint64_t getUsedBytes();
     uint64_t getFreeBytes();
     String getStorageType() const { return sdAvailable ? "SD" : "LittleFS"; }
+    fs::FS& activeFs();  // Backing filesystem, for handing files to the web server
     
     // Migration helpers
     bool migrateSoundsToSD();
     bool copyDirectory(const String& srcPath, const String& dstPath, bool deleteSource = false);
+    static bool copyFile(File& src, File& dst, uint8_t* buf, size_t bufSize, size_t* copied = nullptr);
+    
+    // Multi-file transactions - between begin and commit, writes and renames
+    // are only staged. Commit logs them to the journal, then applies them;
+    // a journal found at mount is rolled forward if complete, back if not
+    bool beginJournal();
+    bool commitJournal();
+    void abortJournal();
+    bool isJournalOpen() const { return journalOpen; }
+    
+    // Write-behind cache - writeFile()/writeJson() land in RAM (PSRAM when
+    // present) and a background task writes them out once they have been dirty
+    // for the flush interval. Reads see cached data. flush() is a barrier:
+    // everything written before the call is on the medium when it returns
+    void flush();
+    void requestFlush();  // Wake the flush task, e.g. when a race stops
+    void setFlushInterval(uint32_t ms) { flushIntervalMs = ms; }
+    uint32_t getFlushInterval() const { return flushIntervalMs; }
+    StorageStats getStats();
     
    private:
+    struct JournalEntry {
+        String from;
+        String to;
+    };
+    
+    struct CacheEntry {
+        String path;
+        std::shared_ptr<uint8_t> data;  // Shared so a flush can write it without holding the lock
+        size_t len;
+        uint32_t gen;                   // Bumped on every write, so a flush knows if it went stale
+        uint32_t dirtySinceMs;
+    };
+    
     bool sdAvailable;
+    bool journalOpen;
+    std::vector<JournalEntry> journalEntries;
+    
+    std::vector<CacheEntry> cache;
+    size_t cacheBytes;
+    size_t cacheLimit;
+    uint32_t cacheGen;
+    volatile uint32_t flushIntervalMs;
+    StorageStats stats;
+    SemaphoreHandle_t cacheMutex;  // Guards cache and stats, never held during I/O
+    SemaphoreHandle_t ioMutex;     // Recursive, orders flushes against write-through/delete/rename
+    TaskHandle_t flushTask;
+    
+    static void flushTaskFn(void* arg);
+    uint8_t* cacheAlloc(size_t len);
+    void cacheStore(const String& path, uint8_t* buf, size_t len);
+    bool cacheLookup(const String& path, std::shared_ptr<uint8_t>& data, size_t& len, bool countStats = true);
+    bool dropCached(const String& path);
+    bool flushEntry(const String& path);
+    void flushDirty(bool all);
+    bool writeDirect(const String& path, const uint8_t* data, size_t len);
+    void lockIo();
+    void unlockIo();
+    
+    static String tempPath(const String& path) { return path + STORAGE_TEMP_SUFFIX; }
+    bool finishWrite(const String& path, File& file, bool ok);
+    bool replaceFile(const String& from, const String& to);
+    bool writeJournal(const std::vector<JournalEntry>& entries);
+    bool applyJournal(const std::vector<JournalEntry>& entries);
+    bool recoverJournal();
     
 #ifdef ESP32S3
     bool initSD();
@@ -43,12 +43,9 @@ bool TrackManager::createTrack(const Track& track) {
     trackObj["notes"] = track.notes;
     trackObj["imagePath"] = track.imagePath;
     
-    String json;
-    serializeJson(doc, json);
-    
-    bool success = storage->writeFile(filepath, json);
+    bool success = storage->writeJson(filepath, doc);
     if (success) {
-        DEBUG("Saved track to %s (%d bytes)\n", filepath.c_str(), json.length());
+        DEBUG("Saved track to %s (%d bytes)\n", filepath.c_str(), measureJson(doc));
         
         // Add to in-memory list
         tracks.insert(tracks.begin(), track);
@@ -84,16 +81,9 @@ bool TrackManager::loadTracks() {
         }
         
         String filepath = String(TRACKS_DIR) + "/" + filename;
-        String json;
-        if (!storage->readFile(filepath, json)) {
-            DEBUG("Failed to read %s\n", filepath.c_str());
-            continue;
-        }
-        
         DynamicJsonDocument doc(2048);
-        DeserializationError error = deserializeJson(doc, json);
-        if (error) {
-            DEBUG("Failed to parse %s: %s\n", filepath.c_str(), error.c_str());
+        if (!storage->readJson(filepath, doc)) {
+            DEBUG("Failed to read %s\n", filepath.c_str());
             continue;
         }
         
@@ -172,10 +162,7 @@ bool TrackManager::updateTrack(uint32_t trackId, const Track& updatedTrack) {
     trackObj["notes"] = targetTrack->notes;
     trackObj["imagePath"] = targetTrack->imagePath;
     
-    String json;
-    serializeJson(doc, json);
-    
-    return storage->writeFile(filepath, json);
+    return storage->writeJson(filepath, doc);
 }
 
 bool TrackManager::clearAll() {
@@ -203,9 +190,8 @@ bool TrackManager::clearAll() {
     return true;
 }
 
-String TrackManager::toJsonString() {
-    DynamicJsonDocument doc(16384);
-    JsonArray tracksArray = doc.createNestedArray("tracks");
+void TrackManager::toJson(JsonObject destination) {
+    JsonArray tracksArray = destination.createNestedArray("tracks");
     
     for (const auto& track : tracks) {
         JsonObject trackObj = tracksArray.createNestedObject();
@@ -216,7 +202,11 @@ String TrackManager::toJsonString() {
         trackObj["notes"] = track.notes;
         trackObj["imagePath"] = track.imagePath;
     }
-    
+}
+
+String TrackManager::toJsonString() {
+    DynamicJsonDocument doc(16384);
+    toJson(doc.to<JsonObject>());
     String output;
     serializeJson(doc, output);
     return output;
@@ -236,36 +226,92 @@ bool TrackManager::saveTrackImage(uint32_t trackId, const uint8_t* imageData, si
         return false;
     }
     
-    // Limit image size to 500KB
-    if (imageSize > 512000) {
-        DEBUG("Track image too large: %d bytes (max 500KB)\n", imageSize);
+    File tmpFile = beginTrackImage(trackId);
+    if (!tmpFile) {
+        return false;
+    }
+    if (!appendTrackImage(tmpFile, 0, imageData, imageSize)) {
+        abortTrackImage(trackId, tmpFile);
+        return false;
+    }
+    return commitTrackImage(trackId, tmpFile);
+}
+
+File TrackManager::beginTrackImage(uint32_t trackId) {
+    if (!storage || !getTrackById(trackId)) {
+        return File();
+    }
+    
+    if (!storage->exists(TRACK_IMAGES_DIR)) {
+        storage->mkdir(TRACK_IMAGES_DIR);
+    }
+    
+    File tmpFile = storage->openWrite(getTrackImageTempPath(trackId));
+    if (!tmpFile) {
+        DEBUG("Failed to open temp image file for track %u\n", trackId);
+    }
+    return tmpFile;
+}
+
+bool TrackManager::appendTrackImage(File& tmpFile, size_t offset, const uint8_t* data, size_t len) {
+    if (!tmpFile) {
+        return false;
+    }
+    // Checked per chunk so an oversized upload is cut off as soon as it crosses the limit
+    if (offset + len > TRACK_IMAGE_MAX_BYTES) {
+        DEBUG("Track image too large: >%u bytes (max 500KB)\n", (unsigned)(offset + len));
+        return false;
+    }
+    return tmpFile.write(data, len) == len;
+}
+
+bool TrackManager::commitTrackImage(uint32_t trackId, File& tmpFile) {
+    if (!tmpFile) {
         return false;
     }
+    size_t imageSize = tmpFile.size();
+    tmpFile.close();
     
-    String imagePath = String(TRACK_IMAGES_DIR) + "/" + String(trackId) + ".jpg";
+    String tmpPath = getTrackImageTempPath(trackId);
+    if (imageSize == 0) {
+        storage->deleteFile(tmpPath);
+        return false;
+    }
     
-    // Convert byte array to String for storage (not ideal but works with current storage API)
-    String imageDataStr;
-    imageDataStr.reserve(imageSize);
-    for (size_t i = 0; i < imageSize; i++) {
-        imageDataStr += (char)imageData[i];
+    String imagePath = getTrackImagePath(trackId);
+    if (!storage->rename(tmpPath, imagePath)) {
+        storage->deleteFile(tmpPath);
+        return false;
     }
     
-    bool success = storage->writeFile(imagePath, imageDataStr);
-    if (success) {
-        // Update track's imagePath
-        Track* track = getTrackById(trackId);
-        if (track) {
-            track->imagePath = imagePath;
-            updateTrack(trackId, *track);
-        }
+    // Update track's imagePath
+    Track* track = getTrackById(trackId);
+    if (track) {
+        track->imagePath = imagePath;
+        updateTrack(trackId, *track);
     }
     
-    return success;
+    DEBUG("Track image saved: %s (%u bytes)\n", imagePath.c_str(), (unsigned)imageSize);
+    return true;
+}
+
+void TrackManager::abortTrackImage(uint32_t trackId, File& tmpFile) {
+    if (tmpFile) {
+        tmpFile.close();
+    }
+    if (storage) {
+        storage->deleteFile(getTrackImageTempPath(trackId));
+    }
 }
 
 bool TrackManager::deleteTrackImage(uint32_t trackId) {
-    String imagePath = String(TRACK_IMAGES_DIR) + "/" + String(trackId) + ".jpg";
+    String imagePath = getTrackImagePath(trackId);
+    
+    // Drop any upload left half-written by a reset
+    String tmpPath = getTrackImageTempPath(trackId);
+    if (storage->exists(tmpPath)) {
+        storage->deleteFile(tmpPath);
+    }
     
     if (storage->exists(imagePath)) {
         return storage->deleteFile(imagePath);
@@ -277,3 +323,7 @@ bool TrackManager::deleteTrackImage(uint32_t trackId) {
 String TrackManager::getTrackImagePath(uint32_t trackId) {
     return String(TRACK_IMAGES_DIR) + "/" + String(trackId) + ".jpg";
 }
+
+String TrackManager::getTrackImageTempPath(uint32_t trackId) {
+    return String(TRACK_IMAGES_DIR) + "/" + String(trackId) + ".tmp";
+}
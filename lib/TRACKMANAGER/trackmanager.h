@@ -9,6 +9,7 @@
 #define MAX_TRACKS 50
 #define TRACKS_DIR "/tracks"
 #define TRACK_IMAGES_DIR "/tracks/images"
+#define TRACK_IMAGE_MAX_BYTES 512000
 
 struct Track {
     uint32_t trackId;           // Timestamp-based unique ID
@@ -28,6 +29,7 @@ class TrackManager {
     bool deleteTrack(uint32_t trackId);
     bool updateTrack(uint32_t trackId, const Track& updatedTrack);
     bool clearAll();
+    void toJson(JsonObject destination);
     String toJsonString();
     Track* getTrackById(uint32_t trackId);
     const std::vector<Track>& getTracks() const { return tracks; }
@@ -37,11 +39,19 @@ class TrackManager {
     bool saveTrackImage(uint32_t trackId, const uint8_t* imageData, size_t imageSize);
     bool deleteTrackImage(uint32_t trackId);
     String getTrackImagePath(uint32_t trackId);
+    
+    // Streaming image upload - chunks are appended to a temp file which only
+    // replaces the current image once the upload has completed
+    File beginTrackImage(uint32_t trackId);
+    bool appendTrackImage(File& tmpFile, size_t offset, const uint8_t* data, size_t len);
+    bool commitTrackImage(uint32_t trackId, File& tmpFile);
+    void abortTrackImage(uint32_t trackId, File& tmpFile);
 
    private:
     std::vector<Track> tracks;
     Storage* storage;
     String generateFilename(uint32_t trackId);
+    String getTrackImageTempPath(uint32_t trackId);
 };
 
 #endif
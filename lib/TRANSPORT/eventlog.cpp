@@ -0,0 +1,31 @@
+#include "eventlog.h"
+
+void EventLog::init() {
+    if (!mutex) {
+        mutex = xSemaphoreCreateRecursiveMutex();
+    }
+}
+
+uint32_t EventLog::append(uint8_t type, uint32_t deviceTimeMs, uint32_t value) {
+    RaceEvent &event = events[nextId % EVENT_LOG_SIZE];
+    event.id = nextId;
+    event.deviceTimeMs = deviceTimeMs;
+    event.value = value;
+    event.type = type;
+    return nextId++;
+}
+
+bool EventLog::covers(uint32_t afterId) const {
+    uint32_t oldestId = nextId > EVENT_LOG_SIZE ? nextId - EVENT_LOG_SIZE : 1;
+    return afterId < nextId && afterId + 1 >= oldestId;
+}
+
+size_t EventLog::since(uint32_t afterId, RaceEvent *out, size_t max) const {
+    uint32_t oldestId = nextId > EVENT_LOG_SIZE ? nextId - EVENT_LOG_SIZE : 1;
+    uint32_t id = afterId + 1 > oldestId ? afterId + 1 : oldestId;
+    size_t count = 0;
+    for (; id < nextId && count < max; id++) {
+        out[count++] = events[id % EVENT_LOG_SIZE];
+    }
+    return count;
+}
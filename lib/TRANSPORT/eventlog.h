@@ -0,0 +1,57 @@
+#ifndef EVENTLOG_H
+#define EVENTLOG_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+// Race events kept for replay, the laps of a few races
+#define EVENT_LOG_SIZE 64
+// Events copied out per since() call by the replays
+#define EVENT_LOG_CHUNK 16
+
+typedef enum {
+    RACE_EVENT_LAP = 1,      // value = lap time ms
+    RACE_EVENT_STARTED = 2,
+    RACE_EVENT_STOPPED = 3,
+    RACE_EVENT_ARMED = 4     // value = start tone time, device ms
+} race_event_e;
+
+struct RaceEvent {
+    uint32_t id;
+    uint32_t deviceTimeMs;
+    uint32_t value;
+    uint8_t type;  // race_event_e
+};
+
+// Lap and race state events with ids, counting up from 1 at boot, and a
+// ring of the last EVENT_LOG_SIZE for clients that reconnect. RSSI has no
+// ids: it isn't replayed (GET /rssi/history covers a gap), and an id on it
+// would move an SSE client's Last-Event-ID past laps it never got.
+//
+// The lock orders events: a broadcast appends and sends under it, and a
+// replay holds it, so no transport sees a live event before an older
+// replayed one. Recursive, a command run under it may broadcast
+class EventLog {
+   public:
+    void init();
+    void lock() { xSemaphoreTakeRecursive(mutex, portMAX_DELAY); }
+    void unlock() { xSemaphoreGiveRecursive(mutex); }
+
+    // Under lock(). Returns the new event's id
+    uint32_t append(uint8_t type, uint32_t deviceTimeMs, uint32_t value);
+    uint32_t lastId() const { return nextId - 1; }
+
+    // True if every event after afterId is still kept, so a client that
+    // saw afterId can catch up. An id from before a reboot is not
+    bool covers(uint32_t afterId) const;
+    // Up to max events after afterId, oldest first. Under lock()
+    size_t since(uint32_t afterId, RaceEvent *out, size_t max) const;
+
+   private:
+    RaceEvent events[EVENT_LOG_SIZE];
+    uint32_t nextId = 1;
+    SemaphoreHandle_t mutex = nullptr;
+};
+
+#endif
@@ -3,65 +3,129 @@
 
 #include <Arduino.h>
 
+#include "debug.h"
+#include "eventlog.h"
+
 // Abstract transport interface for sending events to clients
 // Supports multiple simultaneous transports (WiFi, USB, etc.)
+//
+// Every event carries deviceTimeMs, the device's millis() when it happened
+// (for laps: when the gate was crossed). Clients map it to their own clock
+// with the offset and drift from /api/time (USB: time), see
+// tools/clock_sync
+//
+// Lap and race events also carry eventId, their id in the EventLog (0 for
+// events sent to one transport only). A client that reconnects asks for
+// the events after the last id it saw, see EventLog
 class TransportInterface {
    public:
     virtual ~TransportInterface() {}
     
     // Send lap time event to all connected clients
-    virtual void sendLapEvent(uint32_t lapTimeMs) = 0;
+    virtual void sendLapEvent(uint32_t lapTimeMs, uint32_t deviceTimeMs, uint32_t eventId) = 0;
     
     // Send RSSI value to all connected clients (if streaming enabled)
-    virtual void sendRssiEvent(uint8_t rssi) = 0;
+    virtual void sendRssiEvent(uint8_t rssi, uint32_t deviceTimeMs) = 0;
     
     // Send race state event (started/stopped)
-    virtual void sendRaceStateEvent(const char* state) = 0;
+    virtual void sendRaceStateEvent(const char* state, uint32_t deviceTimeMs, uint32_t eventId) = 0;
+
+    // Send the start tone time of an armed start (device millis())
+    virtual void sendRaceArmedEvent(uint32_t startTimeMs, uint32_t deviceTimeMs, uint32_t eventId) = 0;
     
     // Check if transport is ready/connected
     virtual bool isConnected() = 0;
     
     // Update transport (process incoming data, etc.)
     virtual void update(uint32_t currentTimeMs) = 0;
+
+    // Sends a logged event again, for replays
+    void sendRaceEvent(const RaceEvent& event) {
+        switch (event.type) {
+            case RACE_EVENT_LAP:
+                sendLapEvent(event.value, event.deviceTimeMs, event.id);
+                break;
+            case RACE_EVENT_STARTED:
+            case RACE_EVENT_STOPPED:
+                sendRaceStateEvent(event.type == RACE_EVENT_STARTED ? "started" : "stopped", event.deviceTimeMs, event.id);
+                break;
+            case RACE_EVENT_ARMED:
+                sendRaceArmedEvent(event.value, event.deviceTimeMs, event.id);
+                break;
+        }
+    }
 };
 
 // Transport manager - manages multiple transports and broadcasts to all
 class TransportManager {
    public:
     TransportManager() : transportCount(0) {}
+
+    void init() { eventLog.init(); }
+    EventLog* getEventLog() { return &eventLog; }
     
-    // Register a transport
-    void addTransport(TransportInterface* transport) {
-        if (transportCount < MAX_TRANSPORTS) {
-            transports[transportCount++] = transport;
+    // Register a transport. False, and nothing gets its events, if all
+    // MAX_TRANSPORTS are taken
+    bool addTransport(TransportInterface* transport) {
+        if (transportCount >= MAX_TRANSPORTS) {
+            DEBUG("TransportManager full (%u), transport not added\n", (unsigned)MAX_TRANSPORTS);
+            return false;
         }
+        transports[transportCount++] = transport;
+        return true;
     }
     
-    // Broadcast lap event to all transports
-    void broadcastLapEvent(uint32_t lapTimeMs) {
+    // Broadcast lap event to all transports. deviceTimeMs is the gate
+    // crossing; manual laps are stamped now
+    void broadcastLapEvent(uint32_t lapTimeMs, uint32_t deviceTimeMs) {
+        eventLog.lock();
+        uint32_t eventId = eventLog.append(RACE_EVENT_LAP, deviceTimeMs, lapTimeMs);
         for (uint8_t i = 0; i < transportCount; i++) {
             if (transports[i] && transports[i]->isConnected()) {
-                transports[i]->sendLapEvent(lapTimeMs);
+                transports[i]->sendLapEvent(lapTimeMs, deviceTimeMs, eventId);
             }
         }
+        eventLog.unlock();
+    }
+    
+    void broadcastLapEvent(uint32_t lapTimeMs) {
+        broadcastLapEvent(lapTimeMs, millis());
     }
     
     // Broadcast RSSI event to all transports
     void broadcastRssiEvent(uint8_t rssi) {
+        uint32_t now = millis();
         for (uint8_t i = 0; i < transportCount; i++) {
             if (transports[i] && transports[i]->isConnected()) {
-                transports[i]->sendRssiEvent(rssi);
+                transports[i]->sendRssiEvent(rssi, now);
             }
         }
     }
     
     // Broadcast race state event to all transports
     void broadcastRaceStateEvent(const char* state) {
+        uint32_t now = millis();
+        eventLog.lock();
+        uint32_t eventId = eventLog.append(strcmp(state, "started") == 0 ? RACE_EVENT_STARTED : RACE_EVENT_STOPPED, now, 0);
+        for (uint8_t i = 0; i < transportCount; i++) {
+            if (transports[i] && transports[i]->isConnected()) {
+                transports[i]->sendRaceStateEvent(state, now, eventId);
+            }
+        }
+        eventLog.unlock();
+    }
+    
+    // Broadcast an armed start to all transports
+    void broadcastRaceArmedEvent(uint32_t startTimeMs) {
+        uint32_t now = millis();
+        eventLog.lock();
+        uint32_t eventId = eventLog.append(RACE_EVENT_ARMED, now, startTimeMs);
         for (uint8_t i = 0; i < transportCount; i++) {
             if (transports[i] && transports[i]->isConnected()) {
-                transports[i]->sendRaceStateEvent(state);
+                transports[i]->sendRaceArmedEvent(startTimeMs, now, eventId);
             }
         }
+        eventLog.unlock();
     }
     
     // Update all transports
@@ -74,9 +138,10 @@ class TransportManager {
     }
     
    private:
-    static const uint8_t MAX_TRANSPORTS = 4;  // WiFi + USB + future transports
+    static const uint8_t MAX_TRANSPORTS = 8;  // SSE, USB, /ws and UDP use 4
     TransportInterface* transports[MAX_TRANSPORTS];
     uint8_t transportCount;
+    EventLog eventLog;
 };
 
 #endif  // TRANSPORT_H
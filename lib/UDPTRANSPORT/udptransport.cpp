@@ -0,0 +1,88 @@
+#include "udptransport.h"
+
+#include <WiFi.h>
+
+#include "debug.h"
+
+// Largest payload sent
+#define UDP_PAYLOAD_MAX sizeof(UsbRaceSummaryFrame)
+
+void UdpTransport::init(EventLog *log) {
+    eventLog = log;
+    timerId = (uint32_t)(ESP.getEfuseMac() >> 16);
+    summary.state = USB_RACE_STOPPED;
+    DEBUG("UDP transport, group 239.255.70.71:%u, timer %08x\n", UDP_PORT, timerId);
+}
+
+bool UdpTransport::isConnected() {
+    return (WiFi.getMode() & WIFI_STA) && WiFi.isConnected();
+}
+
+void UdpTransport::send(uint8_t type, const void *payload, size_t len) {
+    uint8_t buf[sizeof(UdpHeader) + UDP_PAYLOAD_MAX];
+    if (len > UDP_PAYLOAD_MAX) {
+        return;
+    }
+    UdpHeader header = {UDP_MAGIC, USB_FRAME_VERSION, type, timerId, seq.fetch_add(1)};
+    memcpy(buf, &header, sizeof(header));
+    memcpy(buf + sizeof(header), payload, len);
+    // Fails when lwIP is out of buffers; the seq gap shows it to listeners
+    if (udp.writeTo(buf, sizeof(header) + len, UDP_MULTICAST_GROUP, UDP_PORT) == sizeof(header) + len) {
+        datagramsSent++;
+    } else {
+        sendErrors++;
+    }
+}
+
+// The event callbacks run under the event log lock (TransportManager), so
+// the summary only changes there
+void UdpTransport::sendLapEvent(uint32_t lapTimeMs, uint32_t deviceTimeMs, uint32_t eventId) {
+    UsbLapFrame frame = {lapTimeMs, deviceTimeMs, eventId};
+    send(USB_FRAME_LAP, &frame, sizeof(frame));
+
+    // The first lap of a race is the gate 1 pass, not a full lap
+    if (summary.lapCount > 0 && (summary.bestLapNumber == 0 || lapTimeMs < summary.bestLapMs)) {
+        summary.bestLapMs = lapTimeMs;
+        summary.bestLapNumber = summary.lapCount;
+    }
+    summary.lapCount++;
+    summary.lastLapMs = lapTimeMs;
+    summary.totalMs += lapTimeMs;
+    if (eventId) {
+        summary.lastEventId = eventId;
+    }
+    sendSummary(deviceTimeMs);
+}
+
+void UdpTransport::sendRaceStateEvent(const char *state, uint32_t deviceTimeMs, uint32_t eventId) {
+    bool started = strcmp(state, "started") == 0;
+    UsbRaceStateFrame frame = {deviceTimeMs, (uint8_t)(started ? USB_RACE_STARTED : USB_RACE_STOPPED), eventId};
+    send(USB_FRAME_RACE_STATE, &frame, sizeof(frame));
+
+    if (started) {
+        summary = {};
+    }
+    summary.state = frame.state;
+    summary.lastEventId = eventId;
+    sendSummary(deviceTimeMs);
+}
+
+void UdpTransport::sendRaceArmedEvent(uint32_t startTimeMs, uint32_t deviceTimeMs, uint32_t eventId) {
+    UsbRaceArmedFrame frame = {deviceTimeMs, startTimeMs, eventId};
+    send(USB_FRAME_RACE_ARMED, &frame, sizeof(frame));
+}
+
+void UdpTransport::sendSummary(uint32_t currentTimeMs) {
+    summary.deviceTimeMs = currentTimeMs;
+    send(USB_FRAME_RACE_SUMMARY, &summary, sizeof(summary));
+    lastSummaryMs = currentTimeMs;
+}
+
+void UdpTransport::update(uint32_t currentTimeMs) {
+    if (!eventLog || (currentTimeMs - lastSummaryMs) < UDP_SUMMARY_INTERVAL_MS || !isConnected()) {
+        return;
+    }
+    eventLog->lock();
+    sendSummary(currentTimeMs);
+    eventLog->unlock();
+}
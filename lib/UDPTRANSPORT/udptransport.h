@@ -0,0 +1,75 @@
+#ifndef UDPTRANSPORT_H
+#define UDPTRANSPORT_H
+
+/**
+ * UDP multicast publisher for displays on the LAN, in WiFi station mode
+ *
+ * The access point takes 4 stations, and every SSE or WebSocket client
+ * costs heap and TCP buffers. Here each lap and race event is sent once,
+ * as one datagram to a multicast group, and any number of pit displays
+ * on the network can listen. Nothing is acked or sent again:
+ * - seq in the header counts every datagram, so a listener sees losses
+ * - lap and race payloads carry their event id, a listener that needs
+ *   the missed ones asks over /ws or USB ("events")
+ * - a race summary (usbframe.h UsbRaceSummaryFrame) follows every event
+ *   and repeats each UDP_SUMMARY_INTERVAL_MS, so a display that lost a
+ *   datagram or started late still shows the right standings
+ *
+ * A datagram is UdpHeader | payload, the payload being the usbframe.h
+ * struct of its type. RSSI is not sent. Listener: tools/udp_listen
+ */
+
+#include <Arduino.h>
+#include <AsyncUDP.h>
+
+#include <atomic>
+
+#include "transport.h"
+#include "usbframe.h"
+
+// Administratively scoped group, stays on the LAN
+#define UDP_MULTICAST_GROUP IPAddress(239, 255, 70, 71)
+#define UDP_PORT 5770
+#define UDP_MAGIC 0x4746  // "FG"
+#define UDP_SUMMARY_INTERVAL_MS 2000
+
+struct __attribute__((packed)) UdpHeader {
+    uint16_t magic;
+    uint8_t version;   // USB_FRAME_VERSION
+    uint8_t type;      // usb_frame_type_e
+    uint32_t timerId;  // Low bytes of the MAC, tells timers on one LAN apart
+    uint32_t seq;
+};
+
+class UdpTransport : public TransportInterface {
+   public:
+    // The summary is kept under the event log lock, like the broadcasts
+    void init(EventLog *log);
+    uint32_t getDatagramsSent() const { return datagramsSent; }
+    uint32_t getSendErrors() const { return sendErrors; }
+
+    // TransportInterface implementation
+    void sendLapEvent(uint32_t lapTimeMs, uint32_t deviceTimeMs, uint32_t eventId) override;
+    void sendRssiEvent(uint8_t rssi, uint32_t deviceTimeMs) override {}
+    void sendRaceStateEvent(const char *state, uint32_t deviceTimeMs, uint32_t eventId) override;
+    void sendRaceArmedEvent(uint32_t startTimeMs, uint32_t deviceTimeMs, uint32_t eventId) override;
+    // Station mode with an address, the AP's own clients use SSE or /ws
+    bool isConnected() override;
+    // Repeats the summary
+    void update(uint32_t currentTimeMs) override;
+
+   private:
+    void send(uint8_t type, const void *payload, size_t len);
+    void sendSummary(uint32_t currentTimeMs);
+
+    AsyncUDP udp;
+    EventLog *eventLog = nullptr;
+    uint32_t timerId = 0;
+    std::atomic<uint32_t> seq{0};
+    UsbRaceSummaryFrame summary = {};
+    uint32_t lastSummaryMs = 0;
+    std::atomic<uint32_t> datagramsSent{0};
+    std::atomic<uint32_t> sendErrors{0};
+};
+
+#endif  // UDPTRANSPORT_H
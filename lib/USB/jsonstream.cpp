@@ -0,0 +1,302 @@
+#include "jsonstream.h"
+
+#include <string.h>
+
+void JsonStreamParser::reset() {
+    state = ST_VALUE;
+    depth = 0;
+    arrayBits = 0;
+    textLen = 0;
+    highSurrogate = 0;
+}
+
+// A line end inside a value is an error too. Hosts send a command per
+// line, so a truncated one never swallows the next
+json_stream_e JsonStreamParser::fail(char c) {
+    if (c == '\n' || c == '\r') {
+        reset();
+    } else {
+        state = ST_SKIP;
+    }
+    return JSON_STREAM_ERROR;
+}
+
+json_stream_e JsonStreamParser::feed(char c) {
+    switch (state) {
+        case ST_SKIP:
+            if (c == '\n' || c == '\r') {
+                reset();
+            }
+            return JSON_STREAM_MORE;
+
+        case ST_STRING:
+            if (c == '\\') {
+                state = ST_ESCAPE;
+                return JSON_STREAM_MORE;
+            }
+            if (highSurrogate || (uint8_t)c < 0x20) {
+                return fail(c);
+            }
+            if (c != '"') {
+                return put(c) ? JSON_STREAM_MORE : fail(c);
+            }
+            if (inKey) {
+                text[textLen] = '\0';
+                listener->onKey(text);
+                state = ST_COLON;
+                return JSON_STREAM_MORE;
+            }
+            flushString(true);
+            return endValue();
+
+        case ST_ESCAPE: {
+            const char *from = "\"\\/bfnrt";
+            const char *to = "\"\\/\b\f\n\r\t";
+            const char *found = c ? strchr(from, c) : nullptr;
+            if (c == 'u') {
+                unicode = 0;
+                unicodeDigits = 0;
+                state = ST_UNICODE;
+                return JSON_STREAM_MORE;
+            }
+            if (!found || highSurrogate) {
+                return fail(c);
+            }
+            state = ST_STRING;
+            return put(to[found - from]) ? JSON_STREAM_MORE : fail(c);
+        }
+
+        case ST_UNICODE: {
+            uint8_t digit;
+            if (c >= '0' && c <= '9') {
+                digit = c - '0';
+            } else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f') {
+                digit = (c | 0x20) - 'a' + 10;
+            } else {
+                return fail(c);
+            }
+            unicode = (unicode << 4) | digit;
+            if (++unicodeDigits < 4) {
+                return JSON_STREAM_MORE;
+            }
+            state = ST_STRING;
+            if (unicode >= 0xD800 && unicode < 0xDC00) {
+                if (highSurrogate) {
+                    return fail(c);
+                }
+                highSurrogate = unicode;
+                return JSON_STREAM_MORE;
+            }
+            if (unicode >= 0xDC00 && unicode < 0xE000) {
+                if (!highSurrogate) {
+                    return fail(c);
+                }
+                unicode = 0x10000 + ((highSurrogate - 0xD800) << 10) + (unicode - 0xDC00);
+                highSurrogate = 0;
+            } else if (highSurrogate) {
+                return fail(c);
+            }
+            return putCodePoint(unicode) ? JSON_STREAM_MORE : fail(c);
+        }
+
+        case ST_LITERAL:
+            if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || c == '-' || c == '+' || c == '.' || c == 'E') {
+                if (textLen >= JSON_STREAM_LITERAL_MAX - 1) {
+                    return fail(c);
+                }
+                text[textLen++] = c;
+                return JSON_STREAM_MORE;
+            }
+            {
+                json_stream_e result = endLiteral(c);
+                // A top level literal ends on the byte after it, which is dropped
+                if (result != JSON_STREAM_MORE) {
+                    return result;
+                }
+            }
+            return feed(c);
+
+        default:
+            break;
+    }
+
+    if (c == ' ' || c == '\t' || ((c == '\n' || c == '\r') && depth == 0)) {
+        return JSON_STREAM_MORE;
+    }
+
+    switch (state) {
+        case ST_VALUE_OR_END:
+            if (c == ']') {
+                return close(true);
+            }
+            return beginValue(c);
+
+        case ST_VALUE:
+            return beginValue(c);
+
+        case ST_KEY_OR_END:
+            if (c == '}') {
+                return close(false);
+            }
+            // Fall through
+        case ST_KEY:
+            if (c != '"') {
+                return fail(c);
+            }
+            inKey = true;
+            textLen = 0;
+            state = ST_STRING;
+            return JSON_STREAM_MORE;
+
+        case ST_COLON:
+            if (c != ':') {
+                return fail(c);
+            }
+            state = ST_VALUE;
+            return JSON_STREAM_MORE;
+
+        case ST_AFTER_VALUE:
+            if (c == ',') {
+                state = inArray() ? ST_VALUE : ST_KEY;
+                return JSON_STREAM_MORE;
+            }
+            if (c == (inArray() ? ']' : '}')) {
+                return close(inArray());
+            }
+            return fail(c);
+
+        default:
+            return fail(c);
+    }
+}
+
+json_stream_e JsonStreamParser::beginValue(char c) {
+    if (c == '{' || c == '[') {
+        if (depth >= JSON_STREAM_MAX_DEPTH) {
+            return fail(c);
+        }
+        bool array = c == '[';
+        arrayBits = (arrayBits & ~(1UL << depth)) | ((uint32_t)array << depth);
+        depth++;
+        if (array) {
+            listener->onBeginArray();
+            state = ST_VALUE_OR_END;
+        } else {
+            listener->onBeginObject();
+            state = ST_KEY_OR_END;
+        }
+        return JSON_STREAM_MORE;
+    }
+    if (c == '"') {
+        inKey = false;
+        textLen = 0;
+        state = ST_STRING;
+        return JSON_STREAM_MORE;
+    }
+    if (c == '-' || (c >= '0' && c <= '9') || c == 't' || c == 'f' || c == 'n') {
+        text[0] = c;
+        textLen = 1;
+        state = ST_LITERAL;
+        return JSON_STREAM_MORE;
+    }
+    return fail(c);
+}
+
+json_stream_e JsonStreamParser::endValue() {
+    if (depth == 0) {
+        state = ST_VALUE;
+        return JSON_STREAM_DONE;
+    }
+    state = ST_AFTER_VALUE;
+    return JSON_STREAM_MORE;
+}
+
+json_stream_e JsonStreamParser::close(bool array) {
+    depth--;
+    if (array) {
+        listener->onEndArray();
+    } else {
+        listener->onEndObject();
+    }
+    return endValue();
+}
+
+static bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)? and nothing else; strtod
+// would also take hex, inf, nan and a leading zero
+static bool isJsonNumber(const char *p) {
+    if (*p == '-') {
+        p++;
+    }
+    if (*p == '0') {
+        p++;
+    } else if (isDigit(*p)) {
+        while (isDigit(*p)) p++;
+    } else {
+        return false;
+    }
+    if (*p == '.') {
+        p++;
+        if (!isDigit(*p)) {
+            return false;
+        }
+        while (isDigit(*p)) p++;
+    }
+    if (*p == 'e' || *p == 'E') {
+        p++;
+        if (*p == '+' || *p == '-') {
+            p++;
+        }
+        if (!isDigit(*p)) {
+            return false;
+        }
+        while (isDigit(*p)) p++;
+    }
+    return *p == '\0';
+}
+
+json_stream_e JsonStreamParser::endLiteral(char next) {
+    text[textLen] = '\0';
+    bool valid = strcmp(text, "true") == 0 || strcmp(text, "false") == 0 || strcmp(text, "null") == 0 ||
+                 isJsonNumber(text);
+    if (!valid) {
+        return fail(next);
+    }
+    listener->onLiteral(text);
+    return endValue();
+}
+
+bool JsonStreamParser::put(char c) {
+    if (inKey) {
+        if (textLen >= JSON_STREAM_KEY_MAX - 1) {
+            return false;
+        }
+    } else if (textLen == JSON_STREAM_CHUNK) {
+        flushString(false);
+    }
+    text[textLen++] = c;
+    return true;
+}
+
+bool JsonStreamParser::putCodePoint(uint32_t cp) {
+    if (cp < 0x80) {
+        return put(cp);
+    }
+    if (cp < 0x800) {
+        return put(0xC0 | (cp >> 6)) && put(0x80 | (cp & 0x3F));
+    }
+    if (cp < 0x10000) {
+        return put(0xE0 | (cp >> 12)) && put(0x80 | ((cp >> 6) & 0x3F)) && put(0x80 | (cp & 0x3F));
+    }
+    return put(0xF0 | (cp >> 18)) && put(0x80 | ((cp >> 12) & 0x3F)) && put(0x80 | ((cp >> 6) & 0x3F)) &&
+           put(0x80 | (cp & 0x3F));
+}
+
+void JsonStreamParser::flushString(bool last) {
+    text[textLen] = '\0';
+    listener->onString(text, textLen, last);
+    textLen = 0;
+}
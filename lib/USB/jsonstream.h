@@ -0,0 +1,90 @@
+#ifndef JSONSTREAM_H
+#define JSONSTREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Incremental JSON tokenizer for the USB commands
+ *
+ * Takes one byte at a time, as they come off the port, and reports what
+ * it reads to a listener: containers opening and closing, keys, scalars,
+ * and strings in parts of up to JSON_STREAM_CHUNK bytes. Nothing but the
+ * current key, literal and string part is held, so a value of any length
+ * goes through in bounded memory.
+ *
+ * After an error the rest of the line is skipped, then the next value
+ * starts, like the old line framing. Plain C++ with no Arduino dependency
+ */
+
+#define JSON_STREAM_MAX_DEPTH 16
+#define JSON_STREAM_KEY_MAX 32
+#define JSON_STREAM_LITERAL_MAX 24
+#define JSON_STREAM_CHUNK 64
+
+class JsonStreamListener {
+   public:
+    virtual void onBeginObject() = 0;
+    virtual void onEndObject() = 0;
+    virtual void onBeginArray() = 0;
+    virtual void onEndArray() = 0;
+    // Comes whole, before the member's value
+    virtual void onKey(const char *key) = 0;
+    // Unescaped UTF-8. A string is one or more parts, the last one flagged
+    virtual void onString(const char *part, size_t len, bool last) = 0;
+    // A number, true, false or null, as text
+    virtual void onLiteral(const char *text) = 0;
+};
+
+typedef enum {
+    JSON_STREAM_MORE = 0,
+    JSON_STREAM_DONE,   // A top level value ended
+    JSON_STREAM_ERROR   // Reported once, the rest of the line is dropped
+} json_stream_e;
+
+class JsonStreamParser {
+   public:
+    explicit JsonStreamParser(JsonStreamListener *listener) : listener(listener) {}
+    void reset();
+    json_stream_e feed(char c);
+    uint8_t getDepth() const { return depth; }
+
+   private:
+    typedef enum {
+        ST_VALUE,          // Any value, or whitespace
+        ST_VALUE_OR_END,   // After '['
+        ST_KEY_OR_END,     // After '{'
+        ST_KEY,            // After ',' in an object
+        ST_COLON,
+        ST_AFTER_VALUE,    // ',' or the closing bracket
+        ST_STRING,
+        ST_ESCAPE,
+        ST_UNICODE,
+        ST_LITERAL,
+        ST_SKIP            // Error, up to the end of the line
+    } state_e;
+
+    json_stream_e fail(char c);
+    json_stream_e beginValue(char c);
+    json_stream_e endValue();
+    json_stream_e close(bool array);
+    json_stream_e endLiteral(char next);
+    // false when a key is too long
+    bool put(char c);
+    bool putCodePoint(uint32_t cp);
+    void flushString(bool last);
+    bool inArray() const { return (arrayBits >> (depth - 1)) & 1; }
+
+    JsonStreamListener *listener;
+    state_e state = ST_VALUE;
+    uint8_t depth = 0;
+    uint32_t arrayBits = 0;  // Bit n set: container n + 1 is an array
+    bool inKey = false;
+    char text[JSON_STREAM_CHUNK + 1];  // Key, literal or string part
+    size_t textLen = 0;
+    uint32_t unicode = 0;
+    uint8_t unicodeDigits = 0;
+    uint32_t highSurrogate = 0;
+};
+
+#endif  // JSONSTREAM_H
@@ -1,10 +1,32 @@
 #include "usb.h"
 #include "debug.h"
-#include <WiFi.h>
+#include <esp_timer.h>
 
-#ifdef ESP32S3
-extern RgbLed* g_rgbLed;
-#endif
+// One message being written into a TX ring, by serializeJson() or a
+// UsbFrameWriter. Nothing is written if the ring had no room
+class UsbTxWriter {
+   public:
+    UsbTxWriter(MpscByteRing& ring, size_t maxLen) : ring(ring) { reserved = ring.reserve(maxLen, r); }
+    bool isReserved() const { return reserved; }
+    size_t write(uint8_t c) { return write(&c, 1); }
+    size_t write(const uint8_t* data, size_t len) {
+        if (reserved) {
+            ring.write(r, data, len);
+        }
+        return len;
+    }
+    static void sink(void* ctx, const uint8_t* data, size_t len) { ((UsbTxWriter*)ctx)->write(data, len); }
+    // Returns the length of the message
+    size_t commit() {
+        ring.commit(r);
+        return r.len;
+    }
+
+   private:
+    MpscByteRing& ring;
+    MpscByteRing::Reservation r;
+    bool reserved;
+};
 
 void USBTransport::init(Config *config, LapTimer *lapTimer, BatteryMonitor *batMonitor, 
                         Buzzer *buzzer, Led *l, RaceHistory *raceHist, Storage *stor, 
@@ -22,331 +44,458 @@ void USBTransport::init(Config *config, LapTimer *lapTimer, BatteryMonitor *batM
     
     rssiStreamingEnabled = false;
     lastRssiSentMs = 0;
-    cmdBufferPos = 0;
-    memset(cmdBuffer, 0, CMD_BUFFER_SIZE);
+    lastCommandMs = 0;
+    reader.init(this);
     
     // USB Serial is automatically initialized by ESP32-S3
     // Just set a reasonable timeout for non-blocking reads
     Serial.setTimeout(10);
+    xTaskCreatePinnedToCore(txTaskEntry, "usbTx", USB_TX_TASK_STACK, this, 1, &txTaskHandle, 0);
     
     DEBUG("USB Transport initialized\n");
 }
 
-void USBTransport::sendLapEvent(uint32_t lapTimeMs) {
+// "t" is the device time of the event, "eventId" its id in the event log,
+// see TransportInterface
+void USBTransport::sendLapEvent(uint32_t lapTimeMs, uint32_t deviceTimeMs, uint32_t eventId) {
     if (!isConnected()) return;
     
+    if (binaryMode) {
+        UsbLapFrame frame = {lapTimeMs, deviceTimeMs, eventId};
+        sendFrame(USB_TX_HIGH, USB_FRAME_LAP, &frame, sizeof(frame));
+        return;
+    }
+    
     DynamicJsonDocument doc(128);
     doc["event"] = "lap";
     doc["data"] = lapTimeMs;
+    doc["t"] = deviceTimeMs;
+    doc["eventId"] = eventId;
     
-    serializeJson(doc, Serial);
-    Serial.println();
+    sendJson(doc);
 }
 
-void USBTransport::sendRssiEvent(uint8_t rssi) {
+void USBTransport::sendRssiEvent(uint8_t rssi, uint32_t deviceTimeMs) {
     if (!isConnected() || !rssiStreamingEnabled) return;
     
+    if (binaryMode) {
+        UsbRssiBatchFrame frame = {deviceTimeMs, 0, 1};
+        sendFrame(USB_TX_LOW, USB_FRAME_RSSI_BATCH, &frame, sizeof(frame), &rssi, 1);
+        return;
+    }
+    
     DynamicJsonDocument doc(128);
     doc["event"] = "rssi";
     doc["data"] = rssi;
+    doc["t"] = deviceTimeMs;
     
-    serializeJson(doc, Serial);
-    Serial.println();
+    sendJson(doc, USB_TX_LOW);
 }
 
-void USBTransport::sendRaceStateEvent(const char* state) {
+void USBTransport::sendRaceStateEvent(const char* state, uint32_t deviceTimeMs, uint32_t eventId) {
     if (!isConnected()) return;
     
+    if (binaryMode) {
+        UsbRaceStateFrame frame = {deviceTimeMs, (uint8_t)(strcmp(state, "started") == 0 ? USB_RACE_STARTED : USB_RACE_STOPPED), eventId};
+        sendFrame(USB_TX_HIGH, USB_FRAME_RACE_STATE, &frame, sizeof(frame));
+        return;
+    }
+    
     DynamicJsonDocument doc(128);
     doc["event"] = "raceState";
     doc["data"] = state;
+    doc["t"] = deviceTimeMs;
+    doc["eventId"] = eventId;
+    
+    sendJson(doc);
+}
+
+void USBTransport::sendRaceArmedEvent(uint32_t startTimeMs, uint32_t deviceTimeMs, uint32_t eventId) {
+    if (!isConnected()) return;
+    
+    if (binaryMode) {
+        UsbRaceArmedFrame frame = {deviceTimeMs, startTimeMs, eventId};
+        sendFrame(USB_TX_HIGH, USB_FRAME_RACE_ARMED, &frame, sizeof(frame));
+        return;
+    }
+    
+    DynamicJsonDocument doc(128);
+    doc["event"] = "raceArmed";
+    doc["data"]["startTimeMs"] = startTimeMs;
+    doc["data"]["startsInMs"] = (int32_t)(startTimeMs - deviceTimeMs);
+    doc["t"] = deviceTimeMs;
+    doc["eventId"] = eventId;
+    
+    sendJson(doc);
+}
+
+void USBTransport::replayEvents(uint32_t id, uint32_t since) {
+    if (!eventLog) {
+        sendResponse(id, "ERROR", "No event log");
+        return;
+    }
+    // Held through the reply, so a live event can't come between
+    eventLog->lock();
+    bool complete = eventLog->covers(since);
+    if (complete) {
+        RaceEvent chunk[EVENT_LOG_CHUNK];
+        size_t n;
+        while ((n = eventLog->since(since, chunk, EVENT_LOG_CHUNK)) > 0) {
+            for (size_t i = 0; i < n; i++) {
+                sendRaceEvent(chunk[i]);
+            }
+            since = chunk[n - 1].id;
+        }
+    }
+    DynamicJsonDocument resp(128);
+    resp["id"] = id;
+    resp["status"] = "OK";
+    resp["data"]["lastId"] = eventLog->lastId();
+    resp["data"]["complete"] = complete;
+    sendJson(resp);
+    eventLog->unlock();
+}
+
+// Everything that isn't an event goes through here, so in binary mode
+// command responses arrive as USB_FRAME_JSON frames
+void USBTransport::sendJson(const JsonDocument& doc, usb_tx_priority_e priority) {
+    size_t len = measureJson(doc);
+    // One that could never fit the ring gets an error the host can match
+    if (len + len / 254 + USB_FRAME_OVERHEAD + 3 > txRing(priority).maxRecord()) {
+        DEBUG("USB: %u byte message dropped, larger than the TX ring\n", (unsigned)len);
+        if (doc["id"].is<uint32_t>()) {
+            sendResponse(doc["id"], "ERROR", "Reply too large");
+        }
+        return;
+    }
+    if (binaryMode) {
+        String text;
+        serializeJson(doc, text);
+        sendFrame(priority, USB_FRAME_JSON, text.c_str(), text.length());
+        return;
+    }
+    UsbTxWriter tx(txRing(priority), len + 2);
+    if (tx.isReserved()) {
+        serializeJson(doc, tx);
+        tx.write((const uint8_t*)"\r\n", 2);
+    }
+    finishTx(priority, tx);
+}
+
+// Text mode only, a line already serialized
+void USBTransport::sendLine(const char* text, size_t len) {
+    UsbTxWriter tx(txHigh, len + 2);
+    tx.write((const uint8_t*)text, len);
+    tx.write((const uint8_t*)"\r\n", 2);
+    finishTx(USB_TX_HIGH, tx);
+}
+
+// seq is taken before the ring is tried, so a dropped frame leaves a gap
+void USBTransport::sendFrame(usb_tx_priority_e priority, uint8_t type, const void* head, size_t headLen, const void* tail, size_t tailLen) {
+    uint8_t seq = frameSeq++;
+    size_t len = USB_FRAME_OVERHEAD + headLen + tailLen;
+    // COBS adds a code byte per 254, plus the two delimiters
+    UsbTxWriter tx(txRing(priority), len + len / 254 + 3);
+    if (tx.isReserved()) {
+        UsbFrameWriter writer(UsbTxWriter::sink, &tx);
+        writer.write(type, seq, head, headLen, tail, tailLen);
+    }
+    finishTx(priority, tx);
+}
+
+void USBTransport::finishTx(usb_tx_priority_e priority, UsbTxWriter& tx) {
+    if (!tx.isReserved()) {
+        if (priority == USB_TX_HIGH) {
+            droppedHigh++;
+        } else {
+            droppedLow++;
+        }
+        return;
+    }
+    bytesSent += tx.commit();
+    framesSent++;
+    if (txTaskHandle) {
+        xTaskNotifyGive(txTaskHandle);
+    }
+}
+
+void USBTransport::txTaskEntry(void* param) {
+    ((USBTransport*)param)->txTask();
+}
+
+// Writes no more than the port takes without blocking, so a host that
+// stops reading only leaves the rings full
+void USBTransport::txTask() {
+    for (;;) {
+        // Nothing is kept for the next host
+        if (!Serial) {
+            txHigh.discard();
+            txLow.discard();
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        // A message started is finished first, then laps and replies go
+        // before RSSI
+        MpscByteRing* ring = txLow.inRecord() ? &txLow : &txHigh;
+        const uint8_t* data;
+        size_t len = ring->front(data);
+        if (len == 0 && ring == &txHigh) {
+            ring = &txLow;
+            len = ring->front(data);
+        }
+        if (len == 0) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        size_t room = Serial.availableForWrite();
+        if (room == 0) {
+            vTaskDelay(pdMS_TO_TICKS(USB_TX_POLL_MS));
+            continue;
+        }
+        ring->consume(Serial.write(data, len < room ? len : room));
+    }
+}
+
+void USBTransport::sendPerfFrame() {
+    UsbPerfFrame frame;
+    frame.deviceTimeMs = millis();
+    frame.freeHeap = ESP.getFreeHeap();
+    frame.minFreeHeap = ESP.getMinFreeHeap();
+    frame.cpuMhz = getCpuFrequencyMhz();
+    frame.framesSent = framesSent;
+    frame.bytesSent = bytesSent;
+    frame.framesDropped = getFramesDropped();
+    sendFrame(USB_TX_LOW, USB_FRAME_PERF, &frame, sizeof(frame));
+}
+
+// Same query as GET /rssi/history: {"last"} or {"from","to"}, "res",
+// "points". The answer can run to ~12 KB, so it is written as text rather
+// than built in a JsonDocument
+void USBTransport::sendRssiHistory(uint32_t id, JsonVariantConst data) {
+    if (!rssiHistory) {
+        sendResponse(id, "ERROR", "No history");
+        return;
+    }
+    uint32_t now = millis();
+    RssiHistoryQuery q;
+    if (data.containsKey("last")) {
+        uint32_t lastMs = data["last"];
+        q.fromMs = lastMs > now ? 0 : now - lastMs;
+        q.toMs = now;
+    } else {
+        q.fromMs = data["from"] | (uint32_t)0;
+        q.toMs = data["to"] | now;
+    }
+    q.resolutionMs = data["res"] | (uint16_t)RSSI_RES_AUTO;
+    q.maxPoints = data["points"] | (uint16_t)RSSI_HISTORY_MAX_POINTS;
     
-    serializeJson(doc, Serial);
-    Serial.println();
+    RssiHistoryPoint* points = (RssiHistoryPoint*)malloc(sizeof(RssiHistoryPoint) * RSSI_HISTORY_MAX_POINTS);
+    if (!points) {
+        sendResponse(id, "ERROR", "Out of memory");
+        return;
+    }
+    RssiHistoryResult result;
+    if (!rssiHistory->query(q, points, result)) {
+        free(points);
+        sendResponse(id, "ERROR", "No samples in range");
+        return;
+    }
+    String text;
+    text.reserve(64 + result.count * 16);
+    text += "{\"id\":";
+    text += id;
+    text += ",\"status\":\"OK\",\"data\":";
+    RssiHistory::writeJson(result, [](void* ctx, const char* part, size_t len) {
+        ((String*)ctx)->concat(part, len);
+    }, &text);
+    text += "}";
+    free(points);
+    
+    if (binaryMode) {
+        sendFrame(USB_TX_HIGH, USB_FRAME_JSON, text.c_str(), text.length());
+    } else {
+        sendLine(text.c_str(), text.length());
+    }
 }
 
 bool USBTransport::isConnected() {
-    // Check if USB CDC is connected
-    return Serial && Serial.availableForWrite() > 0;
+    // Check if USB CDC is connected. A host that stopped reading still
+    // counts, the TX rings drop for it
+    return (bool)Serial;
 }
 
 void USBTransport::update(uint32_t currentTimeMs) {
-    // Process incoming commands
+    // Process incoming commands, a byte at a time as they arrive
     while (Serial.available() > 0) {
-        char c = Serial.read();
+        json_stream_e result = reader.feed(Serial.read());
         
-        if (c == '\n' || c == '\r') {
-            if (cmdBufferPos > 0) {
-                cmdBuffer[cmdBufferPos] = '\0';
-                processCommand(cmdBuffer);
-                cmdBufferPos = 0;
+        if (result == JSON_STREAM_DONE) {
+            cmdReceivedUs = esp_timer_get_time();
+            lastCommandMs = currentTimeMs ? currentTimeMs : 1;
+            if (reader.isTooLarge()) {
+                sendResponse(reader.getId(), "ERROR", "Command too large");
+            } else if (reader.isCommand()) {
+                processCommand(reader.getCmd(), reader.getId(), reader.getData());
+            } else {
+                DEBUG("USB: Missing 'cmd' field\n");
             }
-        } else if (cmdBufferPos < CMD_BUFFER_SIZE - 1) {
-            cmdBuffer[cmdBufferPos++] = c;
-        } else {
-            // Buffer overflow, reset
-            cmdBufferPos = 0;
+            finishStream();
+        } else if (result == JSON_STREAM_ERROR) {
+            DEBUG("USB: JSON parse error\n");
+            sendResponse(reader.getId(), "ERROR", "Bad JSON");
+            finishStream();
         }
     }
     
+    // A new host starts in JSON again
+    if (binaryMode && !Serial) {
+        binaryMode = false;
+        DEBUG("USB: host gone, back to JSON\n");
+    }
+    if (binaryMode && (currentTimeMs - lastPerfSentMs) >= USB_PERF_INTERVAL_MS && isConnected()) {
+        sendPerfFrame();
+        lastPerfSentMs = currentTimeMs;
+    }
+    
     // Send periodic RSSI if streaming enabled
     if (rssiStreamingEnabled && (currentTimeMs - lastRssiSentMs) > RSSI_SEND_INTERVAL_MS) {
-        sendRssiEvent(timer->getRssi());
+        sendRssiEvent(timer->getRssi(), millis());
         lastRssiSentMs = currentTimeMs;
     }
-}
-
-void USBTransport::enableRssiStreaming(bool enable) {
-    rssiStreamingEnabled = enable;
-}
-
-void USBTransport::processCommand(const char* cmdLine) {
-    DynamicJsonDocument doc(1024);
-    DeserializationError error = deserializeJson(doc, cmdLine);
     
-    if (error) {
-        DEBUG("USB: JSON parse error: %s\n", error.c_str());
-        return;
+    while (rssiBatcher.poll()) {
+        sendRssiBatch();
     }
+}
+
+// Binary mode sends the samples as they are, JSON mode as rssiBatch
+// events with delta encoded values, see RssiBatcher::toJson()
+void USBTransport::sendRssiBatch() {
+    if (!isConnected()) return;
     
-    if (!doc.containsKey("cmd")) {
-        DEBUG("USB: Missing 'cmd' field\n");
+    const RssiBatch& batch = rssiBatcher.batch();
+    if (binaryMode) {
+        UsbRssiBatchFrame frame = {batch.baseTimeMs, (uint32_t)batch.intervalMs * 1000, batch.count};
+        sendFrame(USB_TX_LOW, USB_FRAME_RSSI_BATCH, &frame, sizeof(frame), batch.values, batch.count);
         return;
     }
     
-    const char* cmd = doc["cmd"];
-    uint32_t id = doc["id"] | 0;
+    char buf[RSSI_BATCH_JSON_MAX];
+    if (rssiBatcher.toJson(buf, sizeof(buf)) == 0) return;
+    DynamicJsonDocument doc(128);
+    doc["event"] = "rssiBatch";
+    doc["data"] = serialized(buf);
+    doc["t"] = batch.baseTimeMs;
     
-    // Timer commands
-    if (strcmp(cmd, "timer/start") == 0) {
-        timer->start();
-        sendResponse(id, "OK");
-        
-    } else if (strcmp(cmd, "timer/stop") == 0) {
-        timer->stop();
-        sendResponse(id, "OK");
+    sendJson(doc, USB_TX_LOW);
+}
+
+void USBTransport::enableRssiStreaming(bool enable) {
+    rssiStreamingEnabled = enable;
+}
+
+bool USBTransport::hasActiveClient(uint32_t currentTimeMs) {
+    return rssiStreamingEnabled || rssiBatcher.isActive() || (lastCommandMs != 0 && (currentTimeMs - lastCommandMs) < USB_CLIENT_IDLE_MS);
+}
+
+void USBTransport::processCommand(const char* cmd, uint32_t id, JsonVariantConst data) {
+    // Protocol negotiation: {"cmd":"proto","data":{"mode":"binary"}} switches
+    // events and responses to usbframe.h frames, "json" switches back.
+    // Commands stay JSON lines either way. The reply is queued in the old
+    // mode, so a host that can only read JSON still sees it
+    if (strcmp(cmd, "proto") == 0) {
+        const char* mode = data["mode"] | "json";
+        bool binary = strcmp(mode, "binary") == 0;
+        if (!binary && strcmp(mode, "json") != 0) {
+            sendResponse(id, "ERROR", "Unknown mode");
+            return;
+        }
+        DynamicJsonDocument resp(128);
+        resp["id"] = id;
+        resp["status"] = "OK";
+        resp["data"]["mode"] = binary ? "binary" : "json";
+        resp["data"]["version"] = USB_FRAME_VERSION;
+        sendJson(resp);
+        binaryMode = binary;
+        frameSeq = 0;
+        lastPerfSentMs = 0;
+        DEBUG("USB: %s mode\n", mode);
         
-    } else if (strcmp(cmd, "timer/lap") == 0) {
-#ifdef ESP32S3
-        if (g_rgbLed) g_rgbLed->flashLap();
-#endif
-        sendResponse(id, "OK");
+    // Clock sync, see /api/time. t1 is when the line was read, so a
+    // sample that waited for the next update() shows a longer delay and
+    // the client's min-delay filter drops it
+    } else if (strcmp(cmd, "time") == 0) {
+        DynamicJsonDocument resp(192);
+        resp["id"] = id;
+        resp["status"] = "OK";
+        resp["data"]["t0"] = data["t0"];
+        resp["data"]["t1"] = cmdReceivedUs;
+        resp["data"]["t2"] = esp_timer_get_time();
+        sendJson(resp);
         
-    } else if (strcmp(cmd, "timer/addLap") == 0) {
-        if (doc.containsKey("data") && doc["data"].containsKey("lapTime")) {
-            uint32_t lapTimeMs = doc["data"]["lapTime"];
-            sendLapEvent(lapTimeMs);
-#ifdef ESP32S3
-            if (g_rgbLed) g_rgbLed->flashLap();
-#endif
-            sendResponse(id, "OK");
-        } else {
-            sendResponse(id, "ERROR", "Missing lapTime");
-        }
+    // Replay after a reconnect: {"since":lastEventId}. The missed lap and
+    // race events come first as normal events, then the reply. complete
+    // false means the log no longer has them all (or the timer rebooted),
+    // nothing is replayed and the host reloads the race instead
+    } else if (strcmp(cmd, "events") == 0) {
+        replayEvents(id, data["since"] | (uint32_t)0);
         
     } else if (strcmp(cmd, "rssi/start") == 0) {
         enableRssiStreaming(true);
         sendResponse(id, "OK");
         
+    // Batched stream: {"rate":Hz,"batch":samples}, both optional. The
+    // reply has the values in use after clamping
+    } else if (strcmp(cmd, "rssi/stream") == 0) {
+        rssiBatcher.start(timer->getRssiRing(), data["rate"] | (uint32_t)RSSI_STREAM_DEFAULT_RATE_HZ,
+                          data["batch"] | (uint32_t)RSSI_BATCH_DEFAULT);
+        DynamicJsonDocument resp(128);
+        resp["id"] = id;
+        resp["status"] = "OK";
+        resp["data"]["rate"] = rssiBatcher.getRateHz();
+        resp["data"]["batch"] = rssiBatcher.getBatchSize();
+        sendJson(resp);
+        
+    } else if (strcmp(cmd, "rssi/history") == 0) {
+        sendRssiHistory(id, data);
+        
     } else if (strcmp(cmd, "rssi/stop") == 0) {
         enableRssiStreaming(false);
+        rssiBatcher.stop();
         sendResponse(id, "OK");
         
-    } else if (strcmp(cmd, "config/get") == 0) {
-        sendConfigResponse(id);
-        
-    } else if (strcmp(cmd, "config/set") == 0) {
-        if (doc.containsKey("data")) {
-            JsonObject data = doc["data"];
-            conf->fromJson(data);
-            sendResponse(id, "OK");
-        } else {
-            sendResponse(id, "ERROR", "Missing data");
-        }
-        
-    } else if (strcmp(cmd, "status") == 0) {
-        sendStatusResponse(id);
-        
-    } else if (strcmp(cmd, "races/get") == 0) {
-        DynamicJsonDocument respDoc(4096);
-        respDoc["id"] = id;
-        respDoc["status"] = "OK";
-        
-        String racesJson = history->toJsonString();
-        DynamicJsonDocument racesDoc(4096);
-        deserializeJson(racesDoc, racesJson);
-        respDoc["data"] = racesDoc;
-        
-        serializeJson(respDoc, Serial);
-        Serial.println();
-        
-    } else if (strcmp(cmd, "races/save") == 0) {
-        if (doc.containsKey("data")) {
-            JsonObject data = doc["data"];
-            RaceSession race;
-            race.timestamp = data["timestamp"];
-            race.fastestLap = data["fastestLap"];
-            race.medianLap = data["medianLap"];
-            race.best3LapsTotal = data["best3LapsTotal"];
-            race.pilotName = data["pilotName"] | "";
-            race.pilotCallsign = data["pilotCallsign"] | "";
-            race.frequency = data["frequency"] | 0;
-            race.band = data["band"] | "";
-            race.channel = data["channel"] | 0;
-            
-            JsonArray lapsArray = data["lapTimes"];
-            for (uint32_t lap : lapsArray) {
-                race.lapTimes.push_back(lap);
-            }
-            
-            bool success = history->saveRace(race);
-            sendResponse(id, success ? "OK" : "ERROR");
+    // {"trackId":N,"image":"<base64>"}, the image streamed to storage as it
+    // arrives, see beginStream(). trackId has to come first
+    } else if (strcmp(cmd, "tracks/image") == 0) {
+        if (streamError) {
+            sendResponse(id, "ERROR", streamError);
+        } else if (streamType != USB_STREAM_BASE64) {
+            sendResponse(id, "ERROR", "Missing image");
         } else {
-            sendResponse(id, "ERROR", "Missing data");
-        }
-        
-    } else if (strcmp(cmd, "races/clear") == 0) {
-        bool success = history->clearAll();
-        sendResponse(id, success ? "OK" : "ERROR");
-        
-    } else if (strcmp(cmd, "selftest") == 0) {
-        selftest->runAllTests();
-        
-        DynamicJsonDocument respDoc(4096);
-        respDoc["id"] = id;
-        respDoc["status"] = "OK";
-        
-        String testJson = selftest->getResultsJSON();
-        DynamicJsonDocument testDoc(4096);
-        deserializeJson(testDoc, testJson);
-        respDoc["data"] = testDoc;
-        
-        serializeJson(respDoc, Serial);
-        Serial.println();
-        
-    // LED commands
-    } else if (strcmp(cmd, "led/preset") == 0) {
-        if (doc.containsKey("data") && doc["data"].containsKey("preset")) {
-            uint8_t presetNum = doc["data"]["preset"];
-#ifdef ESP32S3
-            if (g_rgbLed) {
-                g_rgbLed->setPreset((led_preset_e)presetNum);
-                sendResponse(id, "OK");
-            } else {
-                sendResponse(id, "ERROR", "RGB LED not available");
-            }
-#else
-            sendResponse(id, "ERROR", "RGB LED not supported on this hardware");
-#endif
-        } else {
-            sendResponse(id, "ERROR", "Missing preset");
-        }
-        
-    } else if (strcmp(cmd, "led/color") == 0) {
-        if (doc.containsKey("data") && doc["data"].containsKey("color")) {
-            const char* colorHex = doc["data"]["color"];
-            uint32_t color = (uint32_t)strtoul(colorHex, NULL, 16);
-#ifdef ESP32S3
-            if (g_rgbLed) {
-                g_rgbLed->setManualColor(color);
-                sendResponse(id, "OK");
-            } else {
-                sendResponse(id, "ERROR", "RGB LED not available");
-            }
-#else
-            sendResponse(id, "ERROR", "RGB LED not supported on this hardware");
-#endif
-        } else {
-            sendResponse(id, "ERROR", "Missing color");
-        }
-        
-    } else if (strcmp(cmd, "led/brightness") == 0) {
-        if (doc.containsKey("data") && doc["data"].containsKey("brightness")) {
-            uint8_t brightness = doc["data"]["brightness"];
-#ifdef ESP32S3
-            if (g_rgbLed) {
-                g_rgbLed->setBrightness(brightness);
-                sendResponse(id, "OK");
-            } else {
-                sendResponse(id, "ERROR", "RGB LED not available");
-            }
-#else
-            sendResponse(id, "ERROR", "RGB LED not supported on this hardware");
-#endif
-        } else {
-            sendResponse(id, "ERROR", "Missing brightness");
-        }
-        
-    } else if (strcmp(cmd, "led/speed") == 0) {
-        if (doc.containsKey("data") && doc["data"].containsKey("speed")) {
-            uint8_t speed = doc["data"]["speed"];
-#ifdef ESP32S3
-            if (g_rgbLed) {
-                g_rgbLed->setEffectSpeed(speed);
-                sendResponse(id, "OK");
-            } else {
-                sendResponse(id, "ERROR", "RGB LED not available");
-            }
-#else
-            sendResponse(id, "ERROR", "RGB LED not supported on this hardware");
-#endif
-        } else {
-            sendResponse(id, "ERROR", "Missing speed");
-        }
-        
-    } else if (strcmp(cmd, "led/override") == 0) {
-        if (doc.containsKey("data") && doc["data"].containsKey("enable")) {
-            bool enable = doc["data"]["enable"];
-#ifdef ESP32S3
-            if (g_rgbLed) {
-                g_rgbLed->enableManualOverride(enable);
-                sendResponse(id, "OK");
-            } else {
-                sendResponse(id, "ERROR", "RGB LED not available");
-            }
-#else
-            sendResponse(id, "ERROR", "RGB LED not supported on this hardware");
-#endif
-        } else {
-            sendResponse(id, "ERROR", "Missing enable");
-        }
-        
-    } else if (strcmp(cmd, "led/fadecolor") == 0) {
-        if (doc.containsKey("data") && doc["data"].containsKey("color")) {
-            const char* colorHex = doc["data"]["color"];
-            uint32_t color = (uint32_t)strtoul(colorHex, NULL, 16);
-#ifdef ESP32S3
-            if (g_rgbLed) {
-                g_rgbLed->setFadeColor(color);
-                sendResponse(id, "OK");
-            } else {
-                sendResponse(id, "ERROR", "RGB LED not available");
-            }
-#else
-            sendResponse(id, "ERROR", "RGB LED not supported on this hardware");
-#endif
-        } else {
-            sendResponse(id, "ERROR", "Missing color");
+            sendResponse(id, "OK");
         }
         
-    } else if (strcmp(cmd, "led/strobecolor") == 0) {
-        if (doc.containsKey("data") && doc["data"].containsKey("color")) {
-            const char* colorHex = doc["data"]["color"];
-            uint32_t color = (uint32_t)strtoul(colorHex, NULL, 16);
-#ifdef ESP32S3
-            if (g_rgbLed) {
-                g_rgbLed->setStrobeColor(color);
-                sendResponse(id, "OK");
-            } else {
-                sendResponse(id, "ERROR", "RGB LED not available");
-            }
-#else
-            sendResponse(id, "ERROR", "RGB LED not supported on this hardware");
-#endif
+    // {"races":[...]} in the format of /races/download, each race saved as
+    // it arrives. Races already on the timer are skipped
+    } else if (strcmp(cmd, "races/upload") == 0) {
+        if (streamError) {
+            sendResponse(id, "ERROR", streamError);
+        } else if (streamType != USB_STREAM_ITEMS) {
+            sendResponse(id, "ERROR", "Missing races");
         } else {
-            sendResponse(id, "ERROR", "Missing color");
+            DynamicJsonDocument resp(128);
+            resp["id"] = id;
+            resp["status"] = "OK";
+            resp["data"]["imported"] = streamCount;
+            sendJson(resp);
         }
         
+    // The rest are shared with HTTP and /ws, see command.h
+    } else if (router) {
+        DynamicJsonDocument resp(1024);
+        router->executeToReply(cmd, id, data, resp);
+        sendJson(resp);
+
     } else {
         sendResponse(id, "ERROR", "Unknown command");
     }
@@ -357,8 +506,7 @@ void USBTransport::sendResponse(uint32_t id, const char* status) {
     doc["id"] = id;
     doc["status"] = status;
     
-    serializeJson(doc, Serial);
-    Serial.println();
+    sendJson(doc);
 }
 
 void USBTransport::sendResponse(uint32_t id, const char* status, const char* message) {
@@ -367,75 +515,85 @@ void USBTransport::sendResponse(uint32_t id, const char* status, const char* mes
     doc["status"] = status;
     doc["message"] = message;
     
-    serializeJson(doc, Serial);
-    Serial.println();
+    sendJson(doc);
 }
 
-void USBTransport::sendConfigResponse(uint32_t id) {
-    DynamicJsonDocument doc(2048);
-    doc["id"] = id;
-    doc["status"] = "OK";
-    
-    JsonObject data = doc.createNestedObject("data");
-    
-    // Build config JSON manually (Config::toJson uses AsyncResponseStream)
-    data["freq"] = conf->getFrequency();
-    data["minLap"] = (uint8_t)(conf->getMinLapMs() / 100);
-    data["alarm"] = conf->getAlarmThreshold();
-    data["enterRssi"] = conf->getEnterRssi();
-    data["exitRssi"] = conf->getExitRssi();
-    data["maxLaps"] = conf->getMaxLaps();
-    data["ledMode"] = conf->getLedMode();
-    data["ledBrightness"] = conf->getLedBrightness();
-    data["ledColor"] = conf->getLedColor();
-    data["opMode"] = conf->getOperationMode();
-    data["ssid"] = conf->getSsid();
-    data["pwd"] = conf->getPassword();
-    
-    serializeJson(doc, Serial);
-    Serial.println();
+usb_stream_e USBTransport::getStreamType(const char* cmd, const char* key) {
+    if (strcmp(cmd, "tracks/image") == 0 && strcmp(key, "image") == 0) {
+        return USB_STREAM_BASE64;
+    }
+    if (strcmp(cmd, "races/upload") == 0 && strcmp(key, "races") == 0) {
+        return USB_STREAM_ITEMS;
+    }
+    return USB_STREAM_NONE;
 }
 
-void USBTransport::sendStatusResponse(uint32_t id) {
-    DynamicJsonDocument doc(2048);
-    doc["id"] = id;
-    doc["status"] = "OK";
+// Same checks and messages as the /tracks/image upload
+bool USBTransport::beginStream(const char* cmd, JsonVariantConst data) {
+    streamType = strcmp(cmd, "races/upload") == 0 ? USB_STREAM_ITEMS : USB_STREAM_BASE64;
+    streamError = nullptr;
+    streamOffset = 0;
+    streamCount = 0;
     
-    JsonObject data = doc.createNestedObject("data");
-    
-    // Heap info
-    JsonObject heap = data.createNestedObject("heap");
-    heap["free"] = ESP.getFreeHeap();
-    heap["min"] = ESP.getMinFreeHeap();
-    heap["size"] = ESP.getHeapSize();
-    heap["maxAlloc"] = ESP.getMaxAllocHeap();
-    
-    // Storage info
-    JsonObject stor = data.createNestedObject("storage");
-    stor["type"] = storage->getStorageType();
-    stor["used"] = storage->getUsedBytes();
-    stor["total"] = storage->getTotalBytes();
-    stor["free"] = storage->getFreeBytes();
-    
-    // Chip info
-    JsonObject chip = data.createNestedObject("chip");
-    chip["model"] = ESP.getChipModel();
-    chip["revision"] = ESP.getChipRevision();
-    chip["cores"] = ESP.getChipCores();
-    chip["sdk"] = ESP.getSdkVersion();
-    chip["flashSize"] = ESP.getFlashChipSize();
-    chip["flashSpeed"] = ESP.getFlashChipSpeed() / 1000000;
-    chip["cpuSpeed"] = getCpuFrequencyMhz();
-    
-    // Network info
-    JsonObject network = data.createNestedObject("network");
-    network["ip"] = WiFi.localIP().toString();
-    network["mac"] = WiFi.macAddress();
-    
-    // Battery
-    float voltage = (float)monitor->getBatteryVoltage() / 10;
-    data["batteryVoltage"] = voltage;
+    if (streamType == USB_STREAM_ITEMS) {
+        if (!history) {
+            streamError = "No race history";
+        }
+        return !streamError;
+    }
     
-    serializeJson(doc, Serial);
-    Serial.println();
+    streamTrackId = data["trackId"] | (uint32_t)0;
+    if (!trackManager || streamTrackId == 0 || !trackManager->getTrackById(streamTrackId)) {
+        streamError = "Track not found";
+        return false;
+    }
+    streamFile = trackManager->beginTrackImage(streamTrackId);
+    if (!streamFile) {
+        streamError = "Failed to open image file";
+        return false;
+    }
+    DEBUG("USB: track image upload started: track %u\n", streamTrackId);
+    return true;
+}
+
+bool USBTransport::writeStream(const uint8_t* bytes, size_t len) {
+    if (!trackManager->appendTrackImage(streamFile, streamOffset, bytes, len)) {
+        streamError = streamOffset + len > TRACK_IMAGE_MAX_BYTES ? "Image too large (max 500KB)" : "Failed to write image";
+        return false;
+    }
+    streamOffset += len;
+    return true;
+}
+
+// Not journaled like /races/upload: the journal would hold the storage
+// lock across update() calls. Each race is its own file, and a re-sent
+// upload skips the ones that made it
+bool USBTransport::writeItem(JsonVariantConst item) {
+    if (history->importRace(item.as<JsonObjectConst>())) {
+        streamCount++;
+    }
+    return true;
+}
+
+void USBTransport::endStream(bool complete) {
+    if (streamType != USB_STREAM_BASE64 || !streamFile) {
+        return;
+    }
+    if (!complete) {
+        if (!streamError) {
+            streamError = "Bad image data";
+        }
+        trackManager->abortTrackImage(streamTrackId, streamFile);
+    } else if (!trackManager->commitTrackImage(streamTrackId, streamFile)) {
+        streamError = "Failed to save image";
+    }
+}
+
+// After the reply. A command cut off mid stream has had endStream() from
+// the reader already, this only forgets the state
+void USBTransport::finishStream() {
+    streamType = USB_STREAM_NONE;
+    streamError = nullptr;
+    streamOffset = 0;
+    streamCount = 0;
 }
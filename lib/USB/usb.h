@@ -17,14 +17,36 @@
  * 
  * Protocol:
  * Commands are sent as JSON objects, one per line:
- * {"method":"POST","path":"timer/start","data":{}}
+ * {"cmd":"timer/start","id":1,"data":{}}
+ * They are parsed as they arrive (see usbcommand.h), so there is no line
+ * length limit; track images and race uploads stream to storage
  * 
  * Events are sent as JSON objects prefixed with "EVENT:":
  * EVENT:{"type":"lap","data":12345}
+ *
+ * After {"cmd":"proto","data":{"mode":"binary"}} events and responses are
+ * sent as COBS frames instead, see usbframe.h
+ *
+ * Nothing is written to the port by the sender. Messages go into a TX ring
+ * (lock-free, any task on either core) and a low priority task writes them
+ * out as fast as the host reads. A host that stops reading costs the timing
+ * loop nothing: its messages are dropped and counted, RSSI and perf first
+ * as they have a ring of their own, laps and replies only once
+ * USB_TX_RING_SIZE bytes of them are waiting
  */
 
 #include <Arduino.h>
+#include <ArduinoJson.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <atomic>
+
+#include "command.h"
+#include "mpscbytering.h"
 #include "transport.h"
+#include "usbcommand.h"
+#include "usbframe.h"
 #include "config.h"
 #include "rgbled.h"
 #include "laptimer.h"
@@ -32,6 +54,7 @@
 #include "buzzer.h"
 #include "led.h"
 #include "racehistory.h"
+#include "rssihistory.h"
 #include "storage.h"
 #include "selftest.h"
 #include "rx5808.h"
@@ -41,28 +64,71 @@
 #include "rgbled.h"
 #endif
 
+// Laps, race state and replies. Holds the largest reply (rssi/history)
+#define USB_TX_RING_SIZE 32768
+// RSSI and perf, dropped first
+#define USB_TX_LOW_RING_SIZE 4096
+#define USB_TX_TASK_STACK 3072
+// Drain task poll while the host isn't reading
+#define USB_TX_POLL_MS 2
+
+typedef enum {
+    USB_TX_LOW = 0,   // RSSI and perf
+    USB_TX_HIGH = 1   // Laps, race state and command replies
+} usb_tx_priority_e;
+
+class UsbTxWriter;
+
 // USB Serial transport using native ESP32-S3 USB CDC
-class USBTransport : public TransportInterface {
+class USBTransport : public TransportInterface, public UsbStreamHandler {
    public:
     void init(Config *config, LapTimer *lapTimer, BatteryMonitor *batMonitor, Buzzer *buzzer, 
               Led *led, RaceHistory *raceHist, Storage *stor, SelfTest *test, RX5808 *rx5808, TrackManager *trackMgr);
     
     // TransportInterface implementation
-    void sendLapEvent(uint32_t lapTimeMs) override;
-    void sendRssiEvent(uint8_t rssi) override;
-    void sendRaceStateEvent(const char* state) override;
+    void sendLapEvent(uint32_t lapTimeMs, uint32_t deviceTimeMs, uint32_t eventId) override;
+    void sendRssiEvent(uint8_t rssi, uint32_t deviceTimeMs) override;
+    void sendRaceStateEvent(const char* state, uint32_t deviceTimeMs, uint32_t eventId) override;
+    void sendRaceArmedEvent(uint32_t startTimeMs, uint32_t deviceTimeMs, uint32_t eventId) override;
     bool isConnected() override;
     void update(uint32_t currentTimeMs) override;
     
     // Enable/disable RSSI streaming
     void enableRssiStreaming(bool enable);
+    void setRssiHistory(RssiHistory *h) { rssiHistory = h; }
+    void setEventLog(EventLog *log) { eventLog = log; }
+    // Runs the commands shared with HTTP and /ws
+    void setCommandRouter(CommandRouter *r) { router = r; }
+    // Rate of the batched RSSI stream (rssi/stream), 0 when off
+    uint16_t getRssiStreamRateHz() const { return rssiBatcher.isActive() ? rssiBatcher.getRateHz() : 0; }
+    // A host is streaming RSSI or sent a command within USB_CLIENT_IDLE_MS
+    bool hasActiveClient(uint32_t currentTimeMs);
+    // Messages not sent because their TX ring was full
+    uint32_t getFramesDropped() const { return droppedLow + droppedHigh; }
+    
+    // UsbStreamHandler implementation
+    usb_stream_e getStreamType(const char* cmd, const char* key) override;
+    bool beginStream(const char* cmd, JsonVariantConst data) override;
+    bool writeStream(const uint8_t* bytes, size_t len) override;
+    bool writeItem(JsonVariantConst item) override;
+    void endStream(bool complete) override;
 
    private:
-    void processCommand(const char* cmdLine);
+    void processCommand(const char* cmd, uint32_t id, JsonVariantConst data);
+    void finishStream();
     void sendResponse(uint32_t id, const char* status);
     void sendResponse(uint32_t id, const char* status, const char* message);
-    void sendConfigResponse(uint32_t id);
-    void sendStatusResponse(uint32_t id);
+    void sendJson(const JsonDocument& doc, usb_tx_priority_e priority = USB_TX_HIGH);
+    void sendFrame(usb_tx_priority_e priority, uint8_t type, const void* head, size_t headLen, const void* tail = nullptr, size_t tailLen = 0);
+    void sendLine(const char* text, size_t len);
+    void sendPerfFrame();
+    void sendRssiBatch();
+    void sendRssiHistory(uint32_t id, JsonVariantConst data);
+    void replayEvents(uint32_t id, uint32_t since);
+    MpscByteRing& txRing(usb_tx_priority_e priority) { return priority == USB_TX_HIGH ? txHigh : txLow; }
+    void finishTx(usb_tx_priority_e priority, UsbTxWriter& tx);
+    static void txTaskEntry(void* param);
+    void txTask();
     
     Config *conf;
     LapTimer *timer;
@@ -74,15 +140,47 @@ class USBTransport : public TransportInterface {
     SelfTest *selftest;
     RX5808 *rx;
     TrackManager *trackManager;
+    RssiHistory *rssiHistory = nullptr;
+    EventLog *eventLog = nullptr;
+    CommandRouter *router = nullptr;
     
     bool rssiStreamingEnabled;
     uint32_t lastRssiSentMs;
     static const uint32_t RSSI_SEND_INTERVAL_MS = 200;
+    RssiBatcher rssiBatcher;
+    uint32_t lastCommandMs;
+    int64_t cmdReceivedUs = 0;  // esp_timer time the current command line was read
+    static const uint32_t USB_CLIENT_IDLE_MS = 60000;
+    
+    // Binary mode, see usbframe.h. Senders run on the timing loop and the
+    // housekeeping task
+    std::atomic<bool> binaryMode{false};
+    std::atomic<uint8_t> frameSeq{0};  // Taken by dropped frames too, so the host sees a gap
+    std::atomic<uint32_t> framesSent{0};
+    std::atomic<uint32_t> bytesSent{0};
+    uint32_t lastPerfSentMs = 0;
+    static const uint32_t USB_PERF_INTERVAL_MS = 1000;
+    
+    // TX rings, drained by txTask in order, high first. A message is
+    // written whole before the next one starts
+    uint32_t txHighBuffer[USB_TX_RING_SIZE / 4];
+    uint32_t txLowBuffer[USB_TX_LOW_RING_SIZE / 4];
+    MpscByteRing txHigh{txHighBuffer, sizeof(txHighBuffer)};
+    MpscByteRing txLow{txLowBuffer, sizeof(txLowBuffer)};
+    TaskHandle_t txTaskHandle = nullptr;
+    std::atomic<uint32_t> droppedLow{0};
+    std::atomic<uint32_t> droppedHigh{0};
+    
+    UsbCommandReader reader;
     
-    // Command buffer
-    static const size_t CMD_BUFFER_SIZE = 512;
-    char cmdBuffer[CMD_BUFFER_SIZE];
-    size_t cmdBufferPos;
+    // Field of the current command streamed past the reader's document,
+    // replied to with the command
+    usb_stream_e streamType = USB_STREAM_NONE;
+    const char* streamError = nullptr;
+    uint32_t streamTrackId = 0;
+    File streamFile;
+    size_t streamOffset = 0;
+    uint16_t streamCount = 0;
 };
 
 #endif  // USB_H
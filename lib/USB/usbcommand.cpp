@@ -0,0 +1,272 @@
+#include "usbcommand.h"
+
+#include "debug.h"
+
+json_stream_e UsbCommandReader::feed(char c) {
+    if (complete) {
+        clear();
+    }
+    // Streamed base64 doesn't count, it never reaches the document
+    if (target && !inStreamString && ++bytes > USB_CMD_DATA_MAX && !tooLarge) {
+        DEBUG("USB: %s data over %u bytes\n", cmd, USB_CMD_DATA_MAX);
+        tooLarge = true;
+        abortStream();
+        target = nullptr;
+        data.clear();
+        item.clear();
+        text = String();
+    }
+    json_stream_e result = parser.feed(c);
+    if (result == JSON_STREAM_ERROR) {
+        abortStream();
+    }
+    if (result != JSON_STREAM_MORE) {
+        complete = true;
+    }
+    return result;
+}
+
+void UsbCommandReader::clear() {
+    complete = false;
+    envelope = false;
+    cmd[0] = '\0';
+    cmdLen = 0;
+    id = 0;
+    depth = 0;
+    key[0] = '\0';
+    data.clear();
+    item.clear();
+    target = nullptr;
+    buildDepth = 0;
+    text = String();
+    inString = false;
+    stringToCmd = false;
+    bytes = 0;
+    tooLarge = false;
+    stream = USB_STREAM_NONE;
+    streamOk = false;
+    inStreamString = false;
+}
+
+void UsbCommandReader::abortStream() {
+    if (stream != USB_STREAM_NONE) {
+        handler->endStream(false);
+        stream = USB_STREAM_NONE;
+        inStreamString = false;
+    }
+}
+
+// Picks the document a value at the current depth goes into: data for
+// the envelope's data field, each element of an item stream on its own
+void UsbCommandReader::prepareValue() {
+    if (depth == 1) {
+        target = (strcmp(key, "data") == 0 && !tooLarge) ? &data : nullptr;
+        buildDepth = 1;
+    } else if (stream == USB_STREAM_ITEMS && depth == 3 && !tooLarge) {
+        item.clear();
+        target = &item;
+        buildDepth = 3;
+    }
+}
+
+// Only fields of a data object, once cmd is known
+bool UsbCommandReader::startStream(usb_stream_e type) {
+    if (!handler || tooLarge || depth != 2 || target != &data || !cmd[0] || !containers[2].is<JsonObject>()) {
+        return false;
+    }
+    if (handler->getStreamType(cmd, key) != type) {
+        return false;
+    }
+    stream = type;
+    base64Bits = 0;
+    base64Count = 0;
+    streamOk = handler->beginStream(cmd, data.as<JsonVariantConst>());
+    return true;
+}
+
+void UsbCommandReader::beginContainer(bool array) {
+    if (target && depth >= buildDepth) {
+        JsonVariant child;
+        if (depth == buildDepth) {
+            child = array ? JsonVariant(target->to<JsonArray>()) : JsonVariant(target->to<JsonObject>());
+        } else if (containers[depth].is<JsonArray>()) {
+            JsonArray parent = containers[depth].as<JsonArray>();
+            child = array ? JsonVariant(parent.add<JsonArray>()) : JsonVariant(parent.add<JsonObject>());
+        } else {
+            JsonVariant parent = containers[depth];
+            child = array ? JsonVariant(parent[key].to<JsonArray>()) : JsonVariant(parent[key].to<JsonObject>());
+        }
+        containers[depth + 1] = child;
+    }
+    depth++;
+}
+
+void UsbCommandReader::endContainer() {
+    depth--;
+    if (depth > 0) {
+        valueDone();
+    }
+}
+
+template <typename T>
+void UsbCommandReader::setValue(T value) {
+    if (!target || depth < buildDepth) {
+        return;
+    }
+    if (depth == buildDepth) {
+        target->set(value);
+    } else if (containers[depth].is<JsonArray>()) {
+        containers[depth].as<JsonArray>().add(value);
+    } else {
+        containers[depth][key] = value;
+    }
+}
+
+// A value at the current depth is complete
+void UsbCommandReader::valueDone() {
+    if (stream == USB_STREAM_ITEMS) {
+        if (depth == 3 && target == &item) {
+            if (streamOk) {
+                streamOk = handler->writeItem(item.as<JsonVariantConst>());
+            }
+            item.clear();
+            target = nullptr;
+            bytes = 0;
+        } else if (depth == 2) {
+            handler->endStream(streamOk);
+            stream = USB_STREAM_NONE;
+            target = &data;
+            buildDepth = 1;
+        }
+    }
+    if (depth == 1) {
+        target = nullptr;
+    }
+}
+
+void UsbCommandReader::onBeginObject() {
+    if (depth == 0) {
+        envelope = true;
+        depth = 1;
+        return;
+    }
+    prepareValue();
+    beginContainer(false);
+}
+
+void UsbCommandReader::onBeginArray() {
+    if (depth == 0) {
+        depth = 1;
+        return;
+    }
+    prepareValue();
+    if (startStream(USB_STREAM_ITEMS)) {
+        depth++;
+        return;
+    }
+    beginContainer(true);
+}
+
+void UsbCommandReader::onEndObject() {
+    endContainer();
+}
+
+void UsbCommandReader::onEndArray() {
+    endContainer();
+}
+
+void UsbCommandReader::onKey(const char *k) {
+    strlcpy(key, k, sizeof(key));
+}
+
+void UsbCommandReader::onString(const char *part, size_t len, bool last) {
+    if (!inString) {
+        inString = true;
+        prepareValue();
+        stringToCmd = depth == 1 && strcmp(key, "cmd") == 0;
+        if (stringToCmd) {
+            cmdLen = 0;
+        }
+        inStreamString = startStream(USB_STREAM_BASE64);
+        text = String();
+    }
+    if (stringToCmd) {
+        size_t n = len < USB_CMD_NAME_MAX - 1 - cmdLen ? len : USB_CMD_NAME_MAX - 1 - cmdLen;
+        memcpy(cmd + cmdLen, part, n);
+        cmdLen += n;
+        cmd[cmdLen] = '\0';
+    } else if (inStreamString) {
+        writeBase64(part, len);
+    } else if (target && depth >= buildDepth) {
+        text.concat(part, len);
+    }
+    if (!last) {
+        return;
+    }
+    inString = false;
+    if (inStreamString) {
+        inStreamString = false;
+        handler->endStream(streamOk);
+        stream = USB_STREAM_NONE;
+    } else {
+        setValue(text);
+        text = String();
+    }
+    valueDone();
+}
+
+void UsbCommandReader::onLiteral(const char *literal) {
+    prepareValue();
+    if (depth == 1 && strcmp(key, "id") == 0) {
+        id = strtoul(literal, nullptr, 10);
+    }
+    if (strcmp(literal, "true") == 0 || strcmp(literal, "false") == 0) {
+        setValue(literal[0] == 't');
+    } else if (strcmp(literal, "null") == 0) {
+        setValue(nullptr);
+    } else if (strpbrk(literal, ".eE")) {
+        setValue(strtod(literal, nullptr));
+    } else if (literal[0] == '-') {
+        setValue((int64_t)strtoll(literal, nullptr, 10));
+    } else {
+        setValue((uint64_t)strtoull(literal, nullptr, 10));
+    }
+    valueDone();
+}
+
+// Whitespace and padding are skipped, anything else outside the alphabet
+// fails the stream
+void UsbCommandReader::writeBase64(const char *part, size_t len) {
+    uint8_t out[JSON_STREAM_CHUNK];
+    size_t n = 0;
+    for (size_t i = 0; i < len && streamOk; i++) {
+        char c = part[i];
+        int8_t value;
+        if (c >= 'A' && c <= 'Z') {
+            value = c - 'A';
+        } else if (c >= 'a' && c <= 'z') {
+            value = c - 'a' + 26;
+        } else if (c >= '0' && c <= '9') {
+            value = c - '0' + 52;
+        } else if (c == '+') {
+            value = 62;
+        } else if (c == '/') {
+            value = 63;
+        } else if (c == '=' || c == ' ' || c == '\n' || c == '\r') {
+            continue;
+        } else {
+            streamOk = false;
+            break;
+        }
+        base64Bits = (base64Bits << 6) | value;
+        base64Count += 6;
+        if (base64Count >= 8) {
+            base64Count -= 8;
+            out[n++] = base64Bits >> base64Count;
+            base64Bits &= (1 << base64Count) - 1;
+        }
+    }
+    if (n > 0 && streamOk) {
+        streamOk = handler->writeStream(out, n);
+    }
+}
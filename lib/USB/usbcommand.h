@@ -0,0 +1,117 @@
+#ifndef USBCOMMAND_H
+#define USBCOMMAND_H
+
+/**
+ * USB command reader, on top of the JsonStreamParser
+ *
+ * {"cmd":"races/save","id":3,"data":{...}} is read as it arrives: cmd and
+ * id into fields, data into a JsonDocument, with no copy of the text.
+ * data may take up to USB_CMD_DATA_MAX bytes of JSON, the limit of an
+ * HTTP JSON body; a bigger one is read to its end and refused.
+ *
+ * Large payloads go past the document, through a UsbStreamHandler, when
+ * cmd comes before data (as every host sends it) and the field is one of
+ * the handler's:
+ * - USB_STREAM_BASE64: a base64 string, passed on decoded in small parts
+ *   (track images)
+ * - USB_STREAM_ITEMS: an array, passed on one element at a time, each
+ *   built on its own and freed (race uploads)
+ * The fields of data before the streamed one are in the document by then,
+ * so a stream can depend on them (trackId before image)
+ */
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#include "jsonstream.h"
+
+#define USB_CMD_NAME_MAX 48
+#define USB_CMD_DATA_MAX 16384
+
+typedef enum {
+    USB_STREAM_NONE = 0,
+    USB_STREAM_BASE64,
+    USB_STREAM_ITEMS
+} usb_stream_e;
+
+class UsbStreamHandler {
+   public:
+    // How field key of the command's data is taken
+    virtual usb_stream_e getStreamType(const char *cmd, const char *key) = 0;
+    // data holds the fields before the streamed one. false refuses the
+    // stream, endStream() still follows
+    virtual bool beginStream(const char *cmd, JsonVariantConst data) = 0;
+    // false stops the stream
+    virtual bool writeStream(const uint8_t *bytes, size_t len) = 0;
+    virtual bool writeItem(JsonVariantConst item) = 0;
+    // complete: the whole value arrived and every write succeeded
+    virtual void endStream(bool complete) = 0;
+};
+
+class UsbCommandReader : public JsonStreamListener {
+   public:
+    UsbCommandReader() : parser(this) {}
+    void init(UsbStreamHandler *streamHandler) { handler = streamHandler; }
+    // On JSON_STREAM_DONE the command is ready, its fields stay valid
+    // until the next feed()
+    json_stream_e feed(char c);
+
+    // A top level object with a cmd
+    bool isCommand() const { return envelope && cmd[0]; }
+    bool isTooLarge() const { return tooLarge; }
+    const char *getCmd() const { return cmd; }
+    uint32_t getId() const { return id; }
+    JsonVariantConst getData() const { return data.as<JsonVariantConst>(); }
+
+    // JsonStreamListener implementation
+    void onBeginObject() override;
+    void onEndObject() override;
+    void onBeginArray() override;
+    void onEndArray() override;
+    void onKey(const char *k) override;
+    void onString(const char *part, size_t len, bool last) override;
+    void onLiteral(const char *text) override;
+
+   private:
+    void clear();
+    void abortStream();
+    void prepareValue();
+    bool startStream(usb_stream_e type);
+    void beginContainer(bool array);
+    void endContainer();
+    template <typename T>
+    void setValue(T value);
+    void valueDone();
+    void writeBase64(const char *part, size_t len);
+
+    JsonStreamParser parser;
+    UsbStreamHandler *handler = nullptr;
+    bool complete = false;  // clear() before the next byte
+
+    bool envelope = false;
+    char cmd[USB_CMD_NAME_MAX];
+    uint32_t id = 0;
+    uint8_t depth = 0;
+    char key[JSON_STREAM_KEY_MAX];
+
+    // Document being built, its root a value at depth buildDepth
+    DynamicJsonDocument data{1024};
+    DynamicJsonDocument item{1024};
+    JsonDocument *target = nullptr;
+    uint8_t buildDepth = 0;
+    JsonVariant containers[JSON_STREAM_MAX_DEPTH + 1];  // Open at each depth
+    String text;  // String value in parts
+    bool inString = false;
+    bool stringToCmd = false;
+    size_t cmdLen = 0;
+    size_t bytes = 0;
+    bool tooLarge = false;
+
+    usb_stream_e stream = USB_STREAM_NONE;
+    bool streamOk = false;
+    bool inStreamString = false;
+    uint32_t base64Bits = 0;
+    uint8_t base64Count = 0;
+};
+
+#endif  // USBCOMMAND_H
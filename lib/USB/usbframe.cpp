@@ -0,0 +1,85 @@
+#include "usbframe.h"
+
+// CRC-16/CCITT-FALSE, bitwise - frames are short and this avoids a 512-byte table
+uint16_t usbFrameCrc16(const uint8_t* data, size_t len, uint16_t crc) {
+    for (size_t i = 0; i < len; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+size_t usbFrameCobsDecode(const uint8_t* in, size_t len, uint8_t* out) {
+    size_t read = 0;
+    size_t written = 0;
+    while (read < len) {
+        uint8_t code = in[read++];
+        if (code == 0 || read + code - 1 > len) {
+            return 0;
+        }
+        for (uint8_t i = 1; i < code; i++) {
+            if (in[read] == 0) {
+                return 0;
+            }
+            out[written++] = in[read++];
+        }
+        // A full block carries no implied zero, nor does the last one
+        if (code != 0xFF && read < len) {
+            out[written++] = 0;
+        }
+    }
+    return written;
+}
+
+size_t UsbFrameWriter::write(uint8_t type, uint8_t seq, const void* payload, size_t len) {
+    return write(type, seq, payload, len, nullptr, 0);
+}
+
+size_t UsbFrameWriter::write(uint8_t type, uint8_t seq, const void* head, size_t headLen, const void* tail, size_t tailLen) {
+    static const uint8_t delimiter = 0;
+    written = 0;
+    emit(&delimiter, 1);
+
+    uint8_t header[2] = {type, seq};
+    uint16_t crc = usbFrameCrc16(header, sizeof(header));
+    crc = usbFrameCrc16((const uint8_t*)head, headLen, crc);
+    crc = usbFrameCrc16((const uint8_t*)tail, tailLen, crc);
+    uint8_t trailer[2] = {(uint8_t)(crc & 0xFF), (uint8_t)(crc >> 8)};
+
+    blockLen = 1;
+    put(header, sizeof(header));
+    put((const uint8_t*)head, headLen);
+    put((const uint8_t*)tail, tailLen);
+    put(trailer, sizeof(trailer));
+    flushBlock();
+
+    emit(&delimiter, 1);
+    return written;
+}
+
+void UsbFrameWriter::put(const uint8_t* data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (data[i] == 0) {
+            flushBlock();
+            blockLen = 1;
+        } else {
+            block[blockLen++] = data[i];
+            if (blockLen == 0xFF) {
+                flushBlock();
+                blockLen = 1;
+            }
+        }
+    }
+}
+
+void UsbFrameWriter::flushBlock() {
+    block[0] = blockLen;
+    emit(block, blockLen);
+}
+
+void UsbFrameWriter::emit(const uint8_t* data, size_t len) {
+    sink(ctx, data, len);
+    written += len;
+}
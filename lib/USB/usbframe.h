@@ -0,0 +1,118 @@
+#ifndef USBFRAME_H
+#define USBFRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Binary USB frames, the optional compact mode of the USB transport
+ *
+ * A frame is  type(1) | seq(1) | payload | crc16(2, little endian)
+ * COBS encoded and sent between two 0x00 delimiters. The leading delimiter
+ * keeps debug text printed on the same port out of the next frame: text
+ * ends up in a chunk of its own that fails the CRC, and a host shows it as
+ * text. seq counts frames, so a host can see gaps.
+ *
+ * Payloads are the packed little-endian structs below. Plain C++ with no
+ * Arduino dependency, so tools/usb_proto can build it on the host
+ */
+
+#define USB_FRAME_VERSION 4
+#define USB_FRAME_OVERHEAD 4  // type, seq, crc16
+
+typedef enum {
+    USB_FRAME_JSON = 0x01,        // Command response or other JSON, as text
+    USB_FRAME_LAP = 0x10,
+    USB_FRAME_RSSI_BATCH = 0x11,
+    USB_FRAME_RACE_STATE = 0x12,
+    USB_FRAME_RACE_ARMED = 0x13,
+    USB_FRAME_PERF = 0x14,
+    USB_FRAME_RACE_SUMMARY = 0x15  // UDP only, see udptransport.h
+} usb_frame_type_e;
+
+typedef enum {
+    USB_RACE_STOPPED = 0,
+    USB_RACE_STARTED = 1
+} usb_race_state_e;
+
+struct __attribute__((packed)) UsbLapFrame {
+    uint32_t lapTimeMs;
+    uint32_t deviceTimeMs;  // Gate crossing
+    uint32_t eventId;       // See EventLog, 0 if not logged
+};
+
+// Followed by count RSSI bytes, sample i taken at baseTimeMs + i * intervalUs
+struct __attribute__((packed)) UsbRssiBatchFrame {
+    uint32_t baseTimeMs;
+    uint32_t intervalUs;  // 32 bits since version 4, slow streams overflowed 16
+    uint8_t count;
+};
+
+struct __attribute__((packed)) UsbRaceStateFrame {
+    uint32_t deviceTimeMs;
+    uint8_t state;  // usb_race_state_e
+    uint32_t eventId;
+};
+
+struct __attribute__((packed)) UsbRaceArmedFrame {
+    uint32_t deviceTimeMs;
+    uint32_t startTimeMs;
+    uint32_t eventId;
+};
+
+// Standings of the current race. lapCount includes the gate 1 pass, best
+// leaves it out (bestLapNumber 0 = no lap yet)
+struct __attribute__((packed)) UsbRaceSummaryFrame {
+    uint32_t deviceTimeMs;
+    uint32_t lastEventId;   // Newest lap or race event counted
+    uint8_t state;          // usb_race_state_e
+    uint16_t lapCount;
+    uint32_t lastLapMs;
+    uint32_t bestLapMs;
+    uint16_t bestLapNumber;
+    uint32_t totalMs;       // Sum of all laps
+};
+
+struct __attribute__((packed)) UsbPerfFrame {
+    uint32_t deviceTimeMs;
+    uint32_t freeHeap;
+    uint32_t minFreeHeap;
+    uint16_t cpuMhz;
+    uint32_t framesSent;
+    uint32_t bytesSent;
+    uint32_t framesDropped;  // Events not sent because the link was backed up
+};
+
+uint16_t usbFrameCrc16(const uint8_t* data, size_t len, uint16_t crc = 0xFFFF);
+
+// Decodes one COBS chunk (without delimiters) into out, which must hold len
+// bytes. Returns the decoded length, 0 if the chunk is not valid COBS
+size_t usbFrameCobsDecode(const uint8_t* in, size_t len, uint8_t* out);
+
+// Streams one frame through COBS into a sink, 254-byte blocks at a time,
+// so no encoded copy of the frame is ever held
+class UsbFrameWriter {
+   public:
+    typedef void (*Sink)(void* ctx, const uint8_t* data, size_t len);
+
+    UsbFrameWriter(Sink sink, void* ctx) : sink(sink), ctx(ctx) {}
+
+    // Writes a whole frame, delimiters included. Returns the bytes put on the wire
+    size_t write(uint8_t type, uint8_t seq, const void* payload, size_t len);
+
+    // Same, for a payload made of two parts (a header struct and samples)
+    size_t write(uint8_t type, uint8_t seq, const void* head, size_t headLen, const void* tail, size_t tailLen);
+
+   private:
+    Sink sink;
+    void* ctx;
+    uint8_t block[255];
+    uint8_t blockLen = 1;  // block[0] is the COBS code byte
+    size_t written = 0;
+
+    void put(const uint8_t* data, size_t len);
+    void flushBlock();
+    void emit(const uint8_t* data, size_t len);
+};
+
+#endif
@@ -8,35 +8,60 @@ WebhookManager::WebhookManager() : webhookCount(0), enabled(true), queueHead(0),
     memset(requestQueue, 0, sizeof(requestQueue));
 }
 
-bool WebhookManager::addWebhook(const char* ip) {
-    if (!ip || strlen(ip) == 0) {
-        DEBUG("Invalid webhook IP\n");
-        return false;
-    }
-    
-    // Check if already exists
-    for (uint8_t i = 0; i < webhookCount; i++) {
-        if (strcmp(webhookIPs[i], ip) == 0) {
-            DEBUG("Webhook IP already exists: %s\n", ip);
-            return false;
+// Runs on the config bus task while laps and race events may be sending,
+// so the new list is built aside and swapped in under listMux
+void WebhookManager::onConfigChanged(Config& config, uint32_t changed) {
+    char ips[MAX_WEBHOOKS][16];
+    uint8_t count = 0;
+    memset(ips, 0, sizeof(ips));
+    for (uint8_t i = 0; i < config.getWebhookCount(); i++) {
+        if (!addTo(ips, count, config.getWebhookIP(i))) {
+            DEBUG("Webhook IP skipped: %s\n", config.getWebhookIP(i) ? config.getWebhookIP(i) : "");
         }
     }
     
-    // Check max limit
-    if (webhookCount >= MAX_WEBHOOKS) {
-        DEBUG("Max webhooks reached (%d)\n", MAX_WEBHOOKS);
+    portENTER_CRITICAL(&listMux);
+    memcpy(webhookIPs, ips, sizeof(webhookIPs));
+    webhookCount = count;
+    portEXIT_CRITICAL(&listMux);
+    setEnabled(config.getWebhooksEnabled());
+    DEBUG("Webhooks updated (total: %d)\n", count);
+}
+
+// No logging here, addWebhook() calls it in a critical section
+bool WebhookManager::addTo(char (*ips)[16], uint8_t& count, const char* ip) {
+    if (!ip || strlen(ip) == 0 || count >= MAX_WEBHOOKS) {
         return false;
     }
-    
+    for (uint8_t i = 0; i < count; i++) {
+        if (strcmp(ips[i], ip) == 0) {
+            return false;
+        }
+    }
     // Copy IP to fixed buffer
-    strncpy(webhookIPs[webhookCount], ip, 15);
-    webhookIPs[webhookCount][15] = '\0';  // Ensure null termination
-    webhookCount++;
-    DEBUG("Webhook added: %s (total: %d)\n", ip, webhookCount);
+    strncpy(ips[count], ip, 15);
+    ips[count][15] = '\0';  // Ensure null termination
+    count++;
     return true;
 }
 
+bool WebhookManager::addWebhook(const char* ip) {
+    portENTER_CRITICAL(&listMux);
+    uint8_t count = webhookCount;
+    bool added = addTo(webhookIPs, count, ip);
+    webhookCount = count;
+    portEXIT_CRITICAL(&listMux);
+    if (added) {
+        DEBUG("Webhook added: %s (total: %d)\n", ip, count);
+    } else {
+        DEBUG("Webhook not added (invalid, duplicate or max %d): %s\n", MAX_WEBHOOKS, ip ? ip : "");
+    }
+    return added;
+}
+
 bool WebhookManager::removeWebhook(const char* ip) {
+    bool removed = false;
+    portENTER_CRITICAL(&listMux);
     for (uint8_t i = 0; i < webhookCount; i++) {
         if (strcmp(webhookIPs[i], ip) == 0) {
             // Shift remaining IPs down
@@ -45,17 +70,24 @@ bool WebhookManager::removeWebhook(const char* ip) {
             }
             webhookCount--;
             memset(webhookIPs[webhookCount], 0, 16);  // Clear last slot
-            DEBUG("Webhook removed: %s (remaining: %d)\n", ip, webhookCount);
-            return true;
+            removed = true;
+            break;
         }
     }
-    DEBUG("Webhook not found: %s\n", ip);
-    return false;
+    portEXIT_CRITICAL(&listMux);
+    if (removed) {
+        DEBUG("Webhook removed: %s\n", ip);
+    } else {
+        DEBUG("Webhook not found: %s\n", ip);
+    }
+    return removed;
 }
 
 void WebhookManager::clearWebhooks() {
+    portENTER_CRITICAL(&listMux);
     webhookCount = 0;
     memset(webhookIPs, 0, sizeof(webhookIPs));
+    portEXIT_CRITICAL(&listMux);
     DEBUG("All webhooks cleared\n");
 }
 
@@ -159,9 +191,16 @@ void WebhookManager::processNextRequest() {
     queueCount--;
 }
 
+// The list is copied first: the requests take up to WEBHOOK_TIMEOUT_MS
+// each, far too long to hold listMux
 void WebhookManager::sendToAll(const char* endpoint) {
-    for (uint8_t i = 0; i < webhookCount; i++) {
-        sendWebhook(webhookIPs[i], endpoint);
+    char ips[MAX_WEBHOOKS][16];
+    portENTER_CRITICAL(&listMux);
+    uint8_t count = webhookCount;
+    memcpy(ips, webhookIPs, sizeof(ips));
+    portEXIT_CRITICAL(&listMux);
+    for (uint8_t i = 0; i < count; i++) {
+        sendWebhook(ips[i], endpoint);
     }
 }
 
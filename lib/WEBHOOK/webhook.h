@@ -2,8 +2,11 @@
 #define WEBHOOK_H
 
 #include <Arduino.h>
+#include <freertos/FreeRTOS.h>
 #include <vector>
 
+#include "config.h"
+
 #define MAX_WEBHOOKS 10
 #define WEBHOOK_TIMEOUT_MS 300  // Reduced timeout
 #define WEBHOOK_QUEUE_SIZE 10   // Max pending webhook requests
@@ -13,15 +16,20 @@ struct WebhookRequest {
     uint32_t timestamp;
 };
 
-class WebhookManager {
+class WebhookManager : public ConfigListener {
    public:
     WebhookManager();
     
-    // Add/remove webhook IPs - use const char* to avoid String copies
+    // Subscribed to CONFIG_CHANGED_WEBHOOKS, mirrors the enable flag and IP list
+    void onConfigChanged(Config& config, uint32_t changed) override;
+    
+    // Add/remove webhook IPs - use const char* to avoid String copies.
+    // Safe from any task, the list is only touched under listMux
     bool addWebhook(const char* ip);
     bool removeWebhook(const char* ip);
     void clearWebhooks();
     uint8_t getWebhookCount() const;
+    // Points into the list, valid until the next change
     const char* getWebhookIP(uint8_t index) const;
     
     // Trigger webhook events (queued, truly non-blocking)
@@ -42,6 +50,7 @@ class WebhookManager {
    private:
     char webhookIPs[MAX_WEBHOOKS][16];  // Fixed-size IP storage (xxx.xxx.xxx.xxx\0)
     uint8_t webhookCount;
+    portMUX_TYPE listMux = portMUX_INITIALIZER_UNLOCKED;
     bool enabled;
     
     // Queue for webhook requests
@@ -53,6 +62,9 @@ class WebhookManager {
     // Rate limiting
     uint32_t lastWebhookMs;
     
+    // Appends to a list unless the IP is empty, already there or the list is full
+    static bool addTo(char (*ips)[16], uint8_t& count, const char* ip);
+    
     // Queue a webhook request
     void queueRequest(const char* endpoint);
     
@@ -0,0 +1,208 @@
+#include "ssefanout.h"
+
+#include "debug.h"
+
+void SseFanout::init() {
+    if (!mutex) {
+        mutex = xSemaphoreCreateRecursiveMutex();
+    }
+}
+
+uint32_t SseFanout::addClient(AsyncEventSourceClient *client) {
+    xSemaphoreTakeRecursive(mutex, portMAX_DELAY);
+    Slot *slot = nullptr;
+    for (uint8_t i = 0; i < SSE_MAX_CLIENTS && !slot; i++) {
+        if (!slots[i].client) slot = &slots[i];
+    }
+    if (!slot) {
+        xSemaphoreGiveRecursive(mutex);
+        DEBUG("SSE: %u clients, refusing another\n", SSE_MAX_CLIENTS);
+        client->close();
+        return 0;
+    }
+    if (++lastClientId == 0) {
+        lastClientId = 1;
+    }
+    slot->client = client;
+    slot->id = lastClientId;
+    slot->heldHead = slot->heldCount = 0;
+    slot->dropHead = slot->dropCount = 0;
+    slot->stats = SseClientStats();
+    slot->stats.connectedMs = millis();
+    slot->progressMs = slot->stats.connectedMs;
+    slot->queuedAfterPush = 0;
+    slot->closing = false;
+    uint32_t id = slot->id;
+    xSemaphoreGiveRecursive(mutex);
+    return id;
+}
+
+void SseFanout::removeClient(AsyncEventSourceClient *client) {
+    xSemaphoreTakeRecursive(mutex, portMAX_DELAY);
+    for (uint8_t i = 0; i < SSE_MAX_CLIENTS; i++) {
+        Slot &slot = slots[i];
+        if (slot.client == client) {
+            slot.client = nullptr;
+            slot.id = 0;
+            slot.closing = false;
+            for (uint8_t k = 0; k < SSE_HELD_MAX; k++) slot.held[k].data = String();
+            for (uint8_t k = 0; k < SSE_DROP_QUEUE; k++) slot.drop[k].data = String();
+            DEBUG("SSE client %u gone: %u sent, %u dropped, peak queue %u\n",
+                  i, slot.stats.sent, slot.stats.dropped, slot.stats.peakQueued);
+        }
+    }
+    xSemaphoreGiveRecursive(mutex);
+}
+
+// AsyncTCP reports the disconnect later, on its own task; until then the
+// slot gets nothing and isn't counted as a client
+void SseFanout::close(Slot &slot, const char *reason) {
+    if (slot.closing) {
+        return;
+    }
+    DEBUG("SSE client closed, %s (queue %u, held %u)\n", reason, slot.stats.queued, slot.heldCount);
+    slot.closing = true;
+    closedSaturated++;
+    for (uint8_t k = 0; k < SSE_HELD_MAX; k++) slot.held[k].data = String();
+    for (uint8_t k = 0; k < SSE_DROP_QUEUE; k++) slot.drop[k].data = String();
+    slot.heldCount = 0;
+    slot.dropCount = 0;
+    slot.client->close();
+}
+
+void SseFanout::queue(Slot &slot, const char *data, const char *event, sse_delivery_e delivery, uint32_t id) {
+    if (delivery == SSE_GUARANTEED) {
+        if (slot.heldCount == SSE_HELD_MAX) {
+            close(slot, "lap events backed up");
+            return;
+        }
+        Message &m = slot.held[(slot.heldHead + slot.heldCount) % SSE_HELD_MAX];
+        m.data = data;
+        m.event = event;
+        m.id = id;
+        slot.heldCount++;
+    } else {
+        if (slot.dropCount == SSE_DROP_QUEUE) {
+            slot.dropHead = (slot.dropHead + 1) % SSE_DROP_QUEUE;
+            slot.dropCount--;
+            slot.stats.dropped++;
+        }
+        Message &m = slot.drop[(slot.dropHead + slot.dropCount) % SSE_DROP_QUEUE];
+        m.data = data;
+        m.event = event;
+        m.id = id;
+        slot.dropCount++;
+    }
+    pump(slot, millis());
+}
+
+void SseFanout::send(const char *data, const char *event, sse_delivery_e delivery, uint32_t id) {
+    xSemaphoreTakeRecursive(mutex, portMAX_DELAY);
+    for (uint8_t i = 0; i < SSE_MAX_CLIENTS; i++) {
+        if (slots[i].client && !slots[i].closing) {
+            queue(slots[i], data, event, delivery, id);
+        }
+    }
+    xSemaphoreGiveRecursive(mutex);
+}
+
+void SseFanout::sendTo(AsyncEventSourceClient *client, const char *data, const char *event, uint32_t id) {
+    xSemaphoreTakeRecursive(mutex, portMAX_DELAY);
+    for (uint8_t i = 0; i < SSE_MAX_CLIENTS; i++) {
+        if (slots[i].client == client && !slots[i].closing) {
+            queue(slots[i], data, event, SSE_GUARANTEED, id);
+        }
+    }
+    xSemaphoreGiveRecursive(mutex);
+}
+
+bool SseFanout::sendTo(uint32_t clientId, const char *data, const char *event, sse_delivery_e delivery) {
+    bool found = false;
+    xSemaphoreTakeRecursive(mutex, portMAX_DELAY);
+    for (uint8_t i = 0; i < SSE_MAX_CLIENTS && !found; i++) {
+        if (clientId && slots[i].id == clientId && slots[i].client && !slots[i].closing) {
+            queue(slots[i], data, event, delivery, 0);
+            found = true;
+        }
+    }
+    xSemaphoreGiveRecursive(mutex);
+    return found;
+}
+
+bool SseFanout::hasClient(uint32_t clientId) {
+    bool found = false;
+    xSemaphoreTakeRecursive(mutex, portMAX_DELAY);
+    for (uint8_t i = 0; i < SSE_MAX_CLIENTS && !found; i++) {
+        found = clientId && slots[i].id == clientId && slots[i].client && !slots[i].closing;
+    }
+    xSemaphoreGiveRecursive(mutex);
+    return found;
+}
+
+bool SseFanout::pump(Slot &slot, uint32_t currentTimeMs) {
+    size_t queued = slot.client->packetsWaiting();
+    if (queued == 0 || queued < slot.queuedAfterPush) {
+        slot.progressMs = currentTimeMs;
+    }
+
+    // Guaranteed first, in order, then the newest droppable ones while the
+    // queue is nearly empty
+    while (slot.heldCount && queued < SSE_QUEUE_HIGH) {
+        Message &m = slot.held[slot.heldHead];
+        slot.client->send(m.data.c_str(), m.event, m.id, 0);
+        m.data = String();
+        slot.heldHead = (slot.heldHead + 1) % SSE_HELD_MAX;
+        slot.heldCount--;
+        slot.stats.sent++;
+        queued++;
+    }
+    while (slot.dropCount && queued < SSE_QUEUE_LOW && slot.heldCount == 0) {
+        Message &m = slot.drop[slot.dropHead];
+        slot.client->send(m.data.c_str(), m.event, m.id, 0);
+        m.data = String();
+        slot.dropHead = (slot.dropHead + 1) % SSE_DROP_QUEUE;
+        slot.dropCount--;
+        slot.stats.sent++;
+        queued++;
+    }
+
+    slot.queuedAfterPush = queued;
+    slot.stats.queued = queued;
+    slot.stats.held = slot.heldCount;
+    if (queued > slot.stats.peakQueued) {
+        slot.stats.peakQueued = queued;
+    }
+    slot.stats.saturated = queued >= SSE_QUEUE_LOW || slot.heldCount > 0;
+    if (slot.stats.saturated && currentTimeMs - slot.progressMs > SSE_SATURATED_MS) {
+        close(slot, "saturated");
+        return false;
+    }
+    return true;
+}
+
+void SseFanout::update(uint32_t currentTimeMs) {
+    xSemaphoreTakeRecursive(mutex, portMAX_DELAY);
+    for (uint8_t i = 0; i < SSE_MAX_CLIENTS; i++) {
+        if (slots[i].client && !slots[i].closing) {
+            pump(slots[i], currentTimeMs);
+        }
+    }
+    xSemaphoreGiveRecursive(mutex);
+}
+
+size_t SseFanout::count() {
+    return getStats(nullptr, 0);
+}
+
+size_t SseFanout::getStats(SseClientStats *out, size_t max) {
+    size_t n = 0;
+    xSemaphoreTakeRecursive(mutex, portMAX_DELAY);
+    for (uint8_t i = 0; i < SSE_MAX_CLIENTS; i++) {
+        if (slots[i].client && !slots[i].closing) {
+            if (n < max) out[n] = slots[i].stats;
+            n++;
+        }
+    }
+    xSemaphoreGiveRecursive(mutex);
+    return n;
+}
@@ -0,0 +1,112 @@
+#ifndef SSEFANOUT_H
+#define SSEFANOUT_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+// Event stream clients tracked, five phones and a laptop
+#define SSE_MAX_CLIENTS 6
+// Droppable messages waiting per client; a new one pushes out the oldest
+#define SSE_DROP_QUEUE 4
+// Lap and race messages held per client while its queue is full. One more
+// and the client is closed: it would miss a lap otherwise
+#define SSE_HELD_MAX 16
+// Library queue depth per client: droppable messages only go out below
+// LOW, guaranteed ones are held at HIGH and above
+#define SSE_QUEUE_LOW 4
+#define SSE_QUEUE_HIGH (SSE_MAX_QUEUED_MESSAGES * 3 / 4)
+// A client backed up this long without draining a message is closed
+#define SSE_SATURATED_MS 5000
+
+typedef enum {
+    SSE_DROPPABLE = 0,   // RSSI, telemetry, keepalive: newest wins
+    SSE_GUARANTEED = 1   // Laps and race state: every client gets every one, in order
+} sse_delivery_e;
+
+struct SseClientStats {
+    uint32_t connectedMs;
+    uint32_t sent;
+    uint32_t dropped;      // Droppable messages pushed out by newer ones
+    uint16_t queued;       // Library queue depth at the last check
+    uint16_t peakQueued;
+    uint16_t held;         // Guaranteed messages waiting on our side
+    bool saturated;        // Backed up: queue at SSE_QUEUE_LOW or messages held
+};
+
+// Per-client fan-out over an AsyncEventSource. events.send() puts every
+// message in every client's queue, so one slow phone fills its queue (and
+// the heap) with RSSI. Here each client has its own small queues in front
+// of the library's, and messages move into the library queue only as fast
+// as that client drains it:
+// - Droppable ones wait in a ring of SSE_DROP_QUEUE, the oldest goes first
+// - Guaranteed ones go straight through unless the queue is at HIGH, then
+//   they wait in order; the client is closed before one would be lost
+// - A client backed up for SSE_SATURATED_MS without draining anything is
+//   closed; a slow one that still drains stays, with fewer RSSI updates
+// A closed client reconnects by itself and reloads the race.
+//
+// removeClient() is hooked to AsyncEventSource::onDisconnect, which runs
+// before the library frees the client, so no tracked pointer outlives it.
+// Thread safe, senders run on the timing loop, the housekeeping task and
+// async_tcp
+class SseFanout {
+   public:
+    void init();
+    // From AsyncEventSource::onConnect. Returns the client's id, never 0
+    // and not reused while it is connected, or 0 if all slots are taken and
+    // the client was closed
+    uint32_t addClient(AsyncEventSourceClient *client);
+    // From AsyncEventSource::onDisconnect
+    void removeClient(AsyncEventSourceClient *client);
+    // id, if not 0, becomes the client's Last-Event-ID
+    void send(const char *data, const char *event, sse_delivery_e delivery, uint32_t id = 0);
+    // A guaranteed message to one client, for replays
+    void sendTo(AsyncEventSourceClient *client, const char *data, const char *event, uint32_t id);
+    // A message to the client addClient() gave clientId, for per-client
+    // streams. False if that client is gone or being closed
+    bool sendTo(uint32_t clientId, const char *data, const char *event, sse_delivery_e delivery);
+    bool hasClient(uint32_t clientId);
+    // Moves waiting messages on, closes saturated clients
+    void update(uint32_t currentTimeMs);
+
+    size_t count();
+    // Counters of the clients connected, up to max. Returns how many
+    size_t getStats(SseClientStats *out, size_t max);
+    uint32_t getClosedSaturated() const { return closedSaturated; }
+
+   private:
+    struct Message {
+        String data;
+        const char *event;  // String literals only
+        uint32_t id;
+    };
+    struct Slot {
+        AsyncEventSourceClient *client = nullptr;
+        uint32_t id = 0;
+        Message held[SSE_HELD_MAX];
+        uint8_t heldHead = 0;
+        uint8_t heldCount = 0;
+        Message drop[SSE_DROP_QUEUE];
+        uint8_t dropHead = 0;
+        uint8_t dropCount = 0;
+        uint32_t progressMs = 0;        // Last time the client drained its queue
+        size_t queuedAfterPush = 0;
+        bool closing = false;           // close() called, the disconnect is on its way
+        SseClientStats stats;
+    };
+
+    // Pushes what the client's queue has room for. False if the client was closed
+    bool pump(Slot &slot, uint32_t currentTimeMs);
+    // Once per client. The slot stays taken, but idle, until the disconnect
+    void close(Slot &slot, const char *reason);
+    void queue(Slot &slot, const char *data, const char *event, sse_delivery_e delivery, uint32_t id);
+
+    Slot slots[SSE_MAX_CLIENTS];
+    SemaphoreHandle_t mutex = nullptr;  // Recursive: a close() may report the disconnect right away
+    uint32_t closedSaturated = 0;
+    uint32_t lastClientId = 0;
+};
+
+#endif
@@ -4,6 +4,7 @@
 #include <DNSServer.h>
 #include <ESPmDNS.h>
 #include <LittleFS.h>
+#include <esp_timer.h>
 #include <esp_wifi.h>
 
 #include "debug.h"
@@ -24,6 +25,16 @@ static IPAddress ipAddress;
 static AsyncWebServer server(80);
 static AsyncEventSource events("/events");
 
+// State of a streamed track image upload. Lives in request->_tempObject, which
+// the request releases with free(), so it must stay a plain struct
+struct TrackImageUpload {
+    uint32_t trackId;
+    bool failed;
+    bool done;  // First file part ended, later parts are ignored
+    int errorCode;
+    const char *error;
+};
+
 static const char *wifi_hostname = "FPVGate";
 static const char *wifi_ap_ssid_prefix = "FPVGate";
 static const char *wifi_ap_password = "fpvgate1";
@@ -47,6 +58,7 @@ void Webserver::init(Config *config, LapTimer *lapTimer, BatteryMonitor *batMoni
     trackManager = trackMgr;
     webhooks = webhookMgr;
     transportMgr = nullptr;
+    sse.init();
 
     wifi_ap_ssid = String(wifi_ap_ssid_prefix) + "_" + WiFi.macAddress().substring(WiFi.macAddress().length() - 6);
     wifi_ap_ssid.replace(":", "");
@@ -74,23 +86,119 @@ void Webserver::setTransportManager(TransportManager *tm) {
 }
 
 // TransportInterface implementation
-void Webserver::sendLapEvent(uint32_t lapTimeMs) {
+// Event data is a small JSON object; "t" is the device time of the event
+// Event name and JSON data of a lap or race event, the same live and
+// replayed. startsInMs lets clients without a synced clock place the start tone
+static const char *formatRaceEvent(const RaceEvent &event, char *buf, size_t size) {
+    switch (event.type) {
+        case RACE_EVENT_LAP:
+            snprintf(buf, size, "{\"lapTime\":%u,\"t\":%u}", event.value, event.deviceTimeMs);
+            return "lap";
+        case RACE_EVENT_STARTED:
+        case RACE_EVENT_STOPPED:
+            snprintf(buf, size, "{\"state\":\"%s\",\"t\":%u}",
+                     event.type == RACE_EVENT_STARTED ? "started" : "stopped", event.deviceTimeMs);
+            return "raceState";
+        case RACE_EVENT_ARMED:
+            snprintf(buf, size, "{\"startTimeMs\":%u,\"startsInMs\":%d,\"t\":%u}",
+                     event.value, (int32_t)(event.value - event.deviceTimeMs), event.deviceTimeMs);
+            return "raceArmed";
+        default:
+            return nullptr;
+    }
+}
+
+void Webserver::sendSseEvent(const RaceEvent &event, AsyncEventSourceClient *client) {
+    char buf[80];
+    const char *name = formatRaceEvent(event, buf, sizeof(buf));
+    if (!name) return;
+    if (client) {
+        sse.sendTo(client, buf, name, event.id);
+    } else {
+        sse.send(buf, name, SSE_GUARANTEED, event.id);
+    }
+}
+
+void Webserver::sendLapEvent(uint32_t lapTimeMs, uint32_t deviceTimeMs, uint32_t eventId) {
+    if (!servicesStarted) return;
+    sendSseEvent({eventId, deviceTimeMs, lapTimeMs, RACE_EVENT_LAP}, nullptr);
+}
+
+void Webserver::sendRssiEvent(uint8_t rssi, uint32_t deviceTimeMs) {
     if (!servicesStarted) return;
-    char buf[16];
-    snprintf(buf, sizeof(buf), "%u", lapTimeMs);
-    events.send(buf, "lap");
+    char buf[40];
+    snprintf(buf, sizeof(buf), "{\"rssi\":%u,\"t\":%u}", rssi, deviceTimeMs);
+    sse.send(buf, "rssi", SSE_DROPPABLE);
 }
 
-void Webserver::sendRssiEvent(uint8_t rssi) {
+void Webserver::sendRaceStateEvent(const char* state, uint32_t deviceTimeMs, uint32_t eventId) {
     if (!servicesStarted) return;
-    char buf[16];
-    snprintf(buf, sizeof(buf), "%u", rssi);
-    events.send(buf, "rssi");
+    uint8_t type = strcmp(state, "started") == 0 ? RACE_EVENT_STARTED : RACE_EVENT_STOPPED;
+    sendSseEvent({eventId, deviceTimeMs, 0, type}, nullptr);
 }
 
-void Webserver::sendRaceStateEvent(const char* state) {
+void Webserver::sendRaceArmedEvent(uint32_t startTimeMs, uint32_t deviceTimeMs, uint32_t eventId) {
     if (!servicesStarted) return;
-    events.send(state, "raceState");
+    sendSseEvent({eventId, deviceTimeMs, startTimeMs, RACE_EVENT_ARMED}, nullptr);
+}
+
+// A browser reconnecting sends Last-Event-ID: the lap and race events it
+// missed are replayed to it before anything live. Under the event log lock,
+// so a lap broadcast meanwhile waits and follows the replay. If the log no
+// longer has them (or the timer rebooted) the client gets "resync" and
+// reloads the race instead
+void Webserver::replayEvents(AsyncEventSourceClient *client, uint32_t lastId) {
+    EventLog *log = transportMgr->getEventLog();
+    if (!log->covers(lastId)) {
+        DEBUG("SSE client at event %u, log is at %u, resync\n", lastId, log->lastId());
+        char buf[32];
+        snprintf(buf, sizeof(buf), "{\"lastId\":%u}", log->lastId());
+        sse.sendTo(client, buf, "resync", log->lastId());
+        return;
+    }
+    RaceEvent chunk[EVENT_LOG_CHUNK];
+    size_t n;
+    while ((n = log->since(lastId, chunk, EVENT_LOG_CHUNK)) > 0) {
+        for (size_t i = 0; i < n; i++) {
+            sendSseEvent(chunk[i], client);
+        }
+        lastId = chunk[n - 1].id;
+    }
+}
+
+void Webserver::updateRssiStreams(uint32_t currentTimeMs) {
+    uint16_t fastestHz = 0;
+    for (uint8_t i = 0; i < WEB_RSSI_STREAMS; i++) {
+        WebRssiStream& stream = rssiStreams[i];
+        uint32_t request = stream.request.load();
+        if (request && (int32_t)(currentTimeMs - stream.renewedMs.load()) > WEB_RSSI_STREAM_LEASE_MS) {
+            DEBUG("RSSI stream %u expired\n", i);
+            stream.request.compare_exchange_strong(request, 0);
+            request = stream.request.load();
+        }
+        if (request != stream.applied) {
+            if (request) {
+                stream.batcher.start(timer->getRssiRing(), request >> 8, request & 0xFF);
+            } else {
+                stream.batcher.stop();
+            }
+            stream.applied = request;
+        }
+        while (stream.batcher.poll()) {
+            char buf[RSSI_BATCH_JSON_MAX];
+            if (servicesStarted && stream.batcher.toJson(buf, sizeof(buf), i) &&
+                !sse.sendTo(stream.client.load(), buf, "rssiBatch", SSE_DROPPABLE)) {
+                // Its client disconnected, a reconnect opens a new stream
+                DEBUG("RSSI stream %u lost its client\n", i);
+                stream.request.compare_exchange_strong(request, 0);
+                break;
+            }
+        }
+        if (stream.batcher.isActive() && stream.batcher.getRateHz() > fastestHz) {
+            fastestHz = stream.batcher.getRateHz();
+        }
+    }
+    rssiStreamRateHz = fastestHz;
 }
 
 bool Webserver::isConnected() {
@@ -99,6 +207,13 @@ bool Webserver::isConnected() {
     return servicesStarted;
 }
 
+bool Webserver::hasClients() {
+    if (!servicesStarted) {
+        return false;
+    }
+    return events.count() > 0 || (wsTransport && wsTransport->count() > 0) || (wifiMode == WIFI_AP && WiFi.softAPgetStationNum() > 0);
+}
+
 void Webserver::update(uint32_t currentTimeMs) {
     handleWebUpdate(currentTimeMs);
 }
@@ -107,14 +222,19 @@ void Webserver::handleWebUpdate(uint32_t currentTimeMs) {
     // Note: Lap events are now broadcast via TransportManager in main.cpp
     // This method only handles WiFi-specific logic
 
-    if (sendRssi && ((currentTimeMs - rssiSentMs) > WEB_RSSI_SEND_TIMEOUT_MS)) {
-        sendRssiEvent(timer->getRssi());
+    // >= rather than >: this runs on a 100 ms grid, so > would stretch 200 ms to 300 ms
+    if (sendRssi && ((currentTimeMs - rssiSentMs) >= WEB_RSSI_SEND_TIMEOUT_MS)) {
+        sendRssiEvent(timer->getRssi(), millis());
         rssiSentMs = currentTimeMs;
     }
+    updateRssiStreams(currentTimeMs);
+    if (servicesStarted) {
+        sse.update(currentTimeMs);
+    }
 
     // Send SSE keepalive ping to prevent connection timeout
     if (servicesStarted && ((currentTimeMs - sseKeepaliveMs) > WEB_SSE_KEEPALIVE_MS)) {
-        events.send("ping", "keepalive", millis());
+        sse.send("ping", "keepalive", SSE_DROPPABLE);
         sseKeepaliveMs = currentTimeMs;
     }
 
@@ -353,6 +473,78 @@ static void startMDNS() {
     DEBUG("  HTTP service advertised on port 80\n");
 }
 
+// Form fields and query parameters, as strings
+static void readParams(AsyncWebServerRequest *request, JsonDocument &args) {
+    for (size_t i = 0; i < request->params(); i++) {
+        const AsyncWebParameter *param = request->getParam(i);
+        if (!param->isFile()) {
+            args[param->name()] = param->value();
+        }
+    }
+}
+
+// The command is looked up here, once, not on every request
+void Webserver::addCommandRoute(const char *path, WebRequestMethodComposite method, const char *name) {
+    const CommandDef *command = CommandRouter::find(name);
+    if (!command) {
+        DEBUG("No command %s for %s\n", name, path);
+        return;
+    }
+    server.on(path, method, [this, command](AsyncWebServerRequest *request) {
+        DynamicJsonDocument args(512);
+        readParams(request, args);
+        sendCommandReply(request, command, args.as<JsonVariantConst>());
+    });
+}
+
+void Webserver::addJsonCommandRoute(const char *path, const char *name) {
+    const CommandDef *command = CommandRouter::find(name);
+    if (!command) {
+        DEBUG("No command %s for %s\n", name, path);
+        return;
+    }
+    server.addHandler(new AsyncCallbackJsonWebHandler(path, [this, command](AsyncWebServerRequest *request, JsonVariant &json) {
+        sendCommandReply(request, command, json);
+    }));
+}
+
+void Webserver::addDownloadRoute(const char *path, const char *name, const char *filename, const char *param) {
+    const CommandDef *command = CommandRouter::find(name);
+    if (!command) {
+        DEBUG("No command %s for %s\n", name, path);
+        return;
+    }
+    server.on(path, HTTP_GET, [this, command, filename, param](AsyncWebServerRequest *request) {
+        DynamicJsonDocument args(512);
+        readParams(request, args);
+        char file[48];
+        snprintf(file, sizeof(file), filename, param ? (unsigned)strtoul(args[param] | "", NULL, 10) : 0U);
+        sendCommandReply(request, command, args.as<JsonVariantConst>(), file);
+    });
+}
+
+// {"status": "OK", ...data} or, for the data only commands, the data alone
+void Webserver::sendCommandReply(AsyncWebServerRequest *request, const CommandDef *command, JsonVariantConst args, const char *filename) {
+    DynamicJsonDocument reply(1024);
+    CommandResult result = commands->run(command, args, reply.to<JsonObject>(), true);
+    if (result.status != CMD_OK || !(command->flags & CMD_FLAG_DATA_ONLY)) {
+        reply["status"] = CommandRouter::getStatusName(result.status);
+        if (result.message) {
+            reply["message"] = result.message;
+        }
+    }
+    AsyncResponseStream *response = request->beginResponseStream("application/json");
+    response->setCode(CommandRouter::getHttpCode(result.status));
+    if (filename && result.status == CMD_OK) {
+        response->addHeader("Content-Disposition", String("attachment; filename=\"") + filename + "\"");
+    }
+    serializeJson(reply, *response);
+    request->send(response);
+    if (!(command->flags & CMD_FLAG_NO_BLINK)) {
+        led->on(200);
+    }
+}
+
 void Webserver::startServices() {
     if (servicesStarted) {
         // Restart mDNS when WiFi mode changes
@@ -405,7 +597,7 @@ Chip:\n\
 Network:\n\
 \tIP:\t%s\n\
 \tMAC:\t%s\n\
-EEPROM:\n\
+Config:\n\
 %s";
 
         snprintf(buf, sizeof(buf), format,
@@ -417,128 +609,124 @@ EEPROM:\n\
         led->on(200);
     });
 
-    server.on("/timer/start", HTTP_POST, [this](AsyncWebServerRequest *request) {
-        timer->start();
-        if (transportMgr) {
-            transportMgr->broadcastRaceStateEvent("started");
-        }
-        request->send(200, "application/json", "{\"status\": \"OK\"}");
-    });
+    // Commands shared with USB and /ws, see command.h
+    addCommandRoute("/timer/start", HTTP_POST, "timer/start");
+    addCommandRoute("/timer/arm", HTTP_POST, "timer/arm");
+    addCommandRoute("/timer/stop", HTTP_POST, "timer/stop");
+    addCommandRoute("/timer/lap", HTTP_POST, "timer/lap");
+    // Manual lap and the playback of saved races, broadcast to all clients
+    addJsonCommandRoute("/timer/addLap", "timer/addLap");
+    addJsonCommandRoute("/timer/playbackStart", "timer/playbackStart");
+    addJsonCommandRoute("/timer/playbackLap", "timer/playbackLap");
+    addJsonCommandRoute("/timer/playbackStop", "timer/playbackStop");
 
-    server.on("/timer/stop", HTTP_POST, [this](AsyncWebServerRequest *request) {
-        timer->stop();
-        if (transportMgr) {
-            transportMgr->broadcastRaceStateEvent("stopped");
-        }
+    server.on("/timer/rssiStart", HTTP_POST, [this](AsyncWebServerRequest *request) {
+        sendRssi = true;
         request->send(200, "application/json", "{\"status\": \"OK\"}");
+        led->on(200);
     });
 
-    server.on("/timer/lap", HTTP_POST, [this](AsyncWebServerRequest *request) {
-#ifdef ESP32S3
-        if (g_rgbLed) {
-            g_rgbLed->flashLap();
-        }
-#endif
+    server.on("/timer/rssiStop", HTTP_POST, [this](AsyncWebServerRequest *request) {
+        sendRssi = false;
         request->send(200, "application/json", "{\"status\": \"OK\"}");
+        led->on(200);
     });
 
-    // Manual lap addition - broadcasts lap event to all clients
-    AsyncCallbackJsonWebHandler *addLapHandler = new AsyncCallbackJsonWebHandler("/timer/addLap", [this](AsyncWebServerRequest *request, JsonVariant &json) {
-        JsonObject jsonObj = json.as<JsonObject>();
-        if (jsonObj.containsKey("lapTime")) {
-            uint32_t lapTimeMs = jsonObj["lapTime"].as<uint32_t>();
-            if (transportMgr) {
-                transportMgr->broadcastLapEvent(lapTimeMs);
-            }
-#ifdef ESP32S3
-            if (g_rgbLed) {
-                g_rgbLed->flashLap();
-            }
-#endif
-            // Trigger lap webhook if Gate LEDs enabled and Lap enabled
-            if (webhooks && conf->getGateLEDsEnabled() && conf->getWebhookLap()) {
-                webhooks->triggerLap();
-            }
+    // Ahead of /rssi/stream, which would match this path too
+    server.on("/rssi/stream/stop", HTTP_POST, [this](AsyncWebServerRequest *request) {
+        int id = request->hasParam("stream") ? request->getParam("stream")->value().toInt() : -1;
+        uint32_t client = request->hasParam("client") ? strtoul(request->getParam("client")->value().c_str(), nullptr, 10) : 0;
+        if (id < 0 || id >= WEB_RSSI_STREAMS) {
+            request->send(400, "application/json", "{\"status\": \"ERROR\", \"message\": \"Bad stream\"}");
+            return;
+        }
+        // A lapsed stream may already be someone else's
+        if (rssiStreams[id].client.load() == client) {
+            rssiStreams[id].request = 0;
         }
         request->send(200, "application/json", "{\"status\": \"OK\"}");
     });
-    server.addHandler(addLapHandler);
 
-    // Playback endpoints - replay saved races
-    AsyncCallbackJsonWebHandler *playbackStartHandler = new AsyncCallbackJsonWebHandler("/timer/playbackStart", [this](AsyncWebServerRequest *request, JsonVariant &json) {
-        if (transportMgr) {
-            transportMgr->broadcastRaceStateEvent("started");
-        }
-        // Trigger race start webhook if Gate LEDs enabled
-        if (webhooks && conf->getGateLEDsEnabled() && conf->getWebhookRaceStart()) {
-            webhooks->triggerRaceStart();
+    // Batched RSSI: ?client=id&rate=Hz&batch=samples, client from the
+    // "hello" event, rate and batch optional. Opens a stream or, with
+    // &stream=id, renews or changes that one. Batches arrive as "rssiBatch"
+    // events on that client's event stream only, see RssiBatcher::toJson()
+    server.on("/rssi/stream", HTTP_POST, [this](AsyncWebServerRequest *request) {
+        uint32_t client = request->hasParam("client") ? strtoul(request->getParam("client")->value().c_str(), nullptr, 10) : 0;
+        if (!sse.hasClient(client)) {
+            request->send(400, "application/json", "{\"status\": \"ERROR\", \"message\": \"No such event stream client\"}");
+            return;
         }
-        request->send(200, "application/json", "{\"status\": \"OK\"}");
-    });
-    server.addHandler(playbackStartHandler);
-
-    AsyncCallbackJsonWebHandler *playbackLapHandler = new AsyncCallbackJsonWebHandler("/timer/playbackLap", [this](AsyncWebServerRequest *request, JsonVariant &json) {
-        JsonObject jsonObj = json.as<JsonObject>();
-        if (jsonObj.containsKey("lapTime")) {
-            uint32_t lapTimeMs = jsonObj["lapTime"].as<uint32_t>();
-            if (transportMgr) {
-                transportMgr->broadcastLapEvent(lapTimeMs);
+        uint16_t rate = RssiBatcher::clampRate(request->hasParam("rate") ? request->getParam("rate")->value().toInt() : 0);
+        uint8_t batch = RssiBatcher::clampBatch(request->hasParam("batch") ? request->getParam("batch")->value().toInt() : 0);
+        int id = -1;
+        if (request->hasParam("stream")) {
+            id = request->getParam("stream")->value().toInt();
+            if (id < 0 || id >= WEB_RSSI_STREAMS || rssiStreams[id].request.load() == 0 ||
+                rssiStreams[id].client.load() != client) {
+                request->send(404, "application/json", "{\"status\": \"ERROR\", \"message\": \"No such stream\"}");
+                return;
             }
-#ifdef ESP32S3
-            if (g_rgbLed) {
-                g_rgbLed->flashLap();
+        } else {
+            for (int i = 0; i < WEB_RSSI_STREAMS && id < 0; i++) {
+                if (rssiStreams[i].request.load() == 0) id = i;
             }
-#endif
-            // Trigger lap webhook if Gate LEDs enabled and Lap enabled
-            if (webhooks && conf->getGateLEDsEnabled() && conf->getWebhookLap()) {
-                webhooks->triggerLap();
+            if (id < 0) {
+                request->send(503, "application/json", "{\"status\": \"ERROR\", \"message\": \"Too many streams\"}");
+                return;
             }
         }
-        request->send(200, "application/json", "{\"status\": \"OK\"}");
+        rssiStreams[id].renewedMs = millis();
+        rssiStreams[id].client = client;
+        rssiStreams[id].request = ((uint32_t)rate << 8) | batch;
+        char buf[112];
+        snprintf(buf, sizeof(buf), "{\"status\": \"OK\", \"stream\": %d, \"rate\": %u, \"batch\": %u, \"leaseMs\": %u}",
+                 id, rate, batch, WEB_RSSI_STREAM_LEASE_MS);
+        request->send(200, "application/json", buf);
     });
-    server.addHandler(playbackLapHandler);
 
-    AsyncCallbackJsonWebHandler *playbackStopHandler = new AsyncCallbackJsonWebHandler("/timer/playbackStop", [this](AsyncWebServerRequest *request, JsonVariant &json) {
-        if (transportMgr) {
-            transportMgr->broadcastRaceStateEvent("stopped");
+    // RSSI history: ?last=ms or ?from=&to= (device ms), optional res (0 =
+    // raw, 10, 100, 1000 ms, default: finest that fits) and points (most
+    // returned, up to RSSI_HISTORY_MAX_POINTS)
+    server.on("/rssi/history", HTTP_GET, [this](AsyncWebServerRequest *request) {
+        if (!rssiHistory) {
+            request->send(503, "application/json", "{\"status\": \"ERROR\", \"message\": \"No history\"}");
+            return;
         }
-        // Trigger race stop webhook if Gate LEDs enabled
-        if (webhooks && conf->getGateLEDsEnabled() && conf->getWebhookRaceStop()) {
-            webhooks->triggerRaceStop();
+        uint32_t now = millis();
+        RssiHistoryQuery q;
+        if (request->hasParam("last")) {
+            uint32_t lastMs = strtoul(request->getParam("last")->value().c_str(), nullptr, 10);
+            q.fromMs = lastMs > now ? 0 : now - lastMs;
+            q.toMs = now;
+        } else {
+            q.fromMs = request->hasParam("from") ? strtoul(request->getParam("from")->value().c_str(), nullptr, 10) : 0;
+            q.toMs = request->hasParam("to") ? strtoul(request->getParam("to")->value().c_str(), nullptr, 10) : now;
         }
-        request->send(200, "application/json", "{\"status\": \"OK\"}");
-    });
-    server.addHandler(playbackStopHandler);
+        q.resolutionMs = request->hasParam("res") ? request->getParam("res")->value().toInt() : RSSI_RES_AUTO;
+        q.maxPoints = request->hasParam("points") ? request->getParam("points")->value().toInt() : RSSI_HISTORY_MAX_POINTS;
 
-    server.on("/timer/rssiStart", HTTP_POST, [this](AsyncWebServerRequest *request) {
-        sendRssi = true;
-        request->send(200, "application/json", "{\"status\": \"OK\"}");
-        led->on(200);
-    });
-
-    server.on("/timer/rssiStop", HTTP_POST, [this](AsyncWebServerRequest *request) {
-        sendRssi = false;
-        request->send(200, "application/json", "{\"status\": \"OK\"}");
-        led->on(200);
-    });
-
-    server.on("/config", HTTP_GET, [this](AsyncWebServerRequest *request) {
+        RssiHistoryPoint *points = (RssiHistoryPoint *)malloc(sizeof(RssiHistoryPoint) * RSSI_HISTORY_MAX_POINTS);
+        if (!points) {
+            request->send(503, "application/json", "{\"status\": \"ERROR\", \"message\": \"Out of memory\"}");
+            return;
+        }
+        RssiHistoryResult result;
+        if (!rssiHistory->query(q, points, result)) {
+            free(points);
+            request->send(404, "application/json", "{\"status\": \"ERROR\", \"message\": \"No samples in range\"}");
+            return;
+        }
         AsyncResponseStream *response = request->beginResponseStream("application/json");
-        conf->toJson(*response);
+        RssiHistory::writeJson(result, [](void *ctx, const char *text, size_t len) {
+            ((AsyncResponseStream *)ctx)->write((const uint8_t *)text, len);
+        }, response);
+        free(points);
         request->send(response);
-        led->on(200);
     });
 
-    AsyncCallbackJsonWebHandler *configJsonHandler = new AsyncCallbackJsonWebHandler("/config", [this](AsyncWebServerRequest *request, JsonVariant &json) {
-        JsonObject jsonObj = json.as<JsonObject>();
-#ifdef DEBUG_OUT
-        serializeJsonPretty(jsonObj, DEBUG_OUT);
-        DEBUG("\n");
-#endif
-        conf->fromJson(jsonObj);
-        request->send(200, "application/json", "{\"status\": \"OK\"}");
-        led->on(200);
-    });
+    addCommandRoute("/config", HTTP_GET, "config/get");
+    addJsonCommandRoute("/config", "config/set");
 
     // Serve audio files from SD card voice directories (sounds_default, sounds_rachel, etc.)
     server.on("^\\/sounds_.+\\/.+\\.mp3$", HTTP_GET, [this](AsyncWebServerRequest *request) {
@@ -590,6 +778,29 @@ EEPROM:\n\
         request->send(404, "text/plain", "Audio file not found");
     });
     
+    // Clock sync, one NTP-style exchange: t0 is the client's send time,
+    // echoed back, t1/t2 are device esp_timer microseconds at receive and
+    // reply (millis() is t / 1000). See tools/clock_sync for the estimator
+    server.on("/api/time", HTTP_GET, [](AsyncWebServerRequest *request) {
+        int64_t t1 = esp_timer_get_time();
+        // The whole of t0 must be a finite number; it is echoed as parsed,
+        // so the reply is valid JSON whatever the client sent
+        double t0 = 0;
+        if (request->hasParam("t0")) {
+            const char *text = request->getParam("t0")->value().c_str();
+            char *end;
+            t0 = strtod(text, &end);
+            if (end == text || *end != '\0' || !isfinite(t0)) {
+                request->send(400, "application/json", "{\"status\": \"ERROR\", \"message\": \"Bad t0\"}");
+                return;
+            }
+        }
+        char buf[112];
+        snprintf(buf, sizeof(buf), "{\"t0\":%.17g,\"t1\":%lld,\"t2\":%lld}",
+                 t0, (long long)t1, (long long)esp_timer_get_time());
+        request->send(200, "application/json", buf);
+    });
+
     // WiFi status endpoint (register before serveStatic to prevent VFS errors)
     server.on("/api/wifi", HTTP_GET, [this](AsyncWebServerRequest *request) {
         DynamicJsonDocument doc(512);
@@ -628,12 +839,33 @@ EEPROM:\n\
     server.serveStatic("/", LittleFS, "/").setCacheControl("max-age=600");
 
     events.onConnect([this](AsyncEventSourceClient *client) {
-        if (client->lastId()) {
-            DEBUG("Client reconnected! Last message ID that it got is: %u\n", client->lastId());
+        EventLog *log = transportMgr ? transportMgr->getEventLog() : nullptr;
+        if (log) log->lock();
+        uint32_t clientId = sse.addClient(client);
+        if (!clientId) {
+            if (log) log->unlock();
+            return;
+        }
+        uint32_t lastId = client->lastId();
+        if (log && lastId) {
+            DEBUG("Client reconnected! Last message ID that it got is: %u\n", lastId);
+            client->send("start", NULL, 0, 1000);
+            replayEvents(client, lastId);
+        } else {
+            // A new client starts at the current event
+            client->send("start", NULL, log ? log->lastId() : 0, 1000);
         }
-        client->send("start", NULL, millis(), 1000);
+        // Its id for POST /rssi/stream, new on every connect
+        char hello[32];
+        snprintf(hello, sizeof(hello), "{\"client\":%u}", clientId);
+        sse.sendTo(client, hello, "hello", 0);
+        if (log) log->unlock();
         led->on(200);
     });
+    // Before the library frees the client
+    events.onDisconnect([this](AsyncEventSourceClient *client) {
+        sse.removeClient(client);
+    });
 
     DefaultHeaders::Instance().addHeader("Access-Control-Allow-Origin", "*");
     DefaultHeaders::Instance().addHeader("Access-Control-Max-Age", "600");
@@ -643,54 +875,17 @@ EEPROM:\n\
     server.onNotFound(handleNotFound);
 
     server.addHandler(&events);
-    server.addHandler(configJsonHandler);
+    if (wsTransport) {
+        wsTransport->begin(&server);
+    }
 
     // Race history endpoints
-    server.on("/races", HTTP_GET, [this](AsyncWebServerRequest *request) {
-        String json = history->toJsonString();
-        request->send(200, "application/json", json);
-        led->on(200);
-    });
+    // Downloads go first: "/races" would otherwise also claim them
+    addDownloadRoute("/races/download", "races/get", "races.json");
+    addDownloadRoute("/races/downloadOne", "races/getOne", "race_%u.json", "timestamp");
+    addCommandRoute("/races", HTTP_GET, "races/get");
 
-    server.on("/races/download", HTTP_GET, [this](AsyncWebServerRequest *request) {
-        String json = history->toJsonString();
-        AsyncWebServerResponse *response = request->beginResponse(200, "application/octet-stream", json);
-        response->addHeader("Content-Disposition", "attachment; filename=\"races.json\"");
-        response->addHeader("Content-Type", "application/json");
-        request->send(response);
-        led->on(200);
-    });
-
-    AsyncCallbackJsonWebHandler *raceSaveHandler = new AsyncCallbackJsonWebHandler("/races/save", [this](AsyncWebServerRequest *request, JsonVariant &json) {
-        JsonObject jsonObj = json.as<JsonObject>();
-        
-        RaceSession race;
-        race.timestamp = jsonObj["timestamp"];
-        race.fastestLap = jsonObj["fastestLap"];
-        race.medianLap = jsonObj["medianLap"];
-        race.best3LapsTotal = jsonObj["best3LapsTotal"];
-        race.pilotName = jsonObj["pilotName"] | "";
-        race.pilotCallsign = jsonObj["pilotCallsign"] | "";
-        race.frequency = jsonObj["frequency"] | 0;
-        race.band = jsonObj["band"] | "";
-        race.channel = jsonObj["channel"] | 0;
-        
-        DEBUG("Parsing race save: trackId=%u\n", (uint32_t)(jsonObj["trackId"] | 0));
-        race.trackId = jsonObj["trackId"] | 0;
-        race.trackName = jsonObj["trackName"] | "";
-        DEBUG("Parsing totalDistance...\n");
-        race.totalDistance = jsonObj["totalDistance"] | 0.0;
-        DEBUG("Parsed totalDistance=%.2f\n", race.totalDistance);
-        
-        JsonArray lapsArray = jsonObj["lapTimes"];
-        for (uint32_t lap : lapsArray) {
-            race.lapTimes.push_back(lap);
-        }
-        
-        bool success = history->saveRace(race);
-        request->send(200, "application/json", success ? "{\"status\": \"OK\"}" : "{\"status\": \"ERROR\"}");
-        led->on(200);
-    });
+    addJsonCommandRoute("/races/save", "races/save");
 
     AsyncCallbackJsonWebHandler *raceUploadHandler = new AsyncCallbackJsonWebHandler("/races/upload", [this](AsyncWebServerRequest *request, JsonVariant &json) {
         String jsonString;
@@ -700,237 +895,133 @@ EEPROM:\n\
         led->on(200);
     });
 
-    server.on("/races/delete", HTTP_POST, [this](AsyncWebServerRequest *request) {
-        if (request->hasParam("timestamp", true)) {
-            uint32_t timestamp = request->getParam("timestamp", true)->value().toInt();
-            bool success = history->deleteRace(timestamp);
-            request->send(200, "application/json", success ? "{\"status\": \"OK\"}" : "{\"status\": \"ERROR\"}");
-        } else {
-            request->send(400, "application/json", "{\"status\": \"ERROR\", \"message\": \"Missing timestamp\"}");
-        }
-        led->on(200);
-    });
+    addCommandRoute("/races/delete", HTTP_POST, "races/delete");
+    addCommandRoute("/races/clear", HTTP_POST, "races/clear");
 
-    server.on("/races/clear", HTTP_POST, [this](AsyncWebServerRequest *request) {
-        bool success = history->clearAll();
-        request->send(200, "application/json", success ? "{\"status\": \"OK\"}" : "{\"status\": \"ERROR\"}");
-        led->on(200);
-    });
+    addCommandRoute("/races/update", HTTP_POST, "races/update");
+    addJsonCommandRoute("/races/updateLaps", "races/updateLaps");
 
-    server.on("/races/update", HTTP_POST, [this](AsyncWebServerRequest *request) {
-        if (request->hasParam("timestamp", true) && 
-            request->hasParam("name", true) && 
-            request->hasParam("tag", true)) {
-            uint32_t timestamp = request->getParam("timestamp", true)->value().toInt();
-            String name = request->getParam("name", true)->value();
-            String tag = request->getParam("tag", true)->value();
-            float totalDistance = -1.0f;
-            if (request->hasParam("totalDistance", true)) {
-                totalDistance = request->getParam("totalDistance", true)->value().toFloat();
-            }
-            bool success = history->updateRace(timestamp, name, tag, totalDistance);
-            request->send(200, "application/json", success ? "{\"status\": \"OK\"}" : "{\"status\": \"ERROR\"}");
-        } else {
-            request->send(400, "application/json", "{\"status\": \"ERROR\", \"message\": \"Missing parameters\"}");
-        }
-        led->on(200);
-    });
+    server.addHandler(raceUploadHandler);
 
-    AsyncCallbackJsonWebHandler *updateLapsHandler = new AsyncCallbackJsonWebHandler("/races/updateLaps", [this](AsyncWebServerRequest *request, JsonVariant &json) {
-        JsonObject jsonObj = json.as<JsonObject>();
-        
-        if (!jsonObj.containsKey("timestamp") || !jsonObj.containsKey("lapTimes")) {
-            request->send(400, "application/json", "{\"status\": \"ERROR\", \"message\": \"Missing parameters\"}");
+    // Track endpoints
+    // Image routes go first: "/tracks" would otherwise also claim "/tracks/image"
+    server.on("/tracks/image", HTTP_GET, [this](AsyncWebServerRequest *request) {
+        if (!request->hasParam("trackId")) {
+            request->send(400, "application/json", "{\"status\": \"ERROR\", \"message\": \"Missing trackId\"}");
             return;
         }
+        uint32_t trackId = request->getParam("trackId")->value().toInt();
+        String path = trackManager->getTrackImagePath(trackId);
         
-        uint32_t timestamp = jsonObj["timestamp"];
-        JsonArray lapsArray = jsonObj["lapTimes"];
+        File file = storage->openRead(path);
+        if (!file) {
+            request->send(404, "application/json", "{\"status\": \"ERROR\", \"message\": \"Image not found\"}");
+            return;
+        }
+        // Size + mtime changes whenever a new image replaces the old one
+        String etag = "\"" + String((uint32_t)file.size()) + "-" + String((uint32_t)file.getLastWrite()) + "\"";
+        file.close();
         
-        std::vector<uint32_t> lapTimes;
-        for (JsonVariant lap : lapsArray) {
-            lapTimes.push_back(lap.as<uint32_t>());
+        if (request->hasHeader("If-None-Match") && request->header("If-None-Match") == etag) {
+            AsyncWebServerResponse *response = request->beginResponse(304);
+            response->addHeader("ETag", etag);
+            request->send(response);
+            return;
         }
         
-        bool success = history->updateLaps(timestamp, lapTimes);
-        request->send(200, "application/json", success ? "{\"status\": \"OK\"}" : "{\"status\": \"ERROR\"}");
-        led->on(200);
+        // File responses carry Content-Length and are sent in chunks from storage
+        AsyncWebServerResponse *response = request->beginResponse(storage->activeFs(), path, "image/jpeg");
+        response->addHeader("Cache-Control", "public, max-age=300");
+        response->addHeader("ETag", etag);
+        request->send(response);
     });
 
-    server.on("/races/downloadOne", HTTP_GET, [this](AsyncWebServerRequest *request) {
-        if (request->hasParam("timestamp")) {
-            uint32_t timestamp = request->getParam("timestamp")->value().toInt();
-            
-            // Find the race
-            const auto& races = history->getRaces();
-            for (const auto& race : races) {
-                if (race.timestamp == timestamp) {
-                    // Create JSON for single race
-                    DynamicJsonDocument doc(16384);
-                    JsonArray racesArray = doc.createNestedArray("races");
-                    JsonObject raceObj = racesArray.createNestedObject();
-                    raceObj["timestamp"] = race.timestamp;
-                    raceObj["fastestLap"] = race.fastestLap;
-                    raceObj["medianLap"] = race.medianLap;
-                    raceObj["best3LapsTotal"] = race.best3LapsTotal;
-                    raceObj["name"] = race.name;
-                    raceObj["tag"] = race.tag;
-                    raceObj["pilotName"] = race.pilotName;
-                    raceObj["pilotCallsign"] = race.pilotCallsign;
-                    raceObj["frequency"] = race.frequency;
-                    raceObj["band"] = race.band;
-                    raceObj["channel"] = race.channel;
-                    JsonArray lapsArray = raceObj.createNestedArray("lapTimes");
-                    for (uint32_t lap : race.lapTimes) {
-                        lapsArray.add(lap);
-                    }
-                    
-                    String json;
-                    serializeJson(doc, json);
-                    
-                    String filename = "race_" + String(timestamp) + ".json";
-                    AsyncWebServerResponse *response = request->beginResponse(200, "application/octet-stream", json);
-                    response->addHeader("Content-Disposition", "attachment; filename=\"" + filename + "\"");
-                    response->addHeader("Content-Type", "application/json");
-                    request->send(response);
-                    led->on(200);
-                    return;
-                }
-            }
-            request->send(404, "application/json", "{\"status\": \"ERROR\", \"message\": \"Race not found\"}");
+    server.on("/tracks/image", HTTP_POST, [this](AsyncWebServerRequest *request) {
+        TrackImageUpload *upload = (TrackImageUpload *)request->_tempObject;
+        if (!upload) {
+            request->send(400, "application/json", "{\"status\": \"ERROR\", \"message\": \"Missing image\"}");
+        } else if (upload->failed) {
+            DynamicJsonDocument doc(128);
+            doc["status"] = "ERROR";
+            doc["message"] = upload->error;
+            String response;
+            serializeJson(doc, response);
+            request->send(upload->errorCode, "application/json", response);
         } else {
-            request->send(400, "application/json", "{\"status\": \"ERROR\", \"message\": \"Missing timestamp\"}");
+            request->send(200, "application/json", "{\"status\": \"OK\"}");
         }
         led->on(200);
-    });
-
-    server.addHandler(raceSaveHandler);
-    server.addHandler(raceUploadHandler);
-    server.addHandler(updateLapsHandler);
-
-    // Track endpoints
-    server.on("/tracks", HTTP_GET, [this](AsyncWebServerRequest *request) {
-        String json = trackManager->toJsonString();
-        request->send(200, "application/json", json);
-        led->on(200);
-    });
-
-    AsyncCallbackJsonWebHandler *trackCreateHandler = new AsyncCallbackJsonWebHandler("/tracks/create", [this](AsyncWebServerRequest *request, JsonVariant &json) {
-        JsonObject jsonObj = json.as<JsonObject>();
-        
-        Track track;
-        track.trackId = jsonObj["trackId"];
-        track.name = jsonObj["name"] | "";
-        track.tags = jsonObj["tags"] | "";
-        track.distance = jsonObj["distance"] | 0.0f;
-        track.notes = jsonObj["notes"] | "";
-        track.imagePath = "";
-        
-        bool success = trackManager->createTrack(track);
-        request->send(200, "application/json", success ? "{\"status\": \"OK\"}" : "{\"status\": \"ERROR\"}");
-        led->on(200);
-    });
-
-    AsyncCallbackJsonWebHandler *trackUpdateHandler = new AsyncCallbackJsonWebHandler("/tracks/update", [this](AsyncWebServerRequest *request, JsonVariant &json) {
-        JsonObject jsonObj = json.as<JsonObject>();
-        
-        if (!jsonObj.containsKey("trackId")) {
-            request->send(400, "application/json", "{\"status\": \"ERROR\", \"message\": \"Missing trackId\"}");
-            return;
+    }, [this](AsyncWebServerRequest *request, const String &filename, size_t index, uint8_t *data, size_t len, bool final) {
+        TrackImageUpload *upload = (TrackImageUpload *)request->_tempObject;
+        if (upload && upload->done) {
+            return;  // Only the first file part of a request is taken
         }
         
-        uint32_t trackId = jsonObj["trackId"];
-        Track updatedTrack;
-        updatedTrack.trackId = trackId;
-        updatedTrack.name = jsonObj["name"] | "";
-        updatedTrack.tags = jsonObj["tags"] | "";
-        updatedTrack.distance = jsonObj["distance"] | 0.0f;
-        updatedTrack.notes = jsonObj["notes"] | "";
-        
-        bool success = trackManager->updateTrack(trackId, updatedTrack);
-        request->send(200, "application/json", success ? "{\"status\": \"OK\"}" : "{\"status\": \"ERROR\"}");
-        led->on(200);
-    });
-
-    server.on("/tracks/delete", HTTP_POST, [this](AsyncWebServerRequest *request) {
-        if (request->hasParam("trackId", true)) {
-            uint32_t trackId = request->getParam("trackId", true)->value().toInt();
-            bool success = trackManager->deleteTrack(trackId);
-            
-            // If deleted track was selected, deselect it
-            if (success && conf->getSelectedTrackId() == trackId) {
-                conf->setSelectedTrackId(0);
-                timer->setTrack(nullptr);
+        if (index == 0) {
+            if (upload) {
+                return;
             }
+            upload = (TrackImageUpload *)malloc(sizeof(TrackImageUpload));
+            if (!upload) {
+                return;
+            }
+            upload->trackId = request->hasParam("trackId") ? request->getParam("trackId")->value().toInt() : 0;
+            upload->failed = false;
+            upload->done = false;
+            upload->errorCode = 200;
+            upload->error = nullptr;
+            request->_tempObject = upload;
             
-            request->send(200, "application/json", success ? "{\"status\": \"OK\"}" : "{\"status\": \"ERROR\"}");
-        } else {
-            request->send(400, "application/json", "{\"status\": \"ERROR\", \"message\": \"Missing trackId\"}");
-        }
-        led->on(200);
-    });
-
-    server.on("/tracks/select", HTTP_POST, [this](AsyncWebServerRequest *request) {
-        if (request->hasParam("trackId", true)) {
-            uint32_t trackId = request->getParam("trackId", true)->value().toInt();
-            
-            if (trackId == 0) {
-                // Deselect track
-                conf->setSelectedTrackId(0);
-                timer->setTrack(nullptr);
-                request->send(200, "application/json", "{\"status\": \"OK\"}");
-            } else {
-                Track* track = trackManager->getTrackById(trackId);
-                if (track) {
-                    conf->setSelectedTrackId(trackId);
-                    timer->setTrack(track);
-                    request->send(200, "application/json", "{\"status\": \"OK\"}");
-                } else {
-                    request->send(404, "application/json", "{\"status\": \"ERROR\", \"message\": \"Track not found\"}");
-                }
+            if (upload->trackId == 0 || !trackManager->getTrackById(upload->trackId)) {
+                upload->failed = true;
+                upload->errorCode = 404;
+                upload->error = "Track not found";
+                return;
             }
-        } else {
-            request->send(400, "application/json", "{\"status\": \"ERROR\", \"message\": \"Missing trackId\"}");
+            request->_tempFile = trackManager->beginTrackImage(upload->trackId);
+            if (!request->_tempFile) {
+                upload->failed = true;
+                upload->errorCode = 500;
+                upload->error = "Failed to open image file";
+                return;
+            }
+            DEBUG("Track image upload started: track %u\n", upload->trackId);
         }
-        led->on(200);
-    });
-
-    server.on("/tracks/clear", HTTP_POST, [this](AsyncWebServerRequest *request) {
-        bool success = trackManager->clearAll();
         
-        // Clear selected track if any
-        if (success && conf->getSelectedTrackId() != 0) {
-            conf->setSelectedTrackId(0);
-            timer->setTrack(nullptr);
+        if (!upload) {
+            return;
+        }
+        if (final) {
+            upload->done = true;
+        }
+        if (upload->failed) {
+            return;
         }
         
-        request->send(200, "application/json", success ? "{\"status\": \"OK\"}" : "{\"status\": \"ERROR\"}");
-        led->on(200);
-    });
-
-    server.on("/timer/distance", HTTP_GET, [this](AsyncWebServerRequest *request) {
-        DynamicJsonDocument doc(512);
-        doc["totalDistance"] = timer->getTotalDistance();
-        doc["distanceRemaining"] = timer->getDistanceRemaining();
-        
-        Track* selectedTrack = timer->getSelectedTrack();
-        if (selectedTrack) {
-            doc["trackId"] = selectedTrack->trackId;
-            doc["trackName"] = selectedTrack->name;
-            doc["trackDistance"] = selectedTrack->distance;
-        } else {
-            doc["trackId"] = 0;
-            doc["trackName"] = "";
-            doc["trackDistance"] = 0.0f;
+        if (len > 0 && !trackManager->appendTrackImage(request->_tempFile, index, data, len)) {
+            bool tooLarge = index + len > TRACK_IMAGE_MAX_BYTES;
+            trackManager->abortTrackImage(upload->trackId, request->_tempFile);
+            upload->failed = true;
+            upload->errorCode = tooLarge ? 413 : 500;
+            upload->error = tooLarge ? "Image too large (max 500KB)" : "Failed to write image";
+            return;
         }
         
-        String json;
-        serializeJson(doc, json);
-        request->send(200, "application/json", json);
+        if (final && !trackManager->commitTrackImage(upload->trackId, request->_tempFile)) {
+            upload->failed = true;
+            upload->errorCode = 500;
+            upload->error = "Failed to save image";
+        }
     });
 
-    server.addHandler(trackCreateHandler);
-    server.addHandler(trackUpdateHandler);
+    addCommandRoute("/tracks", HTTP_GET, "tracks/get");
+    addJsonCommandRoute("/tracks/create", "tracks/create");
+    addJsonCommandRoute("/tracks/update", "tracks/update");
+    addCommandRoute("/tracks/delete", HTTP_POST, "tracks/delete");
+    addCommandRoute("/tracks/select", HTTP_POST, "tracks/select");
+    addCommandRoute("/tracks/clear", HTTP_POST, "tracks/clear");
+
+    addCommandRoute("/timer/distance", HTTP_GET, "timer/distance");
 
     // Self-test endpoint
     server.on("/api/selftest", HTTP_GET, [this](AsyncWebServerRequest *request) {
@@ -962,6 +1053,8 @@ EEPROM:\n\
     server.on("/reboot", HTTP_POST, [this](AsyncWebServerRequest *request) {
         request->send(200, "application/json", "{\"status\": \"OK\", \"message\": \"Rebooting...\"}");
         led->on(200);
+        // Cached writes would be lost across the restart
+        storage->flush();
         // Restart immediately without delay to avoid blocking async_tcp task
         ESP.restart();
     });
@@ -975,6 +1068,121 @@ EEPROM:\n\
         led->on(200);
     });
     
+    // Write-behind cache counters
+    server.on("/storage/stats", HTTP_GET, [this](AsyncWebServerRequest *request) {
+        StorageStats stats = storage->getStats();
+        DynamicJsonDocument doc(512);
+        doc["type"] = storage->getStorageType();
+        doc["flushIntervalMs"] = storage->getFlushInterval();
+        doc["dirtyFiles"] = stats.dirtyFiles;
+        doc["dirtyBytes"] = stats.dirtyBytes;
+        doc["cacheHits"] = stats.cacheHits;
+        doc["cacheMisses"] = stats.cacheMisses;
+        doc["coalesced"] = stats.coalesced;
+        doc["writeThroughs"] = stats.writeThroughs;
+        doc["filesFlushed"] = stats.filesFlushed;
+        doc["flushErrors"] = stats.flushErrors;
+        doc["lastFlushUs"] = stats.lastFlushUs;
+        doc["maxFlushUs"] = stats.maxFlushUs;
+        doc["avgFlushUs"] = stats.filesFlushed ? (uint32_t)(stats.totalFlushUs / stats.filesFlushed) : 0;
+        doc["bytesWritten"] = stats.bytesWritten;
+        String json;
+        serializeJson(doc, json);
+        request->send(200, "application/json", json);
+    });
+
+    // Per-client event stream counters, see SseFanout
+    server.on("/events/stats", HTTP_GET, [this](AsyncWebServerRequest *request) {
+        SseClientStats stats[SSE_MAX_CLIENTS];
+        size_t count = sse.getStats(stats, SSE_MAX_CLIENTS);
+        DynamicJsonDocument doc(1024);
+        doc["closedSaturated"] = sse.getClosedSaturated();
+        JsonArray clients = doc.createNestedArray("clients");
+        uint32_t now = millis();
+        for (size_t i = 0; i < count && i < SSE_MAX_CLIENTS; i++) {
+            JsonObject c = clients.createNestedObject();
+            c["connectedMs"] = now - stats[i].connectedMs;
+            c["sent"] = stats[i].sent;
+            c["dropped"] = stats[i].dropped;
+            c["queued"] = stats[i].queued;
+            c["peakQueued"] = stats[i].peakQueued;
+            c["held"] = stats[i].held;
+            c["saturated"] = stats[i].saturated;
+        }
+        String json;
+        serializeJson(doc, json);
+        request->send(200, "application/json", json);
+    });
+
+    // Power mode, clock and battery sizing estimates
+    server.on("/power/stats", HTTP_GET, [this](AsyncWebServerRequest *request) {
+        if (!power) {
+            request->send(503, "application/json", "{\"status\": \"ERROR\", \"message\": \"Power manager not running\"}");
+            return;
+        }
+        PowerStats stats = power->getStats();
+        DynamicJsonDocument doc(768);
+        doc["mode"] = PowerManager::getModeName(stats.mode);
+        doc["cpuMhz"] = stats.cpuMhz;
+        doc["samplePeriodMs"] = stats.samplePeriodMs;
+        doc["lightSleep"] = stats.lightSleep;
+        doc["transitions"] = stats.transitions;
+        doc["lastTransitionUs"] = stats.lastTransitionUs;
+        doc["maxTransitionUs"] = stats.maxTransitionUs;
+        doc["maxWakeUs"] = stats.maxWakeUs;
+        JsonObject timeInMode = doc.createNestedObject("timeInModeMs");
+        for (uint8_t i = 0; i < POWER_MODE_COUNT; i++) {
+            timeInMode[PowerManager::getModeName((power_mode_e)i)] = stats.timeInModeMs[i];
+        }
+        doc["estimatedMa"] = stats.estimatedMa;
+        doc["estimatedMah"] = stats.estimatedMah;
+        String json;
+        serializeJson(doc, json);
+        request->send(200, "application/json", json);
+    });
+
+    // Per-job timing of the core 0 scheduler. POST resets the counters
+    server.on("/scheduler/stats", HTTP_GET, [this](AsyncWebServerRequest *request) {
+        if (!scheduler) {
+            request->send(503, "application/json", "{\"status\": \"ERROR\", \"message\": \"Scheduler not running\"}");
+            return;
+        }
+        DynamicJsonDocument doc(2048);
+        doc["loadPermille"] = scheduler->getLoadPermille();
+        JsonArray jobs = doc.createNestedArray("jobs");
+        SchedulerJobStats stats;
+        for (uint8_t i = 0; i < scheduler->getJobCount(); i++) {
+            if (!scheduler->getJobStats(i, stats)) {
+                continue;
+            }
+            JsonObject job = jobs.createNestedObject();
+            job["name"] = stats.name;
+            job["periodUs"] = stats.periodUs;
+            job["deadlineUs"] = stats.deadlineUs;
+            job["runs"] = stats.runs;
+            job["overruns"] = stats.overruns;
+            job["skipped"] = stats.skipped;
+            job["lastRunUs"] = stats.lastRunUs;
+            job["maxRunUs"] = stats.maxRunUs;
+            job["avgRunUs"] = stats.runs ? (uint32_t)(stats.totalRunUs / stats.runs) : 0;
+            job["maxLatenessUs"] = stats.maxLatenessUs;
+        }
+        String json;
+        serializeJson(doc, json);
+        request->send(200, "application/json", json);
+    });
+
+    server.on("/scheduler/stats", HTTP_POST, [this](AsyncWebServerRequest *request) {
+        if (scheduler) {
+            scheduler->resetStats();
+        }
+        request->send(200, "application/json", "{\"status\": \"OK\"}");
+    });
+
+    // Flush barrier - returns once all cached writes are on the medium.
+    // Optional "interval" (ms) changes the background flush interval
+    addCommandRoute("/storage/flush", HTTP_POST, "storage/flush");
+    
     // SD card test endpoint - list files
     server.on("/storage/sdtest", HTTP_GET, [this](AsyncWebServerRequest *request) {
 #ifdef ESP32S3
@@ -1043,156 +1251,54 @@ EEPROM:\n\
         led->on(200);
     });
 
-#ifdef ESP32S3
-    // LED control endpoints
-    server.on("/led/color", HTTP_POST, [this](AsyncWebServerRequest *request) {
-        if (request->hasParam("color", true)) {
-            String colorStr = request->getParam("color", true)->value();
-            uint32_t color = strtol(colorStr.c_str(), NULL, 16);
-            if (g_rgbLed) {
-                g_rgbLed->setManualColor(color);
-            }
-            conf->setLedColor(color);
-            request->send(200, "application/json", "{\"status\": \"OK\"}");
-        } else {
-            request->send(400, "application/json", "{\"status\": \"ERROR\", \"message\": \"Missing color\"}");
-        }
-        led->on(200);
-    });
-
-    server.on("/led/mode", HTTP_POST, [this](AsyncWebServerRequest *request) {
-        if (request->hasParam("mode", true)) {
-            uint8_t mode = request->getParam("mode", true)->value().toInt();
-            if (g_rgbLed) {
-                if (mode == 0) {
-                    g_rgbLed->off();
-                } else if (mode == 1) {
-                    g_rgbLed->setManualMode(RGB_SOLID);
-                } else if (mode == 2) {
-                    g_rgbLed->setManualMode(RGB_PULSE);
-                } else if (mode == 3) {
-                    g_rgbLed->setRainbowWave();
-                }
-            }
-            request->send(200, "application/json", "{\"status\": \"OK\"}");
-        } else {
-            request->send(400, "application/json", "{\"status\": \"ERROR\", \"message\": \"Missing mode\"}");
-        }
-        led->on(200);
-    });
-
-    server.on("/led/brightness", HTTP_POST, [this](AsyncWebServerRequest *request) {
-        if (request->hasParam("brightness", true)) {
-            uint8_t brightness = request->getParam("brightness", true)->value().toInt();
-            if (g_rgbLed) {
-                g_rgbLed->setBrightness(brightness);
-            }
-            conf->setLedBrightness(brightness);
-            request->send(200, "application/json", "{\"status\": \"OK\"}");
-        } else {
-            request->send(400, "application/json", "{\"status\": \"ERROR\", \"message\": \"Missing brightness\"}");
-        }
-        led->on(200);
-    });
+    // LED control, answered with 503 on boards without the RGB LED
+    addCommandRoute("/led/color", HTTP_POST, "led/color");
+    addCommandRoute("/led/mode", HTTP_POST, "led/mode");
+    addCommandRoute("/led/brightness", HTTP_POST, "led/brightness");
+    addCommandRoute("/led/preset", HTTP_POST, "led/preset");
+    addCommandRoute("/led/override", HTTP_POST, "led/override");
+    addCommandRoute("/led/error", HTTP_POST, "led/error");
+    addCommandRoute("/led/speed", HTTP_POST, "led/speed");
+    addCommandRoute("/led/count", HTTP_POST, "led/count");
+    addCommandRoute("/led/fadecolor", HTTP_POST, "led/fadecolor");
+    addCommandRoute("/led/strobecolor", HTTP_POST, "led/strobecolor");
 
-    server.on("/led/preset", HTTP_POST, [this](AsyncWebServerRequest *request) {
-        if (request->hasParam("preset", true)) {
-            uint8_t preset = request->getParam("preset", true)->value().toInt();
-            if (g_rgbLed) {
-                g_rgbLed->setPreset((led_preset_e)preset);
-            }
-            conf->setLedPreset(preset);
-            request->send(200, "application/json", "{\"status\": \"OK\"}");
-        } else {
-            request->send(400, "application/json", "{\"status\": \"ERROR\", \"message\": \"Missing preset\"}");
-        }
-        led->on(200);
-    });
-
-    server.on("/led/override", HTTP_POST, [this](AsyncWebServerRequest *request) {
-        if (request->hasParam("enable", true)) {
-            bool enable = request->getParam("enable", true)->value() == "1";
-            if (g_rgbLed) {
-                g_rgbLed->enableManualOverride(enable);
-            }
-            conf->setLedManualOverride(enable ? 1 : 0);
-            request->send(200, "application/json", "{\"status\": \"OK\"}");
-        } else {
-            request->send(400, "application/json", "{\"status\": \"ERROR\", \"message\": \"Missing enable\"}");
-        }
-        led->on(200);
-    });
-
-    server.on("/led/error", HTTP_POST, [this](AsyncWebServerRequest *request) {
-        if (request->hasParam("code", true)) {
-            uint8_t code = request->getParam("code", true)->value().toInt();
-            if (g_rgbLed) {
-                g_rgbLed->showErrorCode(code);
-            }
-            request->send(200, "application/json", "{\"status\": \"OK\"}");
-        } else {
-            request->send(400, "application/json", "{\"status\": \"ERROR\", \"message\": \"Missing code\"}");
-        }
-        led->on(200);
-    });
-
-    server.on("/led/speed", HTTP_POST, [this](AsyncWebServerRequest *request) {
-        if (request->hasParam("speed", true)) {
-            uint8_t speed = request->getParam("speed", true)->value().toInt();
-            if (g_rgbLed) {
-                g_rgbLed->setEffectSpeed(speed);
-            }
-            conf->setLedSpeed(speed);
-            request->send(200, "application/json", "{\"status\": \"OK\"}");
-        } else {
-            request->send(400, "application/json", "{\"status\": \"ERROR\", \"message\": \"Missing speed\"}");
-        }
-        led->on(200);
-    });
-
-    server.on("/led/fadecolor", HTTP_POST, [this](AsyncWebServerRequest *request) {
-        if (request->hasParam("color", true)) {
-            String colorStr = request->getParam("color", true)->value();
-            uint32_t color = strtol(colorStr.c_str(), NULL, 16);
-            if (g_rgbLed) {
-                g_rgbLed->setFadeColor(color);
-            }
-            conf->setLedFadeColor(color);
-            request->send(200, "application/json", "{\"status\": \"OK\"}");
-        } else {
-            request->send(400, "application/json", "{\"status\": \"ERROR\", \"message\": \"Missing color\"}");
+#ifdef ESP32S3
+    // Frame timing of the LED renderer. POST resets the counters
+    server.on("/led/stats", HTTP_GET, [this](AsyncWebServerRequest *request) {
+        if (!g_rgbLed) {
+            request->send(503, "application/json", "{\"status\": \"ERROR\", \"message\": \"RGB LED not running\"}");
+            return;
         }
-        led->on(200);
+        RgbFrameStats stats = g_rgbLed->getFrameStats();
+        DynamicJsonDocument doc(512);
+        doc["ledCount"] = stats.ledCount;
+        doc["frames"] = stats.frames;
+        doc["shows"] = stats.shows;
+        doc["busyFrames"] = stats.busyFrames;
+        doc["requests"] = stats.requests;
+        doc["dropped"] = stats.dropped;
+        doc["lastFrameUs"] = stats.lastFrameUs;
+        doc["maxFrameUs"] = stats.maxFrameUs;
+        doc["avgFrameUs"] = stats.avgFrameUs;
+        doc["lastShowUs"] = stats.lastShowUs;
+        doc["maxShowUs"] = stats.maxShowUs;
+        String json;
+        serializeJson(doc, json);
+        request->send(200, "application/json", json);
     });
 
-    server.on("/led/strobecolor", HTTP_POST, [this](AsyncWebServerRequest *request) {
-        if (request->hasParam("color", true)) {
-            String colorStr = request->getParam("color", true)->value();
-            uint32_t color = strtol(colorStr.c_str(), NULL, 16);
-            if (g_rgbLed) {
-                g_rgbLed->setStrobeColor(color);
-            }
-            conf->setLedStrobeColor(color);
-            request->send(200, "application/json", "{\"status\": \"OK\"}");
-        } else {
-            request->send(400, "application/json", "{\"status\": \"ERROR\", \"message\": \"Missing color\"}");
+    server.on("/led/stats", HTTP_POST, [this](AsyncWebServerRequest *request) {
+        if (g_rgbLed) {
+            g_rgbLed->resetFrameStats();
         }
-        led->on(200);
+        request->send(200, "application/json", "{\"status\": \"OK\"}");
     });
 #endif
 
     // Calibration wizard endpoints
-    server.on("/calibration/start", HTTP_POST, [this](AsyncWebServerRequest *request) {
-        timer->startCalibrationWizard();
-        request->send(200, "application/json", "{\"status\": \"OK\"}");
-        led->on(200);
-    });
-
-    server.on("/calibration/stop", HTTP_POST, [this](AsyncWebServerRequest *request) {
-        timer->stopCalibrationWizard();
-        request->send(200, "application/json", "{\"status\": \"OK\"}");
-        led->on(200);
-    });
+    addCommandRoute("/calibration/start", HTTP_POST, "calibration/start");
+    addCommandRoute("/calibration/stop", HTTP_POST, "calibration/stop");
 
     server.on("/calibration/data", HTTP_GET, [this](AsyncWebServerRequest *request) {
         uint16_t count = timer->getCalibrationRssiCount();
@@ -1300,104 +1406,13 @@ EEPROM:\n\
     });
 
     // Webhook management endpoints
-    server.on("/webhooks", HTTP_GET, [this](AsyncWebServerRequest *request) {
-        String json = "{\"enabled\":" + String(webhooks ? (webhooks->isEnabled() ? "true" : "false") : "false") + ",\"webhooks\":[";
-        if (webhooks) {
-            uint8_t count = webhooks->getWebhookCount();
-            for (uint8_t i = 0; i < count; i++) {
-                if (i > 0) json += ",";
-                json += "\"" + String(webhooks->getWebhookIP(i)) + "\"";
-            }
-        }
-        json += "]}";
-        request->send(200, "application/json", json);
-        led->on(200);
-    });
-
-    server.on("/webhooks/add", HTTP_POST, [this](AsyncWebServerRequest *request) {
-        if (request->hasParam("ip", true)) {
-            String ip = request->getParam("ip", true)->value();
-            if (webhooks && webhooks->addWebhook(ip.c_str())) {
-                conf->addWebhookIP(ip.c_str());
-                request->send(200, "application/json", "{\"status\": \"OK\", \"message\": \"Webhook added\"}");
-            } else {
-                request->send(400, "application/json", "{\"status\": \"ERROR\", \"message\": \"Failed to add webhook\"}");
-            }
-        } else {
-            request->send(400, "application/json", "{\"status\": \"ERROR\", \"message\": \"Missing ip\"}");
-        }
-        led->on(200);
-    });
-
-    server.on("/webhooks/remove", HTTP_POST, [this](AsyncWebServerRequest *request) {
-        if (request->hasParam("ip", true)) {
-            String ip = request->getParam("ip", true)->value();
-            if (webhooks && webhooks->removeWebhook(ip.c_str())) {
-                conf->removeWebhookIP(ip.c_str());
-                request->send(200, "application/json", "{\"status\": \"OK\", \"message\": \"Webhook removed\"}");
-            } else {
-                request->send(400, "application/json", "{\"status\": \"ERROR\", \"message\": \"Webhook not found\"}");
-            }
-        } else {
-            request->send(400, "application/json", "{\"status\": \"ERROR\", \"message\": \"Missing ip\"}");
-        }
-        led->on(200);
-    });
-
-    server.on("/webhooks/clear", HTTP_POST, [this](AsyncWebServerRequest *request) {
-        if (webhooks) {
-            webhooks->clearWebhooks();
-            conf->clearWebhookIPs();
-            request->send(200, "application/json", "{\"status\": \"OK\", \"message\": \"All webhooks cleared\"}");
-        } else {
-            request->send(400, "application/json", "{\"status\": \"ERROR\", \"message\": \"Webhooks not initialized\"}");
-        }
-        led->on(200);
-    });
-
-    server.on("/webhooks/enable", HTTP_POST, [this](AsyncWebServerRequest *request) {
-        if (request->hasParam("enabled", true)) {
-            bool enabled = request->getParam("enabled", true)->value() == "1";
-            if (webhooks) {
-                webhooks->setEnabled(enabled);
-                conf->setWebhooksEnabled(enabled ? 1 : 0);
-                request->send(200, "application/json", "{\"status\": \"OK\", \"message\": \"Webhooks " + String(enabled ? "enabled" : "disabled") + "\"}");
-            } else {
-                request->send(400, "application/json", "{\"status\": \"ERROR\", \"message\": \"Webhooks not initialized\"}");
-            }
-        } else {
-            request->send(400, "application/json", "{\"status\": \"ERROR\", \"message\": \"Missing enabled\"}");
-        }
-        led->on(200);
-    });
-
-    // Manual webhook triggers (for testing)
-    server.on("/webhooks/trigger/flash", HTTP_POST, [this](AsyncWebServerRequest *request) {
-        if (!webhooks) {
-            request->send(400, "application/json", "{\"status\": \"ERROR\", \"message\": \"Webhooks not initialized\"}");
-            return;
-        }
-        
-        if (!webhooks->isEnabled()) {
-            request->send(400, "application/json", "{\"status\": \"ERROR\", \"message\": \"Webhooks are disabled\"}");
-            return;
-        }
-        
-        uint8_t hookCount = webhooks->getWebhookCount();
-        if (hookCount == 0) {
-            request->send(400, "application/json", "{\"status\": \"ERROR\", \"message\": \"No webhooks configured\"}");
-            return;
-        }
-        
-        DEBUG("Triggering flash webhook to %d endpoints\n", hookCount);
-        
-        // Send response before triggering webhooks to avoid blocking
-        request->send(200, "application/json", "{\"status\": \"OK\", \"message\": \"Flash triggered\"}");
-        led->on(200);
-        
-        // Trigger webhooks after response sent
-        webhooks->triggerFlash();
-    });
+    addCommandRoute("/webhooks", HTTP_GET, "webhooks/get");
+    addCommandRoute("/webhooks/add", HTTP_POST, "webhooks/add");
+    addCommandRoute("/webhooks/remove", HTTP_POST, "webhooks/remove");
+    addCommandRoute("/webhooks/clear", HTTP_POST, "webhooks/clear");
+    addCommandRoute("/webhooks/enable", HTTP_POST, "webhooks/enable");
+    // Manual trigger, for testing
+    addCommandRoute("/webhooks/trigger/flash", HTTP_POST, "webhooks/trigger/flash");
 
     ElegantOTA.setAutoReboot(true);
     ElegantOTA.begin(&server);
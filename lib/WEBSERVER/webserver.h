@@ -2,34 +2,79 @@
 #include <WiFi.h>
 
 #include "battery.h"
+#include "command.h"
 #include "laptimer.h"
+#include "power.h"
 #include "racehistory.h"
+#include "rssihistory.h"
+#include "scheduler.h"
 #include "storage.h"
 #include "selftest.h"
+#include "ssefanout.h"
 #include "transport.h"
 #include "trackmanager.h"
 #include "webhook.h"
+#include "wstransport.h"
 
 #define WIFI_CONNECTION_TIMEOUT_MS 30000
 #define WIFI_RECONNECT_TIMEOUT_MS 500
 #define WEB_RSSI_SEND_TIMEOUT_MS 200
 #define WEB_SSE_KEEPALIVE_MS 15000
+// Batched RSSI streams (POST /rssi/stream), each renewed by its client
+// within the lease or dropped
+#define WEB_RSSI_STREAMS 4
+#define WEB_RSSI_STREAM_LEASE_MS 10000
+
+// A stream belongs to one event stream client (the id of its "hello"
+// event) and its batches go to that client only. The HTTP handler only
+// posts the wanted settings, handleWebUpdate() applies them and owns the
+// batcher
+struct WebRssiStream {
+    std::atomic<uint32_t> request{0};  // rate << 8 | batch, 0 when the slot is free
+    std::atomic<uint32_t> client{0};   // SseFanout client id, set before request
+    std::atomic<uint32_t> renewedMs{0};
+    uint32_t applied = 0;
+    RssiBatcher batcher;
+};
 
 class Webserver : public TransportInterface {
    public:
     void init(Config *config, LapTimer *lapTimer, BatteryMonitor *batMonitor, Buzzer *buzzer, Led *l, RaceHistory *raceHist, Storage *stor, SelfTest *test, RX5808 *rx5808, TrackManager *trackMgr, WebhookManager *webhookMgr);
     void setTransportManager(TransportManager *tm);
+    void setScheduler(Scheduler *sched) { scheduler = sched; }
+    void setPowerManager(PowerManager *pm) { power = pm; }
+    void setRssiHistory(RssiHistory *h) { rssiHistory = h; }
+    // Served on /ws once the services start
+    void setWsTransport(WsTransport *t) { wsTransport = t; }
+    // Runs the command routes, set before the services start
+    void setCommandRouter(CommandRouter *r) { commands = r; }
+    bool hasClients();  // Stations on our AP, open event streams or WebSockets
+    // Fastest batched RSSI stream, 0 when none is open
+    uint16_t getRssiStreamRateHz() const { return rssiStreamRateHz; }
     void handleWebUpdate(uint32_t currentTimeMs);
     
     // TransportInterface implementation
-    void sendLapEvent(uint32_t lapTimeMs) override;
-    void sendRssiEvent(uint8_t rssi) override;
-    void sendRaceStateEvent(const char* state) override;
+    void sendLapEvent(uint32_t lapTimeMs, uint32_t deviceTimeMs, uint32_t eventId) override;
+    void sendRssiEvent(uint8_t rssi, uint32_t deviceTimeMs) override;
+    void sendRaceStateEvent(const char* state, uint32_t deviceTimeMs, uint32_t eventId) override;
+    void sendRaceArmedEvent(uint32_t startTimeMs, uint32_t deviceTimeMs, uint32_t eventId) override;
     bool isConnected() override;
     void update(uint32_t currentTimeMs) override;
 
    private:
     void startServices();
+    void updateRssiStreams(uint32_t currentTimeMs);
+    // To one client if given, else to all
+    void sendSseEvent(const RaceEvent &event, AsyncEventSourceClient *client);
+    void replayEvents(AsyncEventSourceClient *client, uint32_t lastId);
+    // Routes to a command of the router: arguments from the request's
+    // parameters (form fields or query), or from its JSON body
+    void addCommandRoute(const char *path, WebRequestMethodComposite method, const char *name);
+    void addJsonCommandRoute(const char *path, const char *name);
+    // GET, the reply saved as a file. The filename may take the value of
+    // one parameter: "race_%u.json", "timestamp"
+    void addDownloadRoute(const char *path, const char *name, const char *filename, const char *param = nullptr);
+    void sendCommandReply(AsyncWebServerRequest *request, const CommandDef *command, JsonVariantConst args, const char *filename = nullptr);
 
     Config *conf;
     LapTimer *timer;
@@ -43,6 +88,11 @@ class Webserver : public TransportInterface {
     TrackManager *trackManager;
     WebhookManager *webhooks;
     TransportManager *transportMgr;
+    Scheduler *scheduler = nullptr;
+    PowerManager *power = nullptr;
+    RssiHistory *rssiHistory = nullptr;
+    WsTransport *wsTransport = nullptr;
+    CommandRouter *commands = nullptr;
 
     wifi_mode_t wifiMode = WIFI_OFF;
     wl_status_t lastStatus = WL_IDLE_STATUS;
@@ -53,5 +103,8 @@ class Webserver : public TransportInterface {
 
     bool sendRssi = false;
     uint32_t rssiSentMs = 0;
+    WebRssiStream rssiStreams[WEB_RSSI_STREAMS];
+    std::atomic<uint16_t> rssiStreamRateHz{0};
     uint32_t sseKeepaliveMs = 0;
+    SseFanout sse;
 };
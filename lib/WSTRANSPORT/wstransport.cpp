@@ -0,0 +1,325 @@
+#include "wstransport.h"
+
+#include <esp_timer.h>
+
+#include "debug.h"
+
+void WsTransport::init(LapTimer *lapTimer) {
+    timer = lapTimer;
+}
+
+void WsTransport::begin(AsyncWebServer *server) {
+    if (started) {
+        return;
+    }
+    socket.onEvent([this](AsyncWebSocket *ws, AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data, size_t len) {
+        onEvent(client, type, arg, data, len);
+    });
+    server->addHandler(&socket);
+    started = true;
+    DEBUG("WebSocket transport on /ws\n");
+}
+
+// Runs on the async_tcp task. Slots are only taken and freed here, so a
+// slot is reset before its clientId makes it visible to the senders
+void WsTransport::onEvent(AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data, size_t len) {
+    if (type == WS_EVT_CONNECT) {
+        for (uint8_t i = 0; i < WS_MAX_CLIENTS; i++) {
+            WsClientSlot &slot = slots[i];
+            if (slot.clientId.load() == 0) {
+                slot.mask = WS_SUB_LAPS;
+                slot.rssiRequest = 0;
+                slot.seq = 0;
+                slot.framesSent = 0;
+                slot.bytesSent = 0;
+                slot.framesDropped = 0;
+                slot.clientId = client->id();
+                DEBUG("WS client %u connected\n", client->id());
+                return;
+            }
+        }
+        DEBUG("WS client %u refused, %u clients\n", client->id(), WS_MAX_CLIENTS);
+        client->close(1013, "Too many clients");
+
+    } else if (type == WS_EVT_DISCONNECT) {
+        WsClientSlot *slot = findSlot(client->id());
+        if (slot) {
+            slot->rssiRequest = 0;
+            slot->mask = 0;
+            slot->clientId = 0;
+            DEBUG("WS client %u gone, %u frames dropped\n", client->id(), slot->framesDropped.load());
+        }
+
+    } else if (type == WS_EVT_DATA) {
+        // A command is one unfragmented text message
+        AwsFrameInfo *info = (AwsFrameInfo *)arg;
+        if (info->final && info->index == 0 && info->len == len && info->opcode == WS_TEXT) {
+            processCommand(client, (const char *)data, len);
+        } else if (info->index == 0) {
+            sendResponse(client, 0, "ERROR", "Commands are single text messages");
+        }
+    }
+}
+
+WsClientSlot *WsTransport::findSlot(uint32_t clientId) {
+    for (uint8_t i = 0; i < WS_MAX_CLIENTS; i++) {
+        if (slots[i].clientId.load() == clientId) {
+            return &slots[i];
+        }
+    }
+    return nullptr;
+}
+
+void WsTransport::processCommand(AsyncWebSocketClient *client, const char *text, size_t len) {
+    int64_t receivedUs = esp_timer_get_time();
+    DynamicJsonDocument doc(512);
+    if (deserializeJson(doc, text, len)) {
+        sendResponse(client, 0, "ERROR", "Bad JSON");
+        return;
+    }
+    const char *cmd = doc["cmd"] | "";
+    uint32_t id = doc["id"] | 0;
+    JsonVariantConst data = doc["data"];
+    WsClientSlot *slot = findSlot(client->id());
+    if (!slot) {
+        return;
+    }
+
+    // {"laps":bool,"rssi":bool,"perf":bool,"rate":Hz,"batch":samples},
+    // fields left out keep their value. Replies with what is in effect
+    if (strcmp(cmd, "subscribe") == 0) {
+        uint8_t mask = slot->mask.load();
+        const ws_subscription_e subs[] = {WS_SUB_LAPS, WS_SUB_RSSI, WS_SUB_PERF};
+        const char *const names[] = {"laps", "rssi", "perf"};
+        for (uint8_t i = 0; i < 3; i++) {
+            if (data.containsKey(names[i])) {
+                mask = data[names[i]].as<bool>() ? (mask | subs[i]) : (mask & ~subs[i]);
+            }
+        }
+        uint32_t request = slot->rssiRequest.load();
+        uint16_t rate = RssiBatcher::clampRate(data["rate"] | (request ? request >> 8 : (uint32_t)RSSI_STREAM_DEFAULT_RATE_HZ));
+        uint8_t batch = RssiBatcher::clampBatch(data["batch"] | (request ? request & 0xFF : (uint32_t)RSSI_BATCH_DEFAULT));
+        slot->rssiRequest = (mask & WS_SUB_RSSI) ? ((uint32_t)rate << 8) | batch : 0;
+        slot->mask = mask;
+
+        DynamicJsonDocument resp(192);
+        resp["id"] = id;
+        resp["status"] = "OK";
+        resp["data"]["laps"] = (mask & WS_SUB_LAPS) != 0;
+        resp["data"]["rssi"] = (mask & WS_SUB_RSSI) != 0;
+        resp["data"]["perf"] = (mask & WS_SUB_PERF) != 0;
+        resp["data"]["rate"] = rate;
+        resp["data"]["batch"] = batch;
+        resp["data"]["lastId"] = transportMgr ? transportMgr->getEventLog()->lastId() : 0;
+        String out;
+        serializeJson(resp, out);
+        client->text(out);
+
+    // Replay after a reconnect, {"since":lastEventId}: the missed events
+    // as frames, then {"lastId","complete"}, like the USB command
+    } else if (strcmp(cmd, "events") == 0) {
+        if (!transportMgr) {
+            sendResponse(client, id, "ERROR", "No event log");
+            return;
+        }
+        EventLog *log = transportMgr->getEventLog();
+        uint32_t since = data["since"] | (uint32_t)0;
+        log->lock();
+        bool complete = log->covers(since);
+        if (complete) {
+            RaceEvent chunk[EVENT_LOG_CHUNK];
+            size_t n;
+            while ((n = log->since(since, chunk, EVENT_LOG_CHUNK)) > 0) {
+                for (size_t i = 0; i < n; i++) {
+                    sendRaceFrame(chunk[i], slot);
+                }
+                since = chunk[n - 1].id;
+            }
+        }
+        char buf[96];
+        snprintf(buf, sizeof(buf), "{\"id\":%u,\"status\":\"OK\",\"data\":{\"lastId\":%u,\"complete\":%s}}",
+                 id, log->lastId(), complete ? "true" : "false");
+        client->text(buf);
+        log->unlock();
+
+    // Clock sync, see /api/time
+    } else if (strcmp(cmd, "time") == 0) {
+        char buf[112];
+        snprintf(buf, sizeof(buf), "{\"id\":%u,\"status\":\"OK\",\"data\":{\"t0\":%.0f,\"t1\":%lld,\"t2\":%lld}}",
+                 id, data["t0"] | 0.0, (long long)receivedUs, (long long)esp_timer_get_time());
+        client->text(buf);
+
+    // The rest are shared with HTTP and USB, see command.h
+    } else if (router) {
+        DynamicJsonDocument resp(1024);
+        router->executeToReply(cmd, id, data, resp);
+        String out;
+        serializeJson(resp, out);
+        client->text(out);
+
+    } else {
+        sendResponse(client, id, "ERROR", "Unknown command");
+    }
+}
+
+void WsTransport::sendResponse(AsyncWebSocketClient *client, uint32_t id, const char *status, const char *message) {
+    char buf[128];
+    if (message) {
+        snprintf(buf, sizeof(buf), "{\"id\":%u,\"status\":\"%s\",\"message\":\"%s\"}", id, status, message);
+    } else {
+        snprintf(buf, sizeof(buf), "{\"id\":%u,\"status\":\"%s\"}", id, status);
+    }
+    client->text(buf);
+}
+
+// seq is taken even when the frame is dropped, so the client sees the gap.
+// Runs on loop() and the core 0 jobs while async_tcp may free the client,
+// so it is only reached by id, through the socket's own lookups
+bool WsTransport::sendTo(WsClientSlot &slot, bool droppable, uint8_t type, const void *head, size_t headLen,
+                         const void *tail, size_t tailLen) {
+    uint32_t clientId = slot.clientId.load();
+    size_t len = 2 + headLen + tailLen;
+    if (clientId == 0 || len > WS_FRAME_MAX) {
+        return false;
+    }
+    uint8_t seq = slot.seq.fetch_add(1);
+    if (!socket.availableForWrite(clientId)) {
+        slot.framesDropped++;
+        if (!droppable && slot.clientId.load() == clientId) {
+            DEBUG("WS client %u can't take a lap event, closing\n", clientId);
+            socket.close(clientId);
+        }
+        return false;
+    }
+
+    uint8_t buf[WS_FRAME_MAX];
+    buf[0] = type;
+    buf[1] = seq;
+    memcpy(buf + 2, head, headLen);
+    if (tailLen) {
+        memcpy(buf + 2 + headLen, tail, tailLen);
+    }
+    socket.binary(clientId, (const char *)buf, len);
+    slot.framesSent++;
+    slot.bytesSent += len + WS_FRAME_OVERHEAD;
+    return true;
+}
+
+void WsTransport::broadcast(uint8_t mask, bool droppable, uint8_t type, const void *head, size_t headLen,
+                            const void *tail, size_t tailLen) {
+    if (!started) {
+        return;
+    }
+    for (uint8_t i = 0; i < WS_MAX_CLIENTS; i++) {
+        if (slots[i].mask.load() & mask) {
+            sendTo(slots[i], droppable, type, head, headLen, tail, tailLen);
+        }
+    }
+}
+
+// Live to every lap subscriber, or a replay to one client
+void WsTransport::sendRaceFrame(const RaceEvent &event, WsClientSlot *only) {
+    UsbLapFrame lap = {event.value, event.deviceTimeMs, event.id};
+    UsbRaceStateFrame state = {event.deviceTimeMs, (uint8_t)(event.type == RACE_EVENT_STARTED ? USB_RACE_STARTED : USB_RACE_STOPPED), event.id};
+    UsbRaceArmedFrame armed = {event.deviceTimeMs, event.value, event.id};
+    uint8_t type;
+    const void *frame;
+    size_t len;
+    switch (event.type) {
+        case RACE_EVENT_LAP:
+            type = USB_FRAME_LAP;
+            frame = &lap;
+            len = sizeof(lap);
+            break;
+        case RACE_EVENT_STARTED:
+        case RACE_EVENT_STOPPED:
+            type = USB_FRAME_RACE_STATE;
+            frame = &state;
+            len = sizeof(state);
+            break;
+        case RACE_EVENT_ARMED:
+            type = USB_FRAME_RACE_ARMED;
+            frame = &armed;
+            len = sizeof(armed);
+            break;
+        default:
+            return;
+    }
+    if (only) {
+        sendTo(*only, false, type, frame, len, nullptr, 0);
+    } else {
+        broadcast(WS_SUB_LAPS, false, type, frame, len);
+    }
+}
+
+void WsTransport::sendLapEvent(uint32_t lapTimeMs, uint32_t deviceTimeMs, uint32_t eventId) {
+    sendRaceFrame({eventId, deviceTimeMs, lapTimeMs, RACE_EVENT_LAP}, nullptr);
+}
+
+// One-sample batch, as the USB binary mode sends it
+void WsTransport::sendRssiEvent(uint8_t rssi, uint32_t deviceTimeMs) {
+    UsbRssiBatchFrame frame = {deviceTimeMs, 0, 1};
+    broadcast(WS_SUB_RSSI, true, USB_FRAME_RSSI_BATCH, &frame, sizeof(frame), &rssi, 1);
+}
+
+void WsTransport::sendRaceStateEvent(const char *state, uint32_t deviceTimeMs, uint32_t eventId) {
+    uint8_t type = strcmp(state, "started") == 0 ? RACE_EVENT_STARTED : RACE_EVENT_STOPPED;
+    sendRaceFrame({eventId, deviceTimeMs, 0, type}, nullptr);
+}
+
+void WsTransport::sendRaceArmedEvent(uint32_t startTimeMs, uint32_t deviceTimeMs, uint32_t eventId) {
+    sendRaceFrame({eventId, deviceTimeMs, startTimeMs, RACE_EVENT_ARMED}, nullptr);
+}
+
+void WsTransport::sendPerf(WsClientSlot &slot) {
+    UsbPerfFrame frame;
+    frame.deviceTimeMs = millis();
+    frame.freeHeap = ESP.getFreeHeap();
+    frame.minFreeHeap = ESP.getMinFreeHeap();
+    frame.cpuMhz = getCpuFrequencyMhz();
+    frame.framesSent = slot.framesSent;
+    frame.bytesSent = slot.bytesSent;
+    frame.framesDropped = slot.framesDropped;
+    sendTo(slot, true, USB_FRAME_PERF, &frame, sizeof(frame), nullptr, 0);
+}
+
+bool WsTransport::isConnected() {
+    return started && socket.count() > 0;
+}
+
+void WsTransport::update(uint32_t currentTimeMs) {
+    if (!started) {
+        return;
+    }
+    bool perfDue = (currentTimeMs - lastPerfSentMs) >= WS_PERF_INTERVAL_MS;
+    if (perfDue) {
+        lastPerfSentMs = currentTimeMs;
+        socket.cleanupClients(WS_MAX_CLIENTS);
+    }
+
+    uint16_t fastestHz = 0;
+    for (uint8_t i = 0; i < WS_MAX_CLIENTS; i++) {
+        WsClientSlot &slot = slots[i];
+        uint32_t request = slot.clientId.load() ? slot.rssiRequest.load() : 0;
+        if (request != slot.rssiApplied) {
+            if (request) {
+                slot.batcher.start(timer->getRssiRing(), request >> 8, request & 0xFF);
+            } else {
+                slot.batcher.stop();
+            }
+            slot.rssiApplied = request;
+        }
+        while (slot.batcher.poll()) {
+            const RssiBatch &batch = slot.batcher.batch();
+            UsbRssiBatchFrame frame = {batch.baseTimeMs, (uint32_t)batch.intervalMs * 1000, batch.count};
+            sendTo(slot, true, USB_FRAME_RSSI_BATCH, &frame, sizeof(frame), batch.values, batch.count);
+        }
+        if (slot.batcher.isActive() && slot.batcher.getRateHz() > fastestHz) {
+            fastestHz = slot.batcher.getRateHz();
+        }
+        if (perfDue && (slot.mask.load() & WS_SUB_PERF)) {
+            sendPerf(slot);
+        }
+    }
+    rssiStreamRateHz = fastestHz;
+}
@@ -0,0 +1,110 @@
+#ifndef WSTRANSPORT_H
+#define WSTRANSPORT_H
+
+/**
+ * WebSocket transport on /ws, next to the SSE stream on /events
+ *
+ * One connection carries commands and events both ways:
+ * - Commands are text messages, JSON shaped like the USB ones:
+ *   {"cmd":"timer/start","id":1,"data":{}} -> {"id":1,"status":"OK"}
+ * - Events are binary messages, type(1) | seq(1) | payload, with the
+ *   payloads of the USB binary mode (usbframe.h). WebSocket already frames
+ *   and checks the data, so there is no COBS and no CRC. seq counts the
+ *   events meant for the client, one dropped for backpressure leaves a gap
+ *
+ * Lap and race frames carry their event id. A client that reconnects sends
+ * {"cmd":"events","data":{"since":lastId}} to get the ones it missed.
+ *
+ * A client picks what it gets with "subscribe": laps (lap and race
+ * state events, on by default), rssi (batched like /rssi/stream) and perf.
+ * Before each send the client's queue is checked: RSSI and perf are
+ * dropped while it is full, and a client that can't take a lap is closed
+ * so it reconnects and reloads the race instead of missing it silently
+ */
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <ESPAsyncWebServer.h>
+
+#include <atomic>
+
+#include "command.h"
+#include "laptimer.h"
+#include "rssistream.h"
+#include "transport.h"
+#include "usbframe.h"
+
+#define WS_MAX_CLIENTS 4
+#define WS_PERF_INTERVAL_MS 1000
+// WebSocket header of a server message under 64 KB
+#define WS_FRAME_OVERHEAD 4
+// Largest event message: type, seq, batch header and a full batch
+#define WS_FRAME_MAX (2 + sizeof(UsbRssiBatchFrame) + RSSI_BATCH_MAX)
+
+typedef enum {
+    WS_SUB_LAPS = 1 << 0,  // lap, raceState, raceArmed
+    WS_SUB_RSSI = 1 << 1,  // RSSI batches at the client's rate
+    WS_SUB_PERF = 1 << 2   // Heap and per-client counters each WS_PERF_INTERVAL_MS
+} ws_subscription_e;
+
+// One connected client. The socket callbacks (async_tcp task) take and
+// free the slot and post subscriptions, update() owns the batcher
+struct WsClientSlot {
+    std::atomic<uint32_t> clientId{0};  // AsyncWebSocketClient id, 0 when free
+    std::atomic<uint8_t> mask{0};
+    std::atomic<uint32_t> rssiRequest{0};  // rate << 8 | batch, 0 = no RSSI
+    uint32_t rssiApplied = 0;
+    RssiBatcher batcher;
+    std::atomic<uint8_t> seq{0};
+    std::atomic<uint32_t> framesSent{0};
+    std::atomic<uint32_t> bytesSent{0};
+    std::atomic<uint32_t> framesDropped{0};
+};
+
+class WsTransport : public TransportInterface {
+   public:
+    void init(LapTimer *lapTimer);
+    void setTransportManager(TransportManager *tm) { transportMgr = tm; }
+    // Runs the commands shared with HTTP and USB
+    void setCommandRouter(CommandRouter *r) { router = r; }
+    // Adds the /ws handler, before the server begins
+    void begin(AsyncWebServer *server);
+    uint32_t count() { return started ? socket.count() : 0; }
+    // Fastest RSSI subscription, 0 when none
+    uint16_t getRssiStreamRateHz() const { return rssiStreamRateHz; }
+
+    // TransportInterface implementation
+    void sendLapEvent(uint32_t lapTimeMs, uint32_t deviceTimeMs, uint32_t eventId) override;
+    void sendRssiEvent(uint8_t rssi, uint32_t deviceTimeMs) override;
+    void sendRaceStateEvent(const char *state, uint32_t deviceTimeMs, uint32_t eventId) override;
+    void sendRaceArmedEvent(uint32_t startTimeMs, uint32_t deviceTimeMs, uint32_t eventId) override;
+    bool isConnected() override;
+    void update(uint32_t currentTimeMs) override;
+
+   private:
+    void onEvent(AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data, size_t len);
+    void processCommand(AsyncWebSocketClient *client, const char *text, size_t len);
+    void sendResponse(AsyncWebSocketClient *client, uint32_t id, const char *status, const char *message = nullptr);
+    WsClientSlot *findSlot(uint32_t clientId);
+    // Sends to every client subscribed to mask. Droppable frames only go
+    // to clients with room for them right now
+    void broadcast(uint8_t mask, bool droppable, uint8_t type, const void *head, size_t headLen,
+                   const void *tail = nullptr, size_t tailLen = 0);
+    bool sendTo(WsClientSlot &slot, bool droppable, uint8_t type, const void *head, size_t headLen,
+                const void *tail, size_t tailLen);
+    void sendPerf(WsClientSlot &slot);
+    // To one client if given, else to the lap subscribers
+    void sendRaceFrame(const RaceEvent &event, WsClientSlot *only);
+
+    LapTimer *timer = nullptr;
+    TransportManager *transportMgr = nullptr;
+    CommandRouter *router = nullptr;
+    AsyncWebSocket socket{"/ws"};
+    bool started = false;
+
+    WsClientSlot slots[WS_MAX_CLIENTS];
+    std::atomic<uint16_t> rssiStreamRateHz{0};
+    uint32_t lastPerfSentMs = 0;
+};
+
+#endif  // WSTRANSPORT_H
@@ -1,13 +1,18 @@
+#include "command.h"
 #include "debug.h"
 #include "led.h"
 #include "webserver.h"
+#include "power.h"
 #include "racehistory.h"
+#include "scheduler.h"
 #include "storage.h"
 #include "selftest.h"
 #include "transport.h"
 #include "trackmanager.h"
+#include "udptransport.h"
 #include "usb.h"
 #include "webhook.h"
+#include "wstransport.h"
 // DISABLED FOR NOW: #include "nodemode.h"  // Uncomment to re-enable RotorHazard support
 #include <ElegantOTA.h>
 #ifdef ESP32S3
@@ -37,7 +42,7 @@
 // SOFTWARE MODE SWITCH:
 // - Change "opMode" in config via web interface (0=WiFi, 1=RotorHazard)
 // - Requires REBOOT to take effect
-// - Setting is stored in EEPROM and persists across reboots
+// - Setting is stored in the config store (NVS) and persists across reboots
 //
 // PHYSICAL MODE SWITCH (when installed):
 // - GPIO9 to GND = Force WiFi mode (overrides software setting)
@@ -50,6 +55,8 @@ static Storage storage;
 static SelfTest selfTest;
 static Webserver ws;
 static USBTransport usbTransport;
+static WsTransport wsTransport;
+static UdpTransport udpTransport;
 static TransportManager transportManager;
 static Buzzer buzzer;
 static Led led;
@@ -63,34 +70,44 @@ RgbLed* g_rgbLed = &rgbLed;
 void* g_rgbLed = nullptr;
 #endif
 static LapTimer timer;
+static Scheduler scheduler;
+static PowerManager power;
+static RssiHistory rssiHistory;
+static CommandRouter commandRouter;
 // Battery monitoring removed - legacy feature no longer used
 // static BatteryMonitor monitor;
 
-static TaskHandle_t xTimerTask = NULL;
 static bool sdInitAttempted = false;
 
-static void parallelTask(void *pvArgs) {
-    for (;;) {
-        uint32_t currentTimeMs = millis();
-        buzzer.handleBuzzer(currentTimeMs);
-        led.handleLed(currentTimeMs);
+// Core 0 housekeeping jobs: period and deadline in microseconds. Config
+// writes and RX tuning are event driven on the config bus instead, the
+// buzzer and status LED run off their own hardware timers
+static void initParallelTask() {
 #ifdef ESP32S3
+    scheduler.addJob("rgbLed", 10000, 10000, [](uint32_t currentTimeMs) {
         rgbLed.handleRgbLed(currentTimeMs);
+    });
 #endif
-        ws.handleWebUpdate(currentTimeMs);
+    scheduler.addJob("usb", 10000, 10000, [](uint32_t currentTimeMs) {
         usbTransport.update(currentTimeMs);
-        config.handleEeprom(currentTimeMs);
-        rx.handleFrequencyChange(currentTimeMs, config.getFrequency());
-        // Battery monitoring removed
-        // monitor.checkBatteryState(currentTimeMs, config.getAlarmThreshold());
-        buzzer.handleBuzzer(currentTimeMs);
-        led.handleLed(currentTimeMs);
-    }
-}
-
-static void initParallelTask() {
-    disableCore0WDT();
-    xTaskCreatePinnedToCore(parallelTask, "parallelTask", 8192, NULL, 0, &xTimerTask, 0);
+    });
+    // The lap timer's RSSI ring holds about a second, plenty for 50 ms
+    scheduler.addJob("rssiHistory", 50000, 50000, [](uint32_t currentTimeMs) {
+        rssiHistory.update();
+    });
+    // Drains the WebSocket clients' RSSI batchers, sends perf frames
+    scheduler.addJob("wsTransport", 20000, 20000, [](uint32_t currentTimeMs) {
+        wsTransport.update(currentTimeMs);
+    });
+    // Repeats the race summary to LAN displays
+    scheduler.addJob("udpTransport", 100000, 100000, [](uint32_t currentTimeMs) {
+        udpTransport.update(currentTimeMs);
+    });
+    scheduler.addJob("wifi", 100000, 50000, [](uint32_t currentTimeMs) {
+        ws.handleWebUpdate(currentTimeMs);
+    });
+    // Battery monitoring removed
+    scheduler.start("parallelTask", 1, 0);
 }
 
 void setup() {
@@ -158,17 +175,9 @@ void setup() {
     led.init(PIN_LED, false);
 #ifdef ESP32S3
     rgbLed.init();
-    // Apply saved LED configuration from config
-    rgbLed.setBrightness(config.getLedBrightness());
-    rgbLed.setEffectSpeed(config.getLedSpeed());
-    rgbLed.setManualColor(config.getLedColor());
-    rgbLed.setFadeColor(config.getLedFadeColor());
-    rgbLed.setStrobeColor(config.getLedStrobeColor());
-    rgbLed.enableManualOverride(config.getLedManualOverride());
-    // Apply preset last so all colors are set
-    rgbLed.setPreset((led_preset_e)config.getLedPreset());
 #endif
     timer.init(&config, &rx, &buzzer, &led, &webhookManager);
+    rssiHistory.init(timer.getRssiRing());
     // Battery monitoring removed
     // monitor.init(PIN_VBAT, VBAT_SCALE, VBAT_ADD, &buzzer, &led);
     
@@ -199,33 +208,66 @@ void setup() {
         }
     }
     
-    // Initialize webhook manager and load webhooks from config
-    webhookManager.setEnabled(config.getWebhooksEnabled());
-    for (uint8_t i = 0; i < config.getWebhookCount(); i++) {
-        const char* ip = config.getWebhookIP(i);
-        if (ip) {
-            webhookManager.addWebhook(ip);
-            DEBUG("Loaded webhook: %s\n", ip);
-        }
-    }
+    // Subsystems follow config through the change bus. startBus() hands each
+    // one the saved settings (tune RX, LED preset, webhook list), then every
+    // change made from web, USB or an SD restore
+    config.subscribe(&rx, CONFIG_CHANGED_FREQUENCY);
+    config.subscribe(&timer, CONFIG_CHANGED_TIMING);
+#ifdef ESP32S3
+    config.subscribe(&rgbLed, CONFIG_CHANGED_LED);
+#endif
+    config.subscribe(&webhookManager, CONFIG_CHANGED_WEBHOOKS);
+    config.startBus();
     
     ws.init(&config, &timer, nullptr, &buzzer, &led, &raceHistory, &storage, &selfTest, &rx, &trackManager, &webhookManager);
     
     // Initialize USB transport
     usbTransport.init(&config, &timer, nullptr, &buzzer, &led, &raceHistory, &storage, &selfTest, &rx, &trackManager);
     
+    // WebSocket transport, served by the web server on /ws
+    wsTransport.init(&timer);
+    
+    // Race events to LAN displays over UDP multicast, in station mode
+    udpTransport.init(transportManager.getEventLog());
+    
     // Register transports with TransportManager
+    transportManager.init();
     transportManager.addTransport(&ws);
     transportManager.addTransport(&usbTransport);
+    transportManager.addTransport(&wsTransport);
+    transportManager.addTransport(&udpTransport);
     
     // Set TransportManager in webserver for event broadcasting
     ws.setTransportManager(&transportManager);
+    ws.setScheduler(&scheduler);
+    ws.setPowerManager(&power);
+    ws.setRssiHistory(&rssiHistory);
+    ws.setWsTransport(&wsTransport);
+    wsTransport.setTransportManager(&transportManager);
+    usbTransport.setRssiHistory(&rssiHistory);
+    usbTransport.setEventLog(transportManager.getEventLog());
     
-    DEBUG("Transport system initialized (WiFi + USB)\n");
+    // Commands shared by HTTP, USB and /ws
+    CommandContext commandContext;
+    commandContext.config = &config;
+    commandContext.timer = &timer;
+    commandContext.history = &raceHistory;
+    commandContext.storage = &storage;
+    commandContext.tracks = &trackManager;
+    commandContext.selftest = &selfTest;
+    commandContext.transportMgr = &transportManager;
+    commandContext.webhooks = &webhookManager;
+    commandRouter.init(commandContext);
+    ws.setCommandRouter(&commandRouter);
+    usbTransport.setCommandRouter(&commandRouter);
+    wsTransport.setCommandRouter(&commandRouter);
+    
+    DEBUG("Transport system initialized (WiFi + USB + WebSocket + UDP)\n");
     
     led.on(400);
     buzzer.beep(200);
     initParallelTask();  // Start Core 0 task
+    power.init();
     
     /* DISABLED: RotorHazard mode initialization
     if (currentMode == MODE_WIFI) {
@@ -251,13 +293,28 @@ void loop() {
     // LED Flashing removed - LED_BUILTIN (GPIO48) conflicts with FastLED RMT channels
     // External LEDs on GPIO5 are handled by rgbLed instead
     
-    // Timing always runs
-    timer.handleLapTimerUpdate(currentTimeMs);
+    // Timing runs every pass while racing; stopped, RSSI is sampled on the
+    // power manager's slower grid but commands are still applied right away
+    if (power.sampleDue(currentTimeMs)) {
+        timer.handleLapTimerUpdate(currentTimeMs);
+    } else {
+        timer.processCommands();
+    }
+    uint16_t rssiStreamHz = max(max(ws.getRssiStreamRateHz(), usbTransport.getRssiStreamRateHz()), wsTransport.getRssiStreamRateHz());
+    power.update(currentTimeMs, timer.getState(), ws.hasClients() || usbTransport.hasActiveClient(currentTimeMs), rssiStreamHz);
     
+    // Armed starts are applied and begin on the timing loop, not in a command
+    if (timer.takeArmed()) {
+        transportManager.broadcastRaceArmedEvent(timer.getScheduledStartMs());
+    }
+    if (timer.takeArmedStart()) {
+        transportManager.broadcastRaceStateEvent("started");
+    }
+
     // Broadcast lap events to all transports (WiFi + USB)
     if (timer.isLapAvailable()) {
         uint32_t lapTime = timer.getLapTime();
-        transportManager.broadcastLapEvent(lapTime);
+        transportManager.broadcastLapEvent(lapTime, timer.getLapCrossingMs());
     }
     
     // Process queued webhooks (non-blocking)
@@ -325,14 +382,14 @@ void loop() {
         // RotorHazard mode - run node protocol
         nodeMode.process();
         
-        // Still update hardware (LED, buzzer) but NOT web server
-        buzzer.handleBuzzer(currentTimeMs);
-        led.handleLed(currentTimeMs);
+        // Still update the RGB LED but NOT web server
 #ifdef ESP32S3
         rgbLed.handleRgbLed(currentTimeMs);
 #endif
-        rx.handleFrequencyChange(currentTimeMs, config.getFrequency());
         monitor.checkBatteryState(currentTimeMs, config.getAlarmThreshold());
     }
     */
+
+    // Park until the next sample when stopped (no-op at full power)
+    power.idleWait(currentTimeMs);
 }
@@ -0,0 +1,179 @@
+#!/usr/bin/env python3
+"""
+Clock synchronization with an FPVGate timer
+
+Runs NTP-style exchanges against GET /api/time (WiFi) or the USB "time"
+command and estimates the device clock's offset and drift relative to this
+host. Every event the timer sends carries "t", the device millis() when it
+happened (for laps: the gate crossing), so with the estimate a client can
+place crossings on its own clock instead of stamping events on arrival.
+
+One exchange gives four timestamps:
+    t0  client sends          (client clock)
+    t1  device receives       (device esp_timer microseconds)
+    t2  device replies        (device esp_timer microseconds)
+    t3  client receives       (client clock)
+    offset = ((t1 - t0) + (t2 - t3)) / 2    device minus client
+    delay  = (t3 - t0) - (t2 - t1)          round trip without device time
+
+Queueing only ever adds delay, so the samples with the smallest delay are
+the most symmetric ones. The estimator splits a sliding window into runs of
+BUCKET exchanges, keeps the lowest-delay sample of each run (dropping runs
+that were slow throughout) and fits a line through their offsets: the
+intercept is the offset, the slope the drift. Drift needs a minute or two
+of exchanges to settle.
+
+Usage:
+    python clock_sync.py --host 192.168.4.1
+    python clock_sync.py --serial /dev/ttyACM0      (needs pyserial)
+"""
+
+import argparse
+import json
+import sys
+import time
+import urllib.request
+
+WINDOW = 512  # Exchanges kept
+BUCKET = 16   # Consecutive exchanges that compete for one fit point
+
+
+class Sample:
+    def __init__(self, t0, t1, t2, t3):
+        self.offset = ((t1 - t0) + (t2 - t3)) / 2.0
+        self.delay = (t3 - t0) - (t2 - t1)
+        self.at = (t0 + t3) / 2.0  # Client time the offset belongs to
+
+
+class ClockSync:
+    """Offset and drift of a device clock, all times in microseconds"""
+
+    def __init__(self, window=WINDOW):
+        self.window = window
+        self.samples = []
+        self.offset = 0.0   # Device minus client at ref
+        self.drift = 0.0    # Offset change per client microsecond
+        self.ref = 0.0
+
+    def add(self, t0, t1, t2, t3):
+        sample = Sample(t0, t1, t2, t3)
+        if sample.delay < 0:
+            return None  # Clock stepped or garbage reply
+        self.samples.append(sample)
+        if len(self.samples) > self.window:
+            self.samples.pop(0)
+        self._fit()
+        return sample
+
+    def _fit(self):
+        best = [min(self.samples[i:i + BUCKET], key=lambda s: s.delay)
+                for i in range(0, len(self.samples), BUCKET)]
+        if len(best) > 2:
+            cutoff = sorted(s.delay for s in best)[len(best) // 2] * 2
+            best = [s for s in best if s.delay <= cutoff]
+        self.ref = self.samples[-1].at
+        if len(best) < 2:
+            self.offset = best[0].offset
+            self.drift = 0.0
+            return
+        n = float(len(best))
+        mean_x = sum(s.at for s in best) / n
+        mean_y = sum(s.offset for s in best) / n
+        sxx = sum((s.at - mean_x) ** 2 for s in best)
+        sxy = sum((s.at - mean_x) * (s.offset - mean_y) for s in best)
+        # Samples too close together in time say nothing about drift
+        self.drift = sxy / sxx if sxx > (1e6 ** 2) else 0.0
+        self.offset = mean_y + self.drift * (self.ref - mean_x)
+
+    def offset_at(self, client_us):
+        return self.offset + self.drift * (client_us - self.ref)
+
+    def to_client_us(self, device_us):
+        # device = client + offset + drift * (client - ref), solved for client
+        return (device_us - self.offset + self.drift * self.ref) / (1.0 + self.drift)
+
+    def to_client_ms(self, device_ms):
+        """Maps an event's "t" (device millis()) to client milliseconds"""
+        return self.to_client_us(device_ms * 1000.0) / 1000.0
+
+    def drift_ppm(self):
+        return self.drift * 1e6
+
+
+def client_now_us():
+    return time.perf_counter_ns() // 1000
+
+
+def exchange_http(host, timeout):
+    t0 = client_now_us()
+    with urllib.request.urlopen(f"http://{host}/api/time?t0={t0}", timeout=timeout) as response:
+        reply = json.loads(response.read())
+    t3 = client_now_us()
+    return int(reply["t0"]), reply["t1"], reply["t2"], t3
+
+
+class SerialLink:
+    def __init__(self, port):
+        import serial  # pyserial, only needed for USB
+        self.port = serial.Serial(port, 115200, timeout=1)
+        self.next_id = 1
+
+    def exchange(self):
+        request_id = self.next_id
+        self.next_id += 1
+        t0 = client_now_us()
+        line = json.dumps({"cmd": "time", "id": request_id, "data": {"t0": t0}}) + "\n"
+        self.port.write(line.encode())
+        while True:
+            raw = self.port.readline()
+            t3 = client_now_us()
+            if not raw:
+                raise TimeoutError("no reply")
+            try:
+                reply = json.loads(raw)
+            except ValueError:
+                continue  # Debug output
+            if reply.get("id") == request_id:
+                data = reply["data"]
+                return int(data["t0"]), data["t1"], data["t2"], t3
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Estimate an FPVGate timer's clock offset and drift")
+    target = parser.add_mutually_exclusive_group(required=True)
+    target.add_argument("--host", help="Timer address, e.g. 192.168.4.1")
+    target.add_argument("--serial", help="USB serial port, e.g. /dev/ttyACM0 or COM3")
+    parser.add_argument("--count", type=int, default=240, help="Exchanges to run (default 240)")
+    parser.add_argument("--interval", type=float, default=0.5, help="Seconds between exchanges (default 0.5)")
+    args = parser.parse_args()
+
+    if args.host:
+        exchange = lambda: exchange_http(args.host, 2.0)
+    else:
+        exchange = SerialLink(args.serial).exchange
+
+    sync = ClockSync()
+    for i in range(args.count):
+        try:
+            sample = sync.add(*exchange())
+        except Exception as e:
+            print(f"exchange {i + 1}: failed ({e})")
+            continue
+        if sample:
+            print(f"exchange {i + 1:3d}: delay {sample.delay / 1000:8.3f} ms  "
+                  f"offset {sample.offset / 1000:14.3f} ms  -> estimate {sync.offset / 1000:14.3f} ms")
+        time.sleep(args.interval)
+
+    if not sync.samples:
+        print("No usable exchanges")
+        return 1
+    best = min(s.delay for s in sync.samples)
+    print()
+    print(f"Offset (device - host): {sync.offset / 1000:.3f} ms")
+    print(f"Drift:                  {sync.drift_ppm():+.1f} ppm")
+    print(f"Best round trip:        {best / 1000:.3f} ms (offset uncertainty about half of it)")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
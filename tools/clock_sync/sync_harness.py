@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+"""
+Host test harness for clock_sync.py
+
+Simulates a device clock with a fixed offset and crystal drift behind links
+with synthetic delay, jitter, asymmetry and spikes, feeds the exchanges to
+ClockSync and checks the estimated offset and drift against the true ones.
+Exits non-zero if any scenario misses its limits.
+
+Usage:
+    python sync_harness.py [--seeds 20] [--verbose]
+"""
+
+import argparse
+import random
+import sys
+
+from clock_sync import ClockSync
+
+
+class Link:
+    def __init__(self, name, up_us, down_us, jitter_us, spike_rate, poll_us, max_offset_err_us, max_drift_err_ppm):
+        self.name = name
+        self.up_us = up_us              # Fixed one-way delays
+        self.down_us = down_us
+        self.jitter_us = jitter_us      # Mean of the exponential queueing delay, each way
+        self.spike_rate = spike_rate    # Share of exchanges hit by a 20-200 ms stall
+        self.poll_us = poll_us          # Device side wait before t1 (USB update() grid)
+        self.max_offset_err_us = max_offset_err_us
+        self.max_drift_err_ppm = max_drift_err_ppm
+
+    def one_way(self, rng, base):
+        delay = base + rng.expovariate(1.0 / self.jitter_us)
+        if rng.random() < self.spike_rate:
+            delay += rng.uniform(20000, 200000)
+        return delay
+
+
+# An asymmetric fixed delay can't be seen from the client, half of the
+# difference always ends up in the offset (1 ms in the asymmetric case)
+LINKS = [
+    Link("wifi", 1500, 1500, 4000, 0.05, 0, 1000, 5.0),
+    Link("wifi, slow uplink", 1500, 1500, 8000, 0.10, 0, 1500, 10.0),
+    Link("wifi, asymmetric", 3000, 1000, 4000, 0.05, 0, 1500, 5.0),
+    Link("usb", 300, 300, 200, 0.01, 10000, 750, 2.0),
+]
+
+
+class DeviceClock:
+    def __init__(self, offset_us, drift_ppm):
+        self.offset_us = offset_us
+        self.drift = drift_ppm * 1e-6
+
+    def at(self, true_us):
+        return self.offset_us + (1.0 + self.drift) * true_us
+
+
+# Four minutes of exchanges at 2 Hz, about what a client does before a race
+def run(link, seed, exchanges=480, interval_us=500000):
+    rng = random.Random(seed)
+    device = DeviceClock(rng.uniform(-1e9, 1e9), rng.uniform(-40, 40))
+    sync = ClockSync()
+    naive_err = 0.0
+
+    now = 0.0  # Client clock is the true clock
+    for _ in range(exchanges):
+        t0 = now
+        arrive = t0 + link.one_way(rng, link.up_us)
+        read = arrive + rng.uniform(0, link.poll_us)
+        t1 = device.at(read)
+        reply = read + rng.uniform(100, 400)
+        t2 = device.at(reply)
+        t3 = reply + link.one_way(rng, link.down_us)
+        sample = sync.add(t0, t1, t2, t3)
+        naive_err = max(naive_err, abs(sample.offset - (device.at(sample.at) - sample.at)))
+        now = t3 + interval_us
+
+    # Check the mapping where clients use it: a device timestamp to client time
+    true_us = now
+    mapped = sync.to_client_us(device.at(true_us))
+    offset_err = mapped - true_us
+    drift_err = sync.drift_ppm() - device.drift * 1e6
+    return offset_err, drift_err, naive_err
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Check clock_sync.py against simulated links")
+    parser.add_argument("--seeds", type=int, default=20, help="Runs per link (default 20)")
+    parser.add_argument("--verbose", action="store_true")
+    args = parser.parse_args()
+
+    failed = False
+    print(f"{'link':20s} {'max offset err':>15s} {'limit':>8s} {'max drift err':>14s} {'limit':>9s} {'single-sample err':>18s}")
+    for link in LINKS:
+        worst_offset = 0.0
+        worst_drift = 0.0
+        worst_naive = 0.0
+        for seed in range(args.seeds):
+            offset_err, drift_err, naive_err = run(link, seed)
+            if args.verbose:
+                print(f"  {link.name} seed {seed}: offset {offset_err:+.0f} us, drift {drift_err:+.2f} ppm")
+            worst_offset = max(worst_offset, abs(offset_err))
+            worst_drift = max(worst_drift, abs(drift_err))
+            worst_naive = max(worst_naive, naive_err)
+        ok = worst_offset <= link.max_offset_err_us and worst_drift <= link.max_drift_err_ppm
+        failed |= not ok
+        print(f"{link.name:20s} {worst_offset:12.0f} us {link.max_offset_err_us:5d} us "
+              f"{worst_drift:10.2f} ppm {link.max_drift_err_ppm:5.1f} ppm "
+              f"{worst_naive / 1000:15.1f} ms  {'ok' if ok else 'FAIL'}")
+
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
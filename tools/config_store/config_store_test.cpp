@@ -0,0 +1,234 @@
+// Host test for the file backend of Config (FileConfigStore,
+// lib/CONFIG/configstore.cpp), the one that also runs on a LittleFS path.
+//
+// Build and run from the repository root:
+//   g++ -O1 -std=c++11 -Itools/host_shim -Ilib/CONFIG tools/config_store/config_store_test.cpp lib/CONFIG/configstore.cpp -o config_store_test
+//   ./config_store_test [scratch dir]
+//
+// Writes, reopens, compacts and tears logs in the scratch dir (default
+// /tmp) and checks what begin() reads back.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+#include "check.h"
+#include "configstore.h"
+
+static std::string logPath;
+
+static long fileSize(const std::string& path) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) return -1;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fclose(f);
+    return size;
+}
+
+static void appendBytes(const uint8_t* bytes, size_t len) {
+    FILE* f = fopen(logPath.c_str(), "ab");
+    fwrite(bytes, 1, len, f);
+    fclose(f);
+}
+
+static uint32_t getU32(FileConfigStore& store, const char* key, uint32_t def) {
+    uint32_t value;
+    return store.get(key, &value, sizeof(value)) ? value : def;
+}
+
+static void putU32(FileConfigStore& store, const char* key, uint32_t value) {
+    store.put(key, &value, sizeof(value));
+}
+
+static void testRoundTrip() {
+    printf("round trip\n");
+    FileConfigStore store(logPath.c_str());
+    CHECK(store.clear());
+    CHECK(store.begin());
+    CHECK(getU32(store, "freq", 0) == 0);
+
+    putU32(store, "freq", 5800);
+    char name[32] = "pilot";
+    store.put("name", name, sizeof(name));
+    // Staged values read back before the commit
+    CHECK(getU32(store, "freq", 0) == 5800);
+    CHECK(fileSize(logPath) == -1);
+    CHECK(store.commit());
+    CHECK(fileSize(logPath) == (long)store.getLogBytes());
+
+    FileConfigStore reopened(logPath.c_str());
+    CHECK(reopened.begin());
+    CHECK(getU32(reopened, "freq", 0) == 5800);
+    char readName[32] = {0};
+    CHECK(reopened.get("name", readName, sizeof(readName)));
+    CHECK(strcmp(readName, "pilot") == 0);
+    // Only an exact length matches, like NVS
+    uint16_t narrow;
+    CHECK(!reopened.get("freq", &narrow, sizeof(narrow)));
+    CHECK(!reopened.get("missing", &narrow, sizeof(narrow)));
+}
+
+static void testLatestWins() {
+    printf("latest value wins\n");
+    FileConfigStore store(logPath.c_str(), 1 << 20);
+    store.clear();
+    store.begin();
+    for (uint32_t i = 0; i < 50; i++) {
+        putU32(store, "bright", i);
+        putU32(store, "freq", 5800);
+        CHECK(store.commit());
+    }
+    // Uncommitted values are not in the log
+    putU32(store, "bright", 999);
+
+    FileConfigStore reopened(logPath.c_str(), 1 << 20);
+    CHECK(reopened.begin());
+    CHECK(getU32(reopened, "bright", 0) == 49);
+    CHECK(getU32(reopened, "freq", 0) == 5800);
+}
+
+static void testCompaction() {
+    printf("compaction\n");
+    const size_t compactBytes = 256;
+    FileConfigStore store(logPath.c_str(), compactBytes);
+    store.clear();
+    store.begin();
+    putU32(store, "freq", 5658);
+    store.commit();
+    for (uint32_t i = 0; i < 500; i++) {
+        putU32(store, "bright", i);
+        CHECK(store.commit());
+        // Never more than one commit past the threshold
+        CHECK(store.getLogBytes() < compactBytes + 32);
+    }
+    CHECK(fileSize(logPath + ".tmp") == -1);
+
+    FileConfigStore reopened(logPath.c_str(), compactBytes);
+    CHECK(reopened.begin());
+    CHECK(getU32(reopened, "bright", 0) == 499);
+    CHECK(getU32(reopened, "freq", 0) == 5658);
+}
+
+static void testTornTail() {
+    printf("torn append\n");
+    FileConfigStore store(logPath.c_str());
+    store.clear();
+    store.begin();
+    putU32(store, "freq", 5740);
+    putU32(store, "minLap", 5000);
+    CHECK(store.commit());
+    long goodSize = fileSize(logPath);
+
+    // A reset in the middle of the next append: key length, key, half the length
+    const uint8_t torn[] = {6, 'm', 'i', 'n', 'L', 'a', 'p', 4};
+    appendBytes(torn, sizeof(torn));
+
+    FileConfigStore reopened(logPath.c_str());
+    CHECK(reopened.begin());
+    CHECK(getU32(reopened, "freq", 0) == 5740);
+    CHECK(getU32(reopened, "minLap", 0) == 5000);
+    // begin() rewrote the log without the torn record
+    CHECK(fileSize(logPath) == goodSize);
+    CHECK(reopened.getLogBytes() == (size_t)goodSize);
+
+    // And later appends land after the good records, not after the junk
+    putU32(reopened, "minLap", 3000);
+    CHECK(reopened.commit());
+    FileConfigStore again(logPath.c_str());
+    CHECK(again.begin());
+    CHECK(getU32(again, "minLap", 0) == 3000);
+}
+
+static void testBadChecksum() {
+    printf("bad checksum\n");
+    FileConfigStore store(logPath.c_str());
+    store.clear();
+    store.begin();
+    putU32(store, "freq", 5917);
+    CHECK(store.commit());
+    putU32(store, "freq", 1234);
+    CHECK(store.commit());
+
+    // Flip a data byte of the last record
+    FILE* f = fopen(logPath.c_str(), "r+b");
+    fseek(f, -3, SEEK_END);
+    int byte = fgetc(f);
+    fseek(f, -3, SEEK_END);
+    fputc(byte ^ 0x5A, f);
+    fclose(f);
+
+    FileConfigStore reopened(logPath.c_str());
+    CHECK(reopened.begin());
+    CHECK(getU32(reopened, "freq", 0) == 5917);
+}
+
+static void testBadRecordInTheMiddle() {
+    printf("bad record in the middle\n");
+    FileConfigStore store(logPath.c_str());
+    store.clear();
+    store.begin();
+    putU32(store, "minLap", 4000);
+    CHECK(store.commit());
+    putU32(store, "minLap", 6000);
+    CHECK(store.commit());
+    putU32(store, "freq", 5800);
+    putU32(store, "bright", 77);
+    CHECK(store.commit());
+
+    // Flip a data byte of the second minLap record; keyLen, key, dataLen,
+    // data, checksum
+    const long recordBytes = 1 + 6 + 2 + 4 + 1;
+    FILE* f = fopen(logPath.c_str(), "r+b");
+    fseek(f, recordBytes + 1 + 6 + 2, SEEK_SET);
+    int byte = fgetc(f);
+    fseek(f, recordBytes + 1 + 6 + 2, SEEK_SET);
+    fputc(byte ^ 0x5A, f);
+    fclose(f);
+
+    // Only the broken update is lost, the keys after it are all there
+    FileConfigStore reopened(logPath.c_str());
+    CHECK(reopened.begin());
+    CHECK(getU32(reopened, "minLap", 0) == 4000);
+    CHECK(getU32(reopened, "freq", 0) == 5800);
+    CHECK(getU32(reopened, "bright", 0) == 77);
+    // And the log was rewritten without it
+    CHECK(fileSize(logPath) == (long)reopened.getLogBytes());
+    CHECK(fileSize(logPath) == recordBytes + (1 + 4 + 2 + 4 + 1) + recordBytes);  // minLap, freq, bright
+
+    FileConfigStore again(logPath.c_str());
+    CHECK(again.begin());
+    CHECK(getU32(again, "bright", 0) == 77);
+}
+
+static void testClear() {
+    printf("clear\n");
+    FileConfigStore store(logPath.c_str());
+    store.begin();
+    putU32(store, "freq", 5800);
+    store.commit();
+    CHECK(store.clear());
+    CHECK(fileSize(logPath) == -1);
+    CHECK(getU32(store, "freq", 0) == 0);
+
+    FileConfigStore reopened(logPath.c_str());
+    CHECK(reopened.begin());
+    CHECK(getU32(reopened, "freq", 0) == 0);
+}
+
+int main(int argc, char** argv) {
+    logPath = std::string(argc > 1 ? argv[1] : "/tmp") + "/config_store_test.log";
+
+    testRoundTrip();
+    testLatestWins();
+    testCompaction();
+    testTornTail();
+    testBadChecksum();
+    testBadRecordInTheMiddle();
+    testClear();
+
+    remove(logPath.c_str());
+    return checkResult();
+}
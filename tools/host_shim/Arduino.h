@@ -0,0 +1,30 @@
+#ifndef HOST_SHIM_ARDUINO_H
+#define HOST_SHIM_ARDUINO_H
+
+// Just enough of the Arduino core for the lib/ code the host tests build.
+// Put -Itools/host_shim first on the command line
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+// A test that calls code using millis() defines this and moves it
+extern uint32_t hostShimMillis;
+inline uint32_t millis() { return hostShimMillis; }
+
+class String {
+   public:
+    String() {}
+    String(const char* text) : text(text) {}
+    const char* c_str() const { return text.c_str(); }
+    size_t length() const { return text.size(); }
+
+   private:
+    std::string text;
+};
+
+#endif
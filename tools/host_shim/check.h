@@ -0,0 +1,29 @@
+#ifndef HOST_SHIM_CHECK_H
+#define HOST_SHIM_CHECK_H
+
+// Checks for the host tests under tools/: a failed CHECK prints its line
+// and the test goes on; checkResult() is main()'s return value, non-zero
+// if any failed
+
+#include <stdio.h>
+
+static int checkFailures = 0;
+
+#define CHECK(cond)                                            \
+    do {                                                       \
+        if (!(cond)) {                                         \
+            printf("  FAIL line %d: %s\n", __LINE__, #cond);   \
+            checkFailures++;                                   \
+        }                                                      \
+    } while (0)
+
+inline int checkResult() {
+    if (checkFailures) {
+        printf("%d check(s) failed\n", checkFailures);
+        return 1;
+    }
+    printf("all passed\n");
+    return 0;
+}
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef HOST_SHIM_DEBUG_H
+#define HOST_SHIM_DEBUG_H
+
+#include <stdio.h>
+
+#define DEBUG(...) printf(__VA_ARGS__)
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef HOST_SHIM_FREERTOS_H
+#define HOST_SHIM_FREERTOS_H
+
+#include <stdint.h>
+
+// Single threaded host tests: handles exist, locks do nothing
+
+typedef void* SemaphoreHandle_t;
+typedef uint32_t TickType_t;
+
+#define portMAX_DELAY 0xFFFFFFFFUL
+
+#endif
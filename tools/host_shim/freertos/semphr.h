@@ -0,0 +1,15 @@
+#ifndef HOST_SHIM_SEMPHR_H
+#define HOST_SHIM_SEMPHR_H
+
+#include "FreeRTOS.h"
+
+static int hostShimMutex;
+
+inline SemaphoreHandle_t xSemaphoreCreateMutex() { return &hostShimMutex; }
+inline bool xSemaphoreTake(SemaphoreHandle_t, TickType_t) { return true; }
+inline bool xSemaphoreGive(SemaphoreHandle_t) { return true; }
+inline SemaphoreHandle_t xSemaphoreCreateRecursiveMutex() { return &hostShimMutex; }
+inline bool xSemaphoreTakeRecursive(SemaphoreHandle_t, TickType_t) { return true; }
+inline bool xSemaphoreGiveRecursive(SemaphoreHandle_t) { return true; }
+
+#endif
@@ -0,0 +1,217 @@
+// Host test for the incremental JSON tokenizer of the USB commands
+// (lib/USB/jsonstream.cpp).
+//
+// Build and run from the repository root:
+//   g++ -O1 -std=c++11 -Itools/host_shim -Ilib/USB tools/json_stream/json_stream_test.cpp lib/USB/jsonstream.cpp -o json_stream_test
+//   ./json_stream_test
+//
+// Feeds documents byte by byte and checks what the listener hears: escapes,
+// surrogate pairs, strings split into JSON_STREAM_CHUNK parts, the number
+// grammar, and the skip to the next line after an error.
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+
+#include "check.h"
+#include "jsonstream.h"
+
+// Writes every callback as a token: { } [ ] k:key s:string n:literal. String
+// parts are joined, their sizes and flags are checked on the way
+class Recorder : public JsonStreamListener {
+   public:
+    std::string tokens;
+    std::string string;
+    size_t parts = 0;
+    bool partsOk = true;
+
+    void onBeginObject() override { tokens += "{ "; }
+    void onEndObject() override { tokens += "} "; }
+    void onBeginArray() override { tokens += "[ "; }
+    void onEndArray() override { tokens += "] "; }
+    void onKey(const char *key) override { tokens += std::string("k:") + key + " "; }
+    void onString(const char *part, size_t len, bool last) override {
+        if (len > JSON_STREAM_CHUNK || strlen(part) != len) partsOk = false;
+        if (!last && len != JSON_STREAM_CHUNK) partsOk = false;
+        string.append(part, len);
+        parts++;
+        if (last) {
+            tokens += "s:" + string + " ";
+            string.clear();
+        }
+    }
+    void onLiteral(const char *text) override { tokens += std::string("n:") + text + " "; }
+};
+
+struct Result {
+    int done;
+    int errors;
+};
+
+static Result feed(JsonStreamParser &parser, const std::string &text) {
+    Result r = {0, 0};
+    for (size_t i = 0; i < text.size(); i++) {
+        json_stream_e e = parser.feed(text[i]);
+        if (e == JSON_STREAM_DONE) r.done++;
+        if (e == JSON_STREAM_ERROR) r.errors++;
+    }
+    return r;
+}
+
+// One line, expected to parse into tokens
+static bool parses(const char *line, const char *tokens) {
+    Recorder rec;
+    JsonStreamParser parser(&rec);
+    Result r = feed(parser, std::string(line) + "\n");
+    if (r.done != 1 || r.errors != 0 || rec.tokens != tokens) {
+        printf("  %s -> %s(%d done, %d errors)\n", line, rec.tokens.c_str(), r.done, r.errors);
+        return false;
+    }
+    return true;
+}
+
+static bool rejects(const char *line) {
+    Recorder rec;
+    JsonStreamParser parser(&rec);
+    Result r = feed(parser, std::string(line) + "\n");
+    if (r.errors != 1 || r.done != 0) {
+        printf("  %s accepted as %s\n", line, rec.tokens.c_str());
+        return false;
+    }
+    return true;
+}
+
+static void testEscapes() {
+    printf("escapes\n");
+    CHECK(parses("{\"a\":\"x\\\"y\\\\z\\/\"}", "{ k:a s:x\"y\\z/ } "));
+    CHECK(parses("[\"\\b\\f\\n\\r\\t\"]", "[ s:\b\f\n\r\t ] "));
+    CHECK(parses("\"\\u0041\\u00e9\\u20AC\"", "s:A\xC3\xA9\xE2\x82\xAC "));
+    CHECK(rejects("\"\\x\""));
+    CHECK(rejects("\"\\u12g4\""));
+    // Raw control characters must be escaped
+    CHECK(rejects("\"a\tb\""));
+}
+
+static void testSurrogates() {
+    printf("surrogate pairs\n");
+    CHECK(parses("\"\\ud83d\\ude00\"", "s:\xF0\x9F\x98\x80 "));
+    CHECK(parses("\"\\uD83D\\uDE00!\"", "s:\xF0\x9F\x98\x80! "));
+    CHECK(rejects("\"\\ud83d\""));          // High alone
+    CHECK(rejects("\"\\ud83dx\""));         // High, then a plain character
+    CHECK(rejects("\"\\ud83d\\u0041\""));   // High, then no low
+    CHECK(rejects("\"\\ud83d\\ud83d\""));   // Two highs
+    CHECK(rejects("\"\\ude00\""));          // Low alone
+}
+
+static void testChunks() {
+    printf("64 byte parts\n");
+    // Plain, escaped and multi-byte characters across several part
+    // boundaries, one of them landing exactly on the last byte
+    std::string expected;
+    std::string json = "\"";
+    for (int i = 0; i < 3 * JSON_STREAM_CHUNK + 7; i++) {
+        if (i % 29 == 0) {
+            json += "\\ud83d\\ude00";
+            expected += "\xF0\x9F\x98\x80";
+        } else if (i % 11 == 0) {
+            json += "\\n";
+            expected += "\n";
+        } else {
+            json += (char)('a' + i % 26);
+            expected += (char)('a' + i % 26);
+        }
+    }
+    json += "\"";
+
+    Recorder rec;
+    JsonStreamParser parser(&rec);
+    Result r = feed(parser, json);
+    CHECK(r.done == 1 && r.errors == 0);
+    CHECK(rec.partsOk);
+    CHECK(rec.tokens == "s:" + expected + " ");
+    CHECK(rec.parts == (expected.size() + JSON_STREAM_CHUNK - 1) / JSON_STREAM_CHUNK);
+
+    // Exactly one part full: it goes out once, flagged last
+    Recorder exact;
+    JsonStreamParser exactParser(&exact);
+    CHECK(feed(exactParser, "\"" + std::string(JSON_STREAM_CHUNK, 'x') + "\"").done == 1);
+    CHECK(exact.partsOk && exact.parts == 1);
+    CHECK(exact.tokens == "s:" + std::string(JSON_STREAM_CHUNK, 'x') + " ");
+
+    // Keys are not split, a long one is an error
+    CHECK(parses("{\"0123456789012345678901234567890\":1}", "{ k:0123456789012345678901234567890 n:1 } "));
+    CHECK(rejects("{\"01234567890123456789012345678901\":1}"));
+}
+
+static void testNumbers() {
+    printf("number grammar\n");
+    const char *good[] = {"0", "-0", "7", "-12", "1.5", "-0.25", "10e3", "1E+5", "2.5e-3", "123456789012"};
+    for (size_t i = 0; i < sizeof(good) / sizeof(good[0]); i++) {
+        std::string line = std::string("[") + good[i] + "]";
+        std::string tokens = std::string("[ n:") + good[i] + " ] ";
+        CHECK(parses(line.c_str(), tokens.c_str()));
+    }
+    CHECK(parses("[true,false,null]", "[ n:true n:false n:null ] "));
+
+    // strtod takes all of these
+    const char *bad[] = {"0x1", "-inf", "-nan", "nan", "-infinity", "01", "-01", "1.", "1.e3",
+                         "1e", "1e+", "-", "1E5x", "1-2", "tru", "nulls"};
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        std::string line = std::string("{\"v\":") + bad[i] + "}";
+        CHECK(rejects(line.c_str()));
+    }
+    // Not even the start of a value
+    CHECK(rejects("[+1]"));
+    CHECK(rejects("[.5]"));
+    CHECK(rejects("[inf]"));
+}
+
+static void testResync() {
+    printf("line resync\n");
+    Recorder rec;
+    JsonStreamParser parser(&rec);
+
+    // A bad number, a broken string, a line cut short and a stray closer,
+    // each followed by a good command on the next line
+    Result r = feed(parser,
+                    "{\"cmd\":\"a\",\"data\":0x1}\n"
+                    "{\"cmd\":\"b\"}\n"
+                    "{\"cmd\":\"c\\q\",\"data\":{\"x\":[1,2,3]}}\n"
+                    "{\"cmd\":\"d\"}\r\n"
+                    "{\"cmd\":\"e\",\"data\":{\"x\":\n"
+                    "{\"cmd\":\"f\"}\n"
+                    "]\n"
+                    "{\"cmd\":\"g\"}\n");
+    CHECK(r.errors == 4);
+    CHECK(r.done == 4);
+    CHECK(rec.tokens.find("s:b } ") != std::string::npos);
+    CHECK(rec.tokens.find("s:d } ") != std::string::npos);
+    CHECK(rec.tokens.find("s:f } ") != std::string::npos);
+    CHECK(rec.tokens.find("s:g } ") != std::string::npos);
+    CHECK(parser.getDepth() == 0);
+
+    // Values one after another on a line, and blank lines between them
+    Recorder seq;
+    JsonStreamParser seqParser(&seq);
+    r = feed(seqParser, "{\"a\":1} [2]\n\n\r\n\"three\"\n");
+    CHECK(r.done == 3 && r.errors == 0);
+    CHECK(seq.tokens == "{ k:a n:1 } [ n:2 ] s:three ");
+
+    // Too deep is an error, and the next line parses again
+    std::string deep(JSON_STREAM_MAX_DEPTH + 1, '[');
+    Recorder nest;
+    JsonStreamParser nestParser(&nest);
+    r = feed(nestParser, deep + "\n[1]\n");
+    CHECK(r.errors == 1 && r.done == 1);
+}
+
+int main() {
+    testEscapes();
+    testSurrogates();
+    testChunks();
+    testNumbers();
+    testResync();
+
+    return checkResult();
+}
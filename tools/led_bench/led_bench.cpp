@@ -0,0 +1,69 @@
+// Host benchmark for the RGB LED effects (lib/RGBLED/ledeffects.cpp).
+//
+// Build and run from the repository root:
+//   g++ -O2 -std=c++11 -Ilib/RGBLED tools/led_bench/led_bench.cpp lib/RGBLED/ledeffects.cpp -o led_bench
+//   ./led_bench [leds] [frames]
+//
+// Reports the render cost per frame of each effect at the given strip length
+// (default 600). Host numbers are for comparing effects and catching
+// regressions; the real per-frame cost on the board is in GET /led/stats.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include "ledeffects.h"
+
+static LedPixel frame[RGB_MAX_LEDS];
+static volatile uint32_t sink;  // Keeps the optimizer from dropping the rendering
+
+struct Bench {
+    const char* name;
+    void (*render)(LedEffects& fx, uint32_t n);
+};
+
+static const LedPixel white = {255, 255, 255};
+static const LedPixel blue = {0, 128, 255};
+
+static const Bench benches[] = {
+    {"solid", [](LedEffects& fx, uint32_t) { fx.fill(frame, blue); }},
+    {"pulse", [](LedEffects& fx, uint32_t n) { fx.fillScaled(frame, blue, (uint8_t)n); }},
+    {"rainbow", [](LedEffects& fx, uint32_t n) { fx.rainbow(frame, (uint8_t)(n * 5)); }},
+    {"ocean", [](LedEffects& fx, uint32_t n) { fx.ocean(frame, (uint8_t)(n * 5)); }},
+    {"fire", [](LedEffects& fx, uint32_t) { fx.fire(frame); }},
+    {"comet", [](LedEffects& fx, uint32_t n) { fx.comet(frame, n * 260); }},
+    {"sparkle", [](LedEffects& fx, uint32_t) { fx.sparkle(frame, white); }},
+};
+
+int main(int argc, char** argv) {
+    int leds = argc > 1 ? atoi(argv[1]) : RGB_MAX_LEDS;
+    int frames = argc > 2 ? atoi(argv[2]) : 20000;
+    if (leds < 1 || leds > RGB_MAX_LEDS || frames < 1) {
+        fprintf(stderr, "usage: %s [leds 1-%d] [frames]\n", argv[0], RGB_MAX_LEDS);
+        return 1;
+    }
+
+    LedEffects fx;
+    fx.setLength((uint16_t)leds);
+
+    // WS2812 at 800 kbit/s: 24 bits per pixel plus the latch
+    double wireUs = leds * 30.0 + 300.0;
+    printf("%d LEDs, %d frames per effect, wire time %.0f us per frame (max %.0f fps pushed)\n\n", leds, frames,
+           wireUs, 1e6 / wireUs);
+    printf("%-10s %12s %12s\n", "effect", "us/frame", "ns/pixel");
+
+    for (const Bench& bench : benches) {
+        for (uint32_t n = 0; n < 100; n++) {
+            bench.render(fx, n);  // Warm up
+        }
+        auto start = std::chrono::steady_clock::now();
+        for (int n = 0; n < frames; n++) {
+            bench.render(fx, (uint32_t)n);
+            sink += frame[n % leds].r;
+        }
+        auto end = std::chrono::steady_clock::now();
+        double us = std::chrono::duration<double, std::micro>(end - start).count() / frames;
+        printf("%-10s %12.2f %12.2f\n", bench.name, us, us * 1000.0 / leds);
+    }
+    return 0;
+}
@@ -0,0 +1,183 @@
+// Host test for the device side RSSI history (lib/RSSISTREAM/rssihistory.cpp).
+//
+// Build and run from the repository root:
+//   g++ -O1 -std=c++11 -Itools/host_shim -Ilib/RSSISTREAM tools/rssi_history/rssi_history_test.cpp lib/RSSISTREAM/rssihistory.cpp lib/RSSISTREAM/rssistream.cpp -o rssi_history_test
+//   ./rssi_history_test
+//
+// Feeds ten minutes at 100 Hz, a gap and half a minute at 1 kHz through an
+// RssiRing, then checks the resolution picked, bucket contents, gaps,
+// truncation and the JSON text. Also prints the answer sizes of the usual
+// queries.
+
+#include <stdio.h>
+
+#include <string>
+
+#include "check.h"
+#include "rssihistory.h"
+
+static RssiRing ring;
+static RssiHistory history;
+static RssiHistoryPoint points[RSSI_HISTORY_MAX_POINTS];
+
+// Phase A: 100 Hz alternating 50/150, so every 100 ms and 1 s bucket is
+// min 50, max 150, mean 100. Phase B: nothing. Phase C: 1 kHz at 80
+static const uint32_t startMs = 1000;
+static const uint32_t gapStartMs = startMs + 600000;
+static const uint32_t gapEndMs = gapStartMs + 5000;
+static const uint32_t endMs = gapEndMs + 30000;
+
+static void sink(void* ctx, const char* text, size_t len) {
+    ((std::string*)ctx)->append(text, len);
+}
+
+static bool run(uint32_t fromMs, uint32_t toMs, uint16_t res, uint16_t maxPoints, RssiHistoryResult& result) {
+    RssiHistoryQuery q = {fromMs, toMs, res, maxPoints};
+    return history.query(q, points, result);
+}
+
+static bool ascending(const RssiHistoryResult& result) {
+    for (size_t i = 1; i < result.count; i++) {
+        if ((int32_t)(points[i].timeMs - points[i - 1].timeMs) <= 0) return false;
+    }
+    return true;
+}
+
+static void feed() {
+    history.init(&ring);
+    uint32_t n = 0;
+    for (uint32_t t = startMs; t < gapStartMs; t += 10, n++) {
+        ring.add(t, n % 2 ? 150 : 50);
+        if (t % 50 == 0) history.update();
+    }
+    for (uint32_t t = gapEndMs; t < endMs; t++) {
+        ring.add(t, 80);
+        if (t % 50 == 0) history.update();
+    }
+    history.update();
+}
+
+static void testAutoResolution() {
+    printf("resolution picked\n");
+    RssiHistoryResult r;
+
+    CHECK(run(endMs - 600000, endMs, RSSI_RES_AUTO, 600, r));
+    CHECK(r.resolutionMs == RSSI_RES_1S);
+    CHECK(r.count <= 600);
+
+    CHECK(run(endMs - 9000, endMs, RSSI_RES_AUTO, 1000, r));
+    CHECK(r.resolutionMs == RSSI_RES_10MS);
+
+    CHECK(run(endMs - 60000, endMs, RSSI_RES_AUTO, 1000, r));
+    CHECK(r.resolutionMs == RSSI_RES_100MS);
+
+    // One sample per ms fits and the raw ring (2 s at 1 kHz) reaches back
+    CHECK(run(endMs - 500, endMs, RSSI_RES_AUTO, 1000, r));
+    CHECK(r.resolutionMs == RSSI_RES_RAW);
+    CHECK(r.count >= 498 && r.count <= 500);
+    CHECK(ascending(r));
+    for (size_t i = 0; i < r.count; i++) {
+        CHECK(points[i].mean == 80);
+    }
+}
+
+static void testBuckets() {
+    printf("bucket contents and gaps\n");
+    RssiHistoryResult r;
+    CHECK(run(endMs - 600000, endMs, RSSI_RES_1S, 1000, r));
+    CHECK(ascending(r));
+    size_t before = 0, after = 0;
+    for (size_t i = 0; i < r.count; i++) {
+        const RssiHistoryPoint& p = points[i];
+        CHECK(p.min <= p.mean && p.mean <= p.max);
+        if (p.timeMs + 1000 <= gapStartMs) {
+            CHECK(p.min == 50 && p.max == 150 && p.mean == 100);
+            before++;
+        } else if (p.timeMs >= gapEndMs) {
+            CHECK(p.min == 80 && p.max == 80 && p.mean == 80);
+            after++;
+        }
+        // Seconds with no sample at all are left out
+        CHECK(!(p.timeMs >= gapStartMs + 1000 && p.timeMs + 1000 <= gapEndMs));
+    }
+    CHECK(before > 500);
+    CHECK(after >= 29);
+
+    CHECK(run(gapStartMs - 1000, gapEndMs + 1000, RSSI_RES_100MS, 1000, r));
+    CHECK(r.count == 21);  // 10 before, 11 after: to is inclusive
+    for (size_t i = 0; i < r.count; i++) {
+        CHECK(points[i].timeMs < gapStartMs || points[i].timeMs >= gapEndMs);
+    }
+}
+
+static void testLimits() {
+    printf("truncation and ranges\n");
+    RssiHistoryResult r;
+    // More buckets than points: the newest are kept
+    CHECK(run(endMs - 20000, endMs, RSSI_RES_10MS, 100, r));
+    CHECK(r.truncated);
+    CHECK(r.count == 100);
+    CHECK(points[r.count - 1].timeMs + 20 >= endMs);
+
+    // 10 ms buckets only reach back about 20 s
+    CHECK(!run(startMs, startMs + 1000, RSSI_RES_10MS, 1000, r));
+    CHECK(!run(endMs, endMs - 1000, RSSI_RES_AUTO, 1000, r));
+}
+
+static void testJson() {
+    printf("json\n");
+    static RssiRing smallRing;
+    static RssiHistory small;
+    small.init(&smallRing);
+    smallRing.add(100, 1);
+    smallRing.add(110, 2);
+    smallRing.add(120, 3);
+    smallRing.add(130, 0);  // Publishes 120
+    small.update();
+
+    RssiHistoryResult r;
+    std::string text;
+    RssiHistoryQuery raw = {0, 125, RSSI_RES_RAW, 10};
+    CHECK(small.query(raw, points, r));
+    RssiHistory::writeJson(r, sink, &text);
+    CHECK(text == "{\"res\":0,\"from\":100,\"to\":120,\"truncated\":false,\"t\":[100,10,10],\"v\":[1,2,3]}");
+
+    text.clear();
+    RssiHistoryQuery buckets = {0, 125, RSSI_RES_10MS, 20};
+    CHECK(small.query(buckets, points, r));
+    RssiHistory::writeJson(r, sink, &text);
+    CHECK(text == "{\"res\":10,\"from\":0,\"to\":129,\"truncated\":false,\"t\":[100,10,10],"
+                  "\"min\":[1,2,3],\"max\":[1,2,3],\"mean\":[1,2,3]}");
+}
+
+static void printSizes() {
+    struct {
+        const char* name;
+        uint32_t spanMs;
+        uint16_t maxPoints;
+    } queries[] = {
+        {"last 10 min", 600000, 600},
+        {"last 10 s", 10000, 1000},
+        {"last 500 ms", 500, 1000},
+    };
+    printf("\nquery          res  points  json bytes\n");
+    for (size_t i = 0; i < sizeof(queries) / sizeof(queries[0]); i++) {
+        RssiHistoryResult r;
+        std::string text;
+        if (run(endMs - queries[i].spanMs, endMs, RSSI_RES_AUTO, queries[i].maxPoints, r)) {
+            RssiHistory::writeJson(r, sink, &text);
+        }
+        printf("%-13s %4u  %6zu  %10zu\n", queries[i].name, r.resolutionMs, r.count, text.size());
+    }
+}
+
+int main() {
+    feed();
+    testAutoResolution();
+    testBuckets();
+    testLimits();
+    testJson();
+    printSizes();
+
+    return checkResult();
+}
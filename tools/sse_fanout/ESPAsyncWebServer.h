@@ -0,0 +1,41 @@
+#ifndef SSE_FANOUT_TEST_ESPASYNCWEBSERVER_H
+#define SSE_FANOUT_TEST_ESPASYNCWEBSERVER_H
+
+// Stand-in for the event source client of ESPAsyncWebServer: a queue the
+// test drains at the pace of a fast or slow phone. close() only marks the
+// client, the test reports the disconnect later, as async_tcp does
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#define SSE_MAX_QUEUED_MESSAGES 32
+
+class AsyncEventSourceClient {
+   public:
+    std::deque<std::string> queued;     // "event:data", not yet on the wire
+    std::vector<std::string> received;  // Drained, in order
+    uint32_t lastId = 0;
+    int closeCalls = 0;
+    int sentAfterClose = 0;
+
+    size_t packetsWaiting() const { return queued.size(); }
+    void send(const char* message, const char* event, uint32_t id, uint32_t /* reconnect */) {
+        if (closeCalls) {
+            sentAfterClose++;
+            return;
+        }
+        queued.push_back(std::string(event) + ":" + message);
+        if (id) lastId = id;
+    }
+    void close() { closeCalls++; }
+
+    void drain(size_t max) {
+        for (size_t i = 0; i < max && !queued.empty(); i++) {
+            received.push_back(queued.front());
+            queued.pop_front();
+        }
+    }
+};
+
+#endif
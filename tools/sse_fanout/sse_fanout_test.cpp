@@ -0,0 +1,201 @@
+// Host test for the per-client SSE fan-out (lib/WEBSERVER/ssefanout.cpp),
+// with stubbed event source clients (ESPAsyncWebServer.h next to this file).
+//
+// Build and run from the repository root:
+//   g++ -O1 -std=c++11 -Itools/sse_fanout -Itools/host_shim -Ilib/WEBSERVER tools/sse_fanout/sse_fanout_test.cpp lib/WEBSERVER/ssefanout.cpp -o sse_fanout_test
+//   ./sse_fanout_test
+//
+// Runs a fast, a slow and a stuck client through RSSI at 100 Hz and a lap
+// a second, then a lap burst and a full house. Checks that every live
+// client gets every lap in order, that RSSI is dropped rather than queued,
+// and that a client is closed once and left alone until its disconnect
+// arrives, and that a per-client stream reaches its client only.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "check.h"
+#include "ssefanout.h"
+
+uint32_t hostShimMillis = 1;
+
+static int countEvents(const AsyncEventSourceClient& client, const char* event) {
+    std::string prefix = std::string(event) + ":";
+    int n = 0;
+    for (const std::string& message : client.received) {
+        if (message.compare(0, prefix.size(), prefix) == 0) n++;
+    }
+    return n;
+}
+
+// Laps carry their number as data; true if the client got 1..laps in order
+static bool lapsInOrder(const AsyncEventSourceClient& client, int laps) {
+    int next = 1;
+    for (const std::string& message : client.received) {
+        if (message.compare(0, 4, "lap:") == 0) {
+            if (atoi(message.c_str() + 4) != next) return false;
+            next++;
+        }
+    }
+    return next == laps + 1;
+}
+
+static void testPacing() {
+    printf("fast, slow and stuck clients\n");
+    SseFanout fanout;
+    fanout.init();
+    AsyncEventSourceClient fast, slow, stuck;
+    CHECK(fanout.addClient(&fast));
+    CHECK(fanout.addClient(&slow));
+    CHECK(fanout.addClient(&stuck));
+
+    int laps = 0;
+    uint32_t stuckClosedMs = 0;
+    for (uint32_t t = 10; t <= 12000; t += 10) {
+        hostShimMillis = t;
+        char data[16];
+        snprintf(data, sizeof(data), "%u", t);
+        fanout.send(data, "rssi", SSE_DROPPABLE);
+        if (t % 1000 == 0) {
+            laps++;
+            snprintf(data, sizeof(data), "%d", laps);
+            fanout.send(data, "lap", SSE_GUARANTEED, laps);
+        }
+        if (t % 100 == 0) {
+            fanout.update(t);
+        }
+        fast.drain(100);
+        if (t % 50 == 0) {
+            slow.drain(1);
+        }
+        if (stuck.closeCalls && !stuckClosedMs) {
+            stuckClosedMs = t;
+        }
+    }
+
+    CHECK(lapsInOrder(fast, laps));
+    CHECK(fast.lastId == (uint32_t)laps);
+    CHECK(countEvents(fast, "rssi") > 1150);
+
+    // Drains a fifth of the RSSI rate: stays, with every lap and fewer RSSI
+    CHECK(slow.closeCalls == 0);
+    CHECK(slow.queued.size() < SSE_QUEUE_HIGH);
+    slow.drain(SSE_MAX_QUEUED_MESSAGES);
+    CHECK(lapsInOrder(slow, laps));
+    CHECK(countEvents(slow, "rssi") < 300);
+
+    // Closed once, about SSE_SATURATED_MS in, and sent nothing after that
+    // although the disconnect never came
+    CHECK(stuck.closeCalls == 1);
+    CHECK(stuckClosedMs >= SSE_SATURATED_MS && stuckClosedMs <= SSE_SATURATED_MS + 1000);
+    CHECK(stuck.sentAfterClose == 0);
+    CHECK(stuck.queued.size() <= SSE_QUEUE_HIGH);
+    CHECK(fanout.getClosedSaturated() == 1);
+    CHECK(fanout.count() == 2);
+
+    SseClientStats stats[SSE_MAX_CLIENTS];
+    CHECK(fanout.getStats(stats, SSE_MAX_CLIENTS) == 2);
+    CHECK(stats[1].dropped > 0);
+
+    // The disconnect frees the slot
+    fanout.removeClient(&stuck);
+    AsyncEventSourceClient next;
+    CHECK(fanout.addClient(&next));
+    CHECK(fanout.count() == 3);
+}
+
+static void testLapBurst() {
+    printf("lap burst on a client that reads nothing\n");
+    SseFanout fanout;
+    fanout.init();
+    hostShimMillis = 100000;
+    AsyncEventSourceClient reader, stuck;
+    fanout.addClient(&reader);
+    fanout.addClient(&stuck);
+
+    // The library queue takes up to SSE_QUEUE_HIGH, SSE_HELD_MAX more wait
+    // on our side, one more and the client would miss a lap
+    int laps = SSE_QUEUE_HIGH + SSE_HELD_MAX + 5;
+    for (int lap = 1; lap <= laps; lap++) {
+        char data[16];
+        snprintf(data, sizeof(data), "%d", lap);
+        fanout.send(data, "lap", SSE_GUARANTEED, lap);
+        reader.drain(100);
+    }
+    fanout.update(hostShimMillis);
+
+    CHECK(lapsInOrder(reader, laps));
+    CHECK(reader.closeCalls == 0);
+    CHECK(stuck.closeCalls == 1);
+    CHECK(stuck.sentAfterClose == 0);
+    CHECK(stuck.queued.size() == SSE_QUEUE_HIGH);
+    CHECK(fanout.getClosedSaturated() == 1);
+    CHECK(fanout.count() == 1);
+
+    // A replay goes to its client only, and not to one being closed
+    fanout.sendTo(&reader, "7", "lap", 7);
+    fanout.sendTo(&stuck, "7", "lap", 7);
+    reader.drain(100);
+    CHECK(reader.received.back() == "lap:7");
+    CHECK(stuck.sentAfterClose == 0);
+}
+
+static void testFullHouse() {
+    printf("full house\n");
+    SseFanout fanout;
+    fanout.init();
+    AsyncEventSourceClient clients[SSE_MAX_CLIENTS + 1];
+    for (int i = 0; i < SSE_MAX_CLIENTS; i++) {
+        CHECK(fanout.addClient(&clients[i]));
+    }
+    CHECK(!fanout.addClient(&clients[SSE_MAX_CLIENTS]));
+    CHECK(clients[SSE_MAX_CLIENTS].closeCalls == 1);
+    CHECK(fanout.count() == SSE_MAX_CLIENTS);
+
+    fanout.send("1", "lap", SSE_GUARANTEED, 1);
+    for (int i = 0; i < SSE_MAX_CLIENTS; i++) {
+        CHECK(clients[i].queued.size() == 1);
+    }
+    CHECK(clients[SSE_MAX_CLIENTS].queued.empty());
+
+    // Removing an unknown client changes nothing
+    AsyncEventSourceClient stranger;
+    fanout.removeClient(&stranger);
+    CHECK(fanout.count() == SSE_MAX_CLIENTS);
+}
+
+static void testClientIds() {
+    printf("per-client streams\n");
+    SseFanout fanout;
+    fanout.init();
+    AsyncEventSourceClient a, b;
+    uint32_t idA = fanout.addClient(&a);
+    uint32_t idB = fanout.addClient(&b);
+    CHECK(idA != 0 && idB != 0 && idA != idB);
+    CHECK(fanout.hasClient(idA));
+    CHECK(!fanout.hasClient(0));
+
+    // A batch for one client reaches that one only
+    CHECK(fanout.sendTo(idB, "{}", "rssiBatch", SSE_DROPPABLE));
+    a.drain(100);
+    b.drain(100);
+    CHECK(countEvents(a, "rssiBatch") == 0);
+    CHECK(countEvents(b, "rssiBatch") == 1);
+
+    // Gone, and its id is not handed out again to the next client
+    fanout.removeClient(&b);
+    CHECK(!fanout.hasClient(idB));
+    CHECK(!fanout.sendTo(idB, "{}", "rssiBatch", SSE_DROPPABLE));
+    AsyncEventSourceClient c;
+    uint32_t idC = fanout.addClient(&c);
+    CHECK(idC != 0 && idC != idB && idC != idA);
+}
+
+int main() {
+    testPacing();
+    testLapBurst();
+    testFullHouse();
+    testClientIds();
+
+    return checkResult();
+}
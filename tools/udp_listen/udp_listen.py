@@ -0,0 +1,187 @@
+#!/usr/bin/env python3
+"""
+Listener for the FPVGate UDP race events (lib/UDPTRANSPORT/udptransport.h)
+
+In WiFi station mode the timer sends each lap and race event once to the
+multicast group 239.255.70.71, port 5770, with a race summary after every
+event and every 2 s. A datagram is
+    magic "FG"(2) | version(1) | type(1) | timerId(4) | seq(4) | payload
+all little endian, the payload being the usbframe.h struct of its type,
+decoded with usb_proto/fpvgate_usb.py. seq counts every datagram of a
+timer, so lost ones show as gaps.
+
+Usage:
+    python udp_listen.py                 print events from every timer
+    python udp_listen.py --bench [--rate 20000] [--count 100000]
+                                         loopback throughput of the encoding
+                                         and the listener, no timer needed
+"""
+
+import argparse
+import os
+import socket
+import struct
+import sys
+import threading
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "usb_proto"))
+import fpvgate_usb as usb  # noqa: E402
+
+GROUP = "239.255.70.71"
+PORT = 5770
+MAGIC = 0x4746
+VERSION = 4  # USB_FRAME_VERSION
+HEADER = struct.Struct("<HBBII")
+
+
+def parse_datagram(data):
+    """Returns (timer id, seq, event dict), None if it isn't one of ours"""
+    if len(data) < HEADER.size:
+        return None
+    magic, version, frame_type, timer_id, seq = HEADER.unpack_from(data)
+    if magic != MAGIC:
+        return None
+    event = usb.parse_payload(frame_type, data[HEADER.size:])
+    event["version"] = version
+    return timer_id, seq, event
+
+
+def encode_datagram(frame_type, timer_id, seq, payload):
+    return HEADER.pack(MAGIC, VERSION, frame_type, timer_id, seq & 0xFFFFFFFF) + payload
+
+
+class SeqTracker:
+    """Lost datagrams per timer, from the seq gaps"""
+
+    def __init__(self):
+        self.last = {}
+        self.received = {}
+        self.lost = {}
+
+    def feed(self, timer_id, seq):
+        last = self.last.get(timer_id)
+        if last is not None:
+            gap = (seq - last - 1) & 0xFFFFFFFF
+            # A big jump back is a reboot, not a loss
+            if gap < 0x80000000:
+                self.lost[timer_id] = self.lost.get(timer_id, 0) + gap
+        self.last[timer_id] = seq
+        self.received[timer_id] = self.received.get(timer_id, 0) + 1
+
+
+def open_socket(group, port, interface):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    if hasattr(socket, "SO_REUSEPORT"):
+        sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEPORT, 1)
+    sock.bind(("", port))
+    if group:
+        membership = socket.inet_aton(group) + socket.inet_aton(interface)
+        sock.setsockopt(socket.IPPROTO_IP, socket.IP_ADD_MEMBERSHIP, membership)
+    return sock
+
+
+def format_summary(event):
+    best = f"best {event['bestLapMs'] / 1000:.2f}s (lap {event['bestLap']})" if event["bestLap"] else "no full lap"
+    return (f"{event['state']:8s} laps {event['laps']:3d}  last {event['lastLapMs'] / 1000:6.2f}s  "
+            f"{best}  total {event['totalMs'] / 1000:.2f}s")
+
+
+def listen(args):
+    sock = open_socket(args.group, args.port, args.interface)
+    tracker = SeqTracker()
+    print(f"Listening on {args.group}:{args.port}")
+    try:
+        while True:
+            data, (host, _) = sock.recvfrom(2048)
+            parsed = parse_datagram(data)
+            if parsed is None:
+                continue
+            timer_id, seq, event = parsed
+            tracker.feed(timer_id, seq)
+            if event["event"] == "summary":
+                if args.summaries:
+                    print(f"{host} {timer_id:08x} #{seq}: {format_summary(event)}")
+                continue
+            lost = tracker.lost.get(timer_id, 0)
+            print(f"{host} {timer_id:08x} #{seq}: {event}" + (f"  ({lost} lost so far)" if lost else ""))
+    except KeyboardInterrupt:
+        for timer_id, received in tracker.received.items():
+            print(f"timer {timer_id:08x}: {received} received, {tracker.lost.get(timer_id, 0)} lost")
+    return 0
+
+
+def bench(args):
+    """Sends lap + summary pairs over loopback at --rate (0 = as fast as
+    the socket takes them) and counts what arrives: the listener's ceiling,
+    and a check that the encoding round trips"""
+    port = args.port + 1
+    receiver = open_socket(None, port, args.interface)
+    receiver.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 1 << 20)
+    receiver.settimeout(0.5)
+    sender = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+
+    lap = usb.LAP.pack(23456, 1000, 7)
+    summary = usb.RACE_SUMMARY.pack(1000, 7, 1, 5, 23456, 21000, 3, 110000)
+    datagrams = [encode_datagram(usb.FRAME_LAP, 0x12345678, i, lap) if i % 2 == 0
+                 else encode_datagram(usb.FRAME_RACE_SUMMARY, 0x12345678, i, summary) for i in range(args.count)]
+
+    tracker = SeqTracker()
+    bad = []
+    decode_s = [0.0]
+
+    def receive():
+        while True:
+            try:
+                data = receiver.recv(2048)
+            except socket.timeout:
+                return
+            start = time.perf_counter()
+            parsed = parse_datagram(data)
+            decode_s[0] += time.perf_counter() - start
+            if parsed is None:
+                bad.append(data)
+                continue
+            timer_id, seq, event = parsed
+            tracker.feed(timer_id, seq)
+            expected = "lap" if seq % 2 == 0 else "summary"
+            if event["event"] != expected or (expected == "lap" and event["data"] != 23456):
+                bad.append(event)
+
+    thread = threading.Thread(target=receive)
+    thread.start()
+    start = time.perf_counter()
+    for i, data in enumerate(datagrams):
+        if args.rate:
+            while time.perf_counter() - start < i / args.rate:
+                pass
+        sender.sendto(data, ("127.0.0.1", port))
+    send_s = time.perf_counter() - start
+    thread.join()
+
+    received = sum(tracker.received.values())
+    lost = args.count - received
+    size = sum(len(d) for d in datagrams) / len(datagrams)
+    print(f"{args.count} datagrams, {size:.1f} bytes each on average")
+    print(f"sent {args.count / send_s:,.0f}/s, received {received} ({lost} lost, "
+          f"{sum(tracker.lost.values())} seq gaps), decode {decode_s[0] * 1e6 / max(received, 1):.2f} us each")
+    print("round trip: " + ("ok" if not bad else f"FAIL ({bad[:3]})"))
+    return 1 if bad else 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description="FPVGate UDP race event listener")
+    parser.add_argument("--group", default=GROUP)
+    parser.add_argument("--port", type=int, default=PORT)
+    parser.add_argument("--interface", default="0.0.0.0", help="address of the interface to join the group on")
+    parser.add_argument("--summaries", action="store_true", help="print the race summaries too")
+    parser.add_argument("--bench", action="store_true", help="loopback throughput test instead of listening")
+    parser.add_argument("--count", type=int, default=100000, help="datagrams for --bench")
+    parser.add_argument("--rate", type=int, default=20000, help="datagrams/s for --bench, 0 = flood")
+    args = parser.parse_args()
+    return bench(args) if args.bench else listen(args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,183 @@
+#!/usr/bin/env python3
+"""
+Reader for the FPVGate USB binary mode (lib/USB/usbframe.h)
+
+After {"cmd":"proto","data":{"mode":"binary"}} the timer sends COBS frames
+between 0x00 delimiters:
+    type(1) | seq(1) | payload | crc16(2, little endian, CCITT-FALSE)
+Anything between delimiters that doesn't decode with a valid CRC is debug
+text printed on the same port and is returned as such.
+
+Usage:
+    python fpvgate_usb.py /dev/ttyACM0     (needs pyserial, prints events)
+"""
+
+import json
+import struct
+import sys
+
+FRAME_JSON = 0x01
+FRAME_LAP = 0x10
+FRAME_RSSI_BATCH = 0x11
+FRAME_RACE_STATE = 0x12
+FRAME_RACE_ARMED = 0x13
+FRAME_PERF = 0x14
+FRAME_RACE_SUMMARY = 0x15  # UDP only
+
+LAP = struct.Struct("<III")
+RSSI_BATCH = struct.Struct("<IIB")
+RACE_STATE = struct.Struct("<IBI")
+RACE_ARMED = struct.Struct("<III")
+PERF = struct.Struct("<IIIHIII")
+RACE_SUMMARY = struct.Struct("<IIBHIIHI")
+
+
+def _crc_table():
+    table = []
+    for byte in range(256):
+        crc = byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) & 0xFFFF if crc & 0x8000 else (crc << 1) & 0xFFFF
+        table.append(crc)
+    return table
+
+
+_CRC_TABLE = _crc_table()
+
+
+def crc16(data, crc=0xFFFF):
+    table = _CRC_TABLE
+    for byte in data:
+        crc = ((crc << 8) & 0xFFFF) ^ table[(crc >> 8) ^ byte]
+    return crc
+
+
+def cobs_decode(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        i += 1
+        if code == 0 or i + code - 1 > len(data):
+            return None
+        out += data[i:i + code - 1]
+        i += code - 1
+        if code != 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def cobs_encode(data):
+    out = bytearray()
+    block = bytearray()
+    for byte in data:
+        if byte == 0:
+            out.append(len(block) + 1)
+            out += block
+            block = bytearray()
+        else:
+            block.append(byte)
+            if len(block) == 0xFE:
+                out.append(0xFF)
+                out += block
+                block = bytearray()
+    out.append(len(block) + 1)
+    out += block
+    return bytes(out)
+
+
+def encode_frame(frame_type, seq, payload):
+    """Same bytes as UsbFrameWriter, for tests and benchmarks"""
+    body = bytes([frame_type, seq]) + payload
+    return b"\x00" + cobs_encode(body + struct.pack("<H", crc16(body))) + b"\x00"
+
+
+def parse_payload(frame_type, payload):
+    """Returns the event as a dict shaped like the JSON mode's events"""
+    if frame_type == FRAME_JSON:
+        return json.loads(payload)
+    if frame_type == FRAME_LAP:
+        lap_ms, t, event_id = LAP.unpack(payload)
+        return {"event": "lap", "data": lap_ms, "t": t, "eventId": event_id}
+    if frame_type == FRAME_RSSI_BATCH:
+        base_ms, interval_us, count = RSSI_BATCH.unpack_from(payload)
+        samples = payload[RSSI_BATCH.size:RSSI_BATCH.size + count]
+        return {"event": "rssi", "t": base_ms, "intervalUs": interval_us, "data": list(samples)}
+    if frame_type == FRAME_RACE_STATE:
+        t, state, event_id = RACE_STATE.unpack(payload)
+        return {"event": "raceState", "data": "started" if state else "stopped", "t": t, "eventId": event_id}
+    if frame_type == FRAME_RACE_ARMED:
+        t, start_ms, event_id = RACE_ARMED.unpack(payload)
+        return {"event": "raceArmed", "data": {"startTimeMs": start_ms, "startsInMs": start_ms - t}, "t": t,
+                "eventId": event_id}
+    if frame_type == FRAME_PERF:
+        t, free_heap, min_free_heap, cpu_mhz, frames, sent, dropped = PERF.unpack(payload)
+        return {"event": "perf", "t": t, "freeHeap": free_heap, "minFreeHeap": min_free_heap,
+                "cpuMhz": cpu_mhz, "framesSent": frames, "bytesSent": sent, "framesDropped": dropped}
+    if frame_type == FRAME_RACE_SUMMARY:
+        t, event_id, state, laps, last_ms, best_ms, best_lap, total_ms = RACE_SUMMARY.unpack(payload)
+        return {"event": "summary", "t": t, "eventId": event_id, "state": "started" if state else "stopped",
+                "laps": laps, "lastLapMs": last_ms, "bestLapMs": best_ms, "bestLap": best_lap, "totalMs": total_ms}
+    return {"event": "unknown", "type": frame_type, "raw": payload.hex()}
+
+
+class FrameReader:
+    """Feed raw serial bytes in, get (kind, value) tuples out:
+    ("frame", dict), ("text", str) for debug output, ("gap", n) for lost frames"""
+
+    def __init__(self):
+        self.buffer = bytearray()
+        self.last_seq = None
+        self.bad_frames = 0
+
+    def feed(self, data):
+        self.buffer += data
+        out = []
+        while True:
+            end = self.buffer.find(b"\x00")
+            if end < 0:
+                break
+            chunk = bytes(self.buffer[:end])
+            del self.buffer[:end + 1]
+            if chunk:
+                out.extend(self._chunk(chunk))
+        return out
+
+    def _chunk(self, chunk):
+        body = cobs_decode(chunk)
+        if body is None or len(body) < 4 or crc16(body[:-2]) != struct.unpack_from("<H", body, len(body) - 2)[0]:
+            # A JSON reply sent before the switch or debug text
+            text = chunk.decode("utf-8", "replace").strip()
+            return [("text", text)] if text else []
+        frame_type, seq = body[0], body[1]
+        out = []
+        if self.last_seq is not None and seq != (self.last_seq + 1) & 0xFF:
+            out.append(("gap", (seq - self.last_seq - 1) & 0xFF))
+        self.last_seq = seq
+        try:
+            out.append(("frame", parse_payload(frame_type, body[2:-2])))
+        except (struct.error, ValueError):
+            self.bad_frames += 1
+        return out
+
+
+def main():
+    if len(sys.argv) != 2:
+        print(__doc__)
+        return 1
+    import serial  # pyserial
+    port = serial.Serial(sys.argv[1], 115200, timeout=0.1)
+    port.write(b'{"cmd":"proto","id":1,"data":{"mode":"binary"}}\n')
+    port.write(b'{"cmd":"rssi/start","id":2}\n')
+    reader = FrameReader()
+    try:
+        while True:
+            for kind, value in reader.feed(port.read(4096)):
+                print(kind, value)
+    except KeyboardInterrupt:
+        port.write(b'{"cmd":"proto","id":3,"data":{"mode":"json"}}\n')
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,329 @@
+// Host benchmark and cross-check of the USB binary frames
+// (lib/USB/usbframe.cpp) against the JSON lines of the text mode.
+//
+// Build and run from the repository root. ArduinoJson is header only, take
+// the copy PlatformIO fetched for any target; without it only the frames
+// are timed:
+//   g++ -O2 -std=c++11 -Ilib/USB -I.pio/libdeps/ESP32S3/ArduinoJson/src tools/usb_proto/frame_bench.cpp lib/USB/usbframe.cpp -o frame_bench
+//   ./frame_bench [--events 20000] [--dump dir]
+//   python tools/usb_proto/proto_bench.py --check dir
+//
+// Times, per event of a race's mix (RSSI every 10 ms, a lap every 4 s),
+// what USBTransport does in each mode: a UsbFrameWriter into the TX ring,
+// or a document built and put through measureJson() and serializeJson().
+// Every frame is decoded again with usbFrameCobsDecode() and its CRC
+// checked. --dump writes the frames and the same events as JSON lines,
+// plus batches long enough to span several COBS blocks, for proto_bench.py
+// to check against the Python encoder and reader. Host times are for
+// comparing the two paths, not for the ESP32's absolute numbers.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "usbframe.h"
+
+#if defined(__has_include)
+#if __has_include(<ArduinoJson.h>)
+#include <ArduinoJson.h>
+#define FRAME_BENCH_JSON 1
+#endif
+#endif
+
+struct Event {
+    uint8_t type;  // usb_frame_type_e
+    uint32_t t;
+    uint32_t value;  // Lap time, RSSI or race state
+    uint32_t eventId;
+    uint32_t intervalUs;
+    std::vector<uint8_t> samples;  // Batches of more than one sample only
+};
+
+// The TX ring, as far as the writers can tell
+struct Buffer {
+    std::vector<uint8_t> data;
+    size_t write(uint8_t c) {
+        data.push_back(c);
+        return 1;
+    }
+    size_t write(const uint8_t *bytes, size_t len) {
+        data.insert(data.end(), bytes, bytes + len);
+        return len;
+    }
+    static void sink(void *ctx, const uint8_t *bytes, size_t len) { ((Buffer *)ctx)->write(bytes, len); }
+};
+
+static uint32_t lcg = 1;
+static uint32_t nextRandom(uint32_t range) {
+    lcg = lcg * 1664525u + 1013904223u;
+    return (lcg >> 8) % range;
+}
+
+static std::vector<Event> makeRace(size_t count) {
+    std::vector<Event> events;
+    uint32_t t = nextRandom(1u << 24) * 64;
+    for (size_t i = 0; i < count; i++) {
+        t += 10;
+        Event e = {USB_FRAME_RSSI_BATCH, t, nextRandom(256), 0, 0, std::vector<uint8_t>()};
+        if (i == 0) {
+            e.type = USB_FRAME_RACE_STATE;
+            e.value = USB_RACE_STARTED;
+            e.eventId = 1;
+        } else if (i % 400 == 399) {
+            e.type = USB_FRAME_LAP;
+            e.value = 8000 + nextRandom(52000);
+            e.eventId = i / 400 + 2;
+        }
+        events.push_back(e);
+    }
+    return events;
+}
+
+// Runs of 254 non-zero bytes and zeros on either side of the block edge,
+// the cases COBS gets wrong. zeroAt is a position in the frame body (type,
+// seq, header, samples), -1 for none
+static void addLongBatches(std::vector<Event> &events) {
+    const struct {
+        size_t count;
+        int zeroAt;
+    } batches[] = {{1, -1}, {120, 60}, {245, -1}, {246, -1}, {247, -1}, {255, -1}, {255, 253}, {255, 254}, {255, 200}};
+    const size_t header = 2 + sizeof(UsbRssiBatchFrame);
+    uint32_t t = events.empty() ? 0 : events.back().t;
+    for (size_t k = 0; k < sizeof(batches) / sizeof(batches[0]); k++) {
+        Event e = {USB_FRAME_RSSI_BATCH, t += 1000, 0, 0, 5000, std::vector<uint8_t>()};
+        for (size_t i = 0; i < batches[k].count; i++) {
+            e.samples.push_back((int)(header + i) == batches[k].zeroAt ? 0 : 1 + nextRandom(255));
+        }
+        events.push_back(e);
+    }
+    Event zeros = {USB_FRAME_RSSI_BATCH, t += 1000, 0, 0, 100000, std::vector<uint8_t>(255, 0)};
+    events.push_back(zeros);
+}
+
+// As USBTransport::sendLapEvent() and friends in binary mode
+static size_t writeFrame(const Event &e, uint8_t seq, Buffer &out) {
+    UsbFrameWriter writer(Buffer::sink, &out);
+    switch (e.type) {
+        case USB_FRAME_LAP: {
+            UsbLapFrame frame = {e.value, e.t, e.eventId};
+            return writer.write(USB_FRAME_LAP, seq, &frame, sizeof(frame));
+        }
+        case USB_FRAME_RACE_STATE: {
+            UsbRaceStateFrame frame = {e.t, (uint8_t)e.value, e.eventId};
+            return writer.write(USB_FRAME_RACE_STATE, seq, &frame, sizeof(frame));
+        }
+        default: {
+            uint8_t single = (uint8_t)e.value;
+            const uint8_t *samples = e.samples.empty() ? &single : e.samples.data();
+            size_t count = e.samples.empty() ? 1 : e.samples.size();
+            UsbRssiBatchFrame frame = {e.t, e.intervalUs, (uint8_t)count};
+            return writer.write(USB_FRAME_RSSI_BATCH, seq, &frame, sizeof(frame), samples, count);
+        }
+    }
+}
+
+#ifdef FRAME_BENCH_JSON
+// As USBTransport in text mode: the document, then measureJson() for the
+// ring reservation and serializeJson() into it. JsonDocument is what
+// DynamicJsonDocument is in ArduinoJson 7
+static size_t writeJsonLine(const Event &e, Buffer &out) {
+    JsonDocument doc;
+    switch (e.type) {
+        case USB_FRAME_LAP:
+            doc["event"] = "lap";
+            doc["data"] = e.value;
+            doc["t"] = e.t;
+            doc["eventId"] = e.eventId;
+            break;
+        case USB_FRAME_RACE_STATE:
+            doc["event"] = "raceState";
+            doc["data"] = e.value == USB_RACE_STARTED ? "started" : "stopped";
+            doc["t"] = e.t;
+            doc["eventId"] = e.eventId;
+            break;
+        default:
+            doc["event"] = "rssi";
+            if (e.samples.empty()) {
+                doc["data"] = e.value;
+                doc["t"] = e.t;
+            } else {
+                doc["t"] = e.t;
+                doc["intervalUs"] = e.intervalUs;
+                JsonArray data = doc["data"].to<JsonArray>();
+                for (size_t i = 0; i < e.samples.size(); i++) data.add(e.samples[i]);
+            }
+            break;
+    }
+    size_t len = measureJson(doc);
+    out.data.reserve(out.data.size() + len + 2);
+    serializeJson(doc, out);
+    out.write((const uint8_t *)"\r\n", 2);
+    return len + 2;
+}
+#else
+// The same lines for --dump, when ArduinoJson is not on the include path
+static size_t writeJsonLine(const Event &e, Buffer &out) {
+    char line[2048];
+    int len;
+    if (e.type == USB_FRAME_LAP) {
+        len = snprintf(line, sizeof(line), "{\"event\":\"lap\",\"data\":%u,\"t\":%u,\"eventId\":%u}\r\n",
+                       e.value, e.t, e.eventId);
+    } else if (e.type == USB_FRAME_RACE_STATE) {
+        len = snprintf(line, sizeof(line), "{\"event\":\"raceState\",\"data\":\"%s\",\"t\":%u,\"eventId\":%u}\r\n",
+                       e.value == USB_RACE_STARTED ? "started" : "stopped", e.t, e.eventId);
+    } else if (e.samples.empty()) {
+        len = snprintf(line, sizeof(line), "{\"event\":\"rssi\",\"data\":%u,\"t\":%u}\r\n", e.value, e.t);
+    } else {
+        len = snprintf(line, sizeof(line), "{\"event\":\"rssi\",\"t\":%u,\"intervalUs\":%u,\"data\":[", e.t, e.intervalUs);
+        for (size_t i = 0; i < e.samples.size(); i++) {
+            len += snprintf(line + len, sizeof(line) - len, i ? ",%u" : "%u", e.samples[i]);
+        }
+        len += snprintf(line + len, sizeof(line) - len, "]}\r\n");
+    }
+    return out.write((const uint8_t *)line, len);
+}
+#endif
+
+// Splits the stream on the delimiters and decodes every frame again.
+// Returns how many failed
+static size_t verifyFrames(const std::vector<Event> &events, const Buffer &stream) {
+    size_t failed = 0;
+    size_t index = 0;
+    size_t start = 0;
+    const std::vector<uint8_t> &bytes = stream.data;
+    for (size_t i = 0; i < bytes.size(); i++) {
+        if (bytes[i] != 0) continue;
+        size_t len = i - start;
+        const uint8_t *chunk = bytes.data() + start;
+        start = i + 1;
+        if (len == 0) continue;
+
+        uint8_t body[512];
+        size_t bodyLen = usbFrameCobsDecode(chunk, len, body);
+        bool ok = index < events.size() && bodyLen >= USB_FRAME_OVERHEAD;
+        if (ok) {
+            uint16_t crc = body[bodyLen - 2] | (body[bodyLen - 1] << 8);
+            ok = usbFrameCrc16(body, bodyLen - 2) == crc && body[0] == events[index].type &&
+                 body[1] == (uint8_t)index;
+        }
+        if (ok) {
+            // The payload must be what writeFrame() was given
+            Buffer again;
+            writeFrame(events[index], (uint8_t)index, again);
+            ok = again.data.size() == len + 2 && memcmp(again.data.data() + 1, chunk, len) == 0;
+        }
+        if (!ok) {
+            failed++;
+        }
+        index++;
+    }
+    return failed + (index == events.size() ? 0 : 1);
+}
+
+static bool dump(const std::vector<Event> &events, const char *dir) {
+    Buffer frames, lines;
+    for (size_t i = 0; i < events.size(); i++) {
+        writeFrame(events[i], (uint8_t)i, frames);
+        writeJsonLine(events[i], lines);
+    }
+    std::string base(dir);
+    const struct {
+        const char *name;
+        const Buffer *buffer;
+    } files[] = {{"/frames.bin", &frames}, {"/events.jsonl", &lines}};
+    for (size_t k = 0; k < 2; k++) {
+        std::string path = base + files[k].name;
+        FILE *f = fopen(path.c_str(), "wb");
+        if (!f || fwrite(files[k].buffer->data.data(), 1, files[k].buffer->data.size(), f) != files[k].buffer->data.size()) {
+            printf("can't write %s\n", path.c_str());
+            if (f) fclose(f);
+            return false;
+        }
+        fclose(f);
+    }
+    printf("%zu events written to %s/frames.bin and %s/events.jsonl\n", events.size(), dir, dir);
+    return true;
+}
+
+typedef size_t (*EncodeFn)(const Event &e, size_t i, Buffer &out);
+
+static size_t encodeFrame(const Event &e, size_t i, Buffer &out) {
+    return writeFrame(e, (uint8_t)i, out);
+}
+
+#ifdef FRAME_BENCH_JSON
+static size_t encodeJson(const Event &e, size_t, Buffer &out) {
+    return writeJsonLine(e, out);
+}
+#endif
+
+// Best of a few passes, in ns per event
+static double timeEncoder(const std::vector<Event> &events, EncodeFn encode, size_t &bytes) {
+    double best = 1e30;
+    Buffer out;
+    out.data.reserve(events.size() * 64);
+    for (int pass = 0; pass < 5; pass++) {
+        out.data.clear();
+        bytes = 0;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < events.size(); i++) {
+            bytes += encode(events[i], i, out);
+        }
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        if (ns < best) best = ns;
+    }
+    return best / events.size();
+}
+
+int main(int argc, char **argv) {
+    size_t count = 20000;
+    const char *dumpDir = nullptr;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--events") == 0 && i + 1 < argc) {
+            count = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--dump") == 0 && i + 1 < argc) {
+            dumpDir = argv[++i];
+        } else {
+            printf("usage: %s [--events n] [--dump dir]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (count < 2) count = 2;
+
+    std::vector<Event> events = makeRace(count);
+    size_t laps = 0;
+    for (size_t i = 0; i < events.size(); i++) laps += events[i].type == USB_FRAME_LAP;
+    printf("%zu events (%zu laps)\n", events.size(), laps);
+    printf("%-8s %12s %16s\n", "mode", "bytes/event", "encode ns/event");
+
+    size_t bytes;
+    double ns = timeEncoder(events, encodeFrame, bytes);
+    printf("%-8s %12.1f %16.1f\n", "binary", (double)bytes / events.size(), ns);
+#ifdef FRAME_BENCH_JSON
+    ns = timeEncoder(events, encodeJson, bytes);
+    printf("%-8s %12.1f %16.1f\n", "json", (double)bytes / events.size(), ns);
+#else
+    printf("%-8s %12s %16s  (ArduinoJson not on the include path)\n", "json", "-", "-");
+#endif
+
+    std::vector<Event> checked = events;
+    addLongBatches(checked);
+    Buffer stream;
+    for (size_t i = 0; i < checked.size(); i++) {
+        writeFrame(checked[i], (uint8_t)i, stream);
+    }
+    size_t failed = verifyFrames(checked, stream);
+    printf("decode and CRC: %s\n", failed ? "FAIL" : "ok");
+    if (failed) {
+        printf("%zu frames failed\n", failed);
+    }
+    // Written either way, the Python side tells which frames are wrong
+    if (dumpDir && !dump(checked, dumpDir)) {
+        return 1;
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,154 @@
+#!/usr/bin/env python3
+"""
+Compares the USB JSON lines with the binary frames for a race's event mix
+
+Builds the same events both ways (JSON exactly as USBTransport prints it,
+binary as UsbFrameWriter writes it), checks that every frame decodes back
+to its event, and prints wire bytes and host decode time per event.
+Exits non-zero if a frame fails to round trip.
+
+The events/s column is for a UART bridge at --baud (the ESP32 boards,
+Serial at 115200). The C3 and S3 boards use native USB CDC, where the baud
+rate is ignored and USB full speed is far from the limit; bytes/event
+still sets how much the TX ring holds. frame_bench.cpp times the device
+side encoders.
+
+With --check DIR it instead checks the frames frame_bench.cpp wrote with
+--dump: every frame must decode to its JSON line, and this encoder must
+produce the same bytes.
+
+Usage:
+    python proto_bench.py [--events 20000] [--baud 115200]
+    python proto_bench.py --check DIR
+"""
+
+import argparse
+import json
+import random
+import sys
+import time
+
+import fpvgate_usb as usb
+
+
+
+def make_events(count, rng):
+    """RSSI at the 10 ms streaming rate with a lap every few seconds"""
+    events = []
+    t = rng.randrange(1 << 31)
+    for i in range(count):
+        t += 10
+        if i % 400 == 399:
+            events.append({"event": "lap", "data": rng.randrange(8000, 60000), "t": t, "eventId": i // 400 + 2})
+        else:
+            events.append({"event": "rssi", "data": rng.randrange(256), "t": t})
+    events[0] = {"event": "raceState", "data": "started", "t": events[0]["t"], "eventId": 1}
+    return events
+
+
+def encode_json(event):
+    # ArduinoJson's compact output, one line per event
+    return (json.dumps(event, separators=(",", ":")) + "\r\n").encode()
+
+
+def encode_binary(event, seq):
+    kind = event["event"]
+    if kind == "lap":
+        return usb.encode_frame(usb.FRAME_LAP, seq, usb.LAP.pack(event["data"], event["t"], event["eventId"]))
+    if kind == "rssi" and isinstance(event["data"], list):
+        return usb.encode_frame(usb.FRAME_RSSI_BATCH, seq,
+                                usb.RSSI_BATCH.pack(event["t"], event["intervalUs"], len(event["data"]))
+                                + bytes(event["data"]))
+    if kind == "rssi":
+        return usb.encode_frame(usb.FRAME_RSSI_BATCH, seq,
+                                usb.RSSI_BATCH.pack(event["t"], 0, 1) + bytes([event["data"]]))
+    if kind == "raceState":
+        return usb.encode_frame(usb.FRAME_RACE_STATE, seq,
+                                usb.RACE_STATE.pack(event["t"], event["data"] == "started", event["eventId"]))
+    raise ValueError(kind)
+
+
+def decode_json_stream(stream):
+    out = []
+    for line in stream.split(b"\n"):
+        if line.strip():
+            out.append(json.loads(line))
+    return out
+
+
+def decode_binary_stream(stream):
+    reader = usb.FrameReader()
+    return [value for kind, value in reader.feed(stream) if kind == "frame"]
+
+
+def normalize(event):
+    # One RSSI event goes out as a batch of one with no interval
+    if event["event"] == "rssi" and isinstance(event["data"], list) and event["intervalUs"] == 0:
+        return {"event": "rssi", "data": event["data"][0], "t": event["t"]}
+    return event
+
+
+def check_dump(directory):
+    """Frames written by usbframe.cpp against this reader and encoder"""
+    with open(f"{directory}/frames.bin", "rb") as f:
+        frames = f.read()
+    with open(f"{directory}/events.jsonl", "rb") as f:
+        events = decode_json_stream(f.read())
+
+    decoded = decode_binary_stream(frames)
+    failed = [i for i, (a, b) in enumerate(zip(events, decoded)) if normalize(b) != a]
+    failed += [] if len(decoded) == len(events) else ["count"]
+    encoded = b"".join(encode_binary(e, i & 0xFF) for i, e in enumerate(events))
+    failed += [] if encoded == frames else ["bytes"]
+
+    print(f"{len(events)} events, {len(frames)} frame bytes from frame_bench")
+    print("cross-check: " + ("ok" if not failed else f"FAIL ({failed[:5]})"))
+    return 1 if failed else 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description="JSON vs binary USB event encoding")
+    parser.add_argument("--events", type=int, default=20000)
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--baud", type=int, default=115200, help="UART bridge rate for the events/s column")
+    parser.add_argument("--check", metavar="DIR", help="check the output of frame_bench --dump DIR")
+    args = parser.parse_args()
+    if args.check:
+        return check_dump(args.check)
+    baud_bytes_per_s = args.baud / 10  # 8N1
+
+    events = make_events(args.events, random.Random(args.seed))
+    json_stream = b"".join(encode_json(e) for e in events)
+    binary_stream = b"".join(encode_binary(e, i & 0xFF) for i, e in enumerate(events))
+
+    # Debug text between frames must come out as text and not break frames
+    cut = binary_stream.index(b"\x00\x00", len(binary_stream) // 2) + 1
+    noisy = binary_stream[:cut] + b"Lap: 12345\n" + binary_stream[cut:]
+
+    results = {}
+    for name, stream, decode in (("json", json_stream, decode_json_stream),
+                                 ("binary", binary_stream, decode_binary_stream)):
+        start = time.perf_counter()
+        decoded = decode(stream)
+        elapsed = time.perf_counter() - start
+        results[name] = (len(stream), elapsed, decoded)
+
+    failed = [i for i, (a, b) in enumerate(zip(events, results["binary"][2])) if normalize(b) != a]
+    failed += [] if len(results["binary"][2]) == len(events) else ["count"]
+    noisy_frames = len(decode_binary_stream(noisy))
+    failed += [] if noisy_frames == len(events) else ["noisy"]
+
+    print(f"{len(events)} events ({sum(e['event'] == 'lap' for e in events)} laps)")
+    rate_column = f"events/s at {args.baud}"
+    print(f"{'mode':8s} {'bytes/event':>12s} {rate_column:>20s} {'decode us/event':>16s}")
+    for name, (size, elapsed, _) in results.items():
+        per_event = size / len(events)
+        print(f"{name:8s} {per_event:12.1f} {baud_bytes_per_s / per_event:20.0f} "
+              f"{elapsed * 1e6 / len(events):16.2f}")
+    print("round trip: " + ("ok" if not failed else f"FAIL ({failed[:5]})"))
+    print("events/s is for a UART bridge; native USB CDC (C3, S3) ignores the baud rate")
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
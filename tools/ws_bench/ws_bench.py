@@ -0,0 +1,281 @@
+#!/usr/bin/env python3
+"""
+Command round trip over the WebSocket transport (/ws) against HTTP POST
+
+Sends the same harmless command (timer/lap, which only flashes the LED)
+as POST /timer/lap and as a WebSocket text message, and prints latency
+percentiles for each path:
+    http-new    a new TCP connection per POST, like a plain fetch()
+    http-keep   POSTs on one kept-alive connection, if the server keeps it
+    ws          text messages on one WebSocket
+With --load N, N more WebSocket clients subscribe to RSSI (and perf) while
+the commands run, and the events they receive and the seq gaps (frames the
+timer dropped for backpressure) are reported too.
+
+Event messages are type(1) | seq(1) | payload, the payloads of the USB
+binary mode, decoded with usb_proto/fpvgate_usb.py. Standard library only,
+the WebSocket client is the minimal one below.
+
+Usage:
+    python ws_bench.py --host 192.168.4.1 [--count 200] [--load 3] [--rate 200]
+"""
+
+import argparse
+import base64
+import http.client
+import json
+import os
+import socket
+import struct
+import sys
+import threading
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "usb_proto"))
+import fpvgate_usb as usb  # noqa: E402
+
+OP_TEXT = 0x1
+OP_BINARY = 0x2
+OP_CLOSE = 0x8
+OP_PING = 0x9
+OP_PONG = 0xA
+
+
+class WebSocket:
+    """Client side of RFC 6455, enough for /ws: no extensions, no fragments sent"""
+
+    def __init__(self, host, port=80, path="/ws", timeout=5.0):
+        self.sock = socket.create_connection((host, port), timeout=timeout)
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        key = base64.b64encode(os.urandom(16)).decode()
+        self.sock.sendall((f"GET {path} HTTP/1.1\r\nHost: {host}\r\nUpgrade: websocket\r\n"
+                           f"Connection: Upgrade\r\nSec-WebSocket-Key: {key}\r\n"
+                           "Sec-WebSocket-Version: 13\r\n\r\n").encode())
+        self.buffer = b""
+        while b"\r\n\r\n" not in self.buffer:
+            chunk = self.sock.recv(4096)
+            if not chunk:
+                raise ConnectionError("closed during handshake")
+            self.buffer += chunk
+        head, self.buffer = self.buffer.split(b"\r\n\r\n", 1)
+        if b" 101 " not in head.split(b"\r\n")[0]:
+            raise ConnectionError(head.split(b"\r\n")[0].decode(errors="replace"))
+
+    def send(self, payload, opcode=OP_TEXT):
+        if isinstance(payload, str):
+            payload = payload.encode()
+        mask = os.urandom(4)
+        length = len(payload)
+        if length < 126:
+            header = struct.pack("!BB", 0x80 | opcode, 0x80 | length)
+        elif length < 65536:
+            header = struct.pack("!BBH", 0x80 | opcode, 0x80 | 126, length)
+        else:
+            header = struct.pack("!BBQ", 0x80 | opcode, 0x80 | 127, length)
+        masked = bytes(b ^ mask[i & 3] for i, b in enumerate(payload))
+        self.sock.sendall(header + mask + masked)
+
+    def _frame(self):
+        """Next whole frame from the buffer, or None. Nothing is consumed
+        until the frame is complete, so a recv() timeout loses nothing"""
+        if len(self.buffer) < 2:
+            return None
+        b0, b1 = self.buffer[0], self.buffer[1]
+        length, at = b1 & 0x7F, 2
+        if length == 126:
+            if len(self.buffer) < 4:
+                return None
+            length, at = struct.unpack_from("!H", self.buffer, 2)[0], 4
+        elif length == 127:
+            if len(self.buffer) < 10:
+                return None
+            length, at = struct.unpack_from("!Q", self.buffer, 2)[0], 10
+        if len(self.buffer) < at + length:
+            return None
+        payload = self.buffer[at:at + length]
+        self.buffer = self.buffer[at + length:]
+        return b0, payload
+
+    def recv(self):
+        """Returns (opcode, payload) of the next data message, answers pings"""
+        opcode, message = None, b""
+        while True:
+            frame = self._frame()
+            if frame is None:
+                chunk = self.sock.recv(65536)
+                if not chunk:
+                    raise ConnectionError("closed")
+                self.buffer += chunk
+                continue
+            b0, payload = frame
+            if b0 & 0x0F == OP_PING:
+                self.send(payload, OP_PONG)
+                continue
+            if b0 & 0x0F == OP_CLOSE:
+                raise ConnectionError("closed by server: " + payload[2:].decode(errors="replace"))
+            if b0 & 0x0F in (OP_TEXT, OP_BINARY):
+                opcode, message = b0 & 0x0F, b""
+            message += payload
+            if b0 & 0x80:
+                return opcode, message
+
+    def close(self):
+        try:
+            self.send(struct.pack("!H", 1000), OP_CLOSE)
+        finally:
+            self.sock.close()
+
+
+class EventCounter:
+    """Decodes event messages, counts them per type and the seq gaps"""
+
+    def __init__(self):
+        self.events = {}
+        self.gaps = 0
+        self.last_seq = None
+        self.perf = None
+
+    def feed(self, payload):
+        frame_type, seq = payload[0], payload[1]
+        if self.last_seq is not None:
+            self.gaps += (seq - self.last_seq - 1) & 0xFF
+        self.last_seq = seq
+        event = usb.parse_payload(frame_type, payload[2:])
+        self.events[event["event"]] = self.events.get(event["event"], 0) + 1
+        if event["event"] == "perf":
+            self.perf = event
+
+
+def ws_command(ws, cmd, cmd_id, counter, data=None):
+    """Sends a command, returns (round trip s, reply); events on the way are counted"""
+    start = time.perf_counter()
+    ws.send(json.dumps({"cmd": cmd, "id": cmd_id, "data": data or {}}))
+    while True:
+        opcode, payload = ws.recv()
+        if opcode == OP_BINARY:
+            counter.feed(payload)
+            continue
+        reply = json.loads(payload)
+        if reply.get("id") == cmd_id:
+            return time.perf_counter() - start, reply
+
+
+def bench_http_new(host, port, count):
+    times = []
+    for _ in range(count):
+        start = time.perf_counter()
+        conn = http.client.HTTPConnection(host, port, timeout=5)
+        conn.request("POST", "/timer/lap", headers={"Connection": "close"})
+        conn.getresponse().read()
+        conn.close()
+        times.append(time.perf_counter() - start)
+    return times
+
+
+def bench_http_keep(host, port, count):
+    times = []
+    conn = http.client.HTTPConnection(host, port, timeout=5)
+    reconnects = 0
+    for _ in range(count):
+        start = time.perf_counter()
+        conn.request("POST", "/timer/lap")
+        response = conn.getresponse()
+        response.read()
+        times.append(time.perf_counter() - start)
+        if response.getheader("Connection", "").lower() == "close":
+            conn.close()
+            conn = http.client.HTTPConnection(host, port, timeout=5)
+            reconnects += 1
+    conn.close()
+    return times, reconnects
+
+
+def bench_ws(host, port, count, counter):
+    ws = WebSocket(host, port)
+    times = []
+    try:
+        for i in range(count):
+            elapsed, reply = ws_command(ws, "timer/lap", i + 1, counter)
+            if reply.get("status") != "OK":
+                raise RuntimeError(reply)
+            times.append(elapsed)
+    finally:
+        ws.close()
+    return times
+
+
+def load_client(host, port, rate, batch, stop, counter, errors):
+    try:
+        ws = WebSocket(host, port)
+        ws.sock.settimeout(1.0)
+        ws_command(ws, "subscribe", 1, counter, {"rssi": True, "perf": True, "rate": rate, "batch": batch})
+        while not stop.is_set():
+            try:
+                opcode, payload = ws.recv()
+            except socket.timeout:
+                continue
+            if opcode == OP_BINARY:
+                counter.feed(payload)
+        ws.close()
+    except (OSError, ConnectionError) as e:
+        errors.append(str(e))
+
+
+def percentiles(times):
+    ordered = sorted(t * 1000 for t in times)
+
+    def at(p):
+        return ordered[min(len(ordered) - 1, int(p * len(ordered)))]
+    return at(0.5), at(0.9), at(0.99), ordered[-1]
+
+
+def main():
+    parser = argparse.ArgumentParser(description="WebSocket vs HTTP POST command latency")
+    parser.add_argument("--host", default="192.168.4.1")
+    parser.add_argument("--port", type=int, default=80)
+    parser.add_argument("--count", type=int, default=200, help="commands per path")
+    parser.add_argument("--load", type=int, default=0, help="extra WebSocket clients streaming RSSI")
+    parser.add_argument("--rate", type=int, default=200, help="RSSI rate of the load clients, Hz")
+    parser.add_argument("--batch", type=int, default=50)
+    args = parser.parse_args()
+
+    stop = threading.Event()
+    errors = []
+    loaders = []
+    threads = []
+    for _ in range(args.load):
+        counter = EventCounter()
+        thread = threading.Thread(target=load_client, daemon=True,
+                                  args=(args.host, args.port, args.rate, args.batch, stop, counter, errors))
+        thread.start()
+        threads.append(thread)
+        loaders.append(counter)
+    if args.load:
+        time.sleep(1.0)
+
+    ws_counter = EventCounter()
+    results = [("http-new", bench_http_new(args.host, args.port, args.count))]
+    keep_times, reconnects = bench_http_keep(args.host, args.port, args.count)
+    results.append(("http-keep", keep_times))
+    results.append(("ws", bench_ws(args.host, args.port, args.count, ws_counter)))
+    stop.set()
+    for thread in threads:
+        thread.join(2.0)
+
+    print(f"{args.count} x timer/lap, {args.load} load clients at {args.rate} Hz")
+    print(f"{'path':10s} {'p50 ms':>8s} {'p90 ms':>8s} {'p99 ms':>8s} {'max ms':>8s}")
+    for name, times in results:
+        print(f"{name:10s} " + " ".join(f"{v:8.1f}" for v in percentiles(times)))
+    if reconnects:
+        print(f"http-keep: server closed the connection {reconnects} times")
+    for i, counter in enumerate(loaders):
+        perf = counter.perf or {}
+        print(f"load {i}: events {counter.events}, seq gaps {counter.gaps}, "
+              f"device dropped {perf.get('framesDropped', '?')}")
+    for error in errors:
+        print("load client error: " + error)
+    return 1 if errors else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())